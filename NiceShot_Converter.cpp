@@ -1,14 +1,30 @@
 // NiceShot Standalone Video Converter
-// Converts raw RGBA frames to H.264 using x264
+// Converts raw RGBA frames to H.264 using x264, and QOI/TGA/BMP screenshots to PNG
 // Usage: NiceShot_Converter.exe recording.json
+//        NiceShot_Converter.exe --to-png <image or directory> [--delete]
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <filesystem>
+#include <thread>
+
+#include "src/yuv_convert.h"
+#include "src/raw_container.h"
+#include "src/encode_pipeline.h"
+#include "src/frame_timing.h"
+#include "src/mp4_muxer.h"
+#include "src/audio_encoder.h"
+#include "src/image_formats.h"
+#include "src/png_parallel.h"
 
 #ifdef HAVE_X264
 #include <x264.h>
@@ -23,16 +39,24 @@ struct RecordingInfo {
     uint32_t height;
     double fps;
     uint64_t frame_count;
+    VideoTiming timing; // Applies when the raw file has timestamps
+    VideoContainer container; // Recordings from before MP4 output have no "container" and get a bare .h264
+    std::string audio_file; // WAV recorded alongside the frames, muxed into MP4 output
+    AudioCodec audio_codec;
+    double audio_sync_offset; // Seconds of the WAV before the first frame
     bool valid;
     
-    RecordingInfo() : width(0), height(0), fps(0), frame_count(0), valid(false) {}
+    RecordingInfo()
+        : width(0), height(0), fps(0), frame_count(0), timing(VideoTiming::CFR), container(VideoContainer::H264),
+          audio_codec(AudioCodec::OPUS), audio_sync_offset(0), valid(false) {}
 };
 
 // Extract value from JSON line (simple parser for our specific format)
 std::string extract_json_string(const std::string& line) {
-    size_t start = line.find('\"');
-    if (start == std::string::npos) return "";
-    start = line.find('\"', start + 1);
+    // The value is the quoted string after the key's colon (null values have none)
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return "";
+    size_t start = line.find('\"', colon);
     if (start == std::string::npos) return "";
     start++;
     
@@ -95,6 +119,28 @@ RecordingInfo parse_recording_json(const std::string& json_path) {
         else if (line.find("\"frame_count\"") != std::string::npos) {
             info.frame_count = static_cast<uint64_t>(extract_json_number(line));
         }
+        else if (line.find("\"container\"") != std::string::npos) {
+            if (!video_container_from_name(extract_json_string(line), info.container)) {
+                std::cerr << "Warning: Unknown container in " << json_path << ", writing a .h264 stream" << std::endl;
+            }
+        }
+        else if (line.find("\"file\"") != std::string::npos) {
+            info.audio_file = extract_json_string(line);
+        }
+        else if (line.find("\"codec\"") != std::string::npos) {
+            std::string codec = extract_json_string(line);
+            if (!codec.empty() && !audio_codec_from_name(codec, info.audio_codec)) {
+                std::cerr << "Warning: Unknown audio codec in " << json_path << ", using Opus" << std::endl;
+            }
+        }
+        else if (line.find("\"sync_offset\"") != std::string::npos) {
+            info.audio_sync_offset = extract_json_number(line);
+        }
+        else if (line.find("\"timing\"") != std::string::npos) {
+            if (!video_timing_from_name(extract_json_string(line), info.timing)) {
+                std::cerr << "Warning: Unknown timing in " << json_path << ", using constant frame rate" << std::endl;
+            }
+        }
     }
     
     info.valid = !info.raw_file.empty() && !info.h264_file.empty() && 
@@ -103,48 +149,30 @@ RecordingInfo parse_recording_json(const std::string& json_path) {
     return info;
 }
 
-// Fast RGBA to YUV420p conversion (same as DLL version)
-static void convert_rgba_to_yuv420p_fast(const uint8_t* rgba_data, uint32_t width, uint32_t height, 
-                                         uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane) {
-    const uint32_t uv_width = width / 2;
-    
-    for (uint32_t y = 0; y < height; y += 2) {
-        for (uint32_t x = 0; x < width; x += 2) {
-            uint32_t rgba_idx0 = (y * width + x) * 4;
-            uint32_t rgba_idx1 = (y * width + x + 1) * 4;
-            uint32_t rgba_idx2 = ((y + 1) * width + x) * 4;
-            uint32_t rgba_idx3 = ((y + 1) * width + x + 1) * 4;
-            
-            uint8_t r0 = rgba_data[rgba_idx0 + 0], g0 = rgba_data[rgba_idx0 + 1], b0 = rgba_data[rgba_idx0 + 2];
-            uint8_t r1 = rgba_data[rgba_idx1 + 0], g1 = rgba_data[rgba_idx1 + 1], b1 = rgba_data[rgba_idx1 + 2];
-            uint8_t r2 = rgba_data[rgba_idx2 + 0], g2 = rgba_data[rgba_idx2 + 1], b2 = rgba_data[rgba_idx2 + 2];
-            uint8_t r3 = rgba_data[rgba_idx3 + 0], g3 = rgba_data[rgba_idx3 + 1], b3 = rgba_data[rgba_idx3 + 2];
-            
-            y_plane[y * width + x] = (77 * r0 + 150 * g0 + 29 * b0) >> 8;
-            y_plane[y * width + x + 1] = (77 * r1 + 150 * g1 + 29 * b1) >> 8;
-            y_plane[(y + 1) * width + x] = (77 * r2 + 150 * g2 + 29 * b2) >> 8;
-            y_plane[(y + 1) * width + x + 1] = (77 * r3 + 150 * g3 + 29 * b3) >> 8;
-            
-            uint32_t avg_r = (r0 + r1 + r2 + r3) / 4;
-            uint32_t avg_g = (g0 + g1 + g2 + g3) / 4;
-            uint32_t avg_b = (b0 + b1 + b2 + b3) / 4;
-            
-            uint32_t uv_idx = (y / 2) * uv_width + (x / 2);
-            u_plane[uv_idx] = 128 + ((-43 * avg_r - 84 * avg_g + 127 * avg_b) >> 8);
-            v_plane[uv_idx] = 128 + ((127 * avg_r - 106 * avg_g - 21 * avg_b) >> 8);
-        }
-    }
-}
-
 bool convert_raw_to_h264(const RecordingInfo& info) {
+    // MP4 is written directly, with no remux pass afterwards
+    bool mp4_output = info.container != VideoContainer::H264 && !info.mp4_file.empty();
+    const std::string& output_path = mp4_output ? info.mp4_file : info.h264_file;
+    
     std::cout << "Starting H.264 conversion..." << std::endl;
     std::cout << "Input:  " << info.raw_file << std::endl;
-    std::cout << "Output: " << info.h264_file << std::endl;
+    std::cout << "Output: " << output_path << " (" << video_container_name(mp4_output ? info.container : VideoContainer::H264)
+              << ")" << std::endl;
     std::cout << "Format: " << info.width << "x" << info.height << " @ " << info.fps << " fps" << std::endl;
     std::cout << "Frames: " << info.frame_count << std::endl;
     std::cout << std::endl;
     
 #ifdef HAVE_X264
+    // Open the raw file first: whether it has timestamps decides the timing (compressed container or headerless RGBA)
+    RawFrameReader raw_reader;
+    if (!raw_reader.open(info.raw_file, info.width, info.height)) {
+        std::cerr << "Error: Could not open raw file: " << info.raw_file << std::endl;
+        return false;
+    }
+    
+    FrameTimer timer(raw_reader.has_timestamps() ? info.timing : VideoTiming::FRAME_COUNT, info.fps,
+                     raw_reader.get_timebase_num(), raw_reader.get_timebase_den());
+    
     // Create high-quality x264 encoder
     x264_param_t param;
     x264_param_default_preset(&param, "slow", "film");
@@ -153,6 +181,11 @@ bool convert_raw_to_h264(const RecordingInfo& info) {
     param.i_height = info.height;
     param.i_fps_num = static_cast<int>(info.fps * 1000);
     param.i_fps_den = 1000;
+    if (timer.get_timing() == VideoTiming::VFR) {
+        param.b_vfr_input = 1;
+        param.i_timebase_num = timer.get_timebase_num();
+        param.i_timebase_den = timer.get_timebase_den();
+    }
     param.i_keyint_max = static_cast<int>(info.fps) * 10;
     param.b_intra_refresh = 0;
     param.rc.i_rc_method = X264_RC_CRF;
@@ -168,6 +201,10 @@ bool convert_raw_to_h264(const RecordingInfo& info) {
     param.i_bframe_adaptive = X264_B_ADAPT_TRELLIS;
     param.analyse.i_me_method = X264_ME_TESA;
     param.analyse.i_subpel_refine = 11;
+    if (mp4_output) {
+        param.b_annexb = 0; // Length-prefixed NAL units; SPS/PPS go into the MP4 track header
+        param.b_repeat_headers = 0;
+    }
     
     x264_param_apply_profile(&param, "high");
     
@@ -177,66 +214,188 @@ bool convert_raw_to_h264(const RecordingInfo& info) {
         return false;
     }
     
-    // Open files
-    FILE* raw_file = fopen(info.raw_file.c_str(), "rb");
-    if (!raw_file) {
-        std::cerr << "Error: Could not open raw file: " << info.raw_file << std::endl;
+    FILE* output_file = fopen(output_path.c_str(), "wb");
+    if (!output_file) {
+        std::cerr << "Error: Could not create output file: " << output_path << std::endl;
         x264_encoder_close(encoder);
         return false;
     }
     
-    FILE* h264_file = fopen(info.h264_file.c_str(), "wb");
-    if (!h264_file) {
-        std::cerr << "Error: Could not create H.264 file: " << info.h264_file << std::endl;
-        fclose(raw_file);
-        x264_encoder_close(encoder);
-        return false;
+    std::unique_ptr<Mp4Muxer> muxer;
+    int mp4_track = -1;
+    if (mp4_output) {
+        muxer = std::make_unique<Mp4Muxer>(output_file, info.container == VideoContainer::FRAGMENTED_MP4);
+        x264_nal_t* headers;
+        int header_count;
+        int header_size = x264_encoder_headers(encoder, &headers, &header_count);
+        if (header_size > 0) {
+            mp4_track = muxer->add_h264_track(info.width, info.height, timer.get_timebase_den(),
+                                              static_cast<uint32_t>(std::llround(timer.get_timebase_den() / info.fps)),
+                                              headers[0].p_payload, static_cast<size_t>(header_size));
+        }
+        if (mp4_track < 0) {
+            std::cerr << "Error: x264 produced no usable SPS/PPS for the MP4 track" << std::endl;
+            x264_encoder_close(encoder);
+            fclose(output_file);
+            return false;
+        }
     }
     
-    // Allocate buffers
-    x264_picture_t pic_in, pic_out;
-    x264_picture_alloc(&pic_in, param.i_csp, param.i_width, param.i_height);
-    
-    size_t frame_size = info.width * info.height * 4;
-    std::vector<uint8_t> rgba_frame(frame_size);
+    // The recording's WAV becomes an audio track of the MP4, encoded as it is interleaved with the video
+    WavReader audio_reader;
+    AudioEncoder audio_encoder;
+    int audio_track = -1;
+    if (muxer && !info.audio_file.empty()) {
+        std::string error;
+        AudioCodec codec = audio_codec_available(info.audio_codec) ? info.audio_codec : AudioCodec::PCM;
+        if (!audio_reader.open(info.audio_file, error)) {
+            std::cerr << "Warning: " << error << ", converting without audio" << std::endl;
+        } else if (!audio_encoder.open(codec, audio_reader.get_sample_rate(), audio_reader.get_channels(), 0, error) &&
+                   (codec == AudioCodec::PCM ||
+                    !audio_encoder.open(AudioCodec::PCM, audio_reader.get_sample_rate(), audio_reader.get_channels(), 0, error))) {
+            std::cerr << "Warning: " << error << ", converting without audio" << std::endl;
+        } else {
+            audio_track = audio_encoder.add_track(*muxer);
+            audio_reader.skip(static_cast<uint64_t>(std::llround(info.audio_sync_offset * audio_reader.get_sample_rate())));
+            std::cout << "Audio: " << info.audio_file << " -> " << audio_codec_name(audio_encoder.get_codec()) << std::endl;
+        }
+    }
+    std::vector<int16_t> audio_samples(static_cast<size_t>(audio_encoder.get_sample_rate() / 50) * audio_encoder.get_channels());
+    std::vector<AudioPacket> audio_packets;
+    uint64_t audio_read = 0;
+    bool audio_done = audio_track < 0;
+    bool audio_ok = true; // Every sample of the WAV encoded and written
+    
+    // Encode and write the audio that starts before seconds (the end of the file when negative).
+    // Returns false when a sample could not be written; an encoder failure only stops the audio track.
+    auto mux_audio = [&](double seconds) {
+        bool written = true;
+        while (!audio_done && (seconds < 0 || audio_read < seconds * audio_encoder.get_sample_rate())) {
+            size_t frames = audio_reader.read(audio_samples.data(), audio_samples.size() / audio_encoder.get_channels());
+            bool encoded;
+            if (frames == 0) {
+                encoded = audio_encoder.flush(audio_packets);
+                audio_done = true;
+            } else {
+                encoded = audio_encoder.encode(audio_samples.data(), frames, audio_packets);
+                audio_read += frames;
+            }
+            for (const AudioPacket& packet : audio_packets) {
+                written = muxer->write_sample(audio_track, packet.data.data(), packet.data.size(), packet.pts, packet.pts, true) &&
+                          written;
+            }
+            audio_packets.clear();
+            if (!encoded) {
+                std::cerr << "Error: Audio encoding failed, the MP4 audio ends early" << std::endl;
+                audio_ok = false;
+                audio_done = true;
+            }
+        }
+        audio_ok = audio_ok && written;
+        return written;
+    };
+    
+    // Recycled pictures shared by the converter threads and the encoder
+    unsigned converter_threads = encode_pipeline_default_converters();
+    std::vector<x264_picture_t> pictures(converter_threads * 2 + 2);
+    std::vector<YuvPlanes> picture_planes;
+    for (x264_picture_t& picture : pictures) {
+        x264_picture_alloc(&picture, param.i_csp, param.i_width, param.i_height);
+        picture_planes.push_back({ picture.img.plane[0], picture.img.plane[1], picture.img.plane[2],
+                                   picture.img.i_stride[0], picture.img.i_stride[1], picture.img.i_stride[2] });
+    }
+    x264_picture_t pic_out;
     
-    auto start_time = std::chrono::high_resolution_clock::now();
+    std::vector<double> timecodes;
     
-    std::cout << "Encoding with maximum quality settings..." << std::endl;
+    // Cleared by any failed encode or write; the raw file is only deleted when the output is complete
+    bool ok = true;
     
-    // Process frames
-    for (uint64_t i = 0; i < info.frame_count; i++) {
-        size_t read_bytes = fread(rgba_frame.data(), 1, frame_size, raw_file);
-        if (read_bytes != frame_size) {
-            std::cerr << "Warning: Could only read " << read_bytes << " bytes for frame " << i << std::endl;
-            break;
+    // An encoded frame (described by pic_out) goes into the MP4 as one sample, or onto the .h264 stream
+    auto write_output = [&](x264_nal_t* nal, int i_nal, int frame_size) {
+        if (muxer) {
+            int64_t ticks = timer.get_timebase_num();
+            ok = muxer->write_sample(mp4_track, nal[0].p_payload, static_cast<size_t>(frame_size), pic_out.i_dts * ticks,
+                                     pic_out.i_pts * ticks, pic_out.b_keyframe != 0) && ok;
+            ok = mux_audio(static_cast<double>(pic_out.i_pts * ticks) / timer.get_timebase_den()) && ok;
+            return;
         }
-        
-        convert_rgba_to_yuv420p_fast(rgba_frame.data(), info.width, info.height,
-                                    pic_in.img.plane[0], pic_in.img.plane[1], pic_in.img.plane[2]);
-        
-        pic_in.i_pts = i;
+        for (int j = 0; j < i_nal; j++) {
+            ok = fwrite(nal[j].p_payload, 1, nal[j].i_payload, output_file) == static_cast<size_t>(nal[j].i_payload) && ok;
+        }
+    };
+    
+    auto encode_picture = [&](x264_picture_t& picture, int64_t pts) {
+        picture.i_pts = pts;
         
         x264_nal_t* nal;
         int i_nal;
-        int encoded_size = x264_encoder_encode(encoder, &nal, &i_nal, &pic_in, &pic_out);
+        int encoded_size = x264_encoder_encode(encoder, &nal, &i_nal, &picture, &pic_out);
         
-        if (encoded_size > 0) {
-            for (int j = 0; j < i_nal; j++) {
-                fwrite(nal[j].p_payload, 1, nal[j].i_payload, h264_file);
-            }
+        if (encoded_size < 0) {
+            std::cerr << "Error: Encoding failed at pts " << pts << std::endl;
+            ok = false;
+        } else if (encoded_size > 0) {
+            write_output(nal, i_nal, encoded_size);
         }
         
-        if (i % 60 == 0) {
-            auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
-            auto elapsed_seconds = std::chrono::duration<double>(elapsed).count();
-            double progress = (double)i / info.frame_count * 100.0;
-            double fps_encoding = i / elapsed_seconds;
-            
-            std::cout << "Progress: " << std::fixed << std::setprecision(1) << progress 
-                      << "% (" << i << "/" << info.frame_count << " frames, " 
-                      << std::setprecision(1) << fps_encoding << " fps)" << std::endl;
+        if (timer.get_timing() == VideoTiming::VFR && !muxer) {
+            timecodes.push_back(timer.to_milliseconds(pts));
         }
+    };
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    std::cout << "Encoding with maximum quality settings..." << std::endl;
+    std::cout << "Raw input format: " << (raw_reader.is_container() ? "compressed container" : "headerless RGBA")
+              << (raw_reader.is_mapped() ? " (memory-mapped)" : " (buffered reads)") << std::endl;
+    std::cout << "Colour conversion kernel: " << yuv_kernel_name(yuv_best_kernel()) 
+              << " (" << converter_threads << " converter threads, " << pictures.size() << " pictures in flight)" << std::endl;
+    std::cout << "Timing: " << video_timing_name(timer.get_timing())
+              << (raw_reader.has_timestamps() ? "" : " (raw file has no timestamps)") << std::endl;
+    
+    // Process frames: read, convert and encode run as overlapping pipeline stages
+    EncodePipelineStats pipeline_stats;
+    size_t last_slot = SIZE_MAX; // Holds the last frame's picture once the pipeline is done
+    run_encode_pipeline(raw_reader, info.width, info.height, info.frame_count, picture_planes, converter_threads,
+        [&](size_t slot, const EncodePipelineFrame& frame) {
+            uint64_t i = frame.index;
+            FramePlan plan = timer.plan(frame.timestamp, frame.repeat);
+            last_slot = slot;
+            
+            // CFR fills gaps with the previous picture; the pipeline keeps its slot until this frame is done
+            if (frame.previous_slot != SIZE_MAX) {
+                for (uint64_t r = 0; r < plan.repeat_previous; ++r) {
+                    encode_picture(pictures[frame.previous_slot], plan.repeat_pts + static_cast<int64_t>(r));
+                }
+            }
+            
+            if (plan.emit) {
+                encode_picture(pictures[slot], plan.pts);
+            }
+            
+            if (i % 60 == 0) {
+                auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
+                auto elapsed_seconds = std::chrono::duration<double>(elapsed).count();
+                double progress = (double)i / info.frame_count * 100.0;
+                double fps_encoding = i / elapsed_seconds;
+                
+                std::cout << "Progress: " << std::fixed << std::setprecision(1) << progress 
+                          << "% (" << i << "/" << info.frame_count << " frames, " 
+                          << std::setprecision(1) << fps_encoding << " fps)" << std::endl;
+            }
+            return true;
+        },
+        pipeline_stats);
+    
+    if (pipeline_stats.frames < info.frame_count) {
+        std::cerr << "Warning: Raw file ended after " << pipeline_stats.frames << " of " << info.frame_count << " frames" << std::endl;
+    }
+    
+    // VFR: a recording ending on unchanged frames lasts until the last of them, so the video keeps up with the audio
+    FramePlan tail = timer.finish();
+    if (tail.emit && last_slot != SIZE_MAX) {
+        encode_picture(pictures[last_slot], tail.pts);
     }
     
     // Flush delayed frames
@@ -248,37 +407,85 @@ bool convert_raw_to_h264(const RecordingInfo& info) {
         int frame_size = x264_encoder_encode(encoder, &nal, &i_nal, nullptr, &pic_out);
         if (frame_size <= 0) break;
         
-        for (int i = 0; i < i_nal; i++) {
-            fwrite(nal[i].p_payload, 1, nal[i].i_payload, h264_file);
-        }
+        write_output(nal, i_nal, frame_size);
         flushed++;
     }
     
+    if (muxer) {
+        ok = mux_audio(-1.0) && ok;
+    }
+    if (muxer && !muxer->finish()) {
+        std::cerr << "Error: Failed to finalize MP4 file: " << output_path << std::endl;
+        ok = false;
+    }
+    if (fclose(output_file) != 0) {
+        std::cerr << "Error: Failed to close output file: " << output_path << std::endl;
+        ok = false;
+    }
+    
     auto total_time = std::chrono::high_resolution_clock::now() - start_time;
     auto total_seconds = std::chrono::duration<double>(total_time).count();
     
     std::cout << std::endl;
-    std::cout << "Conversion complete!" << std::endl;
+    std::cout << (ok ? "Conversion complete!" : "Conversion incomplete, the output file is not usable") << std::endl;
     std::cout << "Total time: " << std::fixed << std::setprecision(1) << total_seconds << " seconds" << std::endl;
     std::cout << "Flushed frames: " << flushed << std::endl;
-    std::cout << "Output file: " << info.h264_file << std::endl;
+    std::cout << "Output file: " << output_path << std::endl;
+    if (timer.get_timing() == VideoTiming::CFR) {
+        std::cout << "Constant frame rate: " << timer.get_duplicated() << " frames duplicated, "
+                  << timer.get_dropped() << " dropped" << std::endl;
+    }
+    
+    // Per-stage utilisation; with the pipeline keeping x264 fed, encode should be close to 100%
+    double wall = pipeline_stats.wall_seconds > 0 ? pipeline_stats.wall_seconds : 1.0;
+    std::cout << "Stage utilisation: read " << std::setprecision(1) << (100.0 * pipeline_stats.read_busy_seconds / wall)
+              << "%, convert " << (100.0 * pipeline_stats.convert_busy_seconds / (wall * pipeline_stats.converter_threads))
+              << "% (x" << pipeline_stats.converter_threads
+              << (pipeline_stats.band_threads > 1 ? " in " + std::to_string(pipeline_stats.band_threads) + " bands" : "")
+              << "), encode " 
+              << (100.0 * pipeline_stats.encode_busy_seconds / wall) << "%" << std::endl;
     
     // Cleanup
-    x264_picture_clean(&pic_in);
+    for (x264_picture_t& picture : pictures) {
+        x264_picture_clean(&picture);
+    }
     x264_encoder_close(encoder);
-    fclose(raw_file);
-    fclose(h264_file);
+    raw_reader.close();
+    
+    if (!ok) {
+        std::cerr << "Kept " << info.raw_file << " for another attempt" << std::endl;
+        return false;
+    }
+    
+    // A raw .h264 stream has no timestamps of its own; mkvmerge or mp4fpsmod applies these when muxing
+    if (!timecodes.empty()) {
+        std::string timecodes_path = info.h264_file.substr(0, info.h264_file.find_last_of('.')) + "_timecodes.txt";
+        if (write_timecodes_v2(timecodes_path, timecodes)) {
+            std::cout << "Timecodes: " << timecodes_path << std::endl;
+            std::cout << "Mux with: mkvmerge -o out.mkv --timestamps 0:\"" << timecodes_path << "\" \"" << info.h264_file << "\"" << std::endl;
+        } else {
+            std::cerr << "Warning: Could not write timecodes: " << timecodes_path << std::endl;
+        }
+    }
     
     // Delete raw file to save space
     if (remove(info.raw_file.c_str()) == 0) {
         std::cout << "Deleted raw file to save disk space" << std::endl;
     }
+    if (audio_track >= 0) {
+        audio_reader.close();
+        if (!audio_ok) {
+            std::cerr << "Kept " << info.audio_file << ", the MP4 has only part of it" << std::endl;
+        } else if (remove(info.audio_file.c_str()) == 0) {
+            std::cout << "Deleted audio file, it is in the MP4" << std::endl;
+        }
+    }
     
     return true;
     
 #else
     std::cout << "Error: x264 library not available in this build" << std::endl;
-    std::cout << "Alternative: Use FFmpeg directly:" << std::endl;
+    std::cout << "Alternative: Use FFmpeg directly (headerless RGBA recordings only):" << std::endl;
     std::cout << "ffmpeg -f rawvideo -pix_fmt rgba -s " << info.width << "x" << info.height 
               << " -r " << info.fps << " -i \"" << info.raw_file 
               << "\" -c:v libx264 -preset slow -crf 18 \"" << info.h264_file << "\"" << std::endl;
@@ -286,14 +493,88 @@ bool convert_raw_to_h264(const RecordingInfo& info) {
 #endif
 }
 
+// Transcode QOI/TGA/BMP screenshots to PNG, one image per thread
+bool convert_images_to_png(const std::string& target, bool delete_sources) {
+    std::vector<std::string> sources;
+    std::error_code error;
+    if (std::filesystem::is_directory(target, error)) {
+        sources = list_convertible_images(target);
+    } else {
+        sources.push_back(target);
+    }
+    if (sources.empty()) {
+        std::cout << "No .qoi, .tga or .bmp files found in " << target << std::endl;
+        return true;
+    }
+    
+    // Fastest deflate this build has; images are spread across threads, so each one is encoded serially
+    DeflateBackend backend = deflate_backend_available(DeflateBackend::LIBDEFLATE) ? DeflateBackend::LIBDEFLATE :
+                             deflate_backend_available(DeflateBackend::ZLIB_NG) ? DeflateBackend::ZLIB_NG : DeflateBackend::ZLIB;
+    PngParallelFor serial = [](unsigned count, const std::function<void(unsigned)>& fn) {
+        for (unsigned i = 0; i < count; ++i) {
+            fn(i);
+        }
+    };
+    
+    unsigned thread_count = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), static_cast<unsigned>(sources.size())));
+    std::cout << "Converting " << sources.size() << " images to PNG on " << thread_count << " threads ("
+              << deflate_backend_name(backend) << ")" << std::endl;
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::atomic<size_t> next_source{0};
+    std::atomic<size_t> failures{0};
+    auto convert = [&]() {
+        size_t index;
+        while ((index = next_source.fetch_add(1)) < sources.size()) {
+            const std::string& source = sources[index];
+            std::string png_path = png_path_for(source);
+            std::string error_message;
+            std::vector<uint8_t> rgba;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            ImageFormat format;
+            
+            bool ok = read_image_file(source, rgba, width, height, format, error_message) &&
+                      write_png_striped(rgba.data(), width, height, 6, backend, PngFilterStrategy::MIN_SUM_ABS, 1,
+                                        serial, png_path, error_message);
+            if (!ok) {
+                std::cerr << "Failed: " << source << " - " << error_message << std::endl;
+                failures++;
+            } else if (delete_sources) {
+                remove(source.c_str());
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < thread_count; ++i) {
+        threads.emplace_back(convert);
+    }
+    convert();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    
+    auto total_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+    std::cout << "Converted " << (sources.size() - failures.load()) << "/" << sources.size() << " images in "
+              << std::fixed << std::setprecision(1) << total_seconds << " seconds" << std::endl;
+    return failures.load() == 0;
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "================================================" << std::endl;
     std::cout << "NiceShot Standalone Video Converter v1.0" << std::endl;
     std::cout << "================================================" << std::endl;
     std::cout << std::endl;
     
+    if (argc >= 3 && std::string(argv[1]) == "--to-png") {
+        bool delete_sources = argc >= 4 && std::string(argv[3]) == "--delete";
+        return convert_images_to_png(argv[2], delete_sources) ? 0 : 1;
+    }
+    
     if (argc != 2) {
         std::cout << "Usage: " << argv[0] << " <recording.json>" << std::endl;
+        std::cout << "       " << argv[0] << " --to-png <image or directory> [--delete]" << std::endl;
         std::cout << "Example: " << argv[0] << " gameplay_recording.json" << std::endl;
         return 1;
     }
@@ -316,13 +597,18 @@ int main(int argc, char* argv[]) {
     if (success) {
         std::cout << std::endl;
         std::cout << "Conversion completed successfully!" << std::endl;
+        if (info.container != VideoContainer::H264 && !info.mp4_file.empty()) {
+            std::cout << "MP4 file: " << info.mp4_file << std::endl;
+            return 0;
+        }
         std::cout << "H.264 file: " << info.h264_file << std::endl;
         
         if (!info.mp4_file.empty()) {
             std::cout << std::endl;
             std::cout << "To create MP4 with FFmpeg:" << std::endl;
-            std::cout << "ffmpeg -r " << info.fps << " -i \"" << info.h264_file 
-                      << "\" -c:v copy \"" << info.mp4_file << "\"" << std::endl;
+            std::cout << "ffmpeg -r " << info.fps << " -i \"" << info.h264_file << "\" "
+                      << (info.audio_file.empty() ? "" : "-i \"" + info.audio_file + "\" -c:a aac ")
+                      << "-c:v copy \"" << info.mp4_file << "\"" << std::endl;
         }
         
         return 0;
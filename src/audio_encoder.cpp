@@ -0,0 +1,364 @@
+#include "audio_encoder.h"
+#include "mp4_muxer.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef NICESHOT_HAVE_OPUS
+#include <opus/opus.h>
+#endif
+
+// Largest Opus packet (RFC 6716 3.4: 1275 bytes per frame, up to 3 frames of one 20 ms packet in practice)
+static const int OPUS_MAX_PACKET = 4000;
+
+const char* audio_codec_name(AudioCodec codec) {
+    switch (codec) {
+    case AudioCodec::PCM: return "pcm_s16le";
+    case AudioCodec::OPUS: return "opus";
+    }
+    return "unknown";
+}
+
+bool audio_codec_from_name(const std::string& name, AudioCodec& codec) {
+    for (int i = 0; i < AUDIO_CODEC_COUNT; ++i) {
+        if (name == audio_codec_name(static_cast<AudioCodec>(i))) {
+            codec = static_cast<AudioCodec>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool audio_codec_available(AudioCodec codec) {
+    switch (codec) {
+    case AudioCodec::PCM: return true;
+#ifdef NICESHOT_HAVE_OPUS
+    case AudioCodec::OPUS: return true;
+#else
+    case AudioCodec::OPUS: return false;
+#endif
+    }
+    return false;
+}
+
+AudioEncoder::AudioEncoder()
+    : codec(AudioCodec::PCM), sample_rate(0), channels(0), frame_size(0), pre_skip(0), opus(nullptr), next_pts(0) {}
+
+AudioEncoder::~AudioEncoder() {
+#ifdef NICESHOT_HAVE_OPUS
+    if (opus) {
+        opus_encoder_destroy(static_cast<OpusEncoder*>(opus));
+    }
+#endif
+}
+
+bool AudioEncoder::open(AudioCodec audio_codec, uint32_t rate, uint32_t channel_count, uint32_t bitrate_kbps, std::string& error) {
+    if (channel_count < 1 || channel_count > 2) {
+        error = "audio must be mono or stereo";
+        return false;
+    }
+    if (rate < 8000 || rate > 48000) {
+        error = "audio sample rate must be 8000-48000 Hz";
+        return false;
+    }
+    if (!audio_codec_available(audio_codec)) {
+        error = std::string(audio_codec_name(audio_codec)) + " support not compiled in";
+        return false;
+    }
+
+    codec = audio_codec;
+    sample_rate = rate;
+    channels = channel_count;
+    frame_size = rate / 50; // 20 ms packets
+    next_pts = 0;
+    pending.clear();
+
+    if (codec == AudioCodec::OPUS) {
+#ifdef NICESHOT_HAVE_OPUS
+        if (rate != 8000 && rate != 12000 && rate != 16000 && rate != 24000 && rate != 48000) {
+            error = "Opus needs a sample rate of 8000, 12000, 16000, 24000 or 48000 Hz";
+            return false;
+        }
+
+        int result = OPUS_OK;
+        OpusEncoder* encoder = opus_encoder_create(static_cast<opus_int32>(rate), static_cast<int>(channels),
+                                                   OPUS_APPLICATION_AUDIO, &result);
+        if (!encoder || result != OPUS_OK) {
+            error = std::string("opus_encoder_create failed: ") + opus_strerror(result);
+            return false;
+        }
+        opus = encoder;
+
+        uint32_t bitrate = bitrate_kbps ? bitrate_kbps * 1000 : 64000 * channels;
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(static_cast<opus_int32>(bitrate)));
+
+        // Lookahead is in input samples; dOps wants it at 48 kHz
+        opus_int32 lookahead = 0;
+        opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+        pre_skip = static_cast<uint16_t>(lookahead * (48000 / rate));
+#endif
+    }
+#ifndef NICESHOT_HAVE_OPUS
+    (void)bitrate_kbps; // Only Opus has a bitrate
+#endif
+    return true;
+}
+
+bool AudioEncoder::encode_packet(const int16_t* pcm, uint32_t frames, std::vector<AudioPacket>& packets) {
+    AudioPacket packet;
+    packet.pts = next_pts;
+
+    if (codec == AudioCodec::OPUS) {
+#ifdef NICESHOT_HAVE_OPUS
+        packet.data.resize(OPUS_MAX_PACKET);
+        opus_int32 size = opus_encode(static_cast<OpusEncoder*>(opus), pcm, static_cast<int>(frames), packet.data.data(),
+                                      OPUS_MAX_PACKET);
+        if (size < 0) {
+            return false;
+        }
+        packet.data.resize(static_cast<size_t>(size));
+        packet.duration = frames * (48000 / sample_rate);
+#else
+        return false;
+#endif
+    } else {
+        // 'sowt' is little-endian, the layout of the pushed samples on every platform the DLL runs on
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pcm);
+        packet.data.assign(bytes, bytes + static_cast<size_t>(frames) * channels * sizeof(int16_t));
+        packet.duration = frames;
+    }
+
+    next_pts += packet.duration;
+    packets.push_back(std::move(packet));
+    return true;
+}
+
+bool AudioEncoder::encode(const int16_t* pcm, size_t frames, std::vector<AudioPacket>& packets) {
+    if (frame_size == 0) {
+        return false;
+    }
+
+    // Top up a partial packet first, then encode whole packets straight from the input
+    size_t packet_values = static_cast<size_t>(frame_size) * channels;
+    size_t values = frames * channels;
+    size_t used = 0;
+    if (!pending.empty()) {
+        used = std::min(values, packet_values - pending.size());
+        pending.insert(pending.end(), pcm, pcm + used);
+        if (pending.size() < packet_values) {
+            return true;
+        }
+        if (!encode_packet(pending.data(), frame_size, packets)) {
+            return false;
+        }
+        pending.clear();
+    }
+    while (values - used >= packet_values) {
+        if (!encode_packet(pcm + used, frame_size, packets)) {
+            return false;
+        }
+        used += packet_values;
+    }
+    pending.assign(pcm + used, pcm + values);
+    return true;
+}
+
+bool AudioEncoder::flush(std::vector<AudioPacket>& packets) {
+    if (pending.empty()) {
+        return true;
+    }
+
+    // Every packet keeps the track's default duration (Opus needs it anyway); pad the tail with silence
+    pending.resize(static_cast<size_t>(frame_size) * channels, 0);
+    bool ok = encode_packet(pending.data(), frame_size, packets);
+    pending.clear();
+    return ok;
+}
+
+int AudioEncoder::add_track(Mp4Muxer& muxer) const {
+    if (codec == AudioCodec::OPUS) {
+        return muxer.add_opus_track(channels, sample_rate, pre_skip, get_packet_duration());
+    }
+    return muxer.add_pcm_track(sample_rate, channels, get_packet_duration());
+}
+
+static void put_le16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void put_le32(uint8_t* out, uint32_t value) {
+    put_le16(out, static_cast<uint16_t>(value));
+    put_le16(out + 2, static_cast<uint16_t>(value >> 16));
+}
+
+static uint32_t get_le32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static uint16_t get_le16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+static const size_t WAV_HEADER_SIZE = 44;
+
+WavWriter::WavWriter() : file(nullptr), channels(0), frames_written(0) {}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+bool WavWriter::open(const std::string& path, uint32_t sample_rate, uint32_t channel_count) {
+    close();
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "wb");
+#else
+    file = fopen(path.c_str(), "wb");
+#endif
+    if (!file) {
+        return false;
+    }
+    channels = channel_count;
+    frames_written = 0;
+
+    // RIFF and data sizes are patched in close()
+    uint8_t header[WAV_HEADER_SIZE] = {};
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le16(header + 20, 1); // PCM
+    put_le16(header + 22, static_cast<uint16_t>(channels));
+    put_le32(header + 24, sample_rate);
+    put_le32(header + 28, sample_rate * channels * 2);
+    put_le16(header + 32, static_cast<uint16_t>(channels * 2));
+    put_le16(header + 34, 16);
+    std::memcpy(header + 36, "data", 4);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool WavWriter::write(const int16_t* pcm, size_t frames) {
+    if (!file) {
+        return false;
+    }
+    size_t values = frames * channels;
+    if (fwrite(pcm, sizeof(int16_t), values, file) != values) {
+        return false;
+    }
+    frames_written += frames;
+    return true;
+}
+
+bool WavWriter::close() {
+    if (!file) {
+        return true;
+    }
+
+    // WAV sizes are 32-bit; past 4 GB the header is left saturated and readers go by the file size
+    uint64_t data_size = frames_written * channels * 2;
+    uint32_t data_field = static_cast<uint32_t>(std::min<uint64_t>(data_size, UINT32_MAX - WAV_HEADER_SIZE));
+    uint8_t size_field[4];
+    bool ok = true;
+    put_le32(size_field, data_field + static_cast<uint32_t>(WAV_HEADER_SIZE - 8));
+    ok = ok && fseek(file, 4, SEEK_SET) == 0 && fwrite(size_field, 1, 4, file) == 4;
+    put_le32(size_field, data_field);
+    ok = ok && fseek(file, 40, SEEK_SET) == 0 && fwrite(size_field, 1, 4, file) == 4;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
+
+WavReader::WavReader() : file(nullptr), sample_rate(0), channels(0), remaining(0) {}
+
+WavReader::~WavReader() {
+    close();
+}
+
+bool WavReader::open(const std::string& path, std::string& error) {
+    close();
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "rb");
+#else
+    file = fopen(path.c_str(), "rb");
+#endif
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    uint8_t riff[12];
+    if (fread(riff, 1, sizeof(riff), file) != sizeof(riff) || std::memcmp(riff, "RIFF", 4) != 0 ||
+        std::memcmp(riff + 8, "WAVE", 4) != 0) {
+        error = path + " is not a WAVE file";
+        close();
+        return false;
+    }
+
+    // Walk the chunks up to "data", taking the format from "fmt "
+    bool have_format = false;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+        uint32_t size = get_le32(chunk + 4);
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t format[16];
+            if (fread(format, 1, sizeof(format), file) != sizeof(format)) {
+                break;
+            }
+            if (get_le16(format) != 1 || get_le16(format + 14) != 16) {
+                error = path + " is not 16-bit PCM";
+                close();
+                return false;
+            }
+            channels = get_le16(format + 2);
+            sample_rate = get_le32(format + 4);
+            have_format = true;
+            size -= 16;
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!have_format || channels == 0) {
+                break;
+            }
+            remaining = size / (channels * 2);
+            return true;
+        }
+        if (fseek(file, static_cast<long>(size + (size & 1)), SEEK_CUR) != 0) {
+            break;
+        }
+    }
+
+    error = path + " has no PCM data";
+    close();
+    return false;
+}
+
+size_t WavReader::read(int16_t* pcm, size_t frames) {
+    if (!file) {
+        return 0;
+    }
+    frames = static_cast<size_t>(std::min<uint64_t>(frames, remaining));
+    size_t read = fread(pcm, sizeof(int16_t) * channels, frames, file);
+    remaining -= read;
+    return read;
+}
+
+void WavReader::skip(uint64_t frames) {
+    std::vector<int16_t> scratch(4096 * static_cast<size_t>(channels));
+    while (frames > 0) {
+        size_t read = this->read(scratch.data(), static_cast<size_t>(std::min<uint64_t>(frames, 4096)));
+        if (read == 0) {
+            break;
+        }
+        frames -= read;
+    }
+}
+
+void WavReader::close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    remaining = 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Mp4Muxer;
+
+// Audio for recordings, shared by the DLL and NiceShot_Converter: interleaved signed 16-bit PCM in,
+// fixed-size packets out for the MP4 muxer, plus the WAV sidecar used when there is no MP4 to mux into.
+// Opus needs libopus (NICESHOT_HAVE_OPUS); uncompressed PCM always works.
+
+enum class AudioCodec {
+    PCM = 0, // Uncompressed 16-bit PCM ('sowt' track): always available, 192 KB per second of 48 kHz stereo
+    OPUS = 1 // Opus ('Opus' track, decoded at 48 kHz): needs NICESHOT_HAVE_OPUS
+};
+
+static const int AUDIO_CODEC_COUNT = 2;
+
+const char* audio_codec_name(AudioCodec codec);
+
+// Inverse of audio_codec_name (recording metadata); false for anything else
+bool audio_codec_from_name(const std::string& name, AudioCodec& codec);
+
+// True when this build can encode the codec
+bool audio_codec_available(AudioCodec codec);
+
+// One encoded packet; pts and duration count samples per channel from the first sample encoded
+struct AudioPacket {
+    std::vector<uint8_t> data;
+    int64_t pts;
+    uint32_t duration;
+};
+
+class AudioEncoder {
+public:
+    AudioEncoder();
+    ~AudioEncoder();
+
+    // PCM takes any rate; Opus takes 8, 12, 16, 24 or 48 kHz. One or two channels.
+    bool open(AudioCodec codec, uint32_t sample_rate, uint32_t channels, uint32_t bitrate_kbps, std::string& error);
+
+    // Encode interleaved samples; every completed packet is appended to packets
+    bool encode(const int16_t* pcm, size_t frames, std::vector<AudioPacket>& packets);
+
+    // Encode the partial packet left over, padded with silence
+    bool flush(std::vector<AudioPacket>& packets);
+
+    // Add the matching audio track to an MP4 (before its first sample); -1 on failure
+    int add_track(Mp4Muxer& muxer) const;
+
+    AudioCodec get_codec() const { return codec; }
+    uint32_t get_sample_rate() const { return sample_rate; }
+    uint32_t get_channels() const { return channels; }
+
+    // Timescale of packet pts and durations (Opus always decodes at 48 kHz)
+    uint32_t get_timescale() const { return codec == AudioCodec::OPUS ? 48000 : sample_rate; }
+
+    // Duration of every packet, in the timescale
+    uint32_t get_packet_duration() const { return frame_size * (get_timescale() / sample_rate); }
+
+private:
+    bool encode_packet(const int16_t* pcm, uint32_t frames, std::vector<AudioPacket>& packets);
+
+    AudioCodec codec;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t frame_size;  // Samples per channel in one packet
+    uint16_t pre_skip;    // Opus encoder lookahead in 48 kHz samples
+    void* opus;           // OpusEncoder
+    std::vector<int16_t> pending; // Samples waiting for a full packet
+    int64_t next_pts;
+};
+
+// Writes a 16-bit PCM .wav; the header sizes are filled in by close()
+class WavWriter {
+public:
+    WavWriter();
+    ~WavWriter();
+
+    bool open(const std::string& path, uint32_t sample_rate, uint32_t channels);
+    bool write(const int16_t* pcm, size_t frames);
+    bool close();
+
+    bool is_open() const { return file != nullptr; }
+    uint64_t get_frames() const { return frames_written; }
+
+private:
+    FILE* file;
+    uint32_t channels;
+    uint64_t frames_written;
+};
+
+// Reads 16-bit PCM .wav files as written by WavWriter (or any plain PCM WAVE file)
+class WavReader {
+public:
+    WavReader();
+    ~WavReader();
+
+    bool open(const std::string& path, std::string& error);
+
+    // Read up to frames samples per channel; returns the count read (0 at the end)
+    size_t read(int16_t* pcm, size_t frames);
+
+    // Skip samples per channel from the current position
+    void skip(uint64_t frames);
+
+    void close();
+
+    uint32_t get_sample_rate() const { return sample_rate; }
+    uint32_t get_channels() const { return channels; }
+
+private:
+    FILE* file;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint64_t remaining; // Frames left in the data chunk
+};
@@ -0,0 +1,128 @@
+#include "deflate_backend.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+#ifdef NICESHOT_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#ifdef NICESHOT_HAVE_ZLIB_NG
+// Implemented in deflate_zlib_ng.cpp (zlib-ng.h cannot share a translation unit with zlib.h)
+bool zlib_ng_deflate_raw_piece(int level, const uint8_t* dictionary, size_t dictionary_size,
+                               const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out);
+bool zlib_ng_deflate_zlib_buffer(int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+#endif
+
+bool deflate_backend_available(DeflateBackend backend) {
+    switch (backend) {
+    case DeflateBackend::ZLIB:
+        return true;
+    case DeflateBackend::ZLIB_NG:
+#ifdef NICESHOT_HAVE_ZLIB_NG
+        return true;
+#else
+        return false;
+#endif
+    case DeflateBackend::LIBDEFLATE:
+#ifdef NICESHOT_HAVE_LIBDEFLATE
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char* deflate_backend_name(DeflateBackend backend) {
+    switch (backend) {
+    case DeflateBackend::ZLIB: return "zlib";
+    case DeflateBackend::ZLIB_NG: return "zlib-ng";
+    case DeflateBackend::LIBDEFLATE: return "libdeflate";
+    }
+    return "unknown";
+}
+
+bool deflate_backend_supports_stripes(DeflateBackend backend) {
+    return backend == DeflateBackend::ZLIB || backend == DeflateBackend::ZLIB_NG;
+}
+
+static bool zlib_deflate_raw_piece(int level, const uint8_t* dictionary, size_t dictionary_size,
+                                   const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) { // Raw deflate, no zlib header
+        return false;
+    }
+    if (dictionary_size > 0) {
+        deflateSetDictionary(&zs, dictionary, static_cast<uInt>(dictionary_size));
+    }
+
+    out.resize(deflateBound(&zs, static_cast<uLong>(size)) + 16);
+    zs.next_in = const_cast<Bytef*>(data);
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = out.data();
+    zs.avail_out = static_cast<uInt>(out.size());
+
+    int result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool complete = last ? result == Z_STREAM_END : (result == Z_OK && zs.avail_in == 0);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return complete;
+}
+
+static bool zlib_deflate_zlib_buffer(int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    uLongf out_size = compressBound(static_cast<uLong>(size));
+    out.resize(out_size);
+    if (compress2(out.data(), &out_size, data, static_cast<uLong>(size), level) != Z_OK) {
+        return false;
+    }
+    out.resize(out_size);
+    return true;
+}
+
+#ifdef NICESHOT_HAVE_LIBDEFLATE
+static bool libdeflate_zlib_buffer(int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    // libdeflate levels run 0-12; keep the 0-9 scale the rest of NiceShot uses
+    libdeflate_compressor* compressor = libdeflate_alloc_compressor(std::max(0, std::min(level, 12)));
+    if (!compressor) {
+        return false;
+    }
+    out.resize(libdeflate_zlib_compress_bound(compressor, size));
+    size_t written = libdeflate_zlib_compress(compressor, data, size, out.data(), out.size());
+    libdeflate_free_compressor(compressor);
+    out.resize(written);
+    return written > 0;
+}
+#endif
+
+bool deflate_raw_piece(DeflateBackend backend, int level, const uint8_t* dictionary, size_t dictionary_size,
+                       const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out) {
+    switch (backend) {
+    case DeflateBackend::ZLIB:
+        return zlib_deflate_raw_piece(level, dictionary, dictionary_size, data, size, last, out);
+#ifdef NICESHOT_HAVE_ZLIB_NG
+    case DeflateBackend::ZLIB_NG:
+        return zlib_ng_deflate_raw_piece(level, dictionary, dictionary_size, data, size, last, out);
+#endif
+    default:
+        return false; // libdeflate has no dictionaries or sync flush
+    }
+}
+
+bool deflate_zlib_buffer(DeflateBackend backend, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    switch (backend) {
+    case DeflateBackend::ZLIB:
+        return zlib_deflate_zlib_buffer(level, data, size, out);
+#ifdef NICESHOT_HAVE_ZLIB_NG
+    case DeflateBackend::ZLIB_NG:
+        return zlib_ng_deflate_zlib_buffer(level, data, size, out);
+#endif
+#ifdef NICESHOT_HAVE_LIBDEFLATE
+    case DeflateBackend::LIBDEFLATE:
+        return libdeflate_zlib_buffer(level, data, size, out);
+#endif
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Deflate backends for the PNG writer. Stock zlib is always available; zlib-ng and libdeflate are
+// compiled in with NICESHOT_HAVE_ZLIB_NG / NICESHOT_HAVE_LIBDEFLATE and picked at runtime.
+
+enum class DeflateBackend {
+    ZLIB = 0,      // Stock zlib (the one libpng uses)
+    ZLIB_NG = 1,   // zlib-ng native API: SIMD match finding and hashing, streams like zlib
+    LIBDEFLATE = 2 // libdeflate: fastest whole-buffer compressor, no streaming or dictionaries
+};
+
+static const int DEFLATE_BACKEND_COUNT = 3;
+
+bool deflate_backend_available(DeflateBackend backend);
+const char* deflate_backend_name(DeflateBackend backend);
+
+// True when the backend can produce raw deflate pieces that concatenate into one stream
+// (preset dictionary + sync flush), which the striped PNG writer needs
+bool deflate_backend_supports_stripes(DeflateBackend backend);
+
+// Raw deflate (no zlib header) of data into out, primed with dictionary (may be empty).
+// last = true ends the stream with a final block; otherwise it ends byte-aligned on a sync flush.
+bool deflate_raw_piece(DeflateBackend backend, int level, const uint8_t* dictionary, size_t dictionary_size,
+                       const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out);
+
+// Complete zlib stream (header + deflate + Adler-32) of data into out
+bool deflate_zlib_buffer(DeflateBackend backend, int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out);
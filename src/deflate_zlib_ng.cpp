@@ -0,0 +1,44 @@
+// zlib-ng backend for deflate_backend.cpp, built only with NICESHOT_HAVE_ZLIB_NG.
+// Uses the native zng_ API so it links next to the stock zlib that libpng needs.
+#ifdef NICESHOT_HAVE_ZLIB_NG
+
+#include <zlib-ng.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+bool zlib_ng_deflate_raw_piece(int level, const uint8_t* dictionary, size_t dictionary_size,
+                               const uint8_t* data, size_t size, bool last, std::vector<uint8_t>& out) {
+    zng_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (zng_deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) { // Raw deflate, no zlib header
+        return false;
+    }
+    if (dictionary_size > 0) {
+        zng_deflateSetDictionary(&zs, dictionary, static_cast<uint32_t>(dictionary_size));
+    }
+
+    out.resize(zng_deflateBound(&zs, static_cast<unsigned long>(size)) + 16);
+    zs.next_in = data;
+    zs.avail_in = static_cast<uint32_t>(size);
+    zs.next_out = out.data();
+    zs.avail_out = static_cast<uint32_t>(out.size());
+
+    int32_t result = zng_deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool complete = last ? result == Z_STREAM_END : (result == Z_OK && zs.avail_in == 0);
+    out.resize(zs.total_out);
+    zng_deflateEnd(&zs);
+    return complete;
+}
+
+bool zlib_ng_deflate_zlib_buffer(int level, const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    size_t out_size = zng_compressBound(size);
+    out.resize(out_size);
+    if (zng_compress2(out.data(), &out_size, data, size, level) != Z_OK) {
+        return false;
+    }
+    out.resize(out_size);
+    return true;
+}
+
+#endif // NICESHOT_HAVE_ZLIB_NG
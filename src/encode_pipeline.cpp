@@ -0,0 +1,204 @@
+#include "encode_pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+typedef std::chrono::high_resolution_clock PipelineClock;
+
+// From this size a frame is converted in row bands on the shared conversion pool
+const uint64_t BANDED_FRAME_PIXELS = 1920 * 1080;
+
+double seconds_since(PipelineClock::time_point start) {
+    return std::chrono::duration<double>(PipelineClock::now() - start).count();
+}
+
+// Frame handed from the reader to a converter
+struct ReadItem {
+    EncodePipelineFrame frame;
+    const uint8_t* rgba;
+    size_t buffer; // Staging buffer to return once converted
+};
+
+} // namespace
+
+unsigned encode_pipeline_default_converters() {
+    unsigned hw = std::thread::hardware_concurrency();
+    return std::max(1u, std::min(4u, hw / 4));
+}
+
+bool run_encode_pipeline(RawFrameReader& reader, uint32_t width, uint32_t height, uint64_t frame_count,
+                         const std::vector<YuvPlanes>& slots, unsigned converter_threads,
+                         const EncodePipelineCallback& encode, EncodePipelineStats& stats) {
+    unsigned converters = converter_threads ? converter_threads : encode_pipeline_default_converters();
+    unsigned band_threads = 1;
+    if (converters > 1 && static_cast<uint64_t>(width) * height >= BANDED_FRAME_PIXELS) {
+        band_threads = converters;
+        converters = 1;
+    }
+    size_t slot_count = slots.size();
+    size_t frame_size = static_cast<size_t>(width) * height * 4;
+
+    stats = EncodePipelineStats();
+    stats.converter_threads = converters;
+    stats.band_threads = band_threads;
+    if (slot_count < 2) {
+        return false;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Staging buffers for decoded frames; mapped frames are passed through without a copy
+    std::vector<std::vector<uint8_t>> rgba_buffers(slot_count);
+    std::vector<size_t> free_buffers;
+    std::vector<size_t> free_slots;
+    for (size_t i = 0; i < slot_count; ++i) {
+        free_buffers.push_back(i);
+        free_slots.push_back(slot_count - 1 - i);
+    }
+
+    std::deque<ReadItem> read_queue;
+    std::vector<int64_t> ready(slot_count, -1); // Converted slot for frame i at [i % slot_count]
+    std::vector<EncodePipelineFrame> frames(slot_count); // Timing of those frames
+    uint64_t frames_read = 0;
+    bool reader_done = false;
+    bool aborted = false;
+    double read_busy = 0.0;
+    double convert_busy = 0.0;
+
+    auto start_time = PipelineClock::now();
+
+    std::thread reader_thread([&]() {
+        for (uint64_t i = 0; i < frame_count; ++i) {
+            size_t buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return aborted || !free_buffers.empty(); });
+                if (aborted) {
+                    break;
+                }
+                buffer = free_buffers.back();
+                free_buffers.pop_back();
+            }
+
+            auto busy_start = PipelineClock::now();
+            const uint8_t* rgba = reader.next_frame();
+            if (rgba && !reader.frame_is_mapped()) {
+                // The reader reuses its decode buffer on the next call
+                std::vector<uint8_t>& staging = rgba_buffers[buffer];
+                staging.resize(frame_size);
+                std::memcpy(staging.data(), rgba, frame_size);
+                rgba = staging.data();
+            }
+            double busy = seconds_since(busy_start);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            read_busy += busy;
+            if (!rgba) {
+                free_buffers.push_back(buffer);
+                break; // End of file
+            }
+            read_queue.push_back({ { i, reader.get_frame_timestamp(), reader.frame_is_repeat(), SIZE_MAX }, rgba, buffer });
+            frames_read++;
+            cv.notify_all();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        reader_done = true;
+        cv.notify_all();
+    });
+
+    std::vector<std::thread> converter_pool;
+    for (unsigned t = 0; t < converters; ++t) {
+        converter_pool.emplace_back([&]() {
+            while (true) {
+                ReadItem item;
+                size_t slot;
+                {
+                    // Take the frame and its slot together so slots are handed out in frame order;
+                    // otherwise later frames could hold every slot while the encoder waits on an earlier one
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() {
+                        return aborted || (!read_queue.empty() && !free_slots.empty()) ||
+                               (reader_done && read_queue.empty());
+                    });
+                    if (aborted || read_queue.empty()) {
+                        return;
+                    }
+                    item = read_queue.front();
+                    read_queue.pop_front();
+                    slot = free_slots.back();
+                    free_slots.pop_back();
+                }
+
+                // Small frames: parallelism comes from frames in flight; large ones are also split into bands
+                auto busy_start = PipelineClock::now();
+                if (band_threads > 1) {
+                    convert_rgba_to_yuv420p_parallel(item.rgba, width, height, slots[slot], band_threads);
+                } else {
+                    convert_rgba_to_yuv420p(item.rgba, width, height, slots[slot]);
+                }
+                double busy = seconds_since(busy_start);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                convert_busy += busy;
+                free_buffers.push_back(item.buffer);
+                ready[item.frame.index % slot_count] = static_cast<int64_t>(slot);
+                frames[item.frame.index % slot_count] = item.frame;
+                cv.notify_all();
+            }
+        });
+    }
+
+    // Encoder stage on the calling thread, strictly in frame order.
+    // Each slot is held for one extra frame so the callback can repeat the previous picture.
+    size_t previous_slot = SIZE_MAX;
+    for (uint64_t next = 0;; ++next) {
+        size_t slot;
+        EncodePipelineFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() {
+                return aborted || ready[next % slot_count] >= 0 || (reader_done && next >= frames_read);
+            });
+            if (aborted || ready[next % slot_count] < 0) {
+                break;
+            }
+            slot = static_cast<size_t>(ready[next % slot_count]);
+            frame = frames[next % slot_count];
+            ready[next % slot_count] = -1;
+        }
+        frame.previous_slot = previous_slot;
+
+        auto busy_start = PipelineClock::now();
+        bool ok = encode(slot, frame);
+        stats.encode_busy_seconds += seconds_since(busy_start);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (previous_slot != SIZE_MAX) {
+            free_slots.push_back(previous_slot);
+        }
+        previous_slot = slot;
+        stats.frames++;
+        if (!ok) {
+            aborted = true;
+        }
+        cv.notify_all();
+    }
+
+    reader_thread.join();
+    for (std::thread& converter : converter_pool) {
+        converter.join();
+    }
+
+    stats.wall_seconds = seconds_since(start_time);
+    stats.read_busy_seconds = read_busy;
+    stats.convert_busy_seconds = convert_busy;
+    return !aborted;
+}
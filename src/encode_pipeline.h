@@ -0,0 +1,48 @@
+#pragma once
+
+#include "raw_container.h"
+#include "yuv_convert.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Three-stage offline encode pipeline shared by the DLL and NiceShot_Converter:
+//   reader thread (decode .raw) -> N converter threads (RGBA to YUV420p) -> caller's thread (encode)
+// From 1080p up a single converter thread splits each frame into row bands across the same N threads instead,
+// so one frame's working set is converted at a time rather than N.
+// Stages are connected by a fixed set of picture slots, so memory stays bounded and nothing is allocated per frame.
+
+struct EncodePipelineStats {
+    uint64_t frames;
+    unsigned converter_threads;
+    unsigned band_threads;       // Threads each frame's conversion is split across (1 = whole frames per thread)
+    double wall_seconds;
+    double read_busy_seconds;    // Reader thread decoding/copying frames
+    double convert_busy_seconds; // Summed over converter threads
+    double encode_busy_seconds;  // Inside the encode callback
+};
+
+// A frame as handed to the encode callback
+struct EncodePipelineFrame {
+    uint64_t index;
+    int64_t timestamp; // Reader's frame timestamp (0 when the file has none)
+    bool repeat;       // Identical to the previous frame (REPEAT record)
+    size_t previous_slot; // Slot still holding the previous frame's picture (SIZE_MAX for the first frame)
+};
+
+// Encode callback, run on the calling thread in frame order.
+// slot indexes the planes passed to run_encode_pipeline; return false to abort.
+// The previous frame's slot is only recycled once this call returns, so gaps can be filled from it without a copy.
+typedef std::function<bool(size_t slot, const EncodePipelineFrame& frame)> EncodePipelineCallback;
+
+// Default converter thread count for this machine (x264 keeps most cores busy)
+unsigned encode_pipeline_default_converters();
+
+// Run the pipeline over up to frame_count frames of reader.
+// slots are caller-owned picture planes (e.g. x264_picture_t); at least 2 are needed, since the encoder keeps the
+// previous frame's slot. More slots than converters + 1 keeps every stage fed.
+// converter_threads = 0 picks encode_pipeline_default_converters().
+// Returns false if the callback aborted; stopping early at end of file is not an error.
+bool run_encode_pipeline(RawFrameReader& reader, uint32_t width, uint32_t height, uint64_t frame_count,
+                         const std::vector<YuvPlanes>& slots, unsigned converter_threads,
+                         const EncodePipelineCallback& encode, EncodePipelineStats& stats);
@@ -0,0 +1,110 @@
+#include "frame_timing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+const char* video_timing_name(VideoTiming timing) {
+    switch (timing) {
+    case VideoTiming::FRAME_COUNT: return "frame_count";
+    case VideoTiming::CFR: return "cfr";
+    case VideoTiming::VFR: return "vfr";
+    }
+    return "unknown";
+}
+
+bool video_timing_from_name(const std::string& name, VideoTiming& timing) {
+    for (int i = 0; i < VIDEO_TIMING_COUNT; ++i) {
+        if (name == video_timing_name(static_cast<VideoTiming>(i))) {
+            timing = static_cast<VideoTiming>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+FrameTimer::FrameTimer(VideoTiming frame_timing, double frame_rate, uint32_t timebase_num, uint32_t timebase_den)
+    : timing(frame_timing), fps(frame_rate > 0 ? frame_rate : 30.0), input_num(timebase_num ? timebase_num : 1),
+      input_den(timebase_den ? timebase_den : 1), started(false), origin(0), next_pts(0), trailing_repeat(false), last_timestamp(0),
+      duplicated(0), dropped(0) {
+    if (timing == VideoTiming::VFR) {
+        output_num = input_num;
+        output_den = input_den;
+    } else {
+        // Same rational x264 derives from i_fps_num = fps * 1000, i_fps_den = 1000
+        output_num = 1000;
+        output_den = static_cast<uint32_t>(fps * 1000);
+    }
+}
+
+FramePlan FrameTimer::plan(int64_t timestamp, bool repeat) {
+    FramePlan result = { 0, 0, true, 0 };
+    if (!started) {
+        started = true;
+        origin = timestamp;
+    }
+
+    switch (timing) {
+    case VideoTiming::FRAME_COUNT:
+        result.pts = next_pts++;
+        break;
+
+    case VideoTiming::CFR: {
+        // Nearest output slot; a frame landing on a slot already taken is dropped
+        double seconds = static_cast<double>(timestamp - origin) * input_num / input_den;
+        int64_t slot = std::max<int64_t>(0, std::llround(seconds * fps));
+        if (slot < next_pts) {
+            result.emit = false;
+            dropped++;
+            break;
+        }
+        result.repeat_previous = static_cast<uint64_t>(slot - next_pts);
+        result.repeat_pts = next_pts;
+        duplicated += result.repeat_previous;
+        result.pts = slot;
+        next_pts = slot + 1;
+        break;
+    }
+
+    case VideoTiming::VFR:
+        // An unchanged frame needs no picture of its own: the previous one simply stays up longer
+        trailing_repeat = repeat;
+        last_timestamp = timestamp - origin;
+        if (repeat) {
+            result.emit = false;
+            break;
+        }
+        result.pts = std::max(timestamp - origin, next_pts); // x264 needs strictly increasing PTS
+        next_pts = result.pts + 1;
+        break;
+    }
+    return result;
+}
+
+FramePlan FrameTimer::finish() {
+    FramePlan result = { 0, 0, false, 0 };
+    if (timing == VideoTiming::VFR && trailing_repeat) {
+        result.emit = true;
+        result.pts = std::max(last_timestamp, next_pts);
+        next_pts = result.pts + 1;
+        trailing_repeat = false;
+    }
+    return result;
+}
+
+bool write_timecodes_v2(const std::string& path, const std::vector<double>& milliseconds) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "w");
+#else
+    file = fopen(path.c_str(), "w");
+#endif
+    if (!file) {
+        return false;
+    }
+
+    bool ok = fprintf(file, "# timecode format v2\n") > 0;
+    for (double ms : milliseconds) {
+        ok = ok && fprintf(file, "%.3f\n", ms) > 0;
+    }
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Output timing of recordings, shared by the DLL and NiceShot_Converter.
+// Captured frames carry timestamps (in the raw container, or taken live); FrameTimer turns them into encoder PTS
+// so hitches and dropped frames no longer make playback drift.
+
+enum class VideoTiming {
+    FRAME_COUNT = 0, // PTS = frame index at the nominal fps (the old behaviour; used for files without timestamps)
+    CFR = 1,         // Constant frame rate: frames are duplicated across gaps and dropped when they arrive too fast
+    VFR = 2          // Variable frame rate: timestamps become PTS, repeated frames only extend the previous one
+};
+
+static const int VIDEO_TIMING_COUNT = 3;
+
+// Timebase the DLL records timestamps in: microseconds since recording start
+static const uint32_t CAPTURE_TIMEBASE_NUM = 1;
+static const uint32_t CAPTURE_TIMEBASE_DEN = 1000000;
+
+const char* video_timing_name(VideoTiming timing);
+
+// Inverse of video_timing_name (recording metadata); false for anything else
+bool video_timing_from_name(const std::string& name, VideoTiming& timing);
+
+// What to encode for one captured frame
+struct FramePlan {
+    uint64_t repeat_previous; // CFR: output frames of the previous picture to encode first, to fill a gap
+    int64_t repeat_pts;       // PTS of the first of those; the others follow at +1
+    bool emit;                // False when the frame is dropped (CFR: its slot is taken, VFR: unchanged repeat)
+    int64_t pts;              // PTS of this frame when emitted, in the encoder timebase
+};
+
+class FrameTimer {
+public:
+    // fps is the output rate for FRAME_COUNT and CFR; timestamps are in timebase_num / timebase_den seconds
+    FrameTimer(VideoTiming timing, double fps, uint32_t timebase_num, uint32_t timebase_den);
+
+    // Plan the next captured frame (frames must arrive in capture order); repeat marks an unchanged frame
+    FramePlan plan(int64_t timestamp, bool repeat);
+
+    // Plan the end of the stream, after the last frame. VFR: if the recording ended on unchanged frames, emit
+    // the last picture once more at the last repeat's timestamp so the video lasts as long as the capture did.
+    FramePlan finish();
+
+    VideoTiming get_timing() const { return timing; }
+
+    // Encoder timebase (seconds per PTS tick) for x264's i_timebase_num / i_timebase_den
+    uint32_t get_timebase_num() const { return output_num; }
+    uint32_t get_timebase_den() const { return output_den; }
+
+    double to_milliseconds(int64_t pts) const { return 1000.0 * pts * output_num / output_den; }
+
+    uint64_t get_duplicated() const { return duplicated; }
+    uint64_t get_dropped() const { return dropped; }
+
+private:
+    VideoTiming timing;
+    double fps;
+    uint32_t input_num;
+    uint32_t input_den;
+    uint32_t output_num;
+    uint32_t output_den;
+    bool started;
+    int64_t origin;     // Timestamp of the first frame, PTS 0
+    int64_t next_pts;   // Next free PTS (CFR: output slot)
+    bool trailing_repeat;   // VFR: the last planned frame was a repeat that was not emitted
+    int64_t last_timestamp; // Of the last planned frame, relative to origin
+    uint64_t duplicated;
+    uint64_t dropped;
+};
+
+// Write a Matroska "timecode format v2" file (one millisecond time per line) for a raw .h264 stream,
+// which cannot carry timestamps itself: mkvmerge --timestamps 0:file (or mp4fpsmod) applies them when muxing
+bool write_timecodes_v2(const std::string& path, const std::vector<double>& milliseconds);
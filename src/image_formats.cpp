@@ -0,0 +1,576 @@
+#include "image_formats.h"
+#include "raw_container.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+#ifdef NICESHOT_HAVE_LIBJPEG_TURBO
+#include <csetjmp>
+#include <cstdlib>
+#include <jpeglib.h>
+#endif
+
+#ifdef NICESHOT_HAVE_LIBWEBP
+#include <webp/encode.h>
+#endif
+
+static const uint8_t QOI_MAGIC[4] = { 'q', 'o', 'i', 'f' };
+static const size_t QOI_HEADER_SIZE = 14;
+static const uint8_t QOI_END_MARKER[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+static const uint64_t QOI_PIXELS_MAX = 400000000; // The spec's limit on width * height
+static const uint64_t QOI_MAX_PIXELS_PER_BYTE = 62; // A one-byte QOI_OP_RUN is the most one op byte can decode to
+
+static const size_t TGA_HEADER_SIZE = 18;
+static const uint8_t TGA_TYPE_TRUECOLOR = 2;
+static const uint8_t TGA_TYPE_TRUECOLOR_RLE = 10;
+static const uint8_t TGA_DESCRIPTOR_TOP_LEFT = 0x20;
+static const uint64_t TGA_PIXELS_MAX = QOI_PIXELS_MAX; // No limit in the format (up to 65535 x 65535); same cap as QOI
+static const uint64_t TGA_MAX_PIXELS_PER_BYTE = 32; // A 4-byte RLE run packet (3-byte pixel) decodes to 128 pixels
+
+static const size_t BMP_FILE_HEADER_SIZE = 14;
+static const size_t BMP_V4_HEADER_SIZE = 108;
+static const uint32_t BMP_BI_RGB = 0;
+static const uint32_t BMP_BI_BITFIELDS = 3;
+
+// Rows converted per fwrite for the uncompressed writers
+static const uint32_t SWIZZLE_CHUNK_ROWS = 64;
+
+// From this quality up JPEG keeps full-resolution chroma so UI text and HUD edges stay clean
+static const int JPEG_FULL_CHROMA_QUALITY = 90;
+static const uint32_t WEBP_MAX_SIZE = 16383;
+
+static inline void put_le16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static inline void put_le32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static inline void put_be32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+static inline uint16_t get_le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static inline uint32_t get_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+static FILE* open_file(const std::string& filepath, const char* mode) {
+    FILE* fp = nullptr;
+#ifdef _WIN32
+    fopen_s(&fp, filepath.c_str(), mode);
+#else
+    fp = fopen(filepath.c_str(), mode);
+#endif
+    return fp;
+}
+
+const char* image_format_name(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::PNG: return "PNG";
+    case ImageFormat::QOI: return "QOI";
+    case ImageFormat::TGA: return "TGA";
+    case ImageFormat::BMP: return "BMP";
+    case ImageFormat::JPEG: return "JPEG";
+    case ImageFormat::WEBP: return "WebP";
+    }
+    return "unknown";
+}
+
+bool image_format_available(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::PNG:
+    case ImageFormat::QOI:
+    case ImageFormat::TGA:
+    case ImageFormat::BMP:
+        return true;
+    case ImageFormat::JPEG:
+#ifdef NICESHOT_HAVE_LIBJPEG_TURBO
+        return true;
+#else
+        return false;
+#endif
+    case ImageFormat::WEBP:
+#ifdef NICESHOT_HAVE_LIBWEBP
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char* image_format_extension(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::PNG: return ".png";
+    case ImageFormat::QOI: return ".qoi";
+    case ImageFormat::TGA: return ".tga";
+    case ImageFormat::BMP: return ".bmp";
+    case ImageFormat::JPEG: return ".jpg";
+    case ImageFormat::WEBP: return ".webp";
+    }
+    return "";
+}
+
+bool image_format_from_path(const std::string& path, ImageFormat& format) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".jpeg") {
+        format = ImageFormat::JPEG;
+        return true;
+    }
+    for (int i = 0; i < IMAGE_FORMAT_COUNT; ++i) {
+        if (extension == image_format_extension(static_cast<ImageFormat>(i))) {
+            format = static_cast<ImageFormat>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool write_qoi(FILE* fp, const uint8_t* pixels, uint32_t width, uint32_t height) {
+    uint8_t header[QOI_HEADER_SIZE];
+    std::memcpy(header, QOI_MAGIC, 4);
+    put_be32(header + 4, width);
+    put_be32(header + 8, height);
+    header[12] = 4; // RGBA
+    header[13] = 0; // sRGB with linear alpha
+
+    // Left uninitialised: the worst case is 5x the frame and only the encoded prefix is ever touched
+    std::unique_ptr<uint8_t[]> encoded(new uint8_t[qoi_max_encoded_size(width, height)]);
+    size_t encoded_size = qoi_encode_rgba(pixels, width, height, encoded.get());
+
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) &&
+           fwrite(encoded.get(), 1, encoded_size, fp) == encoded_size &&
+           fwrite(QOI_END_MARKER, 1, sizeof(QOI_END_MARKER), fp) == sizeof(QOI_END_MARKER);
+}
+
+// Write rows as BGRA (both TGA and BMP store blue first), a chunk of rows per fwrite
+static bool write_bgra_rows(FILE* fp, const uint8_t* pixels, uint32_t width, uint32_t height) {
+    size_t stride = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> chunk(stride * std::min(height, SWIZZLE_CHUNK_ROWS));
+    for (uint32_t y = 0; y < height; y += SWIZZLE_CHUNK_ROWS) {
+        uint32_t rows = std::min(SWIZZLE_CHUNK_ROWS, height - y);
+        const uint8_t* src = pixels + y * stride;
+        size_t bytes = rows * stride;
+        for (size_t i = 0; i < bytes; i += 4) {
+            chunk[i + 0] = src[i + 2];
+            chunk[i + 1] = src[i + 1];
+            chunk[i + 2] = src[i + 0];
+            chunk[i + 3] = src[i + 3];
+        }
+        if (fwrite(chunk.data(), 1, bytes, fp) != bytes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool write_tga(FILE* fp, const uint8_t* pixels, uint32_t width, uint32_t height) {
+    uint8_t header[TGA_HEADER_SIZE] = { 0 };
+    header[2] = TGA_TYPE_TRUECOLOR;
+    put_le16(header + 12, static_cast<uint16_t>(width));
+    put_le16(header + 14, static_cast<uint16_t>(height));
+    header[16] = 32;
+    header[17] = TGA_DESCRIPTOR_TOP_LEFT | 8; // 8 alpha bits
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) && write_bgra_rows(fp, pixels, width, height);
+}
+
+static bool write_bmp(FILE* fp, const uint8_t* pixels, uint32_t width, uint32_t height) {
+    uint32_t image_size = width * height * 4;
+    uint8_t header[BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE] = { 0 };
+    header[0] = 'B';
+    header[1] = 'M';
+    put_le32(header + 2, static_cast<uint32_t>(sizeof(header)) + image_size);
+    put_le32(header + 10, static_cast<uint32_t>(sizeof(header)));
+
+    uint8_t* info = header + BMP_FILE_HEADER_SIZE;
+    put_le32(info, static_cast<uint32_t>(BMP_V4_HEADER_SIZE));
+    put_le32(info + 4, width);
+    put_le32(info + 8, static_cast<uint32_t>(-static_cast<int32_t>(height))); // Negative height = top-down rows
+    put_le16(info + 12, 1);
+    put_le16(info + 14, 32);
+    put_le32(info + 16, BMP_BI_BITFIELDS);
+    put_le32(info + 20, image_size);
+    put_le32(info + 24, 2835); // 72 DPI
+    put_le32(info + 28, 2835);
+    put_le32(info + 40, 0x00FF0000); // Red mask
+    put_le32(info + 44, 0x0000FF00); // Green mask
+    put_le32(info + 48, 0x000000FF); // Blue mask
+    put_le32(info + 52, 0xFF000000); // Alpha mask
+    put_le32(info + 56, 0x73524742); // 'sRGB'
+
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) && write_bgra_rows(fp, pixels, width, height);
+}
+
+#ifdef NICESHOT_HAVE_LIBJPEG_TURBO
+// libjpeg reports errors by calling error_exit, which must not return; jump back into write_jpeg instead
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+static bool write_jpeg(FILE* fp, const uint8_t* pixels, uint32_t width, uint32_t height, int quality) {
+    jpeg_compress_struct cinfo;
+    JpegErrorManager error;
+    unsigned char* encoded = nullptr;
+    unsigned long encoded_size = 0;
+
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpeg_error_exit;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(encoded);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &encoded, &encoded_size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 4;
+    cinfo.in_color_space = JCS_EXT_RGBA; // libjpeg-turbo extension: SIMD colour conversion straight from RGBA
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    if (quality >= JPEG_FULL_CHROMA_QUALITY) {
+        cinfo.comp_info[0].h_samp_factor = 1;
+        cinfo.comp_info[0].v_samp_factor = 1;
+    }
+    jpeg_start_compress(&cinfo, TRUE);
+
+    size_t stride = static_cast<size_t>(width) * 4;
+    JSAMPROW rows[16];
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JDIMENSION count = std::min<JDIMENSION>(16, cinfo.image_height - cinfo.next_scanline);
+        for (JDIMENSION i = 0; i < count; ++i) {
+            rows[i] = const_cast<JSAMPROW>(pixels + (cinfo.next_scanline + i) * stride);
+        }
+        jpeg_write_scanlines(&cinfo, rows, count);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    bool ok = fwrite(encoded, 1, encoded_size, fp) == encoded_size;
+    jpeg_destroy_compress(&cinfo);
+    free(encoded);
+    return ok;
+}
+#endif
+
+#ifdef NICESHOT_HAVE_LIBWEBP
+static bool write_webp(FILE* fp, const uint8_t* pixels, uint32_t width, uint32_t height, int quality) {
+    uint8_t* encoded = nullptr;
+    int stride = static_cast<int>(width * 4);
+    size_t encoded_size = quality >= 100
+        ? WebPEncodeLosslessRGBA(pixels, static_cast<int>(width), static_cast<int>(height), stride, &encoded)
+        : WebPEncodeRGBA(pixels, static_cast<int>(width), static_cast<int>(height), stride, static_cast<float>(quality), &encoded);
+    bool ok = encoded_size > 0 && fwrite(encoded, 1, encoded_size, fp) == encoded_size;
+    WebPFree(encoded);
+    return ok;
+}
+#endif
+
+bool write_image_file(ImageFormat format, const uint8_t* pixels, uint32_t width, uint32_t height,
+                      const std::string& filepath, std::string& error_message, int quality) {
+    if (format == ImageFormat::TGA && (width > 0xFFFF || height > 0xFFFF)) {
+        error_message = "Image too large for TGA";
+        return false;
+    }
+    if (format == ImageFormat::WEBP && (width > WEBP_MAX_SIZE || height > WEBP_MAX_SIZE)) {
+        error_message = "Image too large for WebP";
+        return false;
+    }
+    if (format == ImageFormat::PNG) {
+        error_message = "PNG is written by the PNG encoder";
+        return false;
+    }
+    if (!image_format_available(format)) {
+        error_message = std::string(image_format_name(format)) + " support is not built in";
+        return false;
+    }
+    quality = std::max(0, std::min(quality, 100));
+
+    FILE* fp = open_file(filepath, "wb");
+    if (!fp) {
+        error_message = "Failed to open file for writing: " + filepath;
+        return false;
+    }
+
+    bool ok = false;
+    switch (format) {
+    case ImageFormat::QOI: ok = write_qoi(fp, pixels, width, height); break;
+    case ImageFormat::TGA: ok = write_tga(fp, pixels, width, height); break;
+    case ImageFormat::BMP: ok = write_bmp(fp, pixels, width, height); break;
+#ifdef NICESHOT_HAVE_LIBJPEG_TURBO
+    case ImageFormat::JPEG: ok = write_jpeg(fp, pixels, width, height, quality); break;
+#endif
+#ifdef NICESHOT_HAVE_LIBWEBP
+    case ImageFormat::WEBP: ok = write_webp(fp, pixels, width, height, quality); break;
+#endif
+    default: break;
+    }
+
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        error_message = std::string("Failed to write ") + image_format_name(format) + " data: " + filepath;
+    }
+    return ok;
+}
+
+static bool read_qoi(const std::vector<uint8_t>& file, std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height) {
+    if (file.size() < QOI_HEADER_SIZE + sizeof(QOI_END_MARKER)) {
+        return false;
+    }
+    width = get_be32(&file[4]);
+    height = get_be32(&file[8]);
+    if (width == 0 || height == 0 || (file[12] != 3 && file[12] != 4)) {
+        return false;
+    }
+    // The header is untrusted: cap the size before allocating, and refuse sizes the payload could never fill
+    uint64_t pixel_count = static_cast<uint64_t>(width) * height;
+    uint64_t payload_size = file.size() - QOI_HEADER_SIZE;
+    if (pixel_count > QOI_PIXELS_MAX || pixel_count > payload_size * QOI_MAX_PIXELS_PER_BYTE) {
+        return false;
+    }
+    // The op stream always carries alpha; a 3-channel file simply never changes it from 255
+    rgba.resize(static_cast<size_t>(width) * height * 4);
+    return qoi_decode_rgba(file.data() + QOI_HEADER_SIZE, file.size() - QOI_HEADER_SIZE, width, height, rgba.data());
+}
+
+static bool read_tga(const std::vector<uint8_t>& file, std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height) {
+    if (file.size() < TGA_HEADER_SIZE) {
+        return false;
+    }
+    uint8_t id_length = file[0];
+    uint8_t image_type = file[2];
+    uint32_t bytes_per_pixel = file[16] / 8;
+    width = get_le16(&file[12]);
+    height = get_le16(&file[14]);
+    bool top_down = (file[17] & TGA_DESCRIPTOR_TOP_LEFT) != 0;
+    bool has_alpha = bytes_per_pixel == 4 && (file[17] & 0x0F) != 0;
+
+    if (file[1] != 0 || (image_type != TGA_TYPE_TRUECOLOR && image_type != TGA_TYPE_TRUECOLOR_RLE) ||
+        (bytes_per_pixel != 3 && bytes_per_pixel != 4) || width == 0 || height == 0) {
+        return false;
+    }
+
+    // Bound the size by the data actually in the file before allocating for it
+    size_t pixel_count = static_cast<size_t>(width) * height;
+    size_t pos = TGA_HEADER_SIZE + id_length;
+    if (file.size() < pos) {
+        return false;
+    }
+    uint64_t payload_size = file.size() - pos;
+    uint64_t max_pixels = image_type == TGA_TYPE_TRUECOLOR ? payload_size / bytes_per_pixel
+                                                           : payload_size * TGA_MAX_PIXELS_PER_BYTE;
+    if (pixel_count > TGA_PIXELS_MAX || pixel_count > max_pixels) {
+        return false;
+    }
+    std::vector<uint8_t> bgra(pixel_count * 4);
+    auto store = [&](size_t index, const uint8_t* src) {
+        uint8_t* dst = &bgra[index * 4];
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = has_alpha ? src[3] : 255;
+    };
+
+    if (image_type == TGA_TYPE_TRUECOLOR) {
+        if (file.size() < pos + pixel_count * bytes_per_pixel) {
+            return false;
+        }
+        for (size_t i = 0; i < pixel_count; ++i) {
+            store(i, &file[pos + i * bytes_per_pixel]);
+        }
+    } else {
+        // RLE packets: high bit set = one pixel repeated, clear = literal pixels; low 7 bits = count - 1
+        size_t i = 0;
+        while (i < pixel_count) {
+            if (pos >= file.size()) {
+                return false;
+            }
+            uint8_t packet = file[pos++];
+            size_t count = std::min<size_t>((packet & 0x7F) + 1, pixel_count - i);
+            size_t literal_bytes = (packet & 0x80) ? bytes_per_pixel : count * bytes_per_pixel;
+            if (pos + literal_bytes > file.size()) {
+                return false;
+            }
+            for (size_t n = 0; n < count; ++n, ++i) {
+                store(i, &file[(packet & 0x80) ? pos : pos + n * bytes_per_pixel]);
+            }
+            pos += literal_bytes;
+        }
+    }
+
+    rgba.resize(pixel_count * 4);
+    size_t stride = static_cast<size_t>(width) * 4;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* src = &bgra[(top_down ? y : height - 1 - y) * stride];
+        uint8_t* dst = &rgba[y * stride];
+        for (size_t x = 0; x < stride; x += 4) {
+            dst[x + 0] = src[x + 2];
+            dst[x + 1] = src[x + 1];
+            dst[x + 2] = src[x + 0];
+            dst[x + 3] = src[x + 3];
+        }
+    }
+    return true;
+}
+
+// Shift that moves an 8-bit channel mask down to bit 0 (masks other tools write are byte aligned)
+static inline int mask_shift(uint32_t mask) {
+    int shift = 0;
+    while (mask && !(mask & 1)) {
+        mask >>= 1;
+        ++shift;
+    }
+    return shift;
+}
+
+static bool read_bmp(const std::vector<uint8_t>& file, std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height) {
+    if (file.size() < BMP_FILE_HEADER_SIZE + 40) {
+        return false;
+    }
+    uint32_t data_offset = get_le32(&file[10]);
+    const uint8_t* info = &file[BMP_FILE_HEADER_SIZE];
+    uint32_t info_size = get_le32(info);
+    int32_t signed_width = static_cast<int32_t>(get_le32(info + 4));
+    int32_t signed_height = static_cast<int32_t>(get_le32(info + 8));
+    uint16_t bit_count = get_le16(info + 14);
+    uint32_t compression = get_le32(info + 16);
+
+    if (signed_width <= 0 || signed_height == 0 || (bit_count != 24 && bit_count != 32) ||
+        (compression != BMP_BI_RGB && !(compression == BMP_BI_BITFIELDS && bit_count == 32))) {
+        return false;
+    }
+    width = static_cast<uint32_t>(signed_width);
+    height = static_cast<uint32_t>(signed_height < 0 ? -static_cast<int64_t>(signed_height) : signed_height);
+    bool top_down = signed_height < 0;
+
+    // BI_RGB 32-bit is BGRX; the fourth byte is usually zero, so treat it as opaque
+    uint32_t masks[4] = { 0x00FF0000, 0x0000FF00, 0x000000FF, 0 };
+    if (compression == BMP_BI_BITFIELDS) {
+        // Masks sit in the V4/V5 header, or right after a 40-byte header
+        size_t mask_offset = BMP_FILE_HEADER_SIZE + 40;
+        size_t mask_count = info_size >= 56 ? 4 : 3;
+        if (file.size() < mask_offset + mask_count * 4) {
+            return false;
+        }
+        for (size_t i = 0; i < mask_count; ++i) {
+            masks[i] = get_le32(&file[mask_offset + i * 4]);
+        }
+    }
+    int shifts[4] = { mask_shift(masks[0]), mask_shift(masks[1]), mask_shift(masks[2]), mask_shift(masks[3]) };
+
+    size_t bytes_per_pixel = bit_count / 8;
+    size_t row_size = (static_cast<size_t>(width) * bytes_per_pixel + 3) & ~static_cast<size_t>(3);
+    if (data_offset > file.size() || file.size() - data_offset < row_size * height) {
+        return false;
+    }
+
+    rgba.resize(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* src = &file[data_offset + (top_down ? y : height - 1 - y) * row_size];
+        uint8_t* dst = &rgba[static_cast<size_t>(y) * width * 4];
+        for (uint32_t x = 0; x < width; ++x, src += bytes_per_pixel, dst += 4) {
+            if (bytes_per_pixel == 3) {
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                dst[3] = 255;
+            } else {
+                uint32_t px = get_le32(src);
+                dst[0] = static_cast<uint8_t>((px & masks[0]) >> shifts[0]);
+                dst[1] = static_cast<uint8_t>((px & masks[1]) >> shifts[1]);
+                dst[2] = static_cast<uint8_t>((px & masks[2]) >> shifts[2]);
+                dst[3] = masks[3] ? static_cast<uint8_t>((px & masks[3]) >> shifts[3]) : 255;
+            }
+        }
+    }
+    return true;
+}
+
+bool read_image_file(const std::string& filepath, std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height,
+                     ImageFormat& format, std::string& error_message) {
+    FILE* fp = open_file(filepath, "rb");
+    if (!fp) {
+        error_message = "Failed to open file for reading: " + filepath;
+        return false;
+    }
+    std::vector<uint8_t> file;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long size = ftell(fp);
+        if (size > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+            file.resize(static_cast<size_t>(size));
+            file.resize(fread(file.data(), 1, file.size(), fp));
+        }
+    }
+    fclose(fp);
+
+    // TGA has no magic number, so it is the fallback after QOI and BMP
+    bool ok;
+    if (file.size() >= 4 && std::memcmp(file.data(), QOI_MAGIC, 4) == 0) {
+        format = ImageFormat::QOI;
+        ok = read_qoi(file, rgba, width, height);
+    } else if (file.size() >= 2 && file[0] == 'B' && file[1] == 'M') {
+        format = ImageFormat::BMP;
+        ok = read_bmp(file, rgba, width, height);
+    } else {
+        format = ImageFormat::TGA;
+        ok = read_tga(file, rgba, width, height);
+    }
+
+    if (!ok) {
+        error_message = "Unsupported or corrupt image: " + filepath;
+    }
+    return ok;
+}
+
+std::vector<std::string> list_convertible_images(const std::string& directory) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        ImageFormat format;
+        std::string path = it->path().string();
+        if (it->is_regular_file(error) && image_format_from_path(path, format) &&
+            (format == ImageFormat::QOI || format == ImageFormat::TGA || format == ImageFormat::BMP)) {
+            paths.push_back(path);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+std::string png_path_for(const std::string& path) {
+    return std::filesystem::path(path).replace_extension(".png").string();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Screenshot formats besides PNG, shared by the DLL and NiceShot_Converter.
+// QOI, TGA and BMP trade file size for latency (no deflate) and can be transcoded to PNG later.
+// JPEG (libjpeg-turbo) and WebP (libwebp) are lossy share-ready outputs, compiled in with
+// NICESHOT_HAVE_LIBJPEG_TURBO / NICESHOT_HAVE_LIBWEBP.
+
+enum class ImageFormat {
+    PNG = 0,
+    QOI = 1,  // Standard .qoi (qoiformat.org): run/index/diff ops, roughly an order of magnitude faster than deflate
+    TGA = 2,  // Uncompressed 32-bit BGRA, top-left origin
+    BMP = 3,  // Uncompressed 32-bit BGRA with alpha mask (BITMAPV4HEADER), top-down
+    JPEG = 4, // Lossy, alpha dropped; 4:2:0 below quality 90, 4:4:4 from 90 up
+    WEBP = 5  // Lossy with alpha; quality 100 switches to lossless (exact wherever alpha is non-zero)
+};
+
+static const int IMAGE_FORMAT_COUNT = 6;
+
+// Quality used for JPEG/WebP when none is given (0-100)
+static const int IMAGE_DEFAULT_QUALITY = 90;
+
+const char* image_format_name(ImageFormat format);
+
+// False for the optional lossy formats when their library is not built in
+bool image_format_available(ImageFormat format);
+
+// Lowercase file extension including the dot
+const char* image_format_extension(ImageFormat format);
+
+// Format of a path by extension (case-insensitive, .jpeg accepted too); false for anything else
+bool image_format_from_path(const std::string& path, ImageFormat& format);
+
+// Write tightly packed RGBA pixels in any format but PNG (handled by the PNG writer).
+// quality (0-100) applies to JPEG and WebP only.
+bool write_image_file(ImageFormat format, const uint8_t* pixels, uint32_t width, uint32_t height,
+                      const std::string& filepath, std::string& error_message, int quality = IMAGE_DEFAULT_QUALITY);
+
+// Read a QOI, TGA or BMP file into tightly packed RGBA. Reads what write_image_file produces plus the common
+// variants other tools write (24/32-bit TGA and BMP, either row order); format is taken from the file contents.
+bool read_image_file(const std::string& filepath, std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height,
+                     ImageFormat& format, std::string& error_message);
+
+// QOI, TGA and BMP files directly inside directory (not recursive), sorted by name
+std::vector<std::string> list_convertible_images(const std::string& directory);
+
+// The same path with its extension replaced by .png
+std::string png_path_for(const std::string& path);
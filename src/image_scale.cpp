@@ -0,0 +1,250 @@
+#include "image_scale.h"
+#include "simd_target.h"
+#include "yuv_convert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NICESHOT_SCALE_X86
+#include <immintrin.h>
+#endif
+
+static const double PI = 3.14159265358979323846;
+
+// Source pixels [first, first + count) feeding one output row or column, weights at offset in the weight table
+struct Contribution {
+    uint32_t first;
+    uint32_t count;
+    size_t offset;
+};
+
+static double lanczos3(double x) {
+    x = std::fabs(x);
+    if (x < 1e-8) {
+        return 1.0;
+    }
+    if (x >= 3.0) {
+        return 0.0;
+    }
+    return 3.0 * std::sin(PI * x) * std::sin(PI * x / 3.0) / (PI * PI * x * x);
+}
+
+// Normalised weights for every output coordinate along one axis.
+// Source pixel j covers [j, j + 1); output pixel i is centred on (i + 0.5) * scale in those units.
+static void build_contributions(uint32_t src_size, uint32_t dst_size, ScaleFilter filter,
+                                std::vector<Contribution>& contributions, std::vector<float>& weights) {
+    double scale = static_cast<double>(src_size) / dst_size;
+    double filter_scale = std::max(scale, 1.0); // Widen the kernel when shrinking so every source pixel counts
+    double support = (filter == ScaleFilter::BOX ? 0.5 : 3.0) * filter_scale;
+
+    contributions.resize(dst_size);
+    weights.clear();
+    std::vector<double> raw;
+    for (uint32_t i = 0; i < dst_size; ++i) {
+        double center = (i + 0.5) * scale;
+        int64_t low = std::max<int64_t>(0, static_cast<int64_t>(std::floor(center - support)));
+        int64_t high = std::min<int64_t>(src_size, static_cast<int64_t>(std::ceil(center + support)));
+
+        raw.clear();
+        double sum = 0.0;
+        for (int64_t j = low; j < high; ++j) {
+            double weight;
+            if (filter == ScaleFilter::BOX) {
+                double from = std::max(static_cast<double>(j), center - filter_scale / 2);
+                double to = std::min(static_cast<double>(j + 1), center + filter_scale / 2);
+                weight = std::max(0.0, to - from);
+            } else {
+                weight = lanczos3((j + 0.5 - center) / filter_scale);
+            }
+            raw.push_back(weight);
+            sum += weight;
+        }
+
+        // Drop zero taps at either end so the kernels do no wasted work
+        size_t begin = 0;
+        size_t end = raw.size();
+        while (begin < end && raw[begin] == 0.0) {
+            ++begin;
+        }
+        while (end > begin && raw[end - 1] == 0.0) {
+            --end;
+        }
+        if (begin == end || sum == 0.0) {
+            // Cannot happen for sane sizes; fall back to the nearest pixel
+            int64_t nearest = std::min<int64_t>(src_size - 1, std::max<int64_t>(0, static_cast<int64_t>(center)));
+            contributions[i] = { static_cast<uint32_t>(nearest), 1, weights.size() };
+            weights.push_back(1.0f);
+            continue;
+        }
+
+        contributions[i] = { static_cast<uint32_t>(low + begin), static_cast<uint32_t>(end - begin), weights.size() };
+        for (size_t k = begin; k < end; ++k) {
+            weights.push_back(static_cast<float>(raw[k] / sum));
+        }
+    }
+}
+
+// Vertical pass: acc[i] += weight * row[i] for count bytes
+typedef void (*AccumulateKernel)(const uint8_t* row, float weight, float* acc, size_t count);
+
+// Horizontal pass: one output row from the accumulated float row (4 floats per source pixel)
+typedef void (*ResampleKernel)(const float* acc, const Contribution* columns, const float* weights, uint32_t width,
+                               uint8_t* out);
+
+static void accumulate_scalar(const uint8_t* row, float weight, float* acc, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        acc[i] += weight * static_cast<float>(row[i]);
+    }
+}
+
+static inline uint8_t to_byte(float value) {
+    long rounded = std::lrintf(value); // Round half to even, like cvtps2dq
+    return static_cast<uint8_t>(std::min(255L, std::max(0L, rounded)));
+}
+
+static void resample_scalar(const float* acc, const Contribution* columns, const float* weights, uint32_t width,
+                            uint8_t* out) {
+    for (uint32_t x = 0; x < width; ++x) {
+        const Contribution& column = columns[x];
+        const float* source = acc + static_cast<size_t>(column.first) * 4;
+        const float* tap_weights = weights + column.offset;
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (uint32_t k = 0; k < column.count; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                sum[c] += source[k * 4 + c] * tap_weights[k];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            out[static_cast<size_t>(x) * 4 + c] = to_byte(sum[c]);
+        }
+    }
+}
+
+#ifdef NICESHOT_SCALE_X86
+
+// SSE2: 16 bytes per iteration, widened to four vectors of 4 floats
+NICESHOT_TARGET("sse2")
+static void accumulate_sse2(const uint8_t* row, float weight, float* acc, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w = _mm_set1_ps(weight);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+        __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+        __m128 f2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+        __m128 f3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w, f0)));
+        _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(w, f1)));
+        _mm_storeu_ps(acc + i + 8, _mm_add_ps(_mm_loadu_ps(acc + i + 8), _mm_mul_ps(w, f2)));
+        _mm_storeu_ps(acc + i + 12, _mm_add_ps(_mm_loadu_ps(acc + i + 12), _mm_mul_ps(w, f3)));
+    }
+    accumulate_scalar(row + i, weight, acc + i, count - i);
+}
+
+// One RGBA pixel per register: each tap is one multiply-add of all four channels
+NICESHOT_TARGET("sse2")
+static void resample_sse2(const float* acc, const Contribution* columns, const float* weights, uint32_t width,
+                          uint8_t* out) {
+    for (uint32_t x = 0; x < width; ++x) {
+        const Contribution& column = columns[x];
+        const float* source = acc + static_cast<size_t>(column.first) * 4;
+        const float* tap_weights = weights + column.offset;
+        __m128 sum = _mm_setzero_ps();
+        for (uint32_t k = 0; k < column.count; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + k * 4), _mm_set1_ps(tap_weights[k])));
+        }
+        __m128i packed = _mm_cvtps_epi32(sum);
+        packed = _mm_packs_epi32(packed, packed);
+        packed = _mm_packus_epi16(packed, packed);
+        int32_t pixel = _mm_cvtsi128_si32(packed);
+        std::memcpy(out + static_cast<size_t>(x) * 4, &pixel, 4);
+    }
+}
+
+// AVX2: 16 bytes per iteration as two vectors of 8 floats
+NICESHOT_TARGET("avx2")
+static void accumulate_avx2(const uint8_t* row, float weight, float* acc, size_t count) {
+    const __m256 w = _mm256_set1_ps(weight);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(w, f0)));
+        _mm256_storeu_ps(acc + i + 8, _mm256_add_ps(_mm256_loadu_ps(acc + i + 8), _mm256_mul_ps(w, f1)));
+    }
+    accumulate_scalar(row + i, weight, acc + i, count - i);
+}
+
+#endif // NICESHOT_SCALE_X86
+
+struct ScaleKernels {
+    AccumulateKernel accumulate;
+    ResampleKernel resample;
+    bool simd;
+};
+
+static ScaleKernels select_kernels() {
+#ifdef NICESHOT_SCALE_X86
+    if (yuv_kernel_supported(YuvKernel::AVX2)) {
+        return { accumulate_avx2, resample_sse2, true };
+    }
+    if (yuv_kernel_supported(YuvKernel::SSE2)) {
+        return { accumulate_sse2, resample_sse2, true };
+    }
+#endif
+    return { accumulate_scalar, resample_scalar, false };
+}
+
+static const ScaleKernels& scale_kernels() {
+    static const ScaleKernels kernels = select_kernels();
+    return kernels;
+}
+
+const char* scale_filter_name(ScaleFilter filter) {
+    switch (filter) {
+    case ScaleFilter::BOX: return "box";
+    case ScaleFilter::LANCZOS3: return "Lanczos-3";
+    }
+    return "unknown";
+}
+
+bool image_scale_simd_available() {
+    return scale_kernels().simd;
+}
+
+bool scale_rgba(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t dst_width,
+                uint32_t dst_height, ScaleFilter filter) {
+    if (!src || !dst || src_width == 0 || src_height == 0 || dst_width == 0 || dst_height == 0) {
+        return false;
+    }
+
+    std::vector<Contribution> columns;
+    std::vector<float> column_weights;
+    std::vector<Contribution> rows;
+    std::vector<float> row_weights;
+    build_contributions(src_width, dst_width, filter, columns, column_weights);
+    build_contributions(src_height, dst_height, filter, rows, row_weights);
+
+    const ScaleKernels& kernels = scale_kernels();
+    size_t src_stride = static_cast<size_t>(src_width) * 4;
+    size_t dst_stride = static_cast<size_t>(dst_width) * 4;
+    std::vector<float> acc(src_stride);
+
+    // Each output row reads its source rows once, straight into a float row that stays in cache for the column pass
+    for (uint32_t y = 0; y < dst_height; ++y) {
+        const Contribution& row = rows[y];
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (uint32_t k = 0; k < row.count; ++k) {
+            kernels.accumulate(src + static_cast<size_t>(row.first + k) * src_stride, row_weights[row.offset + k],
+                               acc.data(), src_stride);
+        }
+        kernels.resample(acc.data(), columns.data(), column_weights.data(), dst_width, dst + y * dst_stride);
+    }
+    return true;
+}
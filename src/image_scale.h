@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+// Downscaling of tightly packed RGBA frames for thumbnails.
+// Separable resampler: each output row accumulates its weighted source rows into a float row, then each output
+// pixel sums its weighted columns with one RGBA pixel per SSE register. The SSE2/AVX2 kernels are picked at runtime
+// and produce output identical to the scalar code. Channels are filtered independently (straight alpha).
+
+enum class ScaleFilter {
+    BOX = 0,     // Area average: every source pixel weighted by how much of it the output pixel covers
+    LANCZOS3 = 1 // Windowed sinc over 3 lobes: sharper, slightly slower, can ring on hard edges
+};
+
+static const int SCALE_FILTER_COUNT = 2;
+
+const char* scale_filter_name(ScaleFilter filter);
+
+// True when the SIMD kernels are in use
+bool image_scale_simd_available();
+
+// Resample src (src_width x src_height) into dst (dst_width x dst_height, dst_width * 4 bytes per row).
+// Works for any size pair; meant for shrinking. False (dst untouched) when a dimension is 0.
+bool scale_rgba(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t dst_width,
+                uint32_t dst_height, ScaleFilter filter);
@@ -0,0 +1,214 @@
+#include "job_pool.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+const int64_t EMPTY_LANE = std::numeric_limits<int64_t>::max();
+
+// Pool and index of the worker running on this thread, so helper tasks stay local
+thread_local const WorkStealingPool* t_pool = nullptr;
+thread_local unsigned t_worker = 0;
+
+int64_t ticks(WorkStealingPool::Clock::time_point time) {
+    return time.time_since_epoch().count();
+}
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(int priority_levels)
+    : levels(priority_levels), lane_levels(priority_levels + 1),
+      queued(new std::atomic<size_t>[priority_levels + 1]), workers(0), running(false), stopping(false), next_worker(0),
+      queued_tasks(0), sleeping(0), steals(0) {
+    for (int i = 0; i < lane_levels; ++i) {
+        queued[i] = 0;
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+}
+
+void WorkStealingPool::start(unsigned thread_count) {
+    if (running.load()) {
+        return;
+    }
+    thread_count = std::max(1u, thread_count);
+
+    lanes.clear();
+    for (size_t i = 0; i < static_cast<size_t>(thread_count) * lane_levels; ++i) {
+        lanes.emplace_back(new Lane());
+        lanes.back()->front_deadline = EMPTY_LANE;
+    }
+    for (int i = 0; i < lane_levels; ++i) {
+        queued[i] = 0;
+    }
+    queued_tasks = 0;
+    steals = 0;
+    workers = thread_count;
+    stopping = false;
+    running = true;
+
+    threads.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        threads.emplace_back(&WorkStealingPool::worker_main, this, i);
+    }
+}
+
+void WorkStealingPool::stop() {
+    if (!running.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads.clear();
+    workers = 0;
+    running = false;
+
+    // Drop queued tasks (and whatever they captured) after the workers are gone
+    lanes.clear();
+    for (int i = 0; i < lane_levels; ++i) {
+        queued[i] = 0;
+    }
+    queued_tasks = 0;
+}
+
+bool WorkStealingPool::submit(Task task, int level, Clock::time_point deadline) {
+    if (!running.load() || stopping.load()) {
+        return false;
+    }
+    level = std::max(0, std::min(level, levels - 1));
+    unsigned worker = next_worker.fetch_add(1) % get_thread_count();
+    return push(worker, level, std::move(task), ticks(deadline));
+}
+
+bool WorkStealingPool::submit_helper(Task task) {
+    if (!running.load() || stopping.load()) {
+        return false;
+    }
+    unsigned worker = t_pool == this ? t_worker : next_worker.fetch_add(1) % get_thread_count();
+    return push(worker, levels, std::move(task), ticks(Clock::now()));
+}
+
+size_t WorkStealingPool::get_queued(int level) const {
+    if (level < 0 || level >= levels) {
+        return 0;
+    }
+    return queued[level].load();
+}
+
+size_t WorkStealingPool::get_queued_total() const {
+    size_t total = 0;
+    for (int i = 0; i < levels; ++i) {
+        total += queued[i].load();
+    }
+    return total;
+}
+
+bool WorkStealingPool::runs_after(const Entry& a, const Entry& b) {
+    return a.deadline != b.deadline ? a.deadline > b.deadline : a.order > b.order;
+}
+
+bool WorkStealingPool::push(unsigned worker, int level, Task task, int64_t deadline) {
+    Lane& target = lane(worker, level);
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.entries.push_back(Entry{ std::move(task), deadline, target.next_order++ });
+        std::push_heap(target.entries.begin(), target.entries.end(), runs_after);
+        target.front_deadline = target.entries.front().deadline;
+        queued[level]++;
+        queued_tasks++;
+    }
+
+    // Pairs with the queued_tasks check in worker_main: either the sleeper sees the task or we see the sleeper
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_one();
+    }
+    return true;
+}
+
+WorkStealingPool::Lane* WorkStealingPool::pick(unsigned worker, int level, int64_t now, int& picked_level) {
+    Lane* best = nullptr;
+    int64_t best_deadline = EMPTY_LANE;
+    // Overdue tasks one level down compete here too (never promoted into the helper level)
+    int lowest = level > 0 && level < lane_levels - 1 ? level - 1 : level;
+    for (int candidate_level = level; candidate_level >= lowest; --candidate_level) {
+        Lane& candidate = lane(worker, candidate_level);
+        int64_t deadline = candidate.front_deadline.load();
+        if (deadline == EMPTY_LANE || (candidate_level != level && deadline >= now)) {
+            continue;
+        }
+        if (deadline < best_deadline) {
+            best = &candidate;
+            best_deadline = deadline;
+            picked_level = candidate_level;
+        }
+    }
+    return best;
+}
+
+bool WorkStealingPool::pop(Lane& from, int level, Task& task) {
+    std::lock_guard<std::mutex> lock(from.mutex);
+    if (from.entries.empty()) {
+        return false; // Another worker got there first
+    }
+    std::pop_heap(from.entries.begin(), from.entries.end(), runs_after);
+    task = std::move(from.entries.back().task);
+    from.entries.pop_back();
+    from.front_deadline = from.entries.empty() ? EMPTY_LANE : from.entries.front().deadline;
+    queued[level]--;
+    queued_tasks--;
+    return true;
+}
+
+bool WorkStealingPool::take(unsigned self, Task& task) {
+    unsigned worker_count = get_thread_count();
+    int64_t now = ticks(Clock::now());
+
+    for (int level = lane_levels - 1; level >= 0; --level) {
+        // Own queue first; only other workers' queues are contended
+        int picked_level = level;
+        Lane* own = pick(self, level, now, picked_level);
+        if (own && pop(*own, picked_level, task)) {
+            return true;
+        }
+        for (unsigned n = 1; n < worker_count; ++n) {
+            unsigned victim = (self + n) % worker_count;
+            Lane* other = pick(victim, level, now, picked_level);
+            if (other && pop(*other, picked_level, task)) {
+                steals++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::worker_main(unsigned self) {
+    t_pool = this;
+    t_worker = self;
+
+    while (!stopping.load()) {
+        Task task;
+        if (take(self, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping++;
+        wake.wait(lock, [this] { return stopping.load() || queued_tasks.load() > 0; });
+        sleeping--;
+    }
+
+    t_pool = nullptr;
+}
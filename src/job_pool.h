@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool behind the async job system.
+// Every worker owns one queue per priority level. Tasks submitted from outside the pool are spread round-robin,
+// helper tasks submitted by a worker stay on its own queue, and idle workers steal from the others.
+// Levels are strict across the pool: a worker only steals at a level where its own queue is empty, and never
+// drops to a lower level while any queue at a higher one holds work. Within a level each queue runs earliest
+// deadline first, and a task still queued past its deadline competes one level higher. Each queue publishes its
+// front deadline in an atomic, so finding work reads atomics only and locks just the queue it takes from.
+
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+    typedef std::chrono::steady_clock Clock;
+
+    // levels = number of priority levels (0 is the lowest); helper tasks get one more level above them all
+    explicit WorkStealingPool(int levels);
+    ~WorkStealingPool();
+
+    void start(unsigned threads);
+
+    // Join the workers once their current task returns; tasks still queued are dropped
+    void stop();
+
+    // False when the pool is not running (the task is dropped)
+    bool submit(Task task, int level, Clock::time_point deadline);
+
+    // Runs ahead of every submitted task, e.g. stripes of an image that is already being encoded
+    bool submit_helper(Task task);
+
+    bool is_running() const { return running.load(); }
+    unsigned get_thread_count() const { return workers; }
+
+    // Tasks waiting at one level (helpers not included)
+    size_t get_queued(int level) const;
+    size_t get_queued_total() const;
+
+    // Tasks a worker took from another worker's queue since start
+    uint64_t get_steals() const { return steals.load(); }
+
+private:
+    struct Entry {
+        Task task;
+        int64_t deadline; // Clock ticks
+        uint64_t order;   // Submission order within the lane, breaks deadline ties
+    };
+
+    // One queue of one worker at one level: a binary heap with the earliest deadline at entries.front()
+    struct Lane {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        uint64_t next_order = 0;
+        std::atomic<int64_t> front_deadline; // INT64_MAX when empty
+    };
+
+    // Heap order for Lane::entries: a runs after b (later deadline, or the same one submitted later)
+    static bool runs_after(const Entry& a, const Entry& b);
+
+    Lane& lane(unsigned worker, int level) { return *lanes[static_cast<size_t>(worker) * lane_levels + level]; }
+    bool push(unsigned worker, int level, Task task, int64_t deadline);
+    Lane* pick(unsigned worker, int level, int64_t now, int& picked_level);
+    bool pop(Lane& from, int level, Task& task);
+    bool take(unsigned self, Task& task);
+    void worker_main(unsigned self);
+
+    const int levels;      // Priority levels
+    const int lane_levels; // levels + helper level
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::unique_ptr<std::atomic<size_t>[]> queued; // Per lane level, summed over workers
+    std::vector<std::thread> threads;
+    unsigned workers; // Fixed before the threads start, read by them without locking
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned> next_worker; // Round-robin target for outside submissions
+    std::atomic<size_t> queued_tasks;  // All levels, for the sleep check
+    std::atomic<unsigned> sleeping;
+    std::atomic<uint64_t> steals;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+};
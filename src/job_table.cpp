@@ -0,0 +1,136 @@
+#include "job_table.h"
+
+namespace {
+
+// Marks a slot being set up by allocate(); never a valid id because generations stop below it
+const uint32_t CLAIMED_ID = 0xFFFFFFFFu;
+const uint32_t MAX_GENERATION = (0xFFFFFFFFu >> JOB_SLOT_BITS) - 1;
+const uint32_t SLOT_MASK = JOB_TABLE_CAPACITY - 1;
+const size_t COMPLETION_MASK = JOB_TABLE_CAPACITY - 1;
+
+} // namespace
+
+JobTable::JobTable() : slots(new JobSlot[JOB_TABLE_CAPACITY]), cursor(0), in_use(0) {
+    for (uint32_t i = 0; i < JOB_TABLE_CAPACITY; ++i) {
+        slots[i].id = 0;
+        slots[i].status = 0;
+        slots[i].buffer_released = true;
+        slots[i].generation = 0;
+    }
+}
+
+uint32_t JobTable::allocate(int status, bool buffer_released) {
+    for (uint32_t probe = 0; probe < JOB_TABLE_CAPACITY; ++probe) {
+        uint32_t index = cursor.fetch_add(1) & SLOT_MASK;
+        JobSlot& candidate = slots[index];
+        uint32_t expected = 0;
+        if (candidate.id.load(std::memory_order_relaxed) != 0 ||
+            !candidate.id.compare_exchange_strong(expected, CLAIMED_ID)) {
+            continue;
+        }
+
+        // Generations run 1..MAX_GENERATION, so slot 0 never produces id 0
+        candidate.generation = candidate.generation % MAX_GENERATION + 1;
+        candidate.status = status;
+        candidate.buffer_released = buffer_released;
+        uint32_t id = (candidate.generation << JOB_SLOT_BITS) | index;
+        candidate.id = id; // Publishes the state above to readers
+        in_use++;
+        return id;
+    }
+    return 0;
+}
+
+bool JobTable::read(uint32_t id, int& status, bool& buffer_released) const {
+    if (id == 0 || id == CLAIMED_ID) {
+        return false;
+    }
+    const JobSlot& entry = slots[id & SLOT_MASK];
+    if (entry.id.load() != id) {
+        return false;
+    }
+    status = entry.status.load();
+    buffer_released = entry.buffer_released.load();
+    return entry.id.load() == id; // The slot was not released and reused while we read it
+}
+
+bool JobTable::release(uint32_t id) {
+    if (id == 0 || id == CLAIMED_ID) {
+        return false;
+    }
+    uint32_t expected = id;
+    if (!slots[id & SLOT_MASK].id.compare_exchange_strong(expected, 0)) {
+        return false;
+    }
+    in_use--;
+    return true;
+}
+
+void JobTable::clear() {
+    for (uint32_t i = 0; i < JOB_TABLE_CAPACITY; ++i) {
+        slots[i].id = 0;
+    }
+    in_use = 0;
+}
+
+CompletionQueue::CompletionQueue() : cells(new Cell[JOB_TABLE_CAPACITY]) {
+    clear();
+}
+
+bool CompletionQueue::push(const JobCompletion& completion) {
+    size_t position = enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[position & COMPLETION_MASK];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (enqueue_pos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false; // Full
+        } else {
+            position = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->value = completion;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool CompletionQueue::pop(JobCompletion& completion) {
+    size_t position = dequeue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[position & COMPLETION_MASK];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+        if (difference == 0) {
+            if (dequeue_pos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false; // Empty
+        } else {
+            position = dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    completion = cell->value;
+    cell->sequence.store(position + JOB_TABLE_CAPACITY, std::memory_order_release);
+    return true;
+}
+
+size_t CompletionQueue::get_size() const {
+    size_t enqueued = enqueue_pos.load();
+    size_t dequeued = dequeue_pos.load();
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+void CompletionQueue::clear() {
+    for (size_t i = 0; i < JOB_TABLE_CAPACITY; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos.store(0);
+    dequeue_pos.store(0);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Fixed-capacity status table and completion queue for async jobs.
+// A job id packs a slot index (low JOB_SLOT_BITS bits) and the slot's generation, so a lookup is one array index
+// and an id compare: wait-free, no hashing, no locks. Reusing a slot bumps its generation, so the id of a job
+// that was cleaned up reads as "not found" instead of aliasing the slot's next job.
+
+static const uint32_t JOB_SLOT_BITS = 14;
+static const uint32_t JOB_TABLE_CAPACITY = 1u << JOB_SLOT_BITS; // Jobs that can be outstanding (not cleaned up)
+
+struct JobSlot {
+    std::atomic<uint32_t> id;          // Job id while in use, 0 when free
+    std::atomic<int> status;           // Written by the worker running the job
+    std::atomic<bool> buffer_released;
+    uint32_t generation;               // Only changed by the thread that claimed the slot
+};
+
+class JobTable {
+public:
+    JobTable();
+
+    // Claim a free slot and set its initial state; returns the new job id (never 0), or 0 when every slot is in use
+    uint32_t allocate(int status, bool buffer_released);
+
+    // Slot of an id returned by allocate, for updates by the job itself
+    JobSlot& slot(uint32_t id) { return slots[id & (JOB_TABLE_CAPACITY - 1)]; }
+
+    // Wait-free snapshot of a job's state; false if the id is not (or no longer) in the table
+    bool read(uint32_t id, int& status, bool& buffer_released) const;
+
+    // Free the slot if it still belongs to id. The job must not touch the slot afterwards.
+    bool release(uint32_t id);
+
+    // Free every slot (no job may be running)
+    void clear();
+
+    uint32_t get_in_use() const { return in_use.load(); }
+
+private:
+    std::unique_ptr<JobSlot[]> slots;
+    std::atomic<uint32_t> cursor; // Next slot to try, so freed slots are reused round-robin
+    std::atomic<uint32_t> in_use;
+};
+
+// Result of a finished job as delivered by CompletionQueue
+struct JobCompletion {
+    uint32_t job_id;
+    int32_t status;      // Final job status code
+    float queue_wait_ms; // Queued until a worker started it
+    float run_ms;        // Encoding/conversion time on the worker
+};
+
+// Bounded lock-free MPMC ring (Vyukov) of finished jobs: workers push, the game thread drains.
+// Holds JOB_TABLE_CAPACITY entries: as many as there can be outstanding jobs, so it only fills if the game stops draining.
+class CompletionQueue {
+public:
+    CompletionQueue();
+
+    // False (and the completion is dropped) when the queue is full
+    bool push(const JobCompletion& completion);
+
+    // False when empty
+    bool pop(JobCompletion& completion);
+
+    // Entries waiting; approximate while workers are pushing
+    size_t get_size() const;
+
+    // Drop every entry (no push or pop may be running)
+    void clear();
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        JobCompletion value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+};
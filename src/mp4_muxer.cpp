@@ -0,0 +1,673 @@
+#include "mp4_muxer.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint32_t MOVIE_TIMESCALE = 1000;
+
+// trun sample flags (ISO/IEC 14496-12 8.8.3.1): depends on nothing / depends on others and is not a sync sample
+static const uint32_t SAMPLE_FLAGS_SYNC = 0x02000000;
+static const uint32_t SAMPLE_FLAGS_NON_SYNC = 0x01010000;
+
+static const uint32_t UNITY_MATRIX[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+static uint32_t fourcc(const char* code) {
+    return (static_cast<uint32_t>(code[0]) << 24) | (static_cast<uint32_t>(code[1]) << 16) |
+           (static_cast<uint32_t>(code[2]) << 8) | static_cast<uint32_t>(code[3]);
+}
+
+// Big-endian box serialisation into memory; begin/end nest and patch the box sizes
+class BoxWriter {
+public:
+    explicit BoxWriter(std::vector<uint8_t>& output) : out(output) {}
+
+    void u8(uint8_t value) { out.push_back(value); }
+    void u16(uint16_t value) {
+        u8(static_cast<uint8_t>(value >> 8));
+        u8(static_cast<uint8_t>(value));
+    }
+    void u32(uint32_t value) {
+        u16(static_cast<uint16_t>(value >> 16));
+        u16(static_cast<uint16_t>(value));
+    }
+    void u64(uint64_t value) {
+        u32(static_cast<uint32_t>(value >> 32));
+        u32(static_cast<uint32_t>(value));
+    }
+    void type(const char* code) { u32(fourcc(code)); }
+    void bytes(const void* data, size_t size) {
+        const uint8_t* begin = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), begin, begin + size);
+    }
+    void zeros(size_t count) { out.insert(out.end(), count, 0); }
+
+    void begin(const char* code) {
+        open.push_back(out.size());
+        u32(0);
+        type(code);
+    }
+    void begin_full(const char* code, uint8_t version, uint32_t flags) {
+        begin(code);
+        u32((static_cast<uint32_t>(version) << 24) | (flags & 0xFFFFFF));
+    }
+    void end() {
+        size_t start = open.back();
+        open.pop_back();
+        patch32(start, static_cast<uint32_t>(out.size() - start));
+    }
+
+    size_t offset() const { return out.size(); }
+    void patch32(size_t at, uint32_t value) {
+        out[at] = static_cast<uint8_t>(value >> 24);
+        out[at + 1] = static_cast<uint8_t>(value >> 16);
+        out[at + 2] = static_cast<uint8_t>(value >> 8);
+        out[at + 3] = static_cast<uint8_t>(value);
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    std::vector<size_t> open;
+};
+
+static uint32_t read_be32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+static bool seek_to(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+const char* video_container_name(VideoContainer container) {
+    switch (container) {
+    case VideoContainer::H264: return "h264";
+    case VideoContainer::MP4: return "mp4";
+    case VideoContainer::FRAGMENTED_MP4: return "fragmented_mp4";
+    }
+    return "unknown";
+}
+
+bool video_container_from_name(const std::string& name, VideoContainer& container) {
+    for (int i = 0; i < VIDEO_CONTAINER_COUNT; ++i) {
+        if (name == video_container_name(static_cast<VideoContainer>(i))) {
+            container = static_cast<VideoContainer>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Mp4Muxer::Mp4Muxer(FILE* output, bool fragmented_layout)
+    : file(output), fragmented(fragmented_layout), started(false), finished(false), failed(false), position(0),
+      mdat_offset(0), last_track(-1), sequence(0) {}
+
+int Mp4Muxer::add_h264_track(uint32_t width, uint32_t height, uint32_t timescale, uint32_t default_duration,
+                             const uint8_t* headers, size_t headers_size) {
+    if (started || !headers || width == 0 || height == 0 || timescale == 0) {
+        return -1;
+    }
+
+    // Pick the SPS (type 7) and PPS (type 8) out of the length-prefixed header NAL units
+    const uint8_t* sps = nullptr;
+    const uint8_t* pps = nullptr;
+    uint32_t sps_size = 0;
+    uint32_t pps_size = 0;
+    size_t offset = 0;
+    while (offset + 4 < headers_size) {
+        uint32_t size = read_be32(headers + offset);
+        offset += 4;
+        if (size == 0 || size > headers_size - offset) {
+            break;
+        }
+        uint8_t nal_type = headers[offset] & 0x1F;
+        if (nal_type == 7 && !sps) {
+            sps = headers + offset;
+            sps_size = size;
+        } else if (nal_type == 8 && !pps) {
+            pps = headers + offset;
+            pps_size = size;
+        }
+        offset += size;
+    }
+    if (!sps || !pps || sps_size < 4 || sps_size > 0xFFFF || pps_size > 0xFFFF) {
+        return -1;
+    }
+
+    Track track = {};
+    track.id = static_cast<uint32_t>(tracks.size() + 1);
+    track.handler = fourcc("vide");
+    track.width = width;
+    track.height = height;
+    track.timescale = timescale;
+    track.default_duration = std::max<uint32_t>(1, default_duration);
+
+    BoxWriter entry(track.sample_entry);
+    entry.begin("avc1");
+    entry.zeros(6);
+    entry.u16(1); // data_reference_index
+    entry.zeros(16);
+    entry.u16(static_cast<uint16_t>(width));
+    entry.u16(static_cast<uint16_t>(height));
+    entry.u32(0x00480000); // 72 dpi
+    entry.u32(0x00480000);
+    entry.u32(0);
+    entry.u16(1); // frame_count
+    static const char compressor[] = "NiceShot H.264";
+    uint8_t compressor_name[32] = {};
+    compressor_name[0] = static_cast<uint8_t>(sizeof(compressor) - 1);
+    std::memcpy(compressor_name + 1, compressor, sizeof(compressor) - 1);
+    entry.bytes(compressor_name, sizeof(compressor_name));
+    entry.u16(0x0018); // depth
+    entry.u16(0xFFFF); // pre_defined = -1
+
+    entry.begin("avcC");
+    entry.u8(1);      // configurationVersion
+    entry.u8(sps[1]); // profile_idc
+    entry.u8(sps[2]); // constraint flags
+    entry.u8(sps[3]); // level_idc
+    entry.u8(0xFF);   // 4-byte NAL lengths
+    entry.u8(0xE1);   // one SPS
+    entry.u16(static_cast<uint16_t>(sps_size));
+    entry.bytes(sps, sps_size);
+    entry.u8(1); // one PPS
+    entry.u16(static_cast<uint16_t>(pps_size));
+    entry.bytes(pps, pps_size);
+    if (sps[1] == 100 || sps[1] == 110 || sps[1] == 122 || sps[1] == 144) {
+        // High profile extension: chroma_format 4:2:0, 8-bit luma and chroma, no SPS extensions
+        entry.u8(0xFC | 1);
+        entry.u8(0xF8);
+        entry.u8(0xF8);
+        entry.u8(0);
+    }
+    entry.end();
+    entry.end();
+
+    tracks.push_back(std::move(track));
+    return static_cast<int>(tracks.size() - 1);
+}
+
+int Mp4Muxer::add_opus_track(uint32_t channels, uint32_t input_sample_rate, uint16_t pre_skip, uint32_t packet_samples) {
+    if (channels == 0 || channels > 2) {
+        return -1;
+    }
+
+    std::vector<uint8_t> config;
+    BoxWriter dops(config);
+    dops.begin("dOps");
+    dops.u8(0); // Version
+    dops.u8(static_cast<uint8_t>(channels));
+    dops.u16(pre_skip);
+    dops.u32(input_sample_rate);
+    dops.u16(0); // OutputGain
+    dops.u8(0);  // ChannelMappingFamily: mono or stereo, no mapping table
+    dops.end();
+    return add_audio_track("Opus", channels, 48000, 48000, packet_samples, config);
+}
+
+int Mp4Muxer::add_pcm_track(uint32_t sample_rate, uint32_t channels, uint32_t packet_samples) {
+    return add_audio_track("sowt", channels, sample_rate, sample_rate, packet_samples, std::vector<uint8_t>());
+}
+
+int Mp4Muxer::add_audio_track(const char* code, uint32_t channels, uint32_t sample_rate, uint32_t timescale,
+                              uint32_t packet_samples, const std::vector<uint8_t>& config) {
+    // The sample entry stores the rate as 16.16 fixed point
+    if (started || channels == 0 || sample_rate == 0 || sample_rate > 0xFFFF || timescale == 0) {
+        return -1;
+    }
+
+    Track track = {};
+    track.id = static_cast<uint32_t>(tracks.size() + 1);
+    track.handler = fourcc("soun");
+    track.timescale = timescale;
+    track.default_duration = std::max<uint32_t>(1, packet_samples);
+
+    BoxWriter entry(track.sample_entry);
+    entry.begin(code);
+    entry.zeros(6);
+    entry.u16(1); // data_reference_index
+    entry.zeros(8);
+    entry.u16(static_cast<uint16_t>(channels));
+    entry.u16(16); // samplesize
+    entry.u32(0);  // pre_defined, reserved
+    entry.u32(sample_rate << 16);
+    entry.bytes(config.data(), config.size());
+    entry.end();
+
+    tracks.push_back(std::move(track));
+    return static_cast<int>(tracks.size() - 1);
+}
+
+bool Mp4Muxer::write_bytes(const void* data, size_t size) {
+    if (failed || fwrite(data, 1, size, file) != size) {
+        failed = true;
+        return false;
+    }
+    position += size;
+    return true;
+}
+
+bool Mp4Muxer::start() {
+    started = true;
+
+    std::vector<uint8_t> header;
+    BoxWriter box(header);
+    box.begin("ftyp");
+    box.type("isom");
+    box.u32(0x200);
+    box.type("isom");
+    box.type("iso2");
+    box.type("avc1");
+    box.type("mp41");
+    if (fragmented) {
+        box.type("iso6");
+    }
+    box.end();
+
+    if (fragmented) {
+        // Sample tables stay empty; every sample is described by the fragments
+        build_moov(header);
+    } else {
+        // 64-bit mdat header; the size is patched in finish() once the payload is known
+        mdat_offset = header.size();
+        box.u32(1);
+        box.type("mdat");
+        box.u64(0);
+    }
+    return write_bytes(header.data(), header.size());
+}
+
+bool Mp4Muxer::write_sample(int track_index, const uint8_t* data, size_t size, int64_t dts, int64_t pts, bool keyframe) {
+    if (finished || failed || track_index < 0 || track_index >= static_cast<int>(tracks.size()) || !data || size == 0 ||
+        size > UINT32_MAX) {
+        return false;
+    }
+    if (!started && !start()) {
+        return false;
+    }
+
+    Track& track = tracks[track_index];
+    if (!track.started) {
+        track.started = true;
+        track.first_dts = dts;
+        track.cts_shift = pts - dts;
+    } else if (dts <= track.last_dts) {
+        return false;
+    }
+
+    Sample sample = {};
+    sample.size = static_cast<uint32_t>(size);
+    sample.decode_time = dts - track.first_dts;
+    sample.cts_offset = static_cast<int32_t>((pts - dts) - track.cts_shift);
+    sample.keyframe = keyframe;
+
+    if (fragmented) {
+        if (!track.samples.empty()) {
+            track.samples.back().duration = static_cast<uint32_t>(dts - track.last_dts);
+            double open_seconds = static_cast<double>(sample.decode_time - track.samples.front().decode_time) / track.timescale;
+            if (track_index == 0 && open_seconds >= MP4_FRAGMENT_SECONDS && !write_fragment()) {
+                return false;
+            }
+        }
+        track.fragment_data.insert(track.fragment_data.end(), data, data + size);
+    } else {
+        // Consecutive samples of one track share a chunk
+        if (last_track != track_index) {
+            track.chunk_offsets.push_back(position);
+            track.chunk_samples.push_back(0);
+        }
+        if (!write_bytes(data, size)) {
+            return false;
+        }
+        track.chunk_samples.back()++;
+    }
+
+    track.samples.push_back(sample);
+    track.last_dts = dts;
+    last_track = track_index;
+    return true;
+}
+
+bool Mp4Muxer::write_fragment() {
+    sequence++;
+
+    std::vector<uint8_t> moof;
+    BoxWriter box(moof);
+    std::vector<size_t> data_offset_fields;
+    box.begin("moof");
+    box.begin_full("mfhd", 0, 0);
+    box.u32(sequence);
+    box.end();
+
+    for (const Track& track : tracks) {
+        if (track.samples.empty()) {
+            continue;
+        }
+
+        bool negative_cts = false;
+        for (const Sample& sample : track.samples) {
+            negative_cts = negative_cts || sample.cts_offset < 0;
+        }
+
+        box.begin("traf");
+        box.begin_full("tfhd", 0, 0x020000); // default-base-is-moof
+        box.u32(track.id);
+        box.end();
+        box.begin_full("tfdt", 1, 0);
+        box.u64(static_cast<uint64_t>(track.samples.front().decode_time));
+        box.end();
+        // data offset, per-sample duration, size, flags and composition offset
+        box.begin_full("trun", negative_cts ? 1 : 0, 0x000001 | 0x000100 | 0x000200 | 0x000400 | 0x000800);
+        box.u32(static_cast<uint32_t>(track.samples.size()));
+        data_offset_fields.push_back(box.offset());
+        box.u32(0);
+        for (const Sample& sample : track.samples) {
+            box.u32(sample.duration ? sample.duration : track.default_duration);
+            box.u32(sample.size);
+            box.u32(sample.keyframe ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC);
+            box.u32(static_cast<uint32_t>(sample.cts_offset));
+        }
+        box.end();
+        box.end();
+    }
+    box.end();
+
+    uint64_t payload = 0;
+    for (const Track& track : tracks) {
+        payload += track.fragment_data.size();
+    }
+    bool large = payload + 8 > UINT32_MAX;
+    size_t mdat_header = large ? 16 : 8;
+
+    // Each traf's samples start where the previous track's data ends, counted from the start of the moof
+    uint64_t data_offset = moof.size() + mdat_header;
+    size_t field = 0;
+    for (const Track& track : tracks) {
+        if (!track.samples.empty()) {
+            box.patch32(data_offset_fields[field++], static_cast<uint32_t>(data_offset));
+            data_offset += track.fragment_data.size();
+        }
+    }
+
+    if (large) {
+        box.u32(1);
+        box.type("mdat");
+        box.u64(payload + 16);
+    } else {
+        box.u32(static_cast<uint32_t>(payload + 8));
+        box.type("mdat");
+    }
+    if (!write_bytes(moof.data(), moof.size())) {
+        return false;
+    }
+
+    for (Track& track : tracks) {
+        if (!track.fragment_data.empty() && !write_bytes(track.fragment_data.data(), track.fragment_data.size())) {
+            return false;
+        }
+        track.fragment_data.clear();
+        track.samples.clear();
+    }
+
+    // A completed fragment must reach the disk to survive a crash
+    fflush(file);
+    return true;
+}
+
+uint64_t Mp4Muxer::track_duration(const Track& track) const {
+    if (track.samples.empty()) {
+        return 0;
+    }
+    return static_cast<uint64_t>(track.samples.back().decode_time) + track.default_duration;
+}
+
+void Mp4Muxer::build_moov(std::vector<uint8_t>& out) const {
+    BoxWriter box(out);
+    uint64_t movie_duration = 0;
+    for (const Track& track : tracks) {
+        movie_duration = std::max(movie_duration, track_duration(track) * MOVIE_TIMESCALE / track.timescale);
+    }
+
+    box.begin("moov");
+    box.begin_full("mvhd", 1, 0);
+    box.u64(0); // creation_time
+    box.u64(0); // modification_time
+    box.u32(MOVIE_TIMESCALE);
+    box.u64(movie_duration);
+    box.u32(0x00010000); // rate 1.0
+    box.u16(0x0100);     // volume 1.0
+    box.zeros(10);
+    for (uint32_t value : UNITY_MATRIX) {
+        box.u32(value);
+    }
+    box.zeros(24);
+    box.u32(static_cast<uint32_t>(tracks.size() + 1)); // next_track_ID
+    box.end();
+
+    for (const Track& track : tracks) {
+        uint64_t duration = track_duration(track);
+
+        box.begin("trak");
+        bool sound = track.handler == fourcc("soun");
+
+        box.begin_full("tkhd", 1, 0x000003); // enabled, in movie
+        box.u64(0);
+        box.u64(0);
+        box.u32(track.id);
+        box.u32(0);
+        box.u64(duration * MOVIE_TIMESCALE / track.timescale);
+        box.zeros(8);
+        box.u16(0); // layer
+        box.u16(0); // alternate_group
+        box.u16(sound ? 0x0100 : 0); // volume
+        box.u16(0);
+        for (uint32_t value : UNITY_MATRIX) {
+            box.u32(value);
+        }
+        box.u32(track.width << 16);
+        box.u32(track.height << 16);
+        box.end();
+
+        box.begin("mdia");
+        box.begin_full("mdhd", 1, 0);
+        box.u64(0);
+        box.u64(0);
+        box.u32(track.timescale);
+        box.u64(duration);
+        box.u16(0x55C4); // "und"
+        box.u16(0);
+        box.end();
+
+        box.begin_full("hdlr", 0, 0);
+        box.u32(0);
+        box.u32(track.handler);
+        box.zeros(12);
+        const char* handler_name = sound ? "SoundHandler" : "VideoHandler";
+        box.bytes(handler_name, std::strlen(handler_name) + 1);
+        box.end();
+
+        box.begin("minf");
+        if (sound) {
+            box.begin_full("smhd", 0, 0);
+            box.zeros(4); // balance, reserved
+        } else {
+            box.begin_full("vmhd", 0, 1);
+            box.zeros(8); // graphicsmode, opcolor
+        }
+        box.end();
+        box.begin("dinf");
+        box.begin_full("dref", 0, 0);
+        box.u32(1);
+        box.begin_full("url ", 0, 1); // Media is in this file
+        box.end();
+        box.end();
+        box.end();
+
+        box.begin("stbl");
+        box.begin_full("stsd", 0, 0);
+        box.u32(1);
+        box.bytes(track.sample_entry.data(), track.sample_entry.size());
+        box.end();
+
+        // Fragmented files describe their samples in the moofs; these tables stay empty
+        const std::vector<Sample> none;
+        const std::vector<Sample>& samples = fragmented ? none : track.samples;
+
+        // stts: runs of equal sample durations
+        std::vector<std::pair<uint32_t, uint32_t>> runs;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            uint32_t delta = i + 1 < samples.size()
+                ? static_cast<uint32_t>(samples[i + 1].decode_time - samples[i].decode_time)
+                : track.default_duration;
+            if (!runs.empty() && runs.back().second == delta) {
+                runs.back().first++;
+            } else {
+                runs.push_back({ 1, delta });
+            }
+        }
+        box.begin_full("stts", 0, 0);
+        box.u32(static_cast<uint32_t>(runs.size()));
+        for (const auto& run : runs) {
+            box.u32(run.first);
+            box.u32(run.second);
+        }
+        box.end();
+
+        // ctts: only with B-frames (composition order differs from decode order)
+        bool reordered = false;
+        bool negative_cts = false;
+        for (const Sample& sample : samples) {
+            reordered = reordered || sample.cts_offset != 0;
+            negative_cts = negative_cts || sample.cts_offset < 0;
+        }
+        if (reordered) {
+            runs.clear();
+            for (const Sample& sample : samples) {
+                uint32_t offset = static_cast<uint32_t>(sample.cts_offset);
+                if (!runs.empty() && runs.back().second == offset) {
+                    runs.back().first++;
+                } else {
+                    runs.push_back({ 1, offset });
+                }
+            }
+            box.begin_full("ctts", negative_cts ? 1 : 0, 0);
+            box.u32(static_cast<uint32_t>(runs.size()));
+            for (const auto& run : runs) {
+                box.u32(run.first);
+                box.u32(run.second);
+            }
+            box.end();
+        }
+
+        // stss: omitted when every sample is a keyframe
+        std::vector<uint32_t> sync_samples;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            if (samples[i].keyframe) {
+                sync_samples.push_back(static_cast<uint32_t>(i + 1));
+            }
+        }
+        if (sync_samples.size() != samples.size()) {
+            box.begin_full("stss", 0, 0);
+            box.u32(static_cast<uint32_t>(sync_samples.size()));
+            for (uint32_t number : sync_samples) {
+                box.u32(number);
+            }
+            box.end();
+        }
+
+        // stsc: runs of chunks holding the same number of samples
+        const std::vector<uint32_t> no_chunks;
+        const std::vector<uint32_t>& chunk_samples = fragmented ? no_chunks : track.chunk_samples;
+        runs.clear();
+        for (size_t i = 0; i < chunk_samples.size(); ++i) {
+            if (runs.empty() || runs.back().second != chunk_samples[i]) {
+                runs.push_back({ static_cast<uint32_t>(i + 1), chunk_samples[i] });
+            }
+        }
+        box.begin_full("stsc", 0, 0);
+        box.u32(static_cast<uint32_t>(runs.size()));
+        for (const auto& run : runs) {
+            box.u32(run.first);
+            box.u32(run.second);
+            box.u32(1); // sample_description_index
+        }
+        box.end();
+
+        box.begin_full("stsz", 0, 0);
+        box.u32(0); // Sizes listed per sample
+        box.u32(static_cast<uint32_t>(samples.size()));
+        for (const Sample& sample : samples) {
+            box.u32(sample.size);
+        }
+        box.end();
+
+        box.begin_full("co64", 0, 0);
+        box.u32(fragmented ? 0 : static_cast<uint32_t>(track.chunk_offsets.size()));
+        if (!fragmented) {
+            for (uint64_t offset : track.chunk_offsets) {
+                box.u64(offset);
+            }
+        }
+        box.end();
+
+        box.end(); // stbl
+        box.end(); // minf
+        box.end(); // mdia
+        box.end(); // trak
+    }
+
+    if (fragmented) {
+        box.begin("mvex");
+        for (const Track& track : tracks) {
+            box.begin_full("trex", 0, 0);
+            box.u32(track.id);
+            box.u32(1); // default_sample_description_index
+            box.u32(0);
+            box.u32(0);
+            box.u32(0);
+            box.end();
+        }
+        box.end();
+    }
+    box.end(); // moov
+}
+
+bool Mp4Muxer::finish() {
+    if (finished) {
+        return !failed;
+    }
+    if (!started && !start()) {
+        finished = true;
+        return false;
+    }
+    finished = true;
+
+    if (fragmented) {
+        bool pending = false;
+        for (const Track& track : tracks) {
+            pending = pending || !track.samples.empty();
+        }
+        return (!pending || write_fragment()) && !failed;
+    }
+
+    uint64_t mdat_size = position - mdat_offset;
+    std::vector<uint8_t> moov;
+    build_moov(moov);
+    if (!write_bytes(moov.data(), moov.size())) {
+        return false;
+    }
+
+    // Patch the 64-bit mdat size now that the payload is complete
+    uint8_t size_field[8];
+    for (int i = 0; i < 8; ++i) {
+        size_field[i] = static_cast<uint8_t>(mdat_size >> (56 - 8 * i));
+    }
+    if (!seek_to(file, mdat_offset + 8) || fwrite(size_field, 1, sizeof(size_field), file) != sizeof(size_field) ||
+        !seek_to(file, position)) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ISO-BMFF (MP4) muxer for the H.264 streams recorded by the DLL and NiceShot_Converter, so recordings are
+// playable as written instead of needing an FFmpeg remux of a raw .h264 stream. Audio tracks (Opus or 16-bit PCM)
+// are interleaved with the video in the order samples are written.
+//
+// Regular layout: ftyp, a single mdat streamed as samples arrive, then moov with the sample tables at finish().
+// Fragmented layout: ftyp and an empty moov (with mvex) up front, then one moof + mdat pair per fragment, flushed
+// to disk as each fragment closes. A fragmented file that was never finished (crash) plays up to its last fragment.
+// Fragments are cut on the first track added (the video), so the other tracks' fragments always end on a whole packet.
+
+enum class VideoContainer {
+    H264 = 0,          // Annex B elementary stream (.h264): no timestamps, needs a remux for most players
+    MP4 = 1,           // Regular MP4, sample tables written when the recording stops
+    FRAGMENTED_MP4 = 2 // Fragmented MP4, readable after a crash up to the last completed fragment
+};
+
+static const int VIDEO_CONTAINER_COUNT = 3;
+
+// Decode time an open fragment may span before it is written out
+static const double MP4_FRAGMENT_SECONDS = 1.0;
+
+const char* video_container_name(VideoContainer container);
+
+// Inverse of video_container_name (recording metadata); false for anything else
+bool video_container_from_name(const std::string& name, VideoContainer& container);
+
+// Writes an MP4 file on a FILE* owned by the caller (opened "wb", positioned at 0)
+class Mp4Muxer {
+public:
+    Mp4Muxer(FILE* file, bool fragmented);
+
+    // Add an H.264 track before the first sample. headers holds the SPS and PPS as 4-byte length-prefixed NAL
+    // units (x264_encoder_headers with b_annexb = 0); the stream must be 8-bit 4:2:0.
+    // Timestamps are in 1 / timescale seconds; default_duration is one frame, used for a track's last sample.
+    // Returns the track index for write_sample, or -1 if the headers lack an SPS/PPS or samples were written.
+    int add_h264_track(uint32_t width, uint32_t height, uint32_t timescale, uint32_t default_duration,
+                       const uint8_t* headers, size_t headers_size);
+
+    // Add an Opus track (ISO/IEC 23003-5 style 'Opus' entry with a dOps box). Timestamps are in 48 kHz samples;
+    // packet_samples is the packet duration, pre_skip the encoder lookahead decoders drop from the start.
+    int add_opus_track(uint32_t channels, uint32_t input_sample_rate, uint16_t pre_skip, uint32_t packet_samples);
+
+    // Add a 16-bit little-endian PCM track ('sowt'); each sample written is a packet of packet_samples frames
+    // and timestamps are in 1 / sample_rate seconds
+    int add_pcm_track(uint32_t sample_rate, uint32_t channels, uint32_t packet_samples);
+
+    // Append one access unit of length-prefixed NAL units, in decode order (dts strictly increasing per track).
+    // The first sample of each track is presented at time 0.
+    bool write_sample(int track, const uint8_t* data, size_t size, int64_t dts, int64_t pts, bool keyframe);
+
+    // Write the open fragment, or the moov of a regular file. Nothing may be written afterwards.
+    bool finish();
+
+    bool is_fragmented() const { return fragmented; }
+    uint64_t get_bytes_written() const { return position; }
+    uint32_t get_fragments() const { return sequence; }
+
+private:
+    struct Sample {
+        uint32_t size;
+        uint32_t duration; // Fragmented: set once the next sample's dts is known (0 = use the default)
+        int64_t decode_time;
+        int32_t cts_offset;
+        bool keyframe;
+    };
+
+    struct Track {
+        uint32_t id;
+        uint32_t handler; // 'vide' or 'soun'
+        uint32_t width;
+        uint32_t height;
+        uint32_t timescale;
+        uint32_t default_duration;
+        std::vector<uint8_t> sample_entry; // stsd entry box
+        bool started;
+        int64_t first_dts;
+        int64_t cts_shift; // pts - dts of the first sample
+        int64_t last_dts;
+        std::vector<Sample> samples; // Regular: every sample; fragmented: the open fragment
+        std::vector<uint64_t> chunk_offsets;
+        std::vector<uint32_t> chunk_samples;
+        std::vector<uint8_t> fragment_data;
+    };
+
+    int add_audio_track(const char* code, uint32_t channels, uint32_t sample_rate, uint32_t timescale,
+                        uint32_t packet_samples, const std::vector<uint8_t>& config);
+    bool start();
+    bool write_bytes(const void* data, size_t size);
+    bool write_fragment();
+    uint64_t track_duration(const Track& track) const;
+    void build_moov(std::vector<uint8_t>& out) const;
+
+    FILE* file;
+    bool fragmented;
+    bool started;
+    bool finished;
+    bool failed;
+    uint64_t position;
+    uint64_t mdat_offset; // Regular: start of the mdat box, its size is patched in finish()
+    int last_track;       // Track of the previous sample; a change starts a new chunk
+    uint32_t sequence;    // Fragments written
+    std::vector<Track> tracks;
+};
@@ -1,7 +1,23 @@
 #include "niceshot.h"
+#include "yuv_convert.h"
+#include "raw_container.h"
+#include "encode_pipeline.h"
+#include "png_parallel.h"
+#include "deflate_backend.h"
+#include "png_filter.h"
+#include "image_formats.h"
+#include "job_pool.h"
+#include "job_table.h"
+#include "image_scale.h"
+#include "frame_timing.h"
+#include "mp4_muxer.h"
+#include "audio_encoder.h"
+#include "replay_buffer.h"
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cstdint>
+#include <cmath>
 #include <csetjmp>
 #include <cstdio>
 #include <sstream>
@@ -10,13 +26,15 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <deque>
+#include <functional>
 #include <atomic>
 #include <memory>
 #include <unordered_map>
 #include <string>
-#include <deque>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
 #ifdef _WIN32
 #include <windows.h>
 #endif
@@ -47,9 +65,192 @@ static bool g_initialized = false;
 // Performance configuration
 static std::atomic<int> g_compression_level{6}; // Default PNG compression level
 static std::atomic<size_t> g_thread_count{0}; // 0 = auto-detect based on CPU cores
+static std::atomic<bool> g_parallel_png{true}; // Split large PNGs into stripes deflated across the worker threads
+static const uint64_t PARALLEL_PNG_MIN_PIXELS = 1024 * 1024; // Smaller images encode faster on one thread
+static std::atomic<int> g_png_backend{static_cast<int>(DeflateBackend::ZLIB)}; // Deflate backend for PNG output
+static std::atomic<int> g_png_filter{static_cast<int>(PngFilterStrategy::MIN_SUM_ABS)}; // PNG row filter strategy
+static std::atomic<int> g_image_quality{IMAGE_DEFAULT_QUALITY}; // JPEG/WebP quality, captured per job at enqueue
+static std::atomic<int> g_thumbnail_filter{static_cast<int>(ScaleFilter::BOX)}; // Filter for thumbnail variants
 
 // Video recording configuration
 static std::atomic<int> g_video_preset{1}; // 0=ultrafast, 1=fast, 2=medium, 3=slow, 4=slower
+static std::atomic<int> g_recording_mode{0}; // 0=raw RGBA intermediate, 1=live H.264, 2=instant replay
+static std::atomic<bool> g_raw_compression{true}; // QOI-compressed .raw container vs legacy headerless RGBA
+static std::atomic<bool> g_frame_delta{true}; // Store repeat markers / changed tiles instead of unchanged frames (compressed raw only)
+static std::atomic<int> g_video_timing{static_cast<int>(VideoTiming::CFR)}; // How capture timestamps become PTS
+static std::atomic<int> g_video_container{static_cast<int>(VideoContainer::MP4)}; // Where encoded H.264 goes
+static std::atomic<uint32_t> g_audio_sample_rate{0}; // 0 = no audio track
+static std::atomic<uint32_t> g_audio_channels{2};
+static std::atomic<int> g_audio_codec{static_cast<int>(audio_codec_available(AudioCodec::OPUS) ? AudioCodec::OPUS : AudioCodec::PCM)};
+static std::atomic<uint32_t> g_audio_bitrate_kbps{0}; // 0 = 64 kbps per channel
+static std::atomic<double> g_replay_seconds{30.0}; // Instant replay window
+static std::atomic<size_t> g_replay_max_bytes{static_cast<size_t>(512) * 1024 * 1024}; // Instant replay memory budget
+
+// Frame Buffer Pool
+// Size-bucketed free lists of pixel buffers shared by PngJob and VideoFrame, so steady-state
+// capture reuses memory instead of hitting the heap for a full frame every time.
+class FrameBufferPool;
+
+// Move-only pixel buffer that returns its storage to the pool when destroyed
+class PooledBuffer {
+public:
+    PooledBuffer() : capacity(0), length(0) {}
+    PooledBuffer(PooledBuffer&& other) noexcept
+        : storage(std::move(other.storage)), capacity(other.capacity), length(other.length) {
+        other.capacity = 0;
+        other.length = 0;
+    }
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            storage = std::move(other.storage);
+            capacity = other.capacity;
+            length = other.length;
+            other.capacity = 0;
+            other.length = 0;
+        }
+        return *this;
+    }
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer() { reset(); }
+    
+    uint8_t* data() { return storage.get(); }
+    const uint8_t* data() const { return storage.get(); }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    
+    // Give the storage back to the pool
+    void reset();
+    
+private:
+    friend class FrameBufferPool;
+    std::unique_ptr<uint8_t[]> storage;
+    size_t capacity; // Bucket size actually allocated
+    size_t length;   // Bytes requested by the owner
+};
+
+class FrameBufferPool {
+public:
+    static constexpr size_t BUCKET_GRANULARITY = 4096; // Round requests up to whole pages
+    
+    FrameBufferPool() : pooled_bytes(0), max_pooled_bytes(1024ull * 1024 * 1024), reserved_bytes(0), hits(0), misses(0) {}
+    
+    static size_t bucket_size(size_t size) {
+        return (size + BUCKET_GRANULARITY - 1) / BUCKET_GRANULARITY * BUCKET_GRANULARITY;
+    }
+    
+    // Get a buffer of at least `size` bytes (contents are undefined)
+    PooledBuffer acquire(size_t size) {
+        PooledBuffer buffer;
+        size_t bucket = bucket_size(size);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = free_lists.find(bucket);
+            if (it != free_lists.end() && !it->second.empty()) {
+                buffer.storage = std::move(it->second.back());
+                it->second.pop_back();
+                pooled_bytes -= bucket;
+            }
+        }
+        
+        if (buffer.storage) {
+            hits++;
+        } else {
+            misses++;
+            buffer.storage.reset(new uint8_t[bucket]); // Uninitialized, the caller overwrites it
+        }
+        buffer.capacity = bucket;
+        buffer.length = size;
+        return buffer;
+    }
+    
+    // Return storage to its bucket, or free it if the pool is over its cap
+    void release(std::unique_ptr<uint8_t[]> storage, size_t capacity) {
+        if (!storage || capacity == 0) {
+            return;
+        }
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pooled_bytes + capacity > max_pooled_bytes + reserved_bytes) {
+            return; // Over budget - storage is freed when it goes out of scope
+        }
+        free_lists[capacity].push_back(std::move(storage));
+        pooled_bytes += capacity;
+    }
+    
+    // Pre-allocate `count` buffers of `size` bytes and keep them pooled even beyond the cap
+    // (used by recording sessions so steady-state capture never allocates)
+    void reserve(size_t size, size_t count) {
+        size_t bucket = bucket_size(size);
+        std::lock_guard<std::mutex> lock(mutex);
+        reserved_bytes = bucket * count;
+        auto& list = free_lists[bucket];
+        while (list.size() < count) {
+            list.emplace_back(new uint8_t[bucket]);
+            pooled_bytes += bucket;
+        }
+    }
+    
+    // Drop a reservation made by reserve() and trim the pool back under its cap
+    void release_reservation() {
+        std::lock_guard<std::mutex> lock(mutex);
+        reserved_bytes = 0;
+        trim_locked();
+    }
+    
+    void set_max_bytes(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        max_pooled_bytes = bytes;
+        trim_locked();
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_lists.clear();
+        pooled_bytes = 0;
+    }
+    
+    size_t get_pooled_bytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pooled_bytes;
+    }
+    
+    uint64_t get_hits() const { return hits.load(); }
+    uint64_t get_misses() const { return misses.load(); }
+    
+private:
+    void trim_locked() {
+        for (auto it = free_lists.begin(); it != free_lists.end() && pooled_bytes > max_pooled_bytes + reserved_bytes; ++it) {
+            while (!it->second.empty() && pooled_bytes > max_pooled_bytes + reserved_bytes) {
+                it->second.pop_back();
+                pooled_bytes -= it->first;
+            }
+        }
+    }
+    
+    std::mutex mutex;
+    std::unordered_map<size_t, std::vector<std::unique_ptr<uint8_t[]>>> free_lists; // Keyed by bucket size
+    size_t pooled_bytes;
+    size_t max_pooled_bytes;
+    size_t reserved_bytes;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+};
+
+static FrameBufferPool& frame_buffer_pool() {
+    // Function-local static so buffers released during static destruction still find the pool
+    static FrameBufferPool* pool = new FrameBufferPool();
+    return *pool;
+}
+
+void PooledBuffer::reset() {
+    if (storage) {
+        frame_buffer_pool().release(std::move(storage), capacity);
+    }
+    capacity = 0;
+    length = 0;
+}
 
 // Async PNG Job System
 enum class JobStatus {
@@ -59,22 +260,181 @@ enum class JobStatus {
     FAILED = -1
 };
 
+// Scheduling class of an async job. Workers take the highest class first and, within a class,
+// the earliest deadline; a job still queued past its deadline competes one class higher.
+enum class JobPriority {
+    LOW = 0,    // Background work: save-slot thumbnails, auto-screenshots, batch conversions
+    NORMAL = 1, // Default for every async API
+    HIGH = 2    // Captures the player asked for
+};
+
+static const int JOB_PRIORITY_COUNT = 3;
+static const double JOB_DEFAULT_DEADLINE_MS[JOB_PRIORITY_COUNT] = { 10000.0, 1000.0, 100.0 }; // Indexed by JobPriority
+
+static const char* job_priority_name(JobPriority priority) {
+    switch (priority) {
+    case JobPriority::LOW: return "low";
+    case JobPriority::NORMAL: return "normal";
+    case JobPriority::HIGH: return "high";
+    }
+    return "unknown";
+}
+
+// What queueing does when a new job would exceed the byte budget or queue depth
+enum class QueueOverflowPolicy {
+    REJECT = 0,          // Fail the new job
+    DROP_OLDEST_LOW = 1, // Drop the oldest waiting job of the lowest class (never above the new job's class)
+    BLOCK = 2            // Wait up to the timeout for workers to make room, then reject
+};
+
+static const int QUEUE_OVERFLOW_POLICY_COUNT = 3;
+
+static const char* queue_overflow_policy_name(QueueOverflowPolicy policy) {
+    switch (policy) {
+    case QueueOverflowPolicy::REJECT: return "reject";
+    case QueueOverflowPolicy::DROP_OLDEST_LOW: return "drop oldest low-priority";
+    case QueueOverflowPolicy::BLOCK: return "block";
+    }
+    return "unknown";
+}
+
+// Async queue admission (niceshot_set_queue_limits). A job's pixel copy counts against the byte budget
+// until the worker has released it; the job counts against the depth limit until a worker starts it.
+static std::atomic<size_t> g_queue_max_bytes{static_cast<size_t>(1024) * 1024 * 1024}; // 0 = unlimited
+static std::atomic<size_t> g_queue_max_jobs{0}; // 0 = unlimited
+static std::atomic<int> g_queue_overflow_policy{static_cast<int>(QueueOverflowPolicy::REJECT)};
+static std::atomic<double> g_queue_block_timeout_ms{100.0};
+static std::atomic<size_t> g_queued_bytes{0};
+static std::atomic<size_t> g_queued_jobs{0};
+static std::atomic<uint64_t> g_queue_overflows{0}; // Jobs rejected or dropped because the queue was full
+static std::mutex g_admission_mutex; // Serialises admission and g_waiting_jobs; workers only take it to wake a blocked caller
+static std::condition_variable g_admission_condition;
+static std::atomic<unsigned> g_admission_waiters{0};
+
+// Wake callers blocked in admit_job after a job left the queue or released its pixels.
+// Never call with g_admission_mutex held.
+static void notify_admission() {
+    if (g_admission_waiters.load() > 0) {
+        std::lock_guard<std::mutex> lock(g_admission_mutex);
+        g_admission_condition.notify_all();
+    }
+}
+
+// Claim state of a queued job: a worker starting it and overflow dropping it race for the claim
+enum class JobClaim {
+    WAITING = 0,
+    STARTED = 1,
+    DROPPED = 2
+};
+
+// Downscaled copy written next to a saved image by the next save, synchronous or async (niceshot_add_thumbnail)
+struct ThumbnailVariant {
+    std::string filepath;
+    ImageFormat format; // From the filepath extension
+    uint32_t width;
+    uint32_t height;    // 0 = keep the screenshot's aspect ratio
+};
+
+static const size_t THUMBNAIL_MAX_VARIANTS = 8; // Per job
+static const uint32_t THUMBNAIL_MAX_SIZE = 16384;
+
+// Variants added since the last save; the next one, synchronous or async, takes them all
+static std::vector<ThumbnailVariant> g_pending_thumbnails;
+static std::mutex g_thumbnail_mutex;
+
+static std::vector<ThumbnailVariant> take_pending_thumbnails() {
+    std::lock_guard<std::mutex> lock(g_thumbnail_mutex);
+    std::vector<ThumbnailVariant> variants;
+    variants.swap(g_pending_thumbnails);
+    return variants;
+}
+
 struct PngJob {
-    uint32_t job_id;
-    std::vector<uint8_t> buffer_data;  // Copied buffer data for thread safety
+    uint32_t job_id;                   // Assigned by submit_job (slot + generation in g_job_table)
+    JobSlot* slot;                     // Status and buffer_released as seen by the polling APIs
+    PooledBuffer buffer_data;          // Copied buffer data for thread safety (empty when borrowed)
+    const uint8_t* pixels;             // Points into buffer_data, or at the caller's buffer when borrowed
+    bool borrowed;                     // Caller owns the pixels until the slot's buffer_released is set
     uint32_t width;
     uint32_t height;
     std::string filepath;
-    JobStatus status;
+    ImageFormat format;                // Output format (PNG for the classic save APIs)
+    int quality;                       // JPEG/WebP quality at the time the job was queued
+    std::string source_path;           // Conversion jobs: QOI/TGA/BMP file to transcode into filepath
+    bool delete_source;                // Conversion jobs: remove source_path once the PNG is written
+    JobPriority priority;              // Set when queued (submit_job)
+    std::chrono::steady_clock::time_point queued_at;
+    std::chrono::steady_clock::time_point deadline;
+    std::vector<ThumbnailVariant> thumbnails; // Written from pixels before the full-size image
+    ScaleFilter thumbnail_filter;
     std::string error_message;
+    std::atomic<JobClaim> claim;       // Decides whether a worker runs the job or overflow drops it
+    size_t reserved_bytes;             // Counted in g_queued_bytes until the pixels are released
+    bool counted_in_queue;             // Counted in g_queued_jobs until claimed
+    
+    PngJob(const uint8_t* src_pixels, uint32_t w, uint32_t h, const std::string& path, bool borrow = false,
+           ImageFormat image_format = ImageFormat::PNG, int image_quality = IMAGE_DEFAULT_QUALITY)
+        : job_id(0), slot(nullptr), pixels(src_pixels), borrowed(borrow),
+          width(w), height(h), filepath(path), format(image_format), quality(image_quality), delete_source(false),
+          priority(JobPriority::NORMAL), thumbnail_filter(ScaleFilter::BOX), claim(JobClaim::WAITING), reserved_bytes(0), counted_in_queue(false)
+    {
+        if (!borrowed) {
+            // Copy buffer data for thread safety
+            size_t buffer_size = static_cast<size_t>(width) * height * 4; // RGBA = 4 bytes per pixel
+            buffer_data = frame_buffer_pool().acquire(buffer_size);
+            std::memcpy(buffer_data.data(), src_pixels, buffer_size);
+            pixels = buffer_data.data();
+        }
+    }
     
-    PngJob(uint32_t id, const uint8_t* pixels, uint32_t w, uint32_t h, const std::string& path)
-        : job_id(id), width(w), height(h), filepath(path), status(JobStatus::QUEUED)
+    // Conversion job: pixels are read from source on the worker
+    PngJob(const std::string& source, const std::string& path, bool delete_after)
+        : job_id(0), slot(nullptr), pixels(nullptr), borrowed(false), width(0), height(0),
+          filepath(path), format(ImageFormat::PNG), quality(IMAGE_DEFAULT_QUALITY), source_path(source),
+          delete_source(delete_after), priority(JobPriority::NORMAL), thumbnail_filter(ScaleFilter::BOX),
+          claim(JobClaim::WAITING), reserved_bytes(0), counted_in_queue(false)
     {
-        // Copy buffer data for thread safety
-        size_t buffer_size = static_cast<size_t>(width) * height * 4; // RGBA = 4 bytes per pixel
-        buffer_data.resize(buffer_size);
-        std::memcpy(buffer_data.data(), pixels, buffer_size);
+    }
+    
+    // Jobs the pool dropped at shutdown (or that never got queued) give back their admission here
+    ~PngJob() {
+        leave_queue();
+        release_reservation();
+    }
+    
+    // Take over the admission made by admit_job for this job
+    void adopt_admission(size_t bytes) {
+        reserved_bytes = bytes;
+        counted_in_queue = true;
+    }
+    
+    // No longer waiting: called once by whoever won the claim (then notify_admission)
+    void leave_queue() {
+        if (counted_in_queue) {
+            counted_in_queue = false;
+            g_queued_jobs--;
+        }
+    }
+    
+    void release_reservation() {
+        if (reserved_bytes > 0) {
+            g_queued_bytes -= reserved_bytes;
+            reserved_bytes = 0;
+        }
+    }
+    
+    // Hand a borrowed buffer back to the caller (or a copied one back to the pool);
+    // NiceShot must not touch the pixels afterwards
+    void release_buffer() {
+        pixels = nullptr;
+        buffer_data.reset();
+        release_reservation();
+        slot->buffer_released = true;
+    }
+    
+    // Publish a new status; COMPLETED/FAILED must be the job's last use of its slot
+    void set_status(JobStatus new_status) {
+        slot->status = static_cast<int>(new_status);
     }
 };
 
@@ -86,23 +446,319 @@ enum class RecordingStatus {
     ERROR_STATE = -1
 };
 
+enum class RecordingMode {
+    RAW = 0,       // Dump RGBA frames to .raw, encode offline afterwards
+    LIVE_H264 = 1, // Encode with x264 on the encoding thread, write .h264 directly
+    REPLAY = 2     // Keep the last seconds in memory (H.264, or QOI without x264); clips saved on request
+};
+
+enum class VideoFrameKind {
+    FULL = 0,  // pixel_data holds the whole frame
+    TILES = 1  // pixel_data holds only the changed tiles listed in tiles, packed
+};
+
 struct VideoFrame {
-    std::vector<uint8_t> pixel_data;
+    PooledBuffer pixel_data;
     uint32_t width;
     uint32_t height;
     std::chrono::high_resolution_clock::time_point timestamp;
     uint64_t frame_number;
-    
-    VideoFrame(const uint8_t* pixels, uint32_t w, uint32_t h, uint64_t frame_num)
-        : width(w), height(h), frame_number(frame_num), timestamp(std::chrono::high_resolution_clock::now())
+    VideoFrameKind kind;
+    size_t payload_size; // Bytes of pixel_data in use
+    std::vector<uint32_t> tiles;
+    uint32_t repeats_before; // Identical frames submitted since the previous slot (never stored)
+    std::vector<int64_t> repeat_times; // Their capture times, microseconds since recording start
+    
+    // Frames are preallocated ring slots; capture() fills them in place
+    VideoFrame(uint32_t w, uint32_t h)
+        : width(w), height(h), frame_number(0), kind(VideoFrameKind::FULL), payload_size(0), repeats_before(0)
     {
         size_t buffer_size = static_cast<size_t>(width) * height * 4; // RGBA
-        pixel_data.resize(buffer_size);
-        std::memcpy(pixel_data.data(), pixels, buffer_size);
+        pixel_data = frame_buffer_pool().acquire(buffer_size);
+    }
+    
+    void capture(const uint8_t* pixels, uint64_t frame_num) {
+        std::memcpy(pixel_data.data(), pixels, pixel_data.size());
+        kind = VideoFrameKind::FULL;
+        payload_size = pixel_data.size();
+        frame_number = frame_num;
+        timestamp = std::chrono::high_resolution_clock::now();
+    }
+    
+    // Copy only the changed tiles (also updating the caller's reference frame)
+    void capture_tiles(const uint8_t* pixels, const uint32_t* changed, size_t changed_count, uint8_t* reference,
+                       uint64_t frame_num) {
+        payload_size = raw_delta_pack_tiles(pixels, width, height, RAW_DELTA_TILE_SIZE, changed, changed_count,
+                                            pixel_data.data(), reference);
+        tiles.assign(changed, changed + changed_count);
+        kind = VideoFrameKind::TILES;
+        frame_number = frame_num;
+        timestamp = std::chrono::high_resolution_clock::now();
     }
     
     size_t get_memory_size() const {
-        return pixel_data.size() + sizeof(VideoFrame);
+        return payload_size + sizeof(VideoFrame);
+    }
+};
+
+// Lock-free single-producer/single-consumer ring of preallocated frame slots.
+// The game thread writes at head and the encoding thread reads at tail; neither side blocks or allocates.
+class FrameRing {
+public:
+    FrameRing(size_t slot_count, uint32_t w, uint32_t h) : head(0), tail(0) {
+        slots.reserve(slot_count);
+        for (size_t i = 0; i < slot_count; ++i) {
+            slots.emplace_back(w, h);
+        }
+    }
+    
+    // Producer: slot to fill, or nullptr if the ring is full
+    VideoFrame* begin_write() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= slots.size()) {
+            return nullptr;
+        }
+        return &slots[h % slots.size()];
+    }
+    
+    // Producer: publish the slot returned by begin_write()
+    void commit_write() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    
+    // Consumer: oldest published slot, or nullptr if the ring is empty
+    VideoFrame* begin_read() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[t % slots.size()];
+    }
+    
+    // Consumer: hand the slot returned by begin_read() back to the producer
+    void commit_read() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    
+    size_t size() const {
+        size_t t = tail.load(std::memory_order_acquire); // Read tail first so head - tail never underflows
+        return head.load(std::memory_order_acquire) - t;
+    }
+    
+    size_t capacity() const { return slots.size(); }
+    
+private:
+    std::vector<VideoFrame> slots;
+    alignas(64) std::atomic<size_t> head; // Next slot to write (game thread)
+    alignas(64) std::atomic<size_t> tail; // Next slot to read (encoding thread)
+};
+
+// One block of game audio from niceshot_record_audio: interleaved 16-bit samples and the capture time of the first
+struct AudioBlock {
+    std::vector<int16_t> samples;
+    int64_t timestamp; // CAPTURE_TIMEBASE units since recording start
+};
+
+// Seconds of audio the game may push ahead of the audio thread (or before the first video frame) before blocks are rejected
+static const uint32_t AUDIO_QUEUE_SECONDS = 10;
+
+// Pushes closer than this to where the stream already is are treated as continuous; later ones are a gap filled with silence
+static const int64_t AUDIO_GAP_US = 100000;
+
+// Game audio for a recording. niceshot_record_audio queues PCM blocks here; once the video thread has the first frame
+// (the audio origin) it starts the audio thread, which places the blocks on the recording timeline and encodes them:
+// into packets that the video thread interleaves into the MP4 (or keeps in the replay buffer), or into a WAV sidecar
+// next to raw and .h264 recordings.
+struct AudioCapture {
+    uint32_t sample_rate;
+    uint32_t channels;
+    AudioCodec codec;
+    uint32_t bitrate_kbps;
+    
+    // Game thread -> audio thread
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<AudioBlock> blocks;
+    size_t queued_samples;
+    bool stopping;
+    std::thread thread;
+    
+    // Audio thread state
+    AudioEncoder encoder;
+    WavWriter wav;
+    std::string wav_path;
+    bool encoded;         // Packets for the video thread to mux or buffer (false: WAV)
+    bool started;
+    int64_t origin;       // First video frame, in samples since recording start: audio sample 0 of the output
+    int64_t position;     // Next sample of the timeline, in samples since recording start
+    bool placed_first;
+    
+    // Audio thread -> video thread (encoded only)
+    std::mutex packet_mutex;
+    std::deque<AudioPacket> packets;
+    
+    std::atomic<uint64_t> samples_pushed;
+    std::atomic<uint64_t> samples_written; // Encoded or written to the WAV, including silence
+    std::atomic<uint64_t> blocks_rejected;
+    
+    AudioCapture(uint32_t rate, uint32_t channel_count, AudioCodec audio_codec, uint32_t bitrate)
+        : sample_rate(rate), channels(channel_count), codec(audio_codec), bitrate_kbps(bitrate), queued_samples(0),
+          stopping(false), encoded(false), started(false), origin(0), position(0), placed_first(false),
+          samples_pushed(0), samples_written(0), blocks_rejected(0) {}
+    
+    ~AudioCapture() {
+        finish();
+    }
+    
+    int64_t to_samples(int64_t timestamp) const {
+        return (timestamp * sample_rate + CAPTURE_TIMEBASE_DEN / 2) / CAPTURE_TIMEBASE_DEN;
+    }
+    
+    // Game thread: queue a block; false if the queue is full
+    bool push(const int16_t* pcm, size_t frames, int64_t timestamp) {
+        size_t values = frames * channels;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || queued_samples + values > static_cast<size_t>(sample_rate) * channels * AUDIO_QUEUE_SECONDS) {
+            blocks_rejected++;
+            return false;
+        }
+        blocks.push_back(AudioBlock{ std::vector<int16_t>(pcm, pcm + values), timestamp });
+        queued_samples += values;
+        samples_pushed += frames;
+        wake.notify_one();
+        return true;
+    }
+    
+    // Video thread: start with the first frame's capture time as the origin, encoding packets for the video thread
+    // or writing wav_file
+    bool start(int64_t first_frame_time, bool encode, const std::string& wav_file) {
+        std::string error;
+        if (encode) {
+            if (!encoder.open(codec, sample_rate, channels, bitrate_kbps, error) &&
+                (codec == AudioCodec::PCM || !encoder.open(AudioCodec::PCM, sample_rate, channels, 0, error))) {
+                std::cerr << "[NiceShot] Audio encoder failed: " << error << std::endl;
+                return false;
+            }
+            if (encoder.get_codec() != codec) {
+                std::cerr << "[NiceShot] " << audio_codec_name(codec) << " unavailable for " << sample_rate
+                          << " Hz audio, recording uncompressed PCM" << std::endl;
+            }
+            encoded = true;
+        } else {
+            if (!wav.open(wav_file, sample_rate, channels)) {
+                std::cerr << "[NiceShot] Failed to open audio file: " << wav_file << std::endl;
+                return false;
+            }
+            wav_path = wav_file;
+        }
+        
+        origin = to_samples(first_frame_time);
+        started = true;
+        thread = std::thread([this]() { run(); });
+        std::cout << "[NiceShot] Audio recording: " << sample_rate << " Hz, " << channels << " channel(s), "
+                  << (encoded ? audio_codec_name(encoder.get_codec()) : "WAV") << std::endl;
+        return true;
+    }
+    
+    // Stop accepting blocks, encode what is queued and flush the encoder
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    
+    // Video thread: next encoded packet that starts before up_to (seconds * the encoder timescale), if any
+    bool pop_packet(int64_t up_to, AudioPacket& packet) {
+        std::lock_guard<std::mutex> lock(packet_mutex);
+        if (packets.empty() || packets.front().pts >= up_to) {
+            return false;
+        }
+        packet = std::move(packets.front());
+        packets.pop_front();
+        return true;
+    }
+    
+private:
+    void run() {
+        std::vector<AudioPacket> output;
+        while (true) {
+            AudioBlock block;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !blocks.empty(); });
+                if (blocks.empty()) {
+                    break;
+                }
+                block = std::move(blocks.front());
+                blocks.pop_front();
+                queued_samples -= block.samples.size();
+            }
+            
+            // The block plays from its push time: the first one is placed exactly, later ones follow on unless
+            // the game stopped pushing for a while
+            int64_t block_start = to_samples(block.timestamp);
+            if (!placed_first) {
+                position = std::min(block_start, origin);
+                placed_first = true;
+            }
+            if (block_start > position && (position <= origin || block_start - position > to_samples(AUDIO_GAP_US))) {
+                write_silence(block_start - position, output);
+            }
+            write(block.samples.data(), block.samples.size() / channels, output);
+        }
+        
+        if (encoded) {
+            encoder.flush(output);
+            publish(output);
+        } else if (!wav.close()) {
+            std::cerr << "[NiceShot] Failed to finalize audio file: " << wav_path << std::endl;
+        }
+    }
+    
+    // Append samples at the current position; whatever falls before the origin is dropped
+    void write(const int16_t* pcm, size_t frames, std::vector<AudioPacket>& output) {
+        if (position < origin) {
+            size_t skip = static_cast<size_t>(std::min<int64_t>(frames, origin - position));
+            pcm += skip * channels;
+            frames -= skip;
+            position += skip;
+        }
+        if (frames == 0) {
+            return;
+        }
+        
+        bool ok = encoded ? encoder.encode(pcm, frames, output) : wav.write(pcm, frames);
+        if (!ok) {
+            std::cerr << "[NiceShot] Audio " << (encoded ? "encoding" : "write") << " failed" << std::endl;
+        }
+        position += frames;
+        samples_written += frames;
+        publish(output);
+    }
+    
+    void write_silence(int64_t frames, std::vector<AudioPacket>& output) {
+        std::vector<int16_t> silence(static_cast<size_t>(sample_rate / 10) * channels, 0);
+        while (frames > 0) {
+            size_t count = static_cast<size_t>(std::min<int64_t>(frames, sample_rate / 10));
+            write(silence.data(), count, output);
+            frames -= count;
+        }
+    }
+    
+    void publish(std::vector<AudioPacket>& output) {
+        if (output.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(packet_mutex);
+        for (AudioPacket& packet : output) {
+            packets.push_back(std::move(packet));
+        }
+        output.clear();
     }
 };
 
@@ -114,11 +770,14 @@ struct VideoRecordingSession {
     double bitrate_kbps;
     std::string output_filepath;
     size_t max_buffer_frames;
+    RecordingMode mode; // May fall back to RAW if x264 cannot be initialized
+    bool raw_compression; // Raw mode writes the compressed container instead of plain RGBA
+    bool delta_capture; // Skip identical frames and store changed tiles (needs the compressed container)
+    VideoTiming timing; // Live mode applies it while encoding; raw mode stores timestamps for the offline encoder
+    VideoContainer container; // Live mode writes it directly; raw mode records it for the converter
     
     // Ring buffer for frames
-    std::deque<std::unique_ptr<VideoFrame>> frame_buffer;
-    std::mutex buffer_mutex;
-    std::condition_variable buffer_condition;
+    FrameRing frame_buffer;
     
     // Recording state
     RecordingStatus status;
@@ -131,15 +790,43 @@ struct VideoRecordingSession {
     std::atomic<size_t> current_buffer_memory;
     size_t max_buffer_memory;
     
+    // Frame delta state (game thread); the reference is the last frame published to the ring
+    PooledBuffer delta_reference;
+    bool delta_has_reference;
+    std::vector<uint32_t> delta_changed;
+    std::atomic<uint64_t> pending_repeats; // Repeats not yet attached to a slot, flushed by the encoder at stop
+    std::vector<int64_t> pending_repeat_times; // Their capture times (same ownership as pending_repeats)
+    uint64_t frames_repeated;
+    uint64_t frames_delta;
+    
+    // Game audio (null when audio recording is off)
+    std::unique_ptr<AudioCapture> audio;
+    
+    // Instant replay (REPLAY mode only): the rolling window and the clip being written
+    std::unique_ptr<ReplayBuffer> replay;
+    std::thread replay_save_thread;
+    std::atomic<int> replay_save_status; // 0 = idle / last save succeeded, 1 = saving, -1 = last save failed
+    
     // Worker threads
     std::thread encoding_thread;
     std::atomic<bool> stop_encoding;
     
-    VideoRecordingSession(uint32_t w, uint32_t h, double f, double bitrate, size_t max_frames, const std::string& filepath)
+    VideoRecordingSession(uint32_t w, uint32_t h, double f, double bitrate, size_t max_frames, const std::string& filepath,
+                          RecordingMode recording_mode, bool compress_raw, bool frame_delta, VideoTiming video_timing,
+                          VideoContainer video_container)
         : width(w), height(h), fps(f), bitrate_kbps(bitrate), output_filepath(filepath), max_buffer_frames(max_frames),
-          status(RecordingStatus::NOT_RECORDING), frames_captured(0), frames_encoded(0), frames_dropped(0),
-          current_buffer_memory(0), stop_encoding(false)
+          mode(recording_mode), raw_compression(compress_raw),
+          delta_capture(frame_delta && compress_raw && recording_mode == RecordingMode::RAW), timing(video_timing),
+          container(video_container),
+          frame_buffer(max_frames, w, h), status(RecordingStatus::NOT_RECORDING), frames_captured(0), frames_encoded(0), frames_dropped(0),
+          current_buffer_memory(0), delta_has_reference(false), pending_repeats(0), frames_repeated(0), frames_delta(0),
+          replay_save_status(0), stop_encoding(false)
     {
+        if (delta_capture) {
+            delta_reference = frame_buffer_pool().acquire(static_cast<size_t>(width) * height * 4);
+            delta_changed.resize(raw_delta_tile_count(width, height, RAW_DELTA_TILE_SIZE));
+        }
+        
         // Calculate maximum memory usage: frame_size * max_frames + overhead
         size_t frame_size = static_cast<size_t>(width) * height * 4 + sizeof(VideoFrame);
         max_buffer_memory = frame_size * max_buffer_frames;
@@ -148,6 +835,17 @@ struct VideoRecordingSession {
         std::cout << "[NiceShot] Max buffer frames: " << max_buffer_frames 
                   << " (≈" << (max_buffer_memory / 1024 / 1024) << "MB)" << std::endl;
     }
+    
+    ~VideoRecordingSession() {
+        if (replay_save_thread.joinable()) {
+            replay_save_thread.join();
+        }
+    }
+    
+    // Capture timestamp in CAPTURE_TIMEBASE units (microseconds since recording start)
+    int64_t capture_time(std::chrono::high_resolution_clock::time_point t) const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - recording_start_time).count();
+    }
 };
 
 // Global video recording state
@@ -155,74 +853,346 @@ static std::unique_ptr<VideoRecordingSession> g_recording_session = nullptr;
 static std::mutex g_recording_mutex;
 
 // Global async system state
-static std::atomic<uint32_t> g_next_job_id{1};
-static std::queue<std::shared_ptr<PngJob>> g_job_queue;
-static std::unordered_map<uint32_t, std::shared_ptr<PngJob>> g_active_jobs;
-static std::mutex g_job_mutex;
-static std::condition_variable g_job_condition;
-static std::vector<std::thread> g_worker_threads;
+static JobTable g_job_table; // Status of every job not yet cleaned up, looked up by job id without locking
+static CompletionQueue g_completions; // Finished jobs for niceshot_drain_completions
+static std::atomic<bool> g_completion_events{false}; // Push finished jobs into g_completions (opt-in)
+static std::atomic<bool> g_completion_overflow_logged{false};
+static const size_t COMPLETION_RECORD_SIZE = 16; // u32 job id, s32 status, f32 queue wait ms, f32 run ms
+static WorkStealingPool g_job_pool(JOB_PRIORITY_COUNT); // Async jobs plus stripe helpers of in-flight jobs
 static std::atomic<bool> g_worker_thread_running{false};
-static std::atomic<bool> g_shutdown_requested{false};
+
+// Priority and deadline stamped onto jobs queued from now on
+static std::atomic<int> g_job_priority{static_cast<int>(JobPriority::NORMAL)};
+static std::atomic<double> g_job_deadline_ms{0.0}; // 0 = JOB_DEFAULT_DEADLINE_MS of the class
+
+// Time jobs spent queued before a worker picked them up, per priority class
+struct QueueWaitStats {
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> total_wait_us{0};
+    std::atomic<uint64_t> max_wait_us{0};
+    std::atomic<uint64_t> missed_deadlines{0}; // Started after their deadline
+};
+static QueueWaitStats g_queue_wait_stats[JOB_PRIORITY_COUNT];
+
+// Replace (or append) the extension of a path, e.g. "clip.mp4" -> "clip.raw"
+static std::string path_with_extension(const std::string& path, const std::string& extension) {
+    size_t ext_pos = path.find_last_of('.');
+    if (ext_pos != std::string::npos) {
+        return path.substr(0, ext_pos) + extension;
+    }
+    return path + extension;
+}
 
 // Forward declarations for internal functions
 static bool encode_png_to_file(const uint8_t* pixels, uint32_t width, uint32_t height, const std::string& filepath, std::string& error_message);
-static void worker_thread_main();
+static bool encode_image_to_file(const uint8_t* pixels, uint32_t width, uint32_t height, ImageFormat format,
+                                 int quality, const std::string& filepath, std::string& error_message);
+static bool convert_image_to_png(const std::string& source_path, const std::string& png_path, bool delete_source,
+                                 std::string& error_message);
 static void video_encoding_thread_main(VideoRecordingSession* session);
 
-// Worker thread main function
-static void worker_thread_main() {
-    std::cout << "[NiceShot] Worker thread started" << std::endl;
+// Run fn(i) for every i in [0, count) on idle PNG workers and return once all calls have finished.
+// The calling thread works through the items too, so this completes even when every other worker is busy.
+static void run_on_png_workers(unsigned count, const std::function<void(unsigned)>& fn) {
+    struct Batch {
+        const std::function<void(unsigned)>* fn;
+        unsigned count;
+        std::atomic<unsigned> next;
+        unsigned remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
     
-    while (!g_shutdown_requested.load()) {
-        std::shared_ptr<PngJob> job = nullptr;
+    auto batch = std::make_shared<Batch>();
+    batch->fn = &fn;
+    batch->count = count;
+    batch->next = 0;
+    batch->remaining = count;
+    
+    // Helpers that start after every item was claimed return without touching fn
+    auto work = [batch]() {
+        unsigned i;
+        while ((i = batch->next.fetch_add(1)) < batch->count) {
+            (*batch->fn)(i);
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (--batch->remaining == 0) {
+                batch->done.notify_all();
+            }
+        }
+    };
+    
+    // Queued on this worker's own deque; idle workers steal them
+    for (unsigned i = 1; i < count; ++i) {
+        g_job_pool.submit_helper(work);
+    }
+    
+    work();
+    
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [&] { return batch->remaining == 0; });
+}
+
+// Record how long a job waited in the queue; called by the worker that starts it. Returns the wait in ms.
+static double record_queue_wait(const PngJob& job, std::chrono::steady_clock::time_point now) {
+    QueueWaitStats& stats = g_queue_wait_stats[static_cast<int>(job.priority)];
+    uint64_t wait_us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - job.queued_at).count());
+    stats.jobs++;
+    stats.total_wait_us += wait_us;
+    uint64_t max_wait = stats.max_wait_us.load();
+    while (wait_us > max_wait && !stats.max_wait_us.compare_exchange_weak(max_wait, wait_us)) {
+    }
+    if (now > job.deadline) {
+        stats.missed_deadlines++;
+    }
+    return wait_us / 1000.0;
+}
+
+// Report a finished job to niceshot_drain_completions; call after its final status is published
+static void publish_completion(const PngJob& job, JobStatus final_status, double queue_wait_ms, double run_ms) {
+    if (!g_completion_events.load()) {
+        return;
+    }
+    JobCompletion completion;
+    completion.job_id = job.job_id;
+    completion.status = static_cast<int32_t>(final_status);
+    completion.queue_wait_ms = static_cast<float>(queue_wait_ms);
+    completion.run_ms = static_cast<float>(run_ms);
+    if (!g_completions.push(completion) && !g_completion_overflow_logged.exchange(true)) {
+        std::cerr << "[NiceShot] Completion queue full; drain it with niceshot_drain_completions" << std::endl;
+    }
+}
+
+// Downscale an image into each thumbnail variant and write it, while the frame is still in hand.
+// job_id only labels the log (0 = synchronous save).
+// Returns false (reasons appended to error_message) if any variant failed; the others are still written.
+static bool write_thumbnails(const uint8_t* pixels, uint32_t width, uint32_t height,
+                             const std::vector<ThumbnailVariant>& variants, ScaleFilter filter, int quality,
+                             uint32_t job_id, std::string& error_message) {
+    bool all_written = true;
+    std::vector<uint8_t> scaled;
+    for (const ThumbnailVariant& variant : variants) {
+        uint32_t thumb_width = variant.width;
+        uint32_t thumb_height = variant.height;
+        if (thumb_height == 0) {
+            double aspect_height = static_cast<double>(height) * thumb_width / width;
+            thumb_height = std::max<uint32_t>(1, static_cast<uint32_t>(aspect_height + 0.5));
+        }
         
-        // Get next job from queue
-        {
-            std::unique_lock<std::mutex> lock(g_job_mutex);
-            
-            // Wait for job or shutdown signal
-            g_job_condition.wait(lock, [] { 
-                return !g_job_queue.empty() || g_shutdown_requested.load(); 
-            });
-            
-            if (g_shutdown_requested.load() && g_job_queue.empty()) {
-                break; // Exit thread
+        std::string error;
+        auto start_time = std::chrono::steady_clock::now();
+        try {
+            scaled.resize(static_cast<size_t>(thumb_width) * thumb_height * 4);
+            if (!scale_rgba(pixels, width, height, scaled.data(), thumb_width, thumb_height, filter)) {
+                error = "invalid thumbnail size";
             }
-            
-            if (!g_job_queue.empty()) {
-                job = g_job_queue.front();
-                g_job_queue.pop();
-                job->status = JobStatus::PROCESSING;
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+        }
+        if (error.empty() &&
+            encode_image_to_file(scaled.data(), thumb_width, thumb_height, variant.format, quality, variant.filepath, error)) {
+            std::cout << "[NiceShot] ";
+            if (job_id != 0) {
+                std::cout << "Job " << job_id << " thumbnail ";
+            } else {
+                std::cout << "Thumbnail ";
             }
+            std::cout << thumb_width << "x" << thumb_height << " (" << scale_filter_name(filter) << ") written in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count()
+                      << "ms: " << variant.filepath << std::endl;
+            continue;
         }
         
-        // Process job outside the lock
-        if (job) {
-            std::cout << "[NiceShot] Processing job " << job->job_id << ": " << job->filepath << std::endl;
-            
-            // Encode PNG using existing logic
-            bool success = encode_png_to_file(
-                job->buffer_data.data(),
+        all_written = false;
+        if (!error_message.empty()) {
+            error_message += "; ";
+        }
+        error_message += "thumbnail " + variant.filepath + ": " + error;
+    }
+    return all_written;
+}
+
+// Run one async job on a pool worker. The job shares only atomics with the GameMaker thread,
+// so status polling never waits for a worker and workers never wait for polling.
+static void run_job(const std::shared_ptr<PngJob>& job) {
+    JobClaim expected = JobClaim::WAITING;
+    if (!job->claim.compare_exchange_strong(expected, JobClaim::STARTED)) {
+        return; // Dropped by the overflow policy while waiting
+    }
+    job->leave_queue();
+    notify_admission();
+    
+    auto start_time = std::chrono::steady_clock::now();
+    double queue_wait_ms = record_queue_wait(*job, start_time);
+    job->set_status(JobStatus::PROCESSING);
+    std::cout << "[NiceShot] Processing job " << job->job_id << ": " << job->filepath << std::endl;
+    
+    // A throw (e.g. bad_alloc on a huge image) fails the job; escaping the worker would terminate the game
+    bool success;
+    try {
+        if (!job->source_path.empty()) {
+            success = convert_image_to_png(job->source_path, job->filepath, job->delete_source, job->error_message);
+        } else {
+            bool thumbnails_written = write_thumbnails(job->pixels, job->width, job->height, job->thumbnails,
+                                                       job->thumbnail_filter, job->quality, job->job_id, job->error_message);
+            success = encode_image_to_file(
+                job->pixels,
                 job->width,
                 job->height,
+                job->format,
+                job->quality,
                 job->filepath,
                 job->error_message
-            );
+            ) && thumbnails_written;
+        }
+    }
+    catch (const std::exception& e) {
+        success = false;
+        if (!job->error_message.empty()) {
+            job->error_message += "; ";
+        }
+        job->error_message += e.what();
+    }
+    
+    job->release_buffer();
+    notify_admission();
+    if (success) {
+        std::cout << "[NiceShot] Job " << job->job_id << " completed successfully" << std::endl;
+    } else {
+        std::cout << "[NiceShot] Job " << job->job_id << " failed: " << job->error_message << std::endl;
+    }
+    JobStatus final_status = success ? JobStatus::COMPLETED : JobStatus::FAILED;
+    job->set_status(final_status);
+    publish_completion(*job, final_status, queue_wait_ms,
+                       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+// Admitted jobs not yet started, oldest first, for DROP_OLDEST_LOW (g_admission_mutex)
+static std::deque<std::shared_ptr<PngJob>> g_waiting_jobs;
+
+// Forget jobs that workers started (or overflow dropped) since; caller holds g_admission_mutex
+static void prune_waiting_jobs_locked() {
+    g_waiting_jobs.erase(std::remove_if(g_waiting_jobs.begin(), g_waiting_jobs.end(),
+                                        [](const std::shared_ptr<PngJob>& job) {
+                                            return job->claim.load() != JobClaim::WAITING;
+                                        }),
+                         g_waiting_jobs.end());
+}
+
+// Drop the oldest waiting job of the lowest class, at most max_priority; caller holds g_admission_mutex.
+// Returns false when there is no such job.
+static bool drop_oldest_waiting_locked(JobPriority max_priority) {
+    prune_waiting_jobs_locked();
+    for (int level = 0; level <= static_cast<int>(max_priority); ++level) {
+        for (auto it = g_waiting_jobs.begin(); it != g_waiting_jobs.end(); ++it) {
+            std::shared_ptr<PngJob> job = *it;
+            JobClaim expected = JobClaim::WAITING;
+            if (static_cast<int>(job->priority) != level ||
+                !job->claim.compare_exchange_strong(expected, JobClaim::DROPPED)) {
+                continue;
+            }
             
-            // Update job status
-            {
-                std::lock_guard<std::mutex> lock(g_job_mutex);
-                job->status = success ? JobStatus::COMPLETED : JobStatus::FAILED;
-                if (success) {
-                    std::cout << "[NiceShot] Job " << job->job_id << " completed successfully" << std::endl;
-                } else {
-                    std::cout << "[NiceShot] Job " << job->job_id << " failed: " << job->error_message << std::endl;
-                }
+            // The pool still holds the task; the worker that pops it sees the claim and skips it
+            g_waiting_jobs.erase(it);
+            job->leave_queue();
+            job->release_buffer();
+            job->error_message = "Dropped to make room in the async queue";
+            job->set_status(JobStatus::FAILED);
+            double waited_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->queued_at).count();
+            publish_completion(*job, JobStatus::FAILED, waited_ms, 0.0);
+            g_queue_overflows++;
+            std::cout << "[NiceShot] Dropped waiting job " << job->job_id << " (" << job_priority_name(job->priority)
+                      << " priority) to make room in the async queue" << std::endl;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Make room for a new job under the queue limits and overflow policy, and count it as queued.
+// The caller passes the admission on with PngJob::adopt_admission or undoes it with cancel_admission.
+static bool admit_job(size_t bytes, JobPriority priority) {
+    std::unique_lock<std::mutex> lock(g_admission_mutex);
+    size_t max_bytes = g_queue_max_bytes.load();
+    size_t max_jobs = g_queue_max_jobs.load();
+    if (max_bytes > 0 && bytes > max_bytes) {
+        g_queue_overflows++;
+        std::cerr << "[NiceShot] Job needs " << (bytes / 1024 / 1024) << "MB, more than the whole async queue budget ("
+                  << (max_bytes / 1024 / 1024) << "MB)" << std::endl;
+        return false;
+    }
+    
+    auto fits = [&]() {
+        return (max_jobs == 0 || g_queued_jobs.load() < max_jobs) &&
+               (max_bytes == 0 || g_queued_bytes.load() + bytes <= max_bytes);
+    };
+    if (!fits()) {
+        QueueOverflowPolicy policy = static_cast<QueueOverflowPolicy>(g_queue_overflow_policy.load());
+        bool room = false;
+        if (policy == QueueOverflowPolicy::DROP_OLDEST_LOW) {
+            while (!(room = fits()) && drop_oldest_waiting_locked(priority)) {
             }
+        } else if (policy == QueueOverflowPolicy::BLOCK) {
+            g_admission_waiters++;
+            room = g_admission_condition.wait_for(lock, std::chrono::duration<double, std::milli>(g_queue_block_timeout_ms.load()),
+                                                  fits);
+            g_admission_waiters--;
+        }
+        if (!room) {
+            g_queue_overflows++;
+            std::cerr << "[NiceShot] Async queue full (" << (g_queued_bytes.load() / 1024 / 1024) << "MB, "
+                      << g_queued_jobs.load() << " jobs waiting), job rejected" << std::endl;
+            return false;
         }
     }
     
-    std::cout << "[NiceShot] Worker thread exiting" << std::endl;
+    g_queued_bytes += bytes;
+    g_queued_jobs++;
+    return true;
+}
+
+// Undo admit_job for a job that was never created
+static void cancel_admission(size_t bytes) {
+    g_queued_bytes -= bytes;
+    g_queued_jobs--;
+    notify_admission();
+}
+
+// Give a job its id and status slot, stamp the current priority and deadline and hand it to the pool.
+// Returns the job id, 0 if the job could not be queued.
+static uint32_t submit_job(const std::shared_ptr<PngJob>& job) {
+    uint32_t job_id = g_job_table.allocate(static_cast<int>(JobStatus::QUEUED), !job->borrowed);
+    if (job_id == 0) {
+        std::cerr << "[NiceShot] Too many outstanding jobs (" << JOB_TABLE_CAPACITY
+                  << "), clean up finished jobs with niceshot_cleanup_job" << std::endl;
+        return 0;
+    }
+    job->job_id = job_id;
+    job->slot = &g_job_table.slot(job_id);
+    
+    job->priority = static_cast<JobPriority>(g_job_priority.load());
+    double deadline_ms = g_job_deadline_ms.load();
+    if (deadline_ms <= 0.0) {
+        deadline_ms = JOB_DEFAULT_DEADLINE_MS[static_cast<int>(job->priority)];
+    }
+    job->queued_at = std::chrono::steady_clock::now();
+    job->deadline = job->queued_at + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(deadline_ms));
+    
+    if (job->counted_in_queue) {
+        std::lock_guard<std::mutex> lock(g_admission_mutex);
+        prune_waiting_jobs_locked();
+        g_waiting_jobs.push_back(job);
+    }
+    
+    if (!g_job_pool.submit([job]() { run_job(job); }, static_cast<int>(job->priority), job->deadline)) {
+        std::cerr << "[NiceShot] Worker pool not running, job dropped" << std::endl;
+        job->claim = JobClaim::DROPPED; // Keeps overflow handling away from the released slot
+        g_job_table.release(job_id);
+        return 0;
+    }
+    return job_id;
 }
 
 // x264 H.264 Encoder Context
@@ -239,58 +1209,145 @@ struct X264EncoderContext {
     double fps;
     uint64_t frame_count;
     std::vector<uint8_t> yuv_buffer; // RGBA to YUV conversion buffer
+    std::unique_ptr<RawFrameWriter> raw_writer; // Compressed raw container (null = headerless RGBA)
     bool x264_available;
-    
-    X264EncoderContext(const std::string& filepath, uint32_t w, uint32_t h, double f, int preset) 
-        : width(w), height(h), fps(f), frame_count(0), x264_available(false) {
+    FrameTimer timer; // Live encode: capture timestamps -> PTS
+    std::string timecodes_path; // Live VFR to .h264: sidecar carrying the PTS a raw stream cannot
+    std::vector<double> timecodes;
+    std::unique_ptr<Mp4Muxer> muxer; // Live encode into MP4 (null = Annex B .h264 stream)
+    int mp4_track;
+    ReplayBuffer* replay; // Instant replay: encoded frames go here instead of a file
+    std::vector<uint8_t> replay_scratch; // QOI replay: worst-case encode buffer
+    
+    // live_encode = false opens the output file only (raw capture), without starting x264
+    // compress_raw selects the QOI-compressed container for raw capture, which also stores capture timestamps
+    // timing and container only affect live encoding; raw capture leaves them to the offline encoder
+    // replay_buffer replaces the output file (filepath is unused): live encoding fills it with 1-second GOPs,
+    // otherwise the caller stores QOI frames in it
+    X264EncoderContext(const std::string& filepath, uint32_t w, uint32_t h, double f, int preset,
+                       double bitrate_kbps = 0.0, bool live_encode = true, bool compress_raw = false,
+                       VideoTiming timing = VideoTiming::FRAME_COUNT, VideoContainer container = VideoContainer::H264,
+                       ReplayBuffer* replay_buffer = nullptr) 
+        : output_file(nullptr), width(w), height(h), fps(f), frame_count(0), x264_available(false),
+          timer(timing, f, CAPTURE_TIMEBASE_NUM, CAPTURE_TIMEBASE_DEN), mp4_track(-1), replay(replay_buffer) {
         
         // Open output file
+        if (!replay) {
 #ifdef _WIN32
-        fopen_s(&output_file, filepath.c_str(), "wb");
+            fopen_s(&output_file, filepath.c_str(), "wb");
 #else
-        output_file = fopen(filepath.c_str(), "wb");
+            output_file = fopen(filepath.c_str(), "wb");
 #endif
+            
+            if (!output_file) {
+                throw std::runtime_error("Failed to open video output file: " + filepath);
+            }
+        }
         
-        if (!output_file) {
-            throw std::runtime_error("Failed to open video output file: " + filepath);
+        if (!live_encode && compress_raw) {
+            raw_writer = std::make_unique<RawFrameWriter>(output_file, width, height, RawFrameCodec::QOI);
+            raw_writer->enable_timestamps(CAPTURE_TIMEBASE_NUM, CAPTURE_TIMEBASE_DEN);
+            if (!raw_writer->write_header()) {
+                fclose(output_file);
+                throw std::runtime_error("Failed to write raw container header: " + filepath);
+            }
         }
         
 #ifdef HAVE_X264
-        // Initialize x264 encoder with optimized settings for real-time
-        x264_param_default_preset(&param, 
-            preset == 0 ? "ultrafast" : 
-            preset == 1 ? "veryfast" :  // Changed from "fast" for better performance
-            preset == 2 ? "fast" : 
-            preset == 3 ? "medium" : "slow", 
-            "zerolatency");
+        encoder = nullptr;
+        if (!live_encode) {
+            std::cout << "[NiceShot] Raw capture mode, x264 encoder not started" << std::endl;
+        } else {
+            // Initialize x264 encoder with optimized settings for real-time
+            x264_param_default_preset(&param, 
+                preset == 0 ? "ultrafast" : 
+                preset == 1 ? "veryfast" :  // Changed from "fast" for better performance
+                preset == 2 ? "fast" : 
+                preset == 3 ? "medium" : "slow", 
+                "zerolatency");
             
-        param.i_width = width;
-        param.i_height = height;
-        param.i_fps_num = static_cast<int>(fps * 1000);
-        param.i_fps_den = 1000;
-        param.i_keyint_max = static_cast<int>(fps) * 4; // Keyframe every 4 seconds (less frequent)
-        param.b_intra_refresh = 0; // Disable intra refresh for better performance
-        param.rc.i_rc_method = X264_RC_CRF;
-        param.rc.f_rf_constant = 28.0f; // Higher CRF = lower quality but faster encoding
-        param.i_csp = X264_CSP_I420; // YUV420p
-        
-        // Performance optimizations for real-time encoding
-        param.i_threads = 2; // Limit threads to reduce CPU contention
-        param.b_deterministic = 0; // Allow non-deterministic optimizations
-        param.i_sync_lookahead = 0; // Disable lookahead for lower latency
-        
-        // Apply preset for latency/quality balance
-        x264_param_apply_profile(&param, "high");
-        
-        encoder = x264_encoder_open(&param);
-        if (encoder) {
-            x264_picture_alloc(&pic_in, param.i_csp, param.i_width, param.i_height);
-            x264_available = true;
+            param.i_width = width;
+            param.i_height = height;
+            param.i_fps_num = static_cast<int>(fps * 1000);
+            param.i_fps_den = 1000;
+            if (timing == VideoTiming::VFR) {
+                // PTS are capture times; fps stays as the rate hint for rate control and keyframe spacing
+                param.b_vfr_input = 1;
+                param.i_timebase_num = timer.get_timebase_num();
+                param.i_timebase_den = timer.get_timebase_den();
+                if (container == VideoContainer::H264) {
+                    timecodes_path = path_with_extension(filepath, "_timecodes.txt");
+                }
+            }
+            if (container != VideoContainer::H264) {
+                // MP4 samples are length-prefixed NAL units; SPS/PPS go into the track header instead of the stream
+                param.b_annexb = 0;
+                param.b_repeat_headers = 0;
+            }
+            param.i_keyint_max = static_cast<int>(fps) * 4; // Keyframe every 4 seconds (less frequent)
+            if (replay) {
+                // GOPs are the unit of replay eviction and where clips start
+                param.i_keyint_max = std::max(1, static_cast<int>(fps));
+            }
+            param.b_intra_refresh = 0; // Disable intra refresh for better performance
+            param.rc.i_rc_method = X264_RC_CRF;
+            param.rc.f_rf_constant = 28.0f; // Higher CRF = lower quality but faster encoding
+            param.i_csp = X264_CSP_I420; // YUV420p
             
-            std::cout << "[NiceShot] x264 encoder initialized: " << width << "x" << height 
-                      << " @ " << fps << "fps, preset=" << preset << std::endl;
-        } else {
-            std::cerr << "[NiceShot] Failed to initialize x264 encoder, falling back to simulation" << std::endl;
+            // Performance optimizations for real-time encoding
+            param.i_threads = 2; // Limit threads to reduce CPU contention
+            param.b_deterministic = 0; // Allow non-deterministic optimizations
+            param.i_sync_lookahead = 0; // Disable lookahead for lower latency
+            
+            // Cap the CRF stream at the requested bitrate so live output stays within budget
+            if (bitrate_kbps > 0) {
+                param.rc.i_vbv_max_bitrate = static_cast<int>(bitrate_kbps);
+                param.rc.i_vbv_buffer_size = static_cast<int>(bitrate_kbps);
+            }
+            
+            // Apply preset for latency/quality balance
+            x264_param_apply_profile(&param, "high");
+            
+            encoder = x264_encoder_open(&param);
+            if (encoder && replay) {
+                x264_nal_t* headers;
+                int header_count;
+                int header_size = x264_encoder_headers(encoder, &headers, &header_count);
+                if (header_size > 0) {
+                    replay->set_video(ReplayFormat::H264, width, height, timer.get_timebase_den(),
+                                      static_cast<uint32_t>(std::llround(timer.get_timebase_den() / fps)),
+                                      headers[0].p_payload, static_cast<size_t>(header_size));
+                } else {
+                    std::cerr << "[NiceShot] x264 produced no usable SPS/PPS for the replay buffer" << std::endl;
+                    x264_encoder_close(encoder);
+                    encoder = nullptr;
+                }
+            } else if (encoder && container != VideoContainer::H264) {
+                muxer = std::make_unique<Mp4Muxer>(output_file, container == VideoContainer::FRAGMENTED_MP4);
+                x264_nal_t* headers;
+                int header_count;
+                int header_size = x264_encoder_headers(encoder, &headers, &header_count);
+                if (header_size > 0) {
+                    mp4_track = muxer->add_h264_track(width, height, timer.get_timebase_den(),
+                                                      static_cast<uint32_t>(std::llround(timer.get_timebase_den() / fps)),
+                                                      headers[0].p_payload, static_cast<size_t>(header_size));
+                }
+                if (mp4_track < 0) {
+                    std::cerr << "[NiceShot] x264 produced no usable SPS/PPS for the MP4 track" << std::endl;
+                    x264_encoder_close(encoder);
+                    encoder = nullptr;
+                    muxer.reset();
+                }
+            }
+            if (encoder) {
+                x264_picture_alloc(&pic_in, param.i_csp, param.i_width, param.i_height);
+                x264_available = true;
+            
+                std::cout << "[NiceShot] x264 encoder initialized: " << width << "x" << height 
+                          << " @ " << fps << "fps, preset=" << preset << std::endl;
+            } else {
+                std::cerr << "[NiceShot] Failed to initialize x264 encoder, falling back to simulation" << std::endl;
+            }
         }
 #else
         std::cout << "[NiceShot] x264 not available, using simulation mode" << std::endl;
@@ -318,22 +1375,48 @@ struct X264EncoderContext {
                 int frame_size = x264_encoder_encode(encoder, &nal, &i_nal, nullptr, &pic_out);
                 if (frame_size <= 0) break;
                 
-                for (int i = 0; i < i_nal; i++) {
-                    size_t written = fwrite(nal[i].p_payload, 1, nal[i].i_payload, output_file);
-                    if (written != nal[i].i_payload) {
-                        std::cerr << "[NiceShot] Failed to write flushed NAL unit" << std::endl;
-                    }
+                if (!write_encoded_frame(nal, i_nal, frame_size)) {
+                    std::cerr << "[NiceShot] Failed to write flushed frame" << std::endl;
                 }
                 flushed_frames++;
             }
             
             std::cout << "[NiceShot] Flushed " << flushed_frames << " delayed frames" << std::endl;
             
+            if (timer.get_timing() == VideoTiming::CFR) {
+                std::cout << "[NiceShot] Constant frame rate: " << timer.get_duplicated() << " frames duplicated, "
+                          << timer.get_dropped() << " dropped" << std::endl;
+            }
+            
             x264_picture_clean(&pic_in);
             x264_encoder_close(encoder);
             std::cout << "[NiceShot] x264 encoder closed" << std::endl;
         }
 #endif
+        if (muxer) {
+            if (muxer->finish()) {
+                std::cout << "[NiceShot] MP4 finalized: " << (muxer->get_bytes_written() / 1024) << "KB"
+                          << (muxer->is_fragmented() ? ", " + std::to_string(muxer->get_fragments()) + " fragments" : "")
+                          << std::endl;
+            } else {
+                std::cerr << "[NiceShot] Failed to finalize MP4 file" << std::endl;
+            }
+        }
+        
+        if (!timecodes_path.empty() && !timecodes.empty()) {
+            if (write_timecodes_v2(timecodes_path, timecodes)) {
+                std::cout << "[NiceShot] Timecodes written: " << timecodes_path << std::endl;
+            } else {
+                std::cerr << "[NiceShot] Failed to write timecodes: " << timecodes_path << std::endl;
+            }
+        }
+        
+        if (raw_writer && raw_writer->get_output_bytes() > 0) {
+            std::cout << "[NiceShot] Raw container: " << (raw_writer->get_input_bytes() / 1024 / 1024) << "MB RGBA -> "
+                      << (raw_writer->get_output_bytes() / 1024 / 1024) << "MB on disk ("
+                      << (100.0 * raw_writer->get_output_bytes() / (raw_writer->get_input_bytes() + 1)) << "%)" << std::endl;
+        }
+        
         if (output_file) {
             // Force flush file buffer before closing
             fflush(output_file);
@@ -341,59 +1424,58 @@ struct X264EncoderContext {
             std::cout << "[NiceShot] Output file closed. Total frames written: " << frame_count << std::endl;
         }
     }
-};
-
-// Fast RGBA to YUV420p conversion optimized for x264
-static void convert_rgba_to_yuv420p_fast(const uint8_t* rgba_data, uint32_t width, uint32_t height, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane) {
-    const uint32_t uv_width = width / 2;
-    const uint32_t uv_height = height / 2;
-    
-    // Convert in blocks for better cache performance
-    for (uint32_t y = 0; y < height; y += 2) {
-        for (uint32_t x = 0; x < width; x += 2) {
-            // Process 2x2 block
-            uint32_t rgba_idx0 = (y * width + x) * 4;       // Top-left
-            uint32_t rgba_idx1 = (y * width + x + 1) * 4;   // Top-right
-            uint32_t rgba_idx2 = ((y + 1) * width + x) * 4; // Bottom-left
-            uint32_t rgba_idx3 = ((y + 1) * width + x + 1) * 4; // Bottom-right
-            
-            // Extract RGBA values
-            uint8_t r0 = rgba_data[rgba_idx0 + 0], g0 = rgba_data[rgba_idx0 + 1], b0 = rgba_data[rgba_idx0 + 2];
-            uint8_t r1 = rgba_data[rgba_idx1 + 0], g1 = rgba_data[rgba_idx1 + 1], b1 = rgba_data[rgba_idx1 + 2];
-            uint8_t r2 = rgba_data[rgba_idx2 + 0], g2 = rgba_data[rgba_idx2 + 1], b2 = rgba_data[rgba_idx2 + 2];
-            uint8_t r3 = rgba_data[rgba_idx3 + 0], g3 = rgba_data[rgba_idx3 + 1], b3 = rgba_data[rgba_idx3 + 2];
-            
-            // Convert to Y (luma) using fast integer math
-            y_plane[y * width + x] = (77 * r0 + 150 * g0 + 29 * b0) >> 8;
-            y_plane[y * width + x + 1] = (77 * r1 + 150 * g1 + 29 * b1) >> 8;
-            y_plane[(y + 1) * width + x] = (77 * r2 + 150 * g2 + 29 * b2) >> 8;
-            y_plane[(y + 1) * width + x + 1] = (77 * r3 + 150 * g3 + 29 * b3) >> 8;
-            
-            // Average 2x2 block for U and V (chroma subsampling)
-            uint32_t avg_r = (r0 + r1 + r2 + r3) / 4;
-            uint32_t avg_g = (g0 + g1 + g2 + g3) / 4;
-            uint32_t avg_b = (b0 + b1 + b2 + b3) / 4;
-            
-            uint32_t uv_idx = (y / 2) * uv_width + (x / 2);
-            u_plane[uv_idx] = 128 + ((-43 * avg_r - 84 * avg_g + 127 * avg_b) >> 8);
-            v_plane[uv_idx] = 128 + ((127 * avg_r - 106 * avg_g - 21 * avg_b) >> 8);
+    
+#ifdef HAVE_X264
+    // Hand one encoded frame (described by pic_out) to the MP4 muxer, or append its NAL units to the .h264 stream
+    bool write_encoded_frame(x264_nal_t* nal, int i_nal, int frame_size) {
+        if (replay) {
+            if (frame_size > 0) {
+                int64_t ticks = timer.get_timebase_num();
+                replay->push_video(std::vector<uint8_t>(nal[0].p_payload, nal[0].p_payload + frame_size),
+                                   pic_out.i_dts * ticks, pic_out.i_pts * ticks, pic_out.b_keyframe != 0);
+            }
+            return true;
         }
+        if (muxer) {
+            // x264 lays a frame's NAL units out back to back, so together they are one length-prefixed sample
+            int64_t ticks = timer.get_timebase_num();
+            return frame_size <= 0 || muxer->write_sample(mp4_track, nal[0].p_payload, static_cast<size_t>(frame_size),
+                                                          pic_out.i_dts * ticks, pic_out.i_pts * ticks, pic_out.b_keyframe != 0);
+        }
+        
+        for (int i = 0; i < i_nal; i++) {
+            size_t written = fwrite(nal[i].p_payload, 1, nal[i].i_payload, output_file);
+            if (written != static_cast<size_t>(nal[i].i_payload)) {
+                return false;
+            }
+        }
+        return true;
     }
-}
+#endif
+};
 
 // Raw frame capture - super fast, no encoding during recording
-static bool capture_frame_raw(X264EncoderContext* ctx, const uint8_t* rgba_data) {
+// timestamp (microseconds since recording start) is kept by the compressed container only
+static bool capture_frame_raw(X264EncoderContext* ctx, const uint8_t* rgba_data, int64_t timestamp) {
     if (!ctx || !rgba_data) {
         return false;
     }
     
-    // Write raw RGBA data directly to file (fastest possible)
-    size_t frame_size = ctx->width * ctx->height * 4; // RGBA = 4 bytes per pixel
-    size_t written = fwrite(rgba_data, 1, frame_size, ctx->output_file);
-    
-    if (written != frame_size) {
-        std::cerr << "[NiceShot] Failed to write raw frame data" << std::endl;
-        return false;
+    if (ctx->raw_writer) {
+        // Lossless QOI-style compression cuts disk bandwidth several-fold on typical game frames
+        if (!ctx->raw_writer->write_frame(rgba_data, timestamp)) {
+            std::cerr << "[NiceShot] Failed to write raw frame data" << std::endl;
+            return false;
+        }
+    } else {
+        // Write raw RGBA data directly to file (fastest possible)
+        size_t frame_size = ctx->width * ctx->height * 4; // RGBA = 4 bytes per pixel
+        size_t written = fwrite(rgba_data, 1, frame_size, ctx->output_file);
+        
+        if (written != frame_size) {
+            std::cerr << "[NiceShot] Failed to write raw frame data" << std::endl;
+            return false;
+        }
     }
     
     ctx->frame_count++;
@@ -407,14 +1489,129 @@ static bool capture_frame_raw(X264EncoderContext* ctx, const uint8_t* rgba_data)
     return true;
 }
 
+// Frame delta records - identical frames become a repeat marker, partial changes a tile list
+// timestamps holds one capture time per repeated frame
+static bool capture_repeat_raw(X264EncoderContext* ctx, uint64_t count, const int64_t* timestamps) {
+    if (!ctx || !ctx->raw_writer) {
+        return false;
+    }
+    
+    while (count > 0) {
+        uint32_t chunk = static_cast<uint32_t>(std::min<uint64_t>(count, UINT32_MAX));
+        if (!ctx->raw_writer->write_repeat(chunk, timestamps)) {
+            std::cerr << "[NiceShot] Failed to write repeat marker" << std::endl;
+            return false;
+        }
+        ctx->frame_count += chunk;
+        count -= chunk;
+        if (timestamps) {
+            timestamps += chunk;
+        }
+    }
+    
+    return true;
+}
+
+static bool capture_tiles_raw(X264EncoderContext* ctx, const VideoFrame* frame, int64_t timestamp) {
+    if (!ctx || !ctx->raw_writer || !frame) {
+        return false;
+    }
+    
+    if (!ctx->raw_writer->write_tiles(frame->tiles.data(), frame->tiles.size(), frame->pixel_data.data(), frame->payload_size,
+                                      timestamp)) {
+        std::cerr << "[NiceShot] Failed to write delta tiles" << std::endl;
+        return false;
+    }
+    
+    ctx->frame_count++;
+    return true;
+}
+
+#ifdef HAVE_X264
+// Encode whatever pic_in currently holds at pts and write its NAL units
+static bool encode_live_picture(X264EncoderContext* ctx, int64_t pts) {
+    ctx->pic_in.i_pts = pts;
+    
+    x264_nal_t* nal;
+    int i_nal;
+    int encoded_size = x264_encoder_encode(ctx->encoder, &nal, &i_nal, &ctx->pic_in, &ctx->pic_out);
+    if (encoded_size < 0) {
+        std::cerr << "[NiceShot] x264 failed to encode frame " << ctx->frame_count << std::endl;
+        return false;
+    }
+    
+    if (!ctx->write_encoded_frame(nal, i_nal, encoded_size)) {
+        std::cerr << "[NiceShot] Failed to write encoded frame" << std::endl;
+        return false;
+    }
+    
+    if (!ctx->timecodes_path.empty()) {
+        ctx->timecodes.push_back(ctx->timer.to_milliseconds(pts));
+    }
+    
+    ctx->frame_count++;
+    
+    // Periodic flush for safety
+    if (ctx->frame_count % 120 == 0) {
+        if (ctx->output_file) {
+            fflush(ctx->output_file);
+        }
+        std::cout << "[NiceShot] Encoded " << ctx->frame_count << " live H.264 frames" << std::endl;
+    }
+    
+    return true;
+}
+
+// Live H.264 encode - converts and compresses on the encoding thread, ~100x less disk I/O than raw
+// timestamp is the capture time in microseconds since recording start
+static bool encode_frame_live(X264EncoderContext* ctx, const uint8_t* rgba_data, int64_t timestamp) {
+    if (!ctx || !rgba_data || !ctx->x264_available) {
+        return false;
+    }
+    
+    FramePlan plan = ctx->timer.plan(timestamp, false);
+    
+    // CFR: a hitch left output slots empty, so the picture still in pic_in (the previous frame) fills them
+    for (uint64_t r = 0; r < plan.repeat_previous; ++r) {
+        if (!encode_live_picture(ctx, plan.repeat_pts + static_cast<int64_t>(r))) {
+            return false;
+        }
+    }
+    
+    // Converted even when dropped, so the next gap repeats the latest picture
+    // Single-threaded SIMD conversion: x264 already has its threads and the game needs the rest
+    YuvPlanes planes = {
+        ctx->pic_in.img.plane[0], ctx->pic_in.img.plane[1], ctx->pic_in.img.plane[2],
+        ctx->pic_in.img.i_stride[0], ctx->pic_in.img.i_stride[1], ctx->pic_in.img.i_stride[2]
+    };
+    convert_rgba_to_yuv420p(rgba_data, ctx->width, ctx->height, planes);
+    
+    return !plan.emit || encode_live_picture(ctx, plan.pts);
+}
+#endif
+
 // Offline H.264 encoder - high quality, takes time but no frame drops
-static void encode_raw_to_h264_offline(const std::string& raw_filepath, const std::string& h264_filepath, 
-                                      uint32_t width, uint32_t height, double fps, uint64_t frame_count) {
+// timing applies when the raw file carries timestamps; otherwise frames are placed by index
+// container selects an MP4 (regular or fragmented) or a bare .h264 stream at output_filepath
+static void encode_raw_to_h264_offline(const std::string& raw_filepath, const std::string& output_filepath, 
+                                      uint32_t width, uint32_t height, double fps, uint64_t frame_count,
+                                      VideoTiming timing = VideoTiming::CFR,
+                                      VideoContainer container = VideoContainer::MP4) {
     std::cout << "[NiceShot] Offline encoder starting..." << std::endl;
     std::cout << "[NiceShot] Processing " << frame_count << " frames from " << raw_filepath << std::endl;
     
     try {
 #ifdef HAVE_X264
+        // Open raw file for reading (compressed container or legacy headerless RGBA)
+        RawFrameReader raw_reader;
+        if (!raw_reader.open(raw_filepath, width, height)) {
+            std::cerr << "[NiceShot] Failed to open raw file: " << raw_filepath << std::endl;
+            return;
+        }
+        
+        FrameTimer timer(raw_reader.has_timestamps() ? timing : VideoTiming::FRAME_COUNT, fps,
+                         raw_reader.get_timebase_num(), raw_reader.get_timebase_den());
+        
         // Create high-quality x264 encoder (not real-time optimized)
         x264_param_t param;
         x264_param_default_preset(&param, "slow", "film"); // High quality preset
@@ -423,6 +1620,11 @@ static void encode_raw_to_h264_offline(const std::string& raw_filepath, const st
         param.i_height = height;
         param.i_fps_num = static_cast<int>(fps * 1000);
         param.i_fps_den = 1000;
+        if (timer.get_timing() == VideoTiming::VFR) {
+            param.b_vfr_input = 1;
+            param.i_timebase_num = timer.get_timebase_num();
+            param.i_timebase_den = timer.get_timebase_den();
+        }
         param.i_keyint_max = static_cast<int>(fps) * 10; // Keyframe every 10 seconds
         param.b_intra_refresh = 0;
         param.rc.i_rc_method = X264_RC_CRF;
@@ -438,6 +1640,10 @@ static void encode_raw_to_h264_offline(const std::string& raw_filepath, const st
         param.i_bframe_adaptive = X264_B_ADAPT_TRELLIS;
         param.analyse.i_me_method = X264_ME_TESA; // Best motion estimation
         param.analyse.i_subpel_refine = 11; // Maximum subpixel refinement
+        if (container != VideoContainer::H264) {
+            param.b_annexb = 0; // Length-prefixed NAL units; SPS/PPS go into the MP4 track header
+            param.b_repeat_headers = 0;
+        }
         
         x264_param_apply_profile(&param, "high");
         
@@ -447,91 +1653,146 @@ static void encode_raw_to_h264_offline(const std::string& raw_filepath, const st
             return;
         }
         
-        // Open raw file for reading
-        FILE* raw_file = nullptr;
+        // Open the output file for writing
+        FILE* output_file = nullptr;
 #ifdef _WIN32
-        fopen_s(&raw_file, raw_filepath.c_str(), "rb");
+        fopen_s(&output_file, output_filepath.c_str(), "wb");
 #else
-        raw_file = fopen(raw_filepath.c_str(), "rb");
+        output_file = fopen(output_filepath.c_str(), "wb");
 #endif
         
-        if (!raw_file) {
-            std::cerr << "[NiceShot] Failed to open raw file: " << raw_filepath << std::endl;
+        if (!output_file) {
+            std::cerr << "[NiceShot] Failed to create output file: " << output_filepath << std::endl;
             x264_encoder_close(encoder);
             return;
         }
         
-        // Open H.264 file for writing
-        FILE* h264_file = nullptr;
-#ifdef _WIN32
-        fopen_s(&h264_file, h264_filepath.c_str(), "wb");
-#else
-        h264_file = fopen(h264_filepath.c_str(), "wb");
-#endif
+        std::unique_ptr<Mp4Muxer> muxer;
+        int mp4_track = -1;
+        if (container != VideoContainer::H264) {
+            muxer = std::make_unique<Mp4Muxer>(output_file, container == VideoContainer::FRAGMENTED_MP4);
+            x264_nal_t* headers;
+            int header_count;
+            int header_size = x264_encoder_headers(encoder, &headers, &header_count);
+            if (header_size > 0) {
+                mp4_track = muxer->add_h264_track(width, height, timer.get_timebase_den(),
+                                                  static_cast<uint32_t>(std::llround(timer.get_timebase_den() / fps)),
+                                                  headers[0].p_payload, static_cast<size_t>(header_size));
+            }
+            if (mp4_track < 0) {
+                std::cerr << "[NiceShot] x264 produced no usable SPS/PPS for the MP4 track" << std::endl;
+                x264_encoder_close(encoder);
+                fclose(output_file);
+                return;
+            }
+        }
         
-        if (!h264_file) {
-            std::cerr << "[NiceShot] Failed to create H.264 file: " << h264_filepath << std::endl;
-            fclose(raw_file);
-            x264_encoder_close(encoder);
-            return;
+        // Recycled x264 pictures shared by the converter and encoder stages
+        unsigned converter_threads = encode_pipeline_default_converters();
+        std::vector<x264_picture_t> pictures(converter_threads * 2 + 2);
+        std::vector<YuvPlanes> picture_planes;
+        for (x264_picture_t& picture : pictures) {
+            x264_picture_alloc(&picture, param.i_csp, param.i_width, param.i_height);
+            picture_planes.push_back({
+                picture.img.plane[0], picture.img.plane[1], picture.img.plane[2], // Y, U, V planes
+                picture.img.i_stride[0], picture.img.i_stride[1], picture.img.i_stride[2]
+            });
         }
+        x264_picture_t pic_out;
         
-        // Allocate x264 picture
-        x264_picture_t pic_in, pic_out;
-        x264_picture_alloc(&pic_in, param.i_csp, param.i_width, param.i_height);
-        
-        // Allocate RGBA frame buffer
-        size_t frame_size = width * height * 4;
-        std::vector<uint8_t> rgba_frame(frame_size);
+        std::vector<double> timecodes;
         
         std::cout << "[NiceShot] Encoding " << frame_count << " frames with high quality settings..." << std::endl;
+        std::cout << "[NiceShot] Colour conversion kernel: " << yuv_kernel_name(yuv_best_kernel()) 
+                  << " (" << converter_threads << " converter threads, " << pictures.size() << " pictures in flight)" << std::endl;
+        std::cout << "[NiceShot] Raw input: " << (raw_reader.is_container() ? "compressed container" : "headerless RGBA")
+                  << (raw_reader.is_mapped() ? ", memory-mapped" : ", buffered reads") << std::endl;
+        std::cout << "[NiceShot] Timing: " << video_timing_name(timer.get_timing()) << std::endl;
         
-        auto start_time = std::chrono::high_resolution_clock::now();
+        // Cleared by any failed encode or write; the raw file is only deleted when the output is complete
+        bool ok = true;
         
-        // Process each frame
-        for (uint64_t i = 0; i < frame_count; i++) {
-            // Read raw RGBA frame
-            size_t read_bytes = fread(rgba_frame.data(), 1, frame_size, raw_file);
-            if (read_bytes != frame_size) {
-                std::cerr << "[NiceShot] Failed to read frame " << i << std::endl;
-                break;
+        // One encoded frame (described by pic_out) into the MP4, or its NAL units onto the .h264 stream
+        auto write_output = [&](x264_nal_t* nal, int i_nal, int frame_size) {
+            if (muxer) {
+                // A frame's NAL units are contiguous, together one length-prefixed sample
+                int64_t ticks = timer.get_timebase_num();
+                ok = muxer->write_sample(mp4_track, nal[0].p_payload, static_cast<size_t>(frame_size), pic_out.i_dts * ticks,
+                                         pic_out.i_pts * ticks, pic_out.b_keyframe != 0) && ok;
+                return;
             }
+            for (int j = 0; j < i_nal; j++) {
+                ok = fwrite(nal[j].p_payload, 1, nal[j].i_payload, output_file) == static_cast<size_t>(nal[j].i_payload) && ok;
+            }
+        };
+        
+        // Encode one picture at pts and write its NAL units
+        auto encode_picture = [&](x264_picture_t& picture, int64_t pts) {
+            picture.i_pts = pts;
             
-            // Convert RGBA to YUV420p
-            convert_rgba_to_yuv420p_fast(rgba_frame.data(), width, height,
-                                        pic_in.img.plane[0], // Y plane
-                                        pic_in.img.plane[1], // U plane  
-                                        pic_in.img.plane[2]); // V plane
-            
-            pic_in.i_pts = i;
-            
-            // Encode frame with x264
             x264_nal_t* nal;
             int i_nal;
-            int encoded_size = x264_encoder_encode(encoder, &nal, &i_nal, &pic_in, &pic_out);
+            int encoded_size = x264_encoder_encode(encoder, &nal, &i_nal, &picture, &pic_out);
             
             if (encoded_size < 0) {
-                std::cerr << "[NiceShot] Encoding failed for frame " << i << std::endl;
-                continue;
+                std::cerr << "[NiceShot] Encoding failed at pts " << pts << std::endl;
+                ok = false;
+                return;
             }
             
             if (encoded_size > 0) {
-                // Write NAL units to H.264 file
-                for (int j = 0; j < i_nal; j++) {
-                    fwrite(nal[j].p_payload, 1, nal[j].i_payload, h264_file);
-                }
+                write_output(nal, i_nal, encoded_size);
             }
             
-            // Progress update every 60 frames
-            if (i % 60 == 0) {
-                auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
-                auto elapsed_seconds = std::chrono::duration<double>(elapsed).count();
-                double progress = (double)i / frame_count * 100.0;
-                double fps_encoding = i / elapsed_seconds;
-                
-                std::cout << "[NiceShot] Progress: " << progress << "% (" << i << "/" << frame_count 
-                          << " frames, " << fps_encoding << " fps encoding)" << std::endl;
+            if (timer.get_timing() == VideoTiming::VFR && !muxer) {
+                timecodes.push_back(timer.to_milliseconds(pts));
             }
+        };
+        
+        auto start_time = std::chrono::high_resolution_clock::now();
+        
+        // Reader, converters and x264 overlap; this thread only feeds x264 and writes NALs
+        EncodePipelineStats pipeline_stats;
+        size_t last_slot = SIZE_MAX; // Holds the last frame's picture once the pipeline is done
+        run_encode_pipeline(raw_reader, width, height, frame_count, picture_planes, converter_threads,
+            [&](size_t slot, const EncodePipelineFrame& frame) {
+                uint64_t i = frame.index;
+                FramePlan plan = timer.plan(frame.timestamp, frame.repeat);
+                last_slot = slot;
+                
+                // CFR gap: repeat the previous picture, still in its pipeline slot, into the empty slots
+                if (frame.previous_slot != SIZE_MAX) {
+                    for (uint64_t r = 0; r < plan.repeat_previous; ++r) {
+                        encode_picture(pictures[frame.previous_slot], plan.repeat_pts + static_cast<int64_t>(r));
+                    }
+                }
+                
+                if (plan.emit) {
+                    encode_picture(pictures[slot], plan.pts);
+                }
+                
+                // Progress update every 60 frames
+                if (i % 60 == 0) {
+                    auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
+                    auto elapsed_seconds = std::chrono::duration<double>(elapsed).count();
+                    double progress = (double)i / frame_count * 100.0;
+                    double fps_encoding = i / elapsed_seconds;
+                    
+                    std::cout << "[NiceShot] Progress: " << progress << "% (" << i << "/" << frame_count 
+                              << " frames, " << fps_encoding << " fps encoding)" << std::endl;
+                }
+                return true;
+            },
+            pipeline_stats);
+        
+        if (pipeline_stats.frames < frame_count) {
+            std::cerr << "[NiceShot] Raw file ended after " << pipeline_stats.frames << " of " << frame_count << " frames" << std::endl;
+        }
+        
+        // VFR: a recording ending on unchanged frames lasts until the last of them, not just past the last change
+        FramePlan tail = timer.finish();
+        if (tail.emit && last_slot != SIZE_MAX) {
+            encode_picture(pictures[last_slot], tail.pts);
         }
         
         // Flush delayed frames
@@ -543,29 +1804,67 @@ static void encode_raw_to_h264_offline(const std::string& raw_filepath, const st
             int frame_size = x264_encoder_encode(encoder, &nal, &i_nal, nullptr, &pic_out);
             if (frame_size <= 0) break;
             
-            for (int i = 0; i < i_nal; i++) {
-                fwrite(nal[i].p_payload, 1, nal[i].i_payload, h264_file);
-            }
+            write_output(nal, i_nal, frame_size);
             flushed++;
         }
         
+        if (muxer && !muxer->finish()) {
+            std::cerr << "[NiceShot] Failed to finalize MP4 file: " << output_filepath << std::endl;
+            ok = false;
+        }
+        if (fclose(output_file) != 0) {
+            std::cerr << "[NiceShot] Failed to close output file: " << output_filepath << std::endl;
+            ok = false;
+        }
+        
         auto total_time = std::chrono::high_resolution_clock::now() - start_time;
         auto total_seconds = std::chrono::duration<double>(total_time).count();
         
-        std::cout << "[NiceShot] Offline encoding complete!" << std::endl;
+        if (ok) {
+            std::cout << "[NiceShot] Offline encoding complete!" << std::endl;
+        } else {
+            std::cerr << "[NiceShot] Offline encoding failed, " << output_filepath << " is incomplete" << std::endl;
+        }
         std::cout << "[NiceShot] Processed " << frame_count << " frames in " << total_seconds << " seconds" << std::endl;
-        std::cout << "[NiceShot] Output: " << h264_filepath << " (high quality H.264)" << std::endl;
+        std::cout << "[NiceShot] Output: " << output_filepath << " (high quality H.264, "
+                  << video_container_name(container) << ")" << std::endl;
         std::cout << "[NiceShot] Flushed " << flushed << " delayed frames" << std::endl;
         
+        // Per-stage utilisation over the pipelined section; the encoder stage should sit near 100%
+        double wall = pipeline_stats.wall_seconds > 0 ? pipeline_stats.wall_seconds : 1.0;
+        std::cout << "[NiceShot] Stage utilisation: read " << (100.0 * pipeline_stats.read_busy_seconds / wall)
+                  << "%, convert " << (100.0 * pipeline_stats.convert_busy_seconds / (wall * pipeline_stats.converter_threads))
+                  << "% (x" << pipeline_stats.converter_threads
+                  << (pipeline_stats.band_threads > 1 ? " in " + std::to_string(pipeline_stats.band_threads) + " bands" : "")
+                  << "), encode " 
+                  << (100.0 * pipeline_stats.encode_busy_seconds / wall) << "%" << std::endl;
+        
+        if (timer.get_timing() == VideoTiming::CFR) {
+            std::cout << "[NiceShot] Constant frame rate: " << timer.get_duplicated() << " frames duplicated, "
+                      << timer.get_dropped() << " dropped" << std::endl;
+        }
+        
         // Cleanup
-        x264_picture_clean(&pic_in);
+        for (x264_picture_t& picture : pictures) {
+            x264_picture_clean(&picture);
+        }
         x264_encoder_close(encoder);
-        fclose(raw_file);
-        fclose(h264_file);
+        raw_reader.close();
+        
+        if (ok && !timecodes.empty()) {
+            std::string timecodes_path = path_with_extension(output_filepath, "_timecodes.txt");
+            if (write_timecodes_v2(timecodes_path, timecodes)) {
+                std::cout << "[NiceShot] Timecodes written: " << timecodes_path << std::endl;
+            }
+        }
         
-        // Delete raw file to save space
-        std::remove(raw_filepath.c_str());
-        std::cout << "[NiceShot] Deleted raw file to save space" << std::endl;
+        // Delete raw file to save space, unless it is still the only complete copy
+        if (ok) {
+            std::remove(raw_filepath.c_str());
+            std::cout << "[NiceShot] Deleted raw file to save space" << std::endl;
+        } else {
+            std::cerr << "[NiceShot] Kept raw file for another attempt: " << raw_filepath << std::endl;
+        }
         
 #else
         std::cout << "[NiceShot] x264 not available for offline encoding" << std::endl;
@@ -576,6 +1875,34 @@ static void encode_raw_to_h264_offline(const std::string& raw_filepath, const st
     }
 }
 
+// Instant replay without x264 - each frame is QOI-compressed into the replay buffer
+// timestamp counts microseconds from the first frame
+static bool capture_frame_replay(X264EncoderContext* ctx, const uint8_t* rgba_data, int64_t timestamp) {
+    if (!ctx || !ctx->replay || !rgba_data) {
+        return false;
+    }
+    
+    size_t size = qoi_encode_rgba(rgba_data, ctx->width, ctx->height, ctx->replay_scratch.data());
+    ctx->replay->push_video(std::vector<uint8_t>(ctx->replay_scratch.data(), ctx->replay_scratch.data() + size),
+                            timestamp, timestamp, true);
+    ctx->frame_count++;
+    return true;
+}
+
+// Hand the audio packets that start before up_to to the MP4 track or the replay buffer
+static void store_audio_packets(AudioCapture* audio, Mp4Muxer* muxer, int audio_track, ReplayBuffer* replay, int64_t up_to) {
+    AudioPacket packet;
+    while (audio->pop_packet(up_to, packet)) {
+        if (muxer && audio_track >= 0) {
+            if (!muxer->write_sample(audio_track, packet.data.data(), packet.data.size(), packet.pts, packet.pts, true)) {
+                std::cerr << "[NiceShot] Failed to write audio packet" << std::endl;
+            }
+        } else if (replay) {
+            replay->push_audio(std::move(packet.data), packet.pts);
+        }
+    }
+}
+
 // Video encoding thread main function with x264 H.264 implementation
 static void video_encoding_thread_main(VideoRecordingSession* session) {
     if (!session) {
@@ -588,22 +1915,71 @@ static void video_encoding_thread_main(VideoRecordingSession* session) {
     // Create x264 encoder context
     std::unique_ptr<X264EncoderContext> encoder_ctx;
     try {
-        // Change extension to .raw for raw RGBA frames
-        std::string raw_filepath = session->output_filepath;
-        size_t ext_pos = raw_filepath.find_last_of('.');
-        if (ext_pos != std::string::npos) {
-            raw_filepath = raw_filepath.substr(0, ext_pos) + ".raw";
-        } else {
-            raw_filepath += ".raw";
+        if (session->mode == RecordingMode::LIVE_H264) {
+            // Live mode writes the compressed stream straight to the final .mp4 (or a bare .h264 stream)
+            std::string live_path = path_with_extension(session->output_filepath,
+                                                        session->container == VideoContainer::H264 ? ".h264" : ".mp4");
+            encoder_ctx = std::make_unique<X264EncoderContext>(
+                live_path,
+                session->width, 
+                session->height, 
+                session->fps,
+                g_video_preset.load(),
+                session->bitrate_kbps,
+                true,
+                false,
+                session->timing,
+                session->container
+            );
+            
+            if (!encoder_ctx->x264_available) {
+                std::cerr << "[NiceShot] Live H.264 unavailable, falling back to raw capture" << std::endl;
+                encoder_ctx.reset();
+                std::remove(live_path.c_str()); // Empty stream
+                session->mode = RecordingMode::RAW;
+            }
         }
         
-        encoder_ctx = std::make_unique<X264EncoderContext>(
-            raw_filepath, 
-            session->width, 
-            session->height, 
-            session->fps,
-            g_video_preset.load()
-        );
+        if (session->mode == RecordingMode::REPLAY) {
+            // Nothing touches the disk until a clip is saved; without x264 the buffer keeps QOI frames instead
+            encoder_ctx = std::make_unique<X264EncoderContext>(
+                session->output_filepath,
+                session->width,
+                session->height,
+                session->fps,
+                g_video_preset.load(),
+                session->bitrate_kbps,
+                true,
+                false,
+                session->timing,
+                VideoContainer::MP4,
+                session->replay.get()
+            );
+            
+            if (!encoder_ctx->x264_available) {
+                std::cerr << "[NiceShot] Live H.264 unavailable, instant replay keeps lossless QOI frames" << std::endl;
+                encoder_ctx->replay_scratch.resize(qoi_max_encoded_size(session->width, session->height));
+                session->replay->set_video(ReplayFormat::QOI, session->width, session->height, CAPTURE_TIMEBASE_DEN,
+                                           static_cast<uint32_t>(std::llround(CAPTURE_TIMEBASE_DEN / session->fps)), nullptr, 0);
+                if (session->audio) {
+                    session->audio->codec = AudioCodec::PCM; // The saved clip carries its audio as a WAV
+                }
+            }
+        }
+        
+        if (!encoder_ctx) {
+            // Change extension to .raw for raw RGBA frames
+            encoder_ctx = std::make_unique<X264EncoderContext>(
+                path_with_extension(session->output_filepath, ".raw"),
+                session->width, 
+                session->height, 
+                session->fps,
+                g_video_preset.load(),
+                session->bitrate_kbps,
+                false,
+                session->raw_compression
+            );
+        }
     }
     catch (const std::exception& e) {
         std::cerr << "[NiceShot] Failed to create H.264 encoder: " << e.what() << std::endl;
@@ -611,38 +1987,78 @@ static void video_encoding_thread_main(VideoRecordingSession* session) {
         return;
     }
     
-    while (!session->stop_encoding.load()) {
-        std::unique_ptr<VideoFrame> frame = nullptr;
+    // Audio starts with the first frame, which is where both tracks begin
+    Mp4Muxer* muxer = encoder_ctx->muxer.get();
+    ReplayBuffer* replay = session->replay.get();
+    bool audio_started = false;
+    int audio_track = -1;
+    int64_t first_timestamp = 0;
+    
+    while (true) {
+        // Get next frame from the lock-free ring
+        VideoFrame* frame = session->frame_buffer.begin_read();
         
-        // Get next frame from buffer (EFFICIENT RING BUFFER)
-        {
-            std::unique_lock<std::mutex> lock(session->buffer_mutex);
-            
-            // Wait for frame or stop signal
-            session->buffer_condition.wait(lock, [session] {
-                return !session->frame_buffer.empty() || session->stop_encoding.load();
-            });
-            
-            if (session->stop_encoding.load() && session->frame_buffer.empty()) {
-                break; // Exit thread
-            }
-            
-            if (!session->frame_buffer.empty()) {
-                frame = std::move(session->frame_buffer.front());
-                session->frame_buffer.pop_front();
-                
-                // Update memory tracking
-                session->current_buffer_memory.fetch_sub(frame->get_memory_size());
+        if (!frame) {
+            // The stop flag is set after the last frame is published, so one more look drains it
+            if (session->stop_encoding.load()) {
+                frame = session->frame_buffer.begin_read();
+                if (!frame) {
+                    break; // Exit thread
+                }
+            } else {
+                // Idle poll instead of a per-frame condition variable wakeup
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
             }
         }
         
-        // Process frame outside the lock (SUPER FAST RAW CAPTURE)
-        if (frame && encoder_ctx) {
-            bool success = capture_frame_raw(encoder_ctx.get(), frame->pixel_data.data());
+        // Process frame in place (live H.264 or SUPER FAST RAW CAPTURE)
+        if (encoder_ctx) {
+            // Identical frames skipped by the game thread are written ahead of this one
+            if (frame->repeats_before > 0 &&
+                capture_repeat_raw(encoder_ctx.get(), frame->repeats_before, frame->repeat_times.data())) {
+                session->frames_encoded += frame->repeats_before;
+            }
+            
+            int64_t timestamp = session->capture_time(frame->timestamp);
+            if (session->audio && !audio_started) {
+                audio_started = true;
+                first_timestamp = timestamp;
+                if (!session->audio->start(timestamp, muxer || replay,
+                                           path_with_extension(session->output_filepath, "_audio.wav"))) {
+                    std::cerr << "[NiceShot] Recording continues without audio" << std::endl;
+                } else if (muxer) {
+                    audio_track = session->audio->encoder.add_track(*muxer);
+                } else if (replay) {
+                    replay->set_audio(&session->audio->encoder);
+                }
+            }
+#ifdef HAVE_X264
+            bool success = replay && !encoder_ctx->x264_available
+                ? capture_frame_replay(encoder_ctx.get(), frame->pixel_data.data(), timestamp - first_timestamp)
+                : session->mode != RecordingMode::RAW
+                ? encode_frame_live(encoder_ctx.get(), frame->pixel_data.data(), timestamp)
+                : frame->kind == VideoFrameKind::TILES
+                ? capture_tiles_raw(encoder_ctx.get(), frame, timestamp)
+                : capture_frame_raw(encoder_ctx.get(), frame->pixel_data.data(), timestamp);
+#else
+            bool success = replay
+                ? capture_frame_replay(encoder_ctx.get(), frame->pixel_data.data(), timestamp - first_timestamp)
+                : frame->kind == VideoFrameKind::TILES
+                ? capture_tiles_raw(encoder_ctx.get(), frame, timestamp)
+                : capture_frame_raw(encoder_ctx.get(), frame->pixel_data.data(), timestamp);
+#endif
             
             if (success) {
                 session->frames_encoded++;
                 
+                // Interleave the audio encoded so far, up to this frame's time
+                if (audio_started && session->audio->encoded) {
+                    int64_t elapsed_us = timestamp - first_timestamp;
+                    store_audio_packets(session->audio.get(), muxer, audio_track, replay,
+                                        elapsed_us * session->audio->encoder.get_timescale() / CAPTURE_TIMEBASE_DEN);
+                }
+                
                 // Progress logging every 60 frames
                 if (session->frames_encoded % 60 == 0) {
                     double elapsed = std::chrono::duration<double>(
@@ -658,75 +2074,175 @@ static void video_encoding_thread_main(VideoRecordingSession* session) {
                 // Continue with next frame rather than stopping
             }
         }
+        
+        // Release the slot back to the game thread
+        session->current_buffer_memory.fetch_sub(frame->get_memory_size());
+        session->frame_buffer.commit_read();
+    }
+    
+    // Identical frames submitted after the last stored one
+    uint64_t trailing_repeats = session->pending_repeats.exchange(0);
+    if (encoder_ctx && trailing_repeats > 0 &&
+        capture_repeat_raw(encoder_ctx.get(), trailing_repeats, session->pending_repeat_times.data())) {
+        session->frames_encoded += trailing_repeats;
+    }
+    
+    // The rest of the audio goes in before the video's delayed frames are flushed and the MP4 is finalized
+    if (session->audio) {
+        session->audio->finish();
+        if (!audio_started) {
+            std::cerr << "[NiceShot] No video frames were recorded, audio discarded" << std::endl;
+        } else if (session->audio->encoded) {
+            store_audio_packets(session->audio.get(), muxer, audio_track, replay, INT64_MAX);
+        }
+        if (session->audio->started) {
+            std::cout << "[NiceShot] Audio: " << session->audio->samples_written.load() << " samples written, "
+                      << session->audio->blocks_rejected.load() << " blocks rejected" << std::endl;
+        }
     }
     
     std::cout << "[NiceShot] Video encoding thread finished. Encoded " 
               << session->frames_encoded << " frames" << std::endl;
 }
 
+// PNG encoding with an explicit deflate backend (the benchmark compares them side by side).
+// Rows go through NiceShot's filter stage and straight into deflate; libpng is not involved.
+static bool encode_png_with_backend(const uint8_t* pixels, uint32_t width, uint32_t height, DeflateBackend backend,
+                                    const std::string& filepath, std::string& error_message) {
+    // Large images: filter and deflate row stripes on the other workers instead of one serial pass
+    unsigned stripes = 1;
+    if (g_parallel_png.load() && static_cast<uint64_t>(width) * height >= PARALLEL_PNG_MIN_PIXELS) {
+        stripes = png_stripe_count(height, static_cast<unsigned>(std::max<size_t>(1, g_thread_count.load())));
+    }
+    
+    return write_png_striped(pixels, width, height, g_compression_level.load(), backend,
+                             static_cast<PngFilterStrategy>(g_png_filter.load()), stripes,
+                             run_on_png_workers, filepath, error_message);
+}
+
 // PNG encoding function extracted from niceshot_save_png
 static bool encode_png_to_file(const uint8_t* pixels, uint32_t width, uint32_t height, const std::string& filepath, std::string& error_message) {
-    // Open file for writing
-    FILE* fp = nullptr;
-#ifdef _WIN32
-    fopen_s(&fp, filepath.c_str(), "wb");
-#else
-    fp = fopen(filepath.c_str(), "wb");
-#endif
-    
-    if (!fp) {
-        error_message = "Failed to open file for writing: " + filepath;
+    return encode_png_with_backend(pixels, width, height, static_cast<DeflateBackend>(g_png_backend.load()),
+                                   filepath, error_message);
+}
+
+// Screenshot in any supported format: PNG through the PNG writer, QOI/TGA/BMP without deflate,
+// JPEG/WebP lossy at the given quality
+static bool encode_image_to_file(const uint8_t* pixels, uint32_t width, uint32_t height, ImageFormat format,
+                                 int quality, const std::string& filepath, std::string& error_message) {
+    if (format == ImageFormat::PNG) {
+        return encode_png_to_file(pixels, width, height, filepath, error_message);
+    }
+    return write_image_file(format, pixels, width, height, filepath, error_message, quality);
+}
+
+// Transcode a QOI/TGA/BMP capture to PNG with the current PNG settings
+static bool convert_image_to_png(const std::string& source_path, const std::string& png_path, bool delete_source,
+                                 std::string& error_message) {
+    std::vector<uint8_t> rgba;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    ImageFormat source_format;
+    if (!read_image_file(source_path, rgba, width, height, source_format, error_message)) {
         return false;
     }
-    
-    // Initialize PNG structures
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) {
-        error_message = "Failed to create PNG write structure";
-        fclose(fp);
+    if (!encode_png_to_file(rgba.data(), width, height, png_path, error_message)) {
         return false;
     }
-    
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        error_message = "Failed to create PNG info structure";
-        png_destroy_write_struct(&png_ptr, nullptr);
-        fclose(fp);
+    if (delete_source && std::remove(source_path.c_str()) != 0) {
+        std::cerr << "[NiceShot] Converted but could not delete: " << source_path << std::endl;
+    }
+    return true;
+}
+
+// Parse the format from a filepath extension for the image save APIs
+static bool image_format_for_save(const char* filepath, ImageFormat& format) {
+    if (!image_format_from_path(filepath, format)) {
+        std::cerr << "[NiceShot] Unsupported image extension (use .png, .qoi, .tga, .bmp, .jpg or .webp): " << filepath << std::endl;
         return false;
     }
-    
-    // Error handling with setjmp/longjmp
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        error_message = "PNG encoding error occurred";
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
+    if (!image_format_available(format)) {
+        std::cerr << "[NiceShot] " << image_format_name(format) << " support is not built into this NiceShot build" << std::endl;
         return false;
     }
+    return true;
+}
+
+// Queue an async save job; shared by the PNG and multi-format async APIs
+static double queue_image_job(const char* buffer_ptr_str, double width, double height, const char* filepath,
+                              ImageFormat format, bool borrowed) {
+    // Parse buffer pointer from string
+    uintptr_t buffer_addr = 0;
+    if (sscanf(buffer_ptr_str, "%llx", &buffer_addr) != 1 || buffer_addr == 0) {
+        std::cerr << "[NiceShot] Invalid buffer pointer string for async save: " << buffer_ptr_str << std::endl;
+        return 0.0;
+    }
     
-    // Set up PNG file writing
-    png_init_io(png_ptr, fp);
-    
-    // Set PNG header information
-    png_set_IHDR(png_ptr, info_ptr, 
-                 width, height,
-                 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    
-    png_set_compression_level(png_ptr, g_compression_level.load());
-    png_write_info(png_ptr, info_ptr);
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(buffer_addr);
+    uint32_t img_width = static_cast<uint32_t>(width);
+    uint32_t img_height = static_cast<uint32_t>(height);
     
-    // Write image data row by row
-    uint32_t stride = width * 4;
-    for (uint32_t y = 0; y < height; ++y) {
-        png_bytep row = const_cast<png_bytep>(pixels + (y * stride));
-        png_write_row(png_ptr, row);
+    // A borrowed buffer belongs to the caller, so only copies count against the byte budget
+    size_t bytes = borrowed ? 0 : static_cast<size_t>(img_width) * img_height * 4;
+    if (!admit_job(bytes, static_cast<JobPriority>(g_job_priority.load()))) {
+        return 0.0;
     }
     
-    png_write_end(png_ptr, nullptr);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    fclose(fp);
+    bool adopted = false;
+    try {
+        // Copies the buffer unless borrowed (the caller then keeps it alive until released)
+        auto job = std::make_shared<PngJob>(pixels, img_width, img_height, std::string(filepath), borrowed, format,
+                                            g_image_quality.load());
+        job->adopt_admission(bytes);
+        adopted = true;
+        job->thumbnails = take_pending_thumbnails();
+        job->thumbnail_filter = static_cast<ScaleFilter>(g_thumbnail_filter.load());
+        
+        uint32_t job_id = submit_job(job);
+        if (job_id == 0) {
+            return 0.0;
+        }
+        
+        std::cout << "[NiceShot] Queued " << (borrowed ? "borrowed " : "") << "async " << image_format_name(format)
+                  << " job " << job_id << ": " << filepath << " (" << img_width << "x" << img_height << ", "
+                  << job_priority_name(job->priority) << " priority";
+        if (!job->thumbnails.empty()) {
+            std::cout << ", " << job->thumbnails.size() << " thumbnail" << (job->thumbnails.size() > 1 ? "s" : "");
+        }
+        std::cout << ")" << std::endl;
+        
+        return static_cast<double>(job_id);
+    }
+    catch (const std::exception& e) {
+        if (!adopted) {
+            cancel_admission(bytes);
+        }
+        std::cerr << "[NiceShot] Failed to queue async " << image_format_name(format) << " job: " << e.what() << std::endl;
+        return 0.0;
+    }
+}
+
+// Queue a QOI/TGA/BMP -> PNG conversion job; returns its job id (0 on failure)
+static double queue_conversion_job(const std::string& source_path, const std::string& png_path, bool delete_source) {
+    // Reads its pixels on the worker, so it only counts against the depth limit
+    if (!admit_job(0, static_cast<JobPriority>(g_job_priority.load()))) {
+        return 0.0;
+    }
     
-    return true;
+    bool adopted = false;
+    try {
+        auto job = std::make_shared<PngJob>(source_path, png_path, delete_source);
+        job->adopt_admission(0);
+        adopted = true;
+        return static_cast<double>(submit_job(job));
+    }
+    catch (const std::exception& e) {
+        if (!adopted) {
+            cancel_admission(0);
+        }
+        std::cerr << "[NiceShot] Failed to queue conversion job: " << e.what() << std::endl;
+        return 0.0;
+    }
 }
 
 // GameMaker interface implementation
@@ -761,17 +2277,10 @@ double niceshot_init() {
             g_thread_count = thread_count;
         }
         
-        // Reset shutdown flag and start worker threads
-        g_shutdown_requested = false;
+        // Start the work-stealing worker pool
+        g_job_pool.start(static_cast<unsigned>(thread_count));
         g_worker_thread_running = true;
         
-        g_worker_threads.clear();
-        g_worker_threads.reserve(thread_count);
-        
-        for (size_t i = 0; i < thread_count; ++i) {
-            g_worker_threads.emplace_back(worker_thread_main);
-        }
-        
         g_initialized = true;
         std::cout << "[NiceShot] Extension initialized successfully with " << thread_count << " worker threads" << std::endl;
         std::cout << "[NiceShot] PNG compression level: " << g_compression_level.load() << std::endl;
@@ -793,30 +2302,28 @@ double niceshot_shutdown() {
     try {
         std::cout << "[NiceShot] Shutting down extension..." << std::endl;
         
-        // Signal worker threads to shutdown
-        g_shutdown_requested = true;
-        g_job_condition.notify_all(); // Wake up all worker threads
-        
-        // Wait for all worker threads to finish
-        for (auto& thread : g_worker_threads) {
-            if (thread.joinable()) {
-                thread.join();
-            }
-        }
-        g_worker_threads.clear();
+        // Workers finish their current job and exit; queued jobs are dropped
+        uint64_t steals = g_job_pool.get_steals();
+        g_job_pool.stop();
         g_worker_thread_running = false;
+        std::cout << "[NiceShot] Worker pool stopped (" << steals << " tasks stolen between workers)" << std::endl;
         
-        // Clear any remaining jobs
+        // The dropped jobs hand their queue bytes back as the last references go
         {
-            std::lock_guard<std::mutex> lock(g_job_mutex);
-            while (!g_job_queue.empty()) {
-                g_job_queue.pop();
-            }
-            g_active_jobs.clear();
+            std::lock_guard<std::mutex> lock(g_admission_mutex);
+            g_waiting_jobs.clear();
         }
+        notify_admission();
         
-        // Reset job ID counter
-        g_next_job_id = 1;
+        // Forget every job; ids handed out before shutdown now read as not found
+        g_job_table.clear();
+        g_completions.clear();
+        
+        // Free pooled pixel buffers
+        frame_buffer_pool().clear();
+        
+        // Stop the colour conversion threads
+        yuv_shutdown_conversion_threads();
         
         g_initialized = false;
         std::cout << "[NiceShot] Extension shutdown successfully" << std::endl;
@@ -941,6 +2448,9 @@ double niceshot_save_png(const char* buffer_ptr_str, double width, double height
         return 0.0;
     }
     
+    // Thumbnails added for this save go with it (or are dropped if it fails), never onto a later save
+    std::vector<ThumbnailVariant> thumbnails = take_pending_thumbnails();
+    
     if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath) {
         std::cerr << "[NiceShot] Invalid parameters for PNG save" << std::endl;
         return 0.0;
@@ -1011,6 +2521,14 @@ double niceshot_save_png(const char* buffer_ptr_str, double width, double height
         return 0.0;
     }
     
+    std::string thumbnail_error;
+    bool thumbnails_written = write_thumbnails(pixels, img_width, img_height, thumbnails,
+                                               static_cast<ScaleFilter>(g_thumbnail_filter.load()),
+                                               g_image_quality.load(), 0, thumbnail_error);
+    if (!thumbnails_written) {
+        std::cerr << "[NiceShot] Thumbnail save failed: " << thumbnail_error << std::endl;
+    }
+    
     // Open file for writing
     FILE* fp = nullptr;
 #ifdef _WIN32
@@ -1100,58 +2618,165 @@ double niceshot_save_png(const char* buffer_ptr_str, double width, double height
     
     std::cout << "[NiceShot] PNG saved successfully: " << filepath << " (" << img_width << "x" << img_height << ")" << std::endl;
     
-    return 1.0; // Success
+    return thumbnails_written ? 1.0 : 0.0; // Success only if every thumbnail was written too
+}
+
+// Async PNG functions
+double niceshot_save_png_async(const char* buffer_ptr_str, double width, double height, const char* filepath) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized" << std::endl;
+        return 0.0;
+    }
+    
+    if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath) {
+        std::cerr << "[NiceShot] Invalid parameters for async PNG save" << std::endl;
+        return 0.0;
+    }
+    
+    return queue_image_job(buffer_ptr_str, width, height, filepath, ImageFormat::PNG, false);
+}
+
+double niceshot_save_png_async_borrowed(const char* buffer_ptr_str, double width, double height, const char* filepath) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized" << std::endl;
+        return 0.0;
+    }
+    
+    if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath) {
+        std::cerr << "[NiceShot] Invalid parameters for borrowed async PNG save" << std::endl;
+        return 0.0;
+    }
+    
+    return queue_image_job(buffer_ptr_str, width, height, filepath, ImageFormat::PNG, true);
+}
+
+double niceshot_save_image(const char* buffer_ptr_str, double width, double height, const char* filepath) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized" << std::endl;
+        return 0.0;
+    }
+    
+    // Thumbnails added for this save go with it (or are dropped if it fails), never onto a later save
+    std::vector<ThumbnailVariant> thumbnails = take_pending_thumbnails();
+    
+    ImageFormat format;
+    if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath || !image_format_for_save(filepath, format)) {
+        std::cerr << "[NiceShot] Invalid parameters for image save" << std::endl;
+        return 0.0;
+    }
+    
+    uintptr_t buffer_addr = 0;
+    if (sscanf(buffer_ptr_str, "%llx", &buffer_addr) != 1 || buffer_addr == 0) {
+        std::cerr << "[NiceShot] Invalid buffer pointer string: " << buffer_ptr_str << std::endl;
+        return 0.0;
+    }
+    
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(buffer_addr);
+    uint32_t img_width = static_cast<uint32_t>(width);
+    uint32_t img_height = static_cast<uint32_t>(height);
+    std::string error_message;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    bool thumbnails_written = write_thumbnails(pixels, img_width, img_height, thumbnails,
+                                               static_cast<ScaleFilter>(g_thumbnail_filter.load()),
+                                               g_image_quality.load(), 0, error_message);
+    bool success = encode_image_to_file(pixels, img_width, img_height, format, g_image_quality.load(), filepath,
+                                        error_message) && thumbnails_written;
+    auto elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+    
+    if (!success) {
+        std::cerr << "[NiceShot] " << image_format_name(format) << " save failed: " << error_message << std::endl;
+        return 0.0;
+    }
+    std::cout << "[NiceShot] " << image_format_name(format) << " saved in " << elapsed_ms << "ms: " << filepath << std::endl;
+    return 1.0;
+}
+
+double niceshot_save_image_async(const char* buffer_ptr_str, double width, double height, const char* filepath) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized" << std::endl;
+        return 0.0;
+    }
+    
+    ImageFormat format;
+    if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath || !image_format_for_save(filepath, format)) {
+        std::cerr << "[NiceShot] Invalid parameters for async image save" << std::endl;
+        return 0.0;
+    }
+    
+    return queue_image_job(buffer_ptr_str, width, height, filepath, format, false);
+}
+
+double niceshot_save_image_async_borrowed(const char* buffer_ptr_str, double width, double height, const char* filepath) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized" << std::endl;
+        return 0.0;
+    }
+    
+    ImageFormat format;
+    if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath || !image_format_for_save(filepath, format)) {
+        std::cerr << "[NiceShot] Invalid parameters for borrowed async image save" << std::endl;
+        return 0.0;
+    }
+    
+    return queue_image_job(buffer_ptr_str, width, height, filepath, format, true);
 }
 
-// Async PNG functions
-double niceshot_save_png_async(const char* buffer_ptr_str, double width, double height, const char* filepath) {
+double niceshot_convert_to_png_async(const char* source_path, const char* png_path) {
     if (!g_initialized) {
         std::cerr << "[NiceShot] Extension not initialized" << std::endl;
         return 0.0;
     }
-    
-    if (!buffer_ptr_str || width <= 0 || height <= 0 || !filepath) {
-        std::cerr << "[NiceShot] Invalid parameters for async PNG save" << std::endl;
+    if (!source_path || source_path[0] == '\0') {
+        std::cerr << "[NiceShot] Invalid source path for PNG conversion" << std::endl;
         return 0.0;
     }
     
-    // Parse buffer pointer from string
-    uintptr_t buffer_addr = 0;
-    if (sscanf(buffer_ptr_str, "%llx", &buffer_addr) != 1 || buffer_addr == 0) {
-        std::cerr << "[NiceShot] Invalid buffer pointer string for async save: " << buffer_ptr_str << std::endl;
-        return 0.0;
+    std::string destination = (png_path && png_path[0] != '\0') ? std::string(png_path) : png_path_for(source_path);
+    double job_id = queue_conversion_job(source_path, destination, false);
+    if (job_id > 0) {
+        std::cout << "[NiceShot] Queued PNG conversion job " << job_id << ": " << source_path << " -> " << destination << std::endl;
+    }
+    return job_id;
+}
+
+double niceshot_convert_directory_to_png(const char* directory, double delete_sources) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized" << std::endl;
+        return -1.0;
+    }
+    if (!directory) {
+        return -1.0;
     }
     
-    uint8_t* pixels = reinterpret_cast<uint8_t*>(buffer_addr);
-    uint32_t img_width = static_cast<uint32_t>(width);
-    uint32_t img_height = static_cast<uint32_t>(height);
+    std::vector<std::string> sources = list_convertible_images(directory);
+    size_t queued = 0;
+    for (const std::string& source : sources) {
+        if (queue_conversion_job(source, png_path_for(source), delete_sources != 0.0) > 0) {
+            queued++;
+        }
+    }
     
-    // Generate unique job ID
-    uint32_t job_id = g_next_job_id.fetch_add(1);
+    std::cout << "[NiceShot] Queued " << queued << " PNG conversion jobs from " << directory << std::endl;
+    return static_cast<double>(queued);
+}
+
+double niceshot_get_job_buffer_released(double job_id) {
+    if (!g_initialized) {
+        return -2.0; // Not initialized
+    }
     
-    try {
-        // Create job with copied buffer data
-        auto job = std::make_shared<PngJob>(job_id, pixels, img_width, img_height, std::string(filepath));
-        
-        // Queue job
-        {
-            std::lock_guard<std::mutex> lock(g_job_mutex);
-            g_job_queue.push(job);
-            g_active_jobs[job_id] = job;
-        }
-        
-        // Notify worker thread
-        g_job_condition.notify_one();
-        
-        std::cout << "[NiceShot] Queued async PNG job " << job_id << ": " << filepath 
-                  << " (" << img_width << "x" << img_height << ")" << std::endl;
-        
-        return static_cast<double>(job_id);
+    uint32_t id = static_cast<uint32_t>(job_id);
+    if (id == 0) {
+        return -2.0; // Invalid job ID
     }
-    catch (const std::exception& e) {
-        std::cerr << "[NiceShot] Failed to queue async PNG job: " << e.what() << std::endl;
-        return 0.0;
+    
+    int status;
+    bool buffer_released;
+    if (!g_job_table.read(id, status, buffer_released)) {
+        return -2.0; // Job not found
     }
+    
+    return buffer_released ? 1.0 : 0.0;
 }
 
 double niceshot_get_job_status(double job_id) {
@@ -1164,13 +2789,13 @@ double niceshot_get_job_status(double job_id) {
         return -2.0; // Invalid job ID
     }
     
-    std::lock_guard<std::mutex> lock(g_job_mutex);
-    auto it = g_active_jobs.find(id);
-    if (it == g_active_jobs.end()) {
+    int status;
+    bool buffer_released;
+    if (!g_job_table.read(id, status, buffer_released)) {
         return -2.0; // Job not found
     }
     
-    return static_cast<double>(static_cast<int>(it->second->status));
+    return static_cast<double>(status);
 }
 
 double niceshot_cleanup_job(double job_id) {
@@ -1183,34 +2808,176 @@ double niceshot_cleanup_job(double job_id) {
         return 0.0;
     }
     
-    std::lock_guard<std::mutex> lock(g_job_mutex);
-    auto it = g_active_jobs.find(id);
-    if (it == g_active_jobs.end()) {
+    int status;
+    bool buffer_released;
+    if (!g_job_table.read(id, status, buffer_released)) {
         return 0.0; // Job not found
     }
     
-    // Only cleanup completed or failed jobs
-    if (it->second->status == JobStatus::COMPLETED || it->second->status == JobStatus::FAILED) {
-        g_active_jobs.erase(it);
-        return 1.0; // Success
+    // Only cleanup completed or failed jobs (both final, so the slot is no longer written)
+    if (status == static_cast<int>(JobStatus::COMPLETED) || status == static_cast<int>(JobStatus::FAILED)) {
+        return g_job_table.release(id) ? 1.0 : 0.0;
     }
     
     return 0.0; // Job still processing
 }
 
+double niceshot_set_completion_queue(double enabled) {
+    bool enable = enabled != 0.0;
+    g_completion_events = enable;
+    if (!enable) {
+        // Undrained completions would otherwise be delivered after re-enabling
+        JobCompletion completion;
+        while (g_completions.pop(completion)) {
+        }
+    }
+    g_completion_overflow_logged = false;
+    std::cout << "[NiceShot] Completion queue " << (enable ? "enabled" : "disabled") << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_completion_count() {
+    if (!g_initialized) {
+        return -1.0;
+    }
+    return static_cast<double>(g_completions.get_size());
+}
+
+double niceshot_drain_completions(const char* buffer_ptr_str, double buffer_size) {
+    if (!g_initialized || !buffer_ptr_str || buffer_size < 0) {
+        return -1.0;
+    }
+    
+    uintptr_t buffer_addr = 0;
+    if (sscanf(buffer_ptr_str, "%llx", &buffer_addr) != 1 || buffer_addr == 0) {
+        std::cerr << "[NiceShot] Invalid buffer pointer string for completion drain: " << buffer_ptr_str << std::endl;
+        return -1.0;
+    }
+    
+    // Records are written little-endian in GameMaker's buffer_u32/s32/f32 layout
+    uint8_t* out = reinterpret_cast<uint8_t*>(buffer_addr);
+    size_t capacity = static_cast<size_t>(buffer_size) / COMPLETION_RECORD_SIZE;
+    size_t written = 0;
+    JobCompletion completion;
+    while (written < capacity && g_completions.pop(completion)) {
+        // Jobs already cleaned up with niceshot_cleanup_job are stale; delivered ones are cleaned up here
+        if (!g_job_table.release(completion.job_id)) {
+            continue;
+        }
+        uint8_t* record = out + written * COMPLETION_RECORD_SIZE;
+        std::memcpy(record + 0, &completion.job_id, 4);
+        std::memcpy(record + 4, &completion.status, 4);
+        std::memcpy(record + 8, &completion.queue_wait_ms, 4);
+        std::memcpy(record + 12, &completion.run_ms, 4);
+        written++;
+    }
+    return static_cast<double>(written);
+}
+
 double niceshot_get_pending_job_count() {
     if (!g_initialized) {
         return -1.0;
     }
     
-    std::lock_guard<std::mutex> lock(g_job_mutex);
-    return static_cast<double>(g_job_queue.size());
+    return static_cast<double>(g_job_pool.get_queued_total());
 }
 
 double niceshot_worker_thread_status() {
     return g_worker_thread_running.load() ? 1.0 : 0.0;
 }
 
+double niceshot_set_job_priority(double priority, double deadline_ms) {
+    int id = static_cast<int>(priority);
+    if (id < 0 || id >= JOB_PRIORITY_COUNT) {
+        std::cerr << "[NiceShot] Invalid job priority: " << id << " (must be 0-" << (JOB_PRIORITY_COUNT - 1) << ")" << std::endl;
+        return 0.0;
+    }
+    if (deadline_ms < 0) {
+        std::cerr << "[NiceShot] Invalid job deadline: " << deadline_ms << "ms (must be >= 0)" << std::endl;
+        return 0.0;
+    }
+    
+    g_job_priority = id;
+    g_job_deadline_ms = deadline_ms;
+    std::cout << "[NiceShot] Job priority set to: " << job_priority_name(static_cast<JobPriority>(id)) << ", deadline "
+              << (deadline_ms > 0 ? deadline_ms : JOB_DEFAULT_DEADLINE_MS[id]) << "ms" << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_job_priority() {
+    return static_cast<double>(g_job_priority.load());
+}
+
+double niceshot_get_queue_wait_stat(double priority, double stat) {
+    int id = static_cast<int>(priority);
+    if (id < 0 || id >= JOB_PRIORITY_COUNT) {
+        return -1.0;
+    }
+    
+    const QueueWaitStats& stats = g_queue_wait_stats[id];
+    uint64_t jobs = stats.jobs.load();
+    switch (static_cast<int>(stat)) {
+    case 0: return static_cast<double>(jobs);
+    case 1: return jobs > 0 ? static_cast<double>(stats.total_wait_us.load()) / jobs / 1000.0 : 0.0;
+    case 2: return static_cast<double>(stats.max_wait_us.load()) / 1000.0;
+    case 3: return static_cast<double>(stats.missed_deadlines.load());
+    case 4: return static_cast<double>(g_job_pool.get_queued(id));
+    default: return -1.0;
+    }
+}
+
+double niceshot_reset_queue_wait_stats() {
+    for (QueueWaitStats& stats : g_queue_wait_stats) {
+        stats.jobs = 0;
+        stats.total_wait_us = 0;
+        stats.max_wait_us = 0;
+        stats.missed_deadlines = 0;
+    }
+    return 1.0;
+}
+
+double niceshot_set_queue_limits(double max_megabytes, double max_jobs) {
+    if (max_megabytes < 0 || max_jobs < 0) {
+        std::cerr << "[NiceShot] Invalid queue limits: " << max_megabytes << "MB, " << max_jobs << " jobs (must be >= 0)" << std::endl;
+        return 0.0;
+    }
+    
+    g_queue_max_bytes = static_cast<size_t>(max_megabytes * 1024.0 * 1024.0);
+    g_queue_max_jobs = static_cast<size_t>(max_jobs);
+    notify_admission(); // Raised limits may admit a blocked caller
+    std::cout << "[NiceShot] Async queue limits set to " << max_megabytes << "MB, " << max_jobs << " jobs (0 = unlimited)" << std::endl;
+    return 1.0;
+}
+
+double niceshot_set_queue_overflow_policy(double policy, double timeout_ms) {
+    int id = static_cast<int>(policy);
+    if (id < 0 || id >= QUEUE_OVERFLOW_POLICY_COUNT) {
+        std::cerr << "[NiceShot] Invalid queue overflow policy: " << id << " (must be 0-" << (QUEUE_OVERFLOW_POLICY_COUNT - 1) << ")" << std::endl;
+        return 0.0;
+    }
+    if (timeout_ms < 0) {
+        std::cerr << "[NiceShot] Invalid block timeout: " << timeout_ms << "ms (must be >= 0)" << std::endl;
+        return 0.0;
+    }
+    
+    g_queue_overflow_policy = id;
+    g_queue_block_timeout_ms = timeout_ms;
+    std::cout << "[NiceShot] Async queue overflow policy set to " << queue_overflow_policy_name(static_cast<QueueOverflowPolicy>(id));
+    if (id == static_cast<int>(QueueOverflowPolicy::BLOCK)) {
+        std::cout << " (up to " << timeout_ms << "ms)";
+    }
+    std::cout << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_queued_memory() {
+    return static_cast<double>(g_queued_bytes.load()) / (1024.0 * 1024.0);
+}
+
+double niceshot_get_queue_overflow_count() {
+    return static_cast<double>(g_queue_overflows.load());
+}
+
 // Performance tuning functions
 double niceshot_set_compression_level(double compression_level) {
     int level = static_cast<int>(compression_level);
@@ -1255,6 +3022,146 @@ double niceshot_get_thread_count() {
     return static_cast<double>(g_thread_count.load());
 }
 
+double niceshot_set_parallel_png(double enabled) {
+    g_parallel_png = enabled != 0.0;
+    std::cout << "[NiceShot] Parallel striped PNG encoding " << (g_parallel_png.load() ? "enabled" : "disabled") << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_parallel_png() {
+    return g_parallel_png.load() ? 1.0 : 0.0;
+}
+
+double niceshot_set_png_backend(double backend) {
+    int id = static_cast<int>(backend);
+    if (id < 0 || id >= DEFLATE_BACKEND_COUNT) {
+        std::cerr << "[NiceShot] Invalid PNG backend: " << id << " (must be 0-" << (DEFLATE_BACKEND_COUNT - 1) << ")" << std::endl;
+        return 0.0;
+    }
+    
+    DeflateBackend selected = static_cast<DeflateBackend>(id);
+    if (!deflate_backend_available(selected)) {
+        std::cerr << "[NiceShot] PNG backend " << deflate_backend_name(selected) << " is not built into this DLL" << std::endl;
+        return 0.0;
+    }
+    
+    g_png_backend = id;
+    std::cout << "[NiceShot] PNG deflate backend set to: " << deflate_backend_name(selected) << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_png_backend() {
+    return static_cast<double>(g_png_backend.load());
+}
+
+double niceshot_is_png_backend_available(double backend) {
+    int id = static_cast<int>(backend);
+    if (id < 0 || id >= DEFLATE_BACKEND_COUNT) {
+        return 0.0;
+    }
+    return deflate_backend_available(static_cast<DeflateBackend>(id)) ? 1.0 : 0.0;
+}
+
+double niceshot_set_png_filter(double strategy) {
+    int id = static_cast<int>(strategy);
+    if (id < 0 || id >= PNG_FILTER_STRATEGY_COUNT) {
+        std::cerr << "[NiceShot] Invalid PNG filter strategy: " << id << " (must be 0-" << (PNG_FILTER_STRATEGY_COUNT - 1) << ")" << std::endl;
+        return 0.0;
+    }
+    
+    g_png_filter = id;
+    std::cout << "[NiceShot] PNG filter strategy set to: " << png_filter_strategy_name(static_cast<PngFilterStrategy>(id))
+              << (png_filter_simd_available() ? " (AVX2)" : " (scalar)") << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_png_filter() {
+    return static_cast<double>(g_png_filter.load());
+}
+
+double niceshot_set_image_quality(double quality) {
+    int value = static_cast<int>(quality);
+    if (value < 1 || value > 100) {
+        std::cerr << "[NiceShot] Invalid image quality: " << value << " (must be 1-100)" << std::endl;
+        return 0.0;
+    }
+    
+    g_image_quality = value;
+    std::cout << "[NiceShot] JPEG/WebP quality set to: " << value << (value == 100 ? " (WebP lossless)" : "") << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_image_quality() {
+    return static_cast<double>(g_image_quality.load());
+}
+
+double niceshot_add_thumbnail(const char* filepath, double width, double height) {
+    ImageFormat format;
+    if (!filepath || width < 1 || width > THUMBNAIL_MAX_SIZE || height < 0 || height > THUMBNAIL_MAX_SIZE ||
+        !image_format_for_save(filepath, format)) {
+        std::cerr << "[NiceShot] Invalid thumbnail parameters (width 1-" << THUMBNAIL_MAX_SIZE << ", height 0-"
+                  << THUMBNAIL_MAX_SIZE << ", supported extension)" << std::endl;
+        return 0.0;
+    }
+    
+    std::lock_guard<std::mutex> lock(g_thumbnail_mutex);
+    if (g_pending_thumbnails.size() >= THUMBNAIL_MAX_VARIANTS) {
+        std::cerr << "[NiceShot] At most " << THUMBNAIL_MAX_VARIANTS << " thumbnails per screenshot" << std::endl;
+        return 0.0;
+    }
+    g_pending_thumbnails.push_back({ filepath, format, static_cast<uint32_t>(width), static_cast<uint32_t>(height) });
+    return 1.0;
+}
+
+double niceshot_clear_thumbnails() {
+    take_pending_thumbnails();
+    return 1.0;
+}
+
+double niceshot_set_thumbnail_filter(double filter) {
+    int id = static_cast<int>(filter);
+    if (id < 0 || id >= SCALE_FILTER_COUNT) {
+        std::cerr << "[NiceShot] Invalid thumbnail filter: " << id << " (0=box, 1=Lanczos-3)" << std::endl;
+        return 0.0;
+    }
+    
+    g_thumbnail_filter = id;
+    std::cout << "[NiceShot] Thumbnail filter set to " << scale_filter_name(static_cast<ScaleFilter>(id))
+              << (image_scale_simd_available() ? " (SIMD)" : " (scalar)") << std::endl;
+    return 1.0;
+}
+
+double niceshot_is_image_format_available(double format) {
+    int id = static_cast<int>(format);
+    if (id < 0 || id >= IMAGE_FORMAT_COUNT) {
+        return 0.0;
+    }
+    return image_format_available(static_cast<ImageFormat>(id)) ? 1.0 : 0.0;
+}
+
+double niceshot_set_buffer_pool_limit(double megabytes) {
+    if (megabytes < 0) {
+        std::cerr << "[NiceShot] Invalid buffer pool limit: " << megabytes << "MB (must be >= 0)" << std::endl;
+        return 0.0;
+    }
+    
+    frame_buffer_pool().set_max_bytes(static_cast<size_t>(megabytes * 1024.0 * 1024.0));
+    std::cout << "[NiceShot] Buffer pool limit set to: " << megabytes << "MB" << std::endl;
+    return 1.0;
+}
+
+double niceshot_get_buffer_pool_hits() {
+    return static_cast<double>(frame_buffer_pool().get_hits());
+}
+
+double niceshot_get_buffer_pool_misses() {
+    return static_cast<double>(frame_buffer_pool().get_misses());
+}
+
+double niceshot_get_buffer_pool_memory() {
+    return static_cast<double>(frame_buffer_pool().get_pooled_bytes()) / (1024.0 * 1024.0);
+}
+
 double niceshot_benchmark_png(double width, double height, double iterations) {
     if (!g_initialized) {
         std::cerr << "[NiceShot] Extension not initialized for benchmark" << std::endl;
@@ -1273,6 +3180,8 @@ double niceshot_benchmark_png(double width, double height, double iterations) {
     std::cout << "[NiceShot] Starting PNG benchmark: " << img_width << "x" << img_height 
               << " x" << iter_count << " iterations" << std::endl;
     std::cout << "[NiceShot] Compression level: " << g_compression_level.load() << std::endl;
+    std::cout << "[NiceShot] Deflate backend: " << deflate_backend_name(static_cast<DeflateBackend>(g_png_backend.load()))
+              << ", filter: " << png_filter_strategy_name(static_cast<PngFilterStrategy>(g_png_filter.load())) << std::endl;
     std::cout << "[NiceShot] Worker threads: " << g_thread_count.load() << std::endl;
     
     // Create test image data
@@ -1297,19 +3206,13 @@ double niceshot_benchmark_png(double width, double height, double iterations) {
         std::string filepath = "benchmark_" + std::to_string(i) + ".png";
         
         // Create job manually to avoid string conversion overhead
-        uint32_t job_id = g_next_job_id.fetch_add(1);
-        
         try {
-            auto job = std::make_shared<PngJob>(job_id, test_pixels.data(), img_width, img_height, filepath);
+            auto job = std::make_shared<PngJob>(test_pixels.data(), img_width, img_height, filepath);
             
-            {
-                std::lock_guard<std::mutex> lock(g_job_mutex);
-                g_job_queue.push(job);
-                g_active_jobs[job_id] = job;
+            uint32_t job_id = submit_job(job);
+            if (job_id != 0) {
+                job_ids.push_back(job_id);
             }
-            
-            job_ids.push_back(job_id);
-            g_job_condition.notify_one();
         }
         catch (const std::exception& e) {
             std::cerr << "[NiceShot] Benchmark failed to create job " << i << ": " << e.what() << std::endl;
@@ -1317,41 +3220,185 @@ double niceshot_benchmark_png(double width, double height, double iterations) {
         }
     }
     
-    // Wait for all jobs to complete
-    bool all_complete = false;
-    while (!all_complete) {
-        all_complete = true;
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        
-        std::lock_guard<std::mutex> lock(g_job_mutex);
-        for (uint32_t job_id : job_ids) {
-            auto it = g_active_jobs.find(job_id);
-            if (it != g_active_jobs.end() && 
-                it->second->status != JobStatus::COMPLETED && 
-                it->second->status != JobStatus::FAILED) {
-                all_complete = false;
-                break;
-            }
+    // Wait for all jobs to complete
+    bool all_complete = false;
+    while (!all_complete) {
+        all_complete = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        
+        for (uint32_t job_id : job_ids) {
+            int status;
+            bool buffer_released;
+            if (g_job_table.read(job_id, status, buffer_released) &&
+                status != static_cast<int>(JobStatus::COMPLETED) &&
+                status != static_cast<int>(JobStatus::FAILED)) {
+                all_complete = false;
+                break;
+            }
+        }
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto total_time = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    double avg_time = total_time / iter_count;
+    
+    // Clean up benchmark jobs
+    for (uint32_t job_id : job_ids) {
+        g_job_table.release(job_id);
+    }
+    
+    std::cout << "[NiceShot] Benchmark completed in " << total_time << "ms" << std::endl;
+    std::cout << "[NiceShot] Average time per PNG: " << avg_time << "ms" << std::endl;
+    std::cout << "[NiceShot] Throughput: " << (1000.0 / avg_time) << " PNG/sec" << std::endl;
+    
+    return avg_time;
+}
+
+double niceshot_benchmark_png_backends(double width, double height, double iterations) {
+    if (!g_initialized) {
+        std::cerr << "[NiceShot] Extension not initialized for backend benchmark" << std::endl;
+        return -1.0;
+    }
+    
+    uint32_t img_width = static_cast<uint32_t>(width);
+    uint32_t img_height = static_cast<uint32_t>(height);
+    uint32_t iter_count = static_cast<uint32_t>(iterations);
+    
+    if (img_width == 0 || img_height == 0 || iter_count == 0) {
+        std::cerr << "[NiceShot] Invalid benchmark parameters" << std::endl;
+        return -1.0;
+    }
+    
+    std::cout << "[NiceShot] Comparing PNG deflate backends: " << img_width << "x" << img_height
+              << " x" << iter_count << " iterations, compression level " << g_compression_level.load()
+              << ", filter " << png_filter_strategy_name(static_cast<PngFilterStrategy>(g_png_filter.load()))
+              << ", parallel " << (g_parallel_png.load() ? "on" : "off") << std::endl;
+    
+    // Same gradient + pattern image as niceshot_benchmark_png
+    std::vector<uint8_t> test_pixels(static_cast<size_t>(img_width) * img_height * 4);
+    for (uint32_t y = 0; y < img_height; ++y) {
+        for (uint32_t x = 0; x < img_width; ++x) {
+            size_t index = (static_cast<size_t>(y) * img_width + x) * 4;
+            test_pixels[index + 0] = static_cast<uint8_t>((x * 255) / img_width);
+            test_pixels[index + 1] = static_cast<uint8_t>((y * 255) / img_height);
+            test_pixels[index + 2] = static_cast<uint8_t>((x + y) % 256);
+            test_pixels[index + 3] = 255;
+        }
+    }
+    double raw_megabytes = test_pixels.size() / (1024.0 * 1024.0);
+    
+    int fastest = -1;
+    double fastest_time = 0.0;
+    for (int id = 0; id < DEFLATE_BACKEND_COUNT; ++id) {
+        DeflateBackend backend = static_cast<DeflateBackend>(id);
+        if (!deflate_backend_available(backend)) {
+            std::cout << "[NiceShot]   " << deflate_backend_name(backend) << ": not built" << std::endl;
+            continue;
+        }
+        
+        std::string filepath = std::string("benchmark_") + deflate_backend_name(backend) + ".png";
+        std::string error_message;
+        bool ok = true;
+        auto start_time = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iter_count && ok; ++i) {
+            ok = encode_png_with_backend(test_pixels.data(), img_width, img_height, backend, filepath, error_message);
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        
+        if (!ok) {
+            std::cerr << "[NiceShot]   " << deflate_backend_name(backend) << ": failed - " << error_message << std::endl;
+            continue;
+        }
+        
+        double avg_time = std::chrono::duration<double, std::milli>(end_time - start_time).count() / iter_count;
+        long file_size = 0;
+        FILE* fp = nullptr;
+#ifdef _WIN32
+        fopen_s(&fp, filepath.c_str(), "rb");
+#else
+        fp = fopen(filepath.c_str(), "rb");
+#endif
+        if (fp) {
+            fseek(fp, 0, SEEK_END);
+            file_size = ftell(fp);
+            fclose(fp);
+        }
+        
+        std::cout << "[NiceShot]   " << deflate_backend_name(backend) << ": " << avg_time << "ms per PNG, "
+                  << (raw_megabytes * 1000.0 / avg_time) << " MB/s, " << file_size << " bytes ("
+                  << (100.0 * file_size / test_pixels.size()) << "% of raw)" << std::endl;
+        
+        if (fastest < 0 || avg_time < fastest_time) {
+            fastest = id;
+            fastest_time = avg_time;
+        }
+    }
+    
+    if (fastest >= 0) {
+        std::cout << "[NiceShot] Fastest backend: " << deflate_backend_name(static_cast<DeflateBackend>(fastest)) << std::endl;
+    }
+    return static_cast<double>(fastest);
+}
+
+double niceshot_benchmark_yuv(double width, double height, double iterations) {
+    uint32_t img_width = static_cast<uint32_t>(width);
+    uint32_t img_height = static_cast<uint32_t>(height);
+    uint32_t iter_count = static_cast<uint32_t>(iterations);
+    
+    if (img_width == 0 || img_height == 0 || iter_count == 0) {
+        std::cerr << "[NiceShot] Invalid YUV benchmark parameters" << std::endl;
+        return -1.0;
+    }
+    
+    std::cout << "[NiceShot] Starting RGBA->YUV420p benchmark: " << img_width << "x" << img_height 
+              << " x" << iter_count << " iterations" << std::endl;
+    std::cout << "[NiceShot] Kernel: " << yuv_kernel_name(yuv_best_kernel()) 
+              << ", conversion threads: " << yuv_conversion_thread_count() << std::endl;
+    
+    size_t luma_size = static_cast<size_t>(img_width) * img_height;
+    size_t chroma_size = static_cast<size_t>((img_width + 1) / 2) * ((img_height + 1) / 2);
+    std::vector<uint8_t> test_pixels(luma_size * 4);
+    std::vector<uint8_t> yuv(luma_size + chroma_size * 2);
+    
+    // Same gradient pattern as the PNG benchmark
+    for (uint32_t y = 0; y < img_height; ++y) {
+        for (uint32_t x = 0; x < img_width; ++x) {
+            size_t index = (static_cast<size_t>(y) * img_width + x) * 4;
+            test_pixels[index + 0] = static_cast<uint8_t>((x * 255) / img_width);
+            test_pixels[index + 1] = static_cast<uint8_t>((y * 255) / img_height);
+            test_pixels[index + 2] = static_cast<uint8_t>((x + y) % 256);
+            test_pixels[index + 3] = 255;
         }
     }
     
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto total_time = std::chrono::duration<double, std::milli>(end_time - start_time).count();
-    double avg_time = total_time / iter_count;
+    int chroma_stride = static_cast<int>((img_width + 1) / 2);
+    YuvPlanes planes = { yuv.data(), yuv.data() + luma_size, yuv.data() + luma_size + chroma_size,
+                         static_cast<int>(img_width), chroma_stride, chroma_stride };
+    double input_gb = static_cast<double>(test_pixels.size()) * iter_count / 1e9;
     
-    // Clean up benchmark jobs
-    {
-        std::lock_guard<std::mutex> lock(g_job_mutex);
-        for (uint32_t job_id : job_ids) {
-            g_active_jobs.erase(job_id);
-        }
+    // Single-threaded baseline
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iter_count; ++i) {
+        convert_rgba_to_yuv420p(test_pixels.data(), img_width, img_height, planes);
     }
+    double single_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
     
-    std::cout << "[NiceShot] Benchmark completed in " << total_time << "ms" << std::endl;
-    std::cout << "[NiceShot] Average time per PNG: " << avg_time << "ms" << std::endl;
-    std::cout << "[NiceShot] Throughput: " << (1000.0 / avg_time) << " PNG/sec" << std::endl;
+    // Row-banded across the conversion pool
+    start_time = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iter_count; ++i) {
+        convert_rgba_to_yuv420p_parallel(test_pixels.data(), img_width, img_height, planes);
+    }
+    double parallel_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
     
-    return avg_time;
+    double single_gbps = input_gb / single_seconds;
+    double parallel_gbps = input_gb / parallel_seconds;
+    
+    std::cout << "[NiceShot] Single-threaded: " << (single_seconds * 1000.0 / iter_count) << "ms/frame, " 
+              << single_gbps << " GB/s" << std::endl;
+    std::cout << "[NiceShot] Multithreaded:   " << (parallel_seconds * 1000.0 / iter_count) << "ms/frame, " 
+              << parallel_gbps << " GB/s (" << (single_seconds / parallel_seconds) << "x speedup)" << std::endl;
+    
+    return parallel_gbps;
 }
 
 // Video Recording Functions
@@ -1413,7 +3460,25 @@ NICESHOT_API double niceshot_start_recording(const char* settings_str, const cha
         uint32_t h = static_cast<uint32_t>(height);
         size_t max_frames = static_cast<size_t>(max_buffer_frames);
         
-        g_recording_session = std::make_unique<VideoRecordingSession>(w, h, fps, bitrate_kbps, max_frames, std::string(filepath));
+        // Pre-warm the buffer pool so the frame ring's slots are served without fresh allocations
+        frame_buffer_pool().reserve(static_cast<size_t>(w) * h * 4, max_frames);
+        
+        RecordingMode mode = static_cast<RecordingMode>(g_recording_mode.load());
+        g_recording_session = std::make_unique<VideoRecordingSession>(w, h, fps, bitrate_kbps, max_frames, std::string(filepath), mode,
+                                                                      g_raw_compression.load(), g_frame_delta.load(),
+                                                                      static_cast<VideoTiming>(g_video_timing.load()),
+                                                                      static_cast<VideoContainer>(g_video_container.load()));
+        
+        if (mode == RecordingMode::REPLAY) {
+            g_recording_session->replay = std::make_unique<ReplayBuffer>(g_replay_seconds.load(), g_replay_max_bytes.load());
+        }
+        
+        uint32_t audio_rate = g_audio_sample_rate.load();
+        if (audio_rate > 0) {
+            g_recording_session->audio = std::make_unique<AudioCapture>(audio_rate, g_audio_channels.load(),
+                                                                        static_cast<AudioCodec>(g_audio_codec.load()),
+                                                                        g_audio_bitrate_kbps.load());
+        }
         
         // Start encoding thread
         g_recording_session->stop_encoding = false;
@@ -1427,6 +3492,7 @@ NICESHOT_API double niceshot_start_recording(const char* settings_str, const cha
     catch (const std::exception& e) {
         std::cerr << "[NiceShot] Failed to start recording: " << e.what() << std::endl;
         g_recording_session.reset();
+        frame_buffer_pool().release_reservation();
         return 0.0;
     }
 }
@@ -1450,10 +3516,30 @@ NICESHOT_API double niceshot_record_frame(const char* buffer_ptr_str) {
     }
     
     uint8_t* pixels = reinterpret_cast<uint8_t*>(buffer_addr);
+    VideoRecordingSession* session = g_recording_session.get();
+    
+    // Diff against the last published frame before touching the ring
+    size_t changed_tiles = 0;
+    bool use_tiles = false;
+    if (session->delta_capture && session->delta_has_reference) {
+        changed_tiles = raw_delta_find_changed_tiles(session->delta_reference.data(), pixels, session->width, session->height,
+                                                     RAW_DELTA_TILE_SIZE, session->delta_changed.data());
+        if (changed_tiles == 0) {
+            // Identical frame: no slot and no copy, the encoder writes a repeat marker
+            session->pending_repeat_times.push_back(session->capture_time(std::chrono::high_resolution_clock::now()));
+            session->pending_repeats++;
+            session->frames_repeated++;
+            session->frames_captured++;
+            return 1.0;
+        }
+        
+        // Past half the tiles a full frame is cheaper to store and decode
+        use_tiles = changed_tiles * 2 < session->delta_changed.size();
+    }
     
-    // Check if buffer is full (memory-based limit)
-    size_t frame_size = static_cast<size_t>(g_recording_session->width) * g_recording_session->height * 4 + sizeof(VideoFrame);
-    if (g_recording_session->current_buffer_memory.load() + frame_size > g_recording_session->max_buffer_memory) {
+    // Claim a preallocated slot; the ring is full when the encoder has fallen behind
+    VideoFrame* slot = g_recording_session->frame_buffer.begin_write();
+    if (!slot) {
         // Buffer full - drop this frame
         g_recording_session->frames_dropped++;
         
@@ -1465,28 +3551,60 @@ NICESHOT_API double niceshot_record_frame(const char* buffer_ptr_str) {
         return -1.0; // Frame dropped
     }
     
-    try {
-        // Create frame
-        auto frame = std::make_unique<VideoFrame>(pixels, g_recording_session->width, 
-                                                 g_recording_session->height, g_recording_session->frames_captured);
-        
-        // Add to buffer
-        {
-            std::lock_guard<std::mutex> buffer_lock(g_recording_session->buffer_mutex);
-            g_recording_session->current_buffer_memory.fetch_add(frame->get_memory_size());
-            g_recording_session->frame_buffer.push_back(std::move(frame));
+    // Copy into the slot and publish it to the encoding thread
+    if (use_tiles) {
+        slot->capture_tiles(pixels, session->delta_changed.data(), changed_tiles, session->delta_reference.data(),
+                            session->frames_captured);
+        session->frames_delta++;
+    } else {
+        slot->capture(pixels, session->frames_captured);
+        if (session->delta_capture) {
+            std::memcpy(session->delta_reference.data(), pixels, session->delta_reference.size());
+            session->delta_has_reference = true;
         }
-        
-        // Notify encoding thread
-        g_recording_session->buffer_condition.notify_one();
-        
-        g_recording_session->frames_captured++;
-        return 1.0; // Success
     }
-    catch (const std::exception& e) {
-        std::cerr << "[NiceShot] Failed to record frame: " << e.what() << std::endl;
+    slot->repeats_before = static_cast<uint32_t>(session->pending_repeats.exchange(0));
+    slot->repeat_times.swap(session->pending_repeat_times); // Keeps both vectors' capacity in circulation
+    session->pending_repeat_times.clear();
+    g_recording_session->current_buffer_memory.fetch_add(slot->get_memory_size());
+    g_recording_session->frame_buffer.commit_write();
+    
+    g_recording_session->frames_captured++;
+    return 1.0; // Success
+}
+
+NICESHOT_API double niceshot_record_audio(const char* buffer_ptr_str, double bytes) {
+    if (!buffer_ptr_str || bytes <= 0) {
+        return 0.0;
+    }
+    
+    std::lock_guard<std::mutex> lock(g_recording_mutex);
+    
+    if (!g_recording_session || g_recording_session->status != RecordingStatus::RECORDING || !g_recording_session->audio) {
+        return 0.0; // Not recording audio
+    }
+    
+    uintptr_t buffer_addr = 0;
+    if (sscanf(buffer_ptr_str, "%llx", &buffer_addr) != 1 || buffer_addr == 0) {
+        std::cerr << "[NiceShot] Invalid buffer pointer for audio: " << buffer_ptr_str << std::endl;
+        return 0.0;
+    }
+    
+    // Whole sample frames only; a trailing partial frame is ignored
+    AudioCapture* audio = g_recording_session->audio.get();
+    size_t frames = static_cast<size_t>(bytes) / (audio->channels * sizeof(int16_t));
+    if (frames == 0) {
         return 0.0;
     }
+    
+    int64_t now = g_recording_session->capture_time(std::chrono::high_resolution_clock::now());
+    if (!audio->push(reinterpret_cast<const int16_t*>(buffer_addr), frames, now)) {
+        if (audio->blocks_rejected % 50 == 1) {
+            std::cout << "[NiceShot] Warning: Audio queue full, rejected " << audio->blocks_rejected << " blocks so far" << std::endl;
+        }
+        return -1.0;
+    }
+    return 1.0;
 }
 
 NICESHOT_API double niceshot_stop_recording() {
@@ -1503,13 +3621,29 @@ NICESHOT_API double niceshot_stop_recording() {
         
         // Signal encoding thread to stop
         g_recording_session->stop_encoding = true;
-        g_recording_session->buffer_condition.notify_all();
         
         // Wait for encoding thread to finish
         if (g_recording_session->encoding_thread.joinable()) {
             g_recording_session->encoding_thread.join();
         }
         
+        // The encoding thread has finished the audio: it is in the MP4, in a WAV sidecar, or absent
+        AudioCapture* audio = g_recording_session->audio.get();
+        bool audio_muxed = audio && audio->started && audio->encoded;
+        std::string audio_wav = audio && audio->started && !audio->encoded ? audio->wav_path : std::string();
+        
+        if (g_recording_session->mode == RecordingMode::REPLAY) {
+            // Nothing was written unless a clip was saved; wait for a save still in progress, then drop the buffer
+            if (g_recording_session->replay_save_thread.joinable()) {
+                g_recording_session->replay_save_thread.join();
+            }
+            std::cout << "[NiceShot] Instant replay stopped: " << g_recording_session->frames_encoded << " frames buffered, "
+                      << g_recording_session->replay->get_evicted_frames() << " evicted" << std::endl;
+            g_recording_session.reset();
+            frame_buffer_pool().release_reservation();
+            return 1.0;
+        }
+        
         // Log final statistics
         double elapsed = std::chrono::duration<double>(
             std::chrono::high_resolution_clock::now() - g_recording_session->recording_start_time).count();
@@ -1532,19 +3666,42 @@ NICESHOT_API double niceshot_stop_recording() {
             h264_path += ".h264";
         }
         
+        // MP4 output is playable as written; only a bare .h264 stream needs the FFmpeg remux script
+        bool mp4_output = g_recording_session->container != VideoContainer::H264;
+        std::string mp4_path = path_with_extension(g_recording_session->output_filepath, ".mp4");
+        
         FILE* script_file = nullptr;
+        if (!mp4_output) {
 #ifdef _WIN32
-        fopen_s(&script_file, script_path.c_str(), "w");
+            fopen_s(&script_file, script_path.c_str(), "w");
 #else
-        script_file = fopen(script_path.c_str(), "w");
+            script_file = fopen(script_path.c_str(), "w");
 #endif
+        }
+        
+        // Live VFR streams only play at the right speed with their timecodes applied
+        bool live_vfr = g_recording_session->mode == RecordingMode::LIVE_H264 && g_recording_session->timing == VideoTiming::VFR &&
+                        !mp4_output;
+        std::string timecodes_path = path_with_extension(h264_path, "_timecodes.txt");
+        
+        // The WAV sidecar starts at the first frame, so it lines up with the stream as is
+        std::string audio_input = audio_wav.empty() ? std::string() : "-i \"" + audio_wav + "\" ";
         
         if (script_file) {
             fprintf(script_file, "@echo off\n");
             fprintf(script_file, "REM Convert raw H.264 to MP4 using FFmpeg\n");
             fprintf(script_file, "REM Usage: Run this batch file to convert the H.264 file to MP4\n");
-            fprintf(script_file, "ffmpeg -r %.2f -i \"%s\" -c:v copy \"%s\"\n", 
-                   g_recording_session->fps, h264_path.c_str(), g_recording_session->output_filepath.c_str());
+            if (live_vfr) {
+                fprintf(script_file, "REM Variable frame rate: mkvmerge applies the timecodes, then FFmpeg remuxes to MP4\n");
+                fprintf(script_file, "mkvmerge -o \"%s.mkv\" --timestamps 0:\"%s\" \"%s\"\n", h264_path.c_str(),
+                        timecodes_path.c_str(), h264_path.c_str());
+                fprintf(script_file, "ffmpeg -i \"%s.mkv\" %s-c:v copy %s\"%s\"\n", h264_path.c_str(),
+                        audio_input.c_str(), audio_wav.empty() ? "" : "-c:a aac ", g_recording_session->output_filepath.c_str());
+            } else {
+                fprintf(script_file, "ffmpeg -r %.2f -i \"%s\" %s-c:v copy %s\"%s\"\n", 
+                       g_recording_session->fps, h264_path.c_str(), audio_input.c_str(), audio_wav.empty() ? "" : "-c:a aac ",
+                       g_recording_session->output_filepath.c_str());
+            }
             fprintf(script_file, "echo Conversion complete: %s\n", g_recording_session->output_filepath.c_str());
             fprintf(script_file, "pause\n");
             fclose(script_file);
@@ -1557,6 +3714,10 @@ NICESHOT_API double niceshot_stop_recording() {
         std::cout << "[NiceShot]   Frames captured: " << g_recording_session->frames_captured << std::endl;
         std::cout << "[NiceShot]   Frames encoded: " << g_recording_session->frames_encoded << std::endl;
         std::cout << "[NiceShot]   Frames dropped: " << g_recording_session->frames_dropped << std::endl;
+        if (g_recording_session->delta_capture) {
+            std::cout << "[NiceShot]   Frames repeated: " << g_recording_session->frames_repeated 
+                      << ", tile deltas: " << g_recording_session->frames_delta << std::endl;
+        }
         std::cout << "[NiceShot]   Average FPS: " << avg_fps << std::endl;
         std::string raw_path = g_recording_session->output_filepath;
         ext_pos = raw_path.find_last_of('.');
@@ -1566,7 +3727,16 @@ NICESHOT_API double niceshot_stop_recording() {
             raw_path += ".raw";
         }
         
-        std::cout << "[NiceShot]   Output: " << raw_path << " (raw RGBA frames)" << std::endl;
+        bool live_h264 = g_recording_session->mode == RecordingMode::LIVE_H264;
+        bool raw_compressed = !live_h264 && g_recording_session->raw_compression;
+        if (live_h264) {
+            std::cout << "[NiceShot]   Output: " << (mp4_output ? mp4_path : h264_path) << " (live H.264"
+                      << (mp4_output ? " in " + std::string(video_container_name(g_recording_session->container)) : " stream")
+                      << ")" << std::endl;
+        } else {
+            std::cout << "[NiceShot]   Output: " << raw_path 
+                      << (raw_compressed ? " (compressed raw container)" : " (raw RGBA frames)") << std::endl;
+        }
         
         // Create comprehensive recording metadata JSON
         std::string metadata_path = g_recording_session->output_filepath;
@@ -1592,31 +3762,70 @@ NICESHOT_API double niceshot_stop_recording() {
             fprintf(metadata_file, "    \"frames_captured\": %llu,\n", g_recording_session->frames_captured);
             fprintf(metadata_file, "    \"frames_encoded\": %llu,\n", g_recording_session->frames_encoded);
             fprintf(metadata_file, "    \"frames_dropped\": %llu,\n", g_recording_session->frames_dropped);
+            fprintf(metadata_file, "    \"frames_repeated\": %llu,\n", g_recording_session->frames_repeated);
+            fprintf(metadata_file, "    \"frames_delta\": %llu,\n", g_recording_session->frames_delta);
             fprintf(metadata_file, "    \"average_fps\": %.2f\n", avg_fps);
             fprintf(metadata_file, "  },\n");
             fprintf(metadata_file, "  \"video\": {\n");
-            fprintf(metadata_file, "    \"raw_file\": \"%s\",\n", raw_path.c_str());
+            if (live_h264) {
+                fprintf(metadata_file, "    \"raw_file\": null,\n");
+                if (mp4_output) {
+                    fprintf(metadata_file, "    \"mp4_file\": \"%s\",\n", mp4_path.c_str());
+                } else {
+                    fprintf(metadata_file, "    \"h264_file\": \"%s\",\n", h264_path.c_str());
+                }
+            } else {
+                fprintf(metadata_file, "    \"raw_file\": \"%s\",\n", raw_path.c_str());
+            }
             fprintf(metadata_file, "    \"width\": %u,\n", g_recording_session->width);
             fprintf(metadata_file, "    \"height\": %u,\n", g_recording_session->height);
             fprintf(metadata_file, "    \"fps\": %.2f,\n", g_recording_session->fps);
-            fprintf(metadata_file, "    \"format\": \"RGBA\",\n");
+            fprintf(metadata_file, "    \"format\": \"%s\",\n", live_h264 ? "H.264" : raw_compressed ? "NSRAW-QOI" : "RGBA");
+            // Live mode: the container written; raw mode: the one NiceShot_Converter should produce
+            fprintf(metadata_file, "    \"container\": \"%s\",\n", video_container_name(g_recording_session->container));
+            // Headerless RGBA has nowhere to keep timestamps, so it is always placed by frame count
+            fprintf(metadata_file, "    \"timing\": \"%s\",\n",
+                    video_timing_name(live_h264 || raw_compressed ? g_recording_session->timing : VideoTiming::FRAME_COUNT));
+            fprintf(metadata_file, "    \"timestamps\": %s,\n", raw_compressed ? "true" : "false");
+            if (live_vfr) {
+                fprintf(metadata_file, "    \"timecodes_file\": \"%s\",\n", timecodes_path.c_str());
+            }
             fprintf(metadata_file, "    \"frame_count\": %llu\n", g_recording_session->frames_encoded);
             fprintf(metadata_file, "  },\n");
             fprintf(metadata_file, "  \"audio\": {\n");
-            fprintf(metadata_file, "    \"file\": null,\n");
-            fprintf(metadata_file, "    \"format\": null,\n");
-            fprintf(metadata_file, "    \"sample_rate\": null,\n");
-            fprintf(metadata_file, "    \"sync_offset\": 0.0,\n");
-            fprintf(metadata_file, "    \"note\": \"Audio can be recorded separately with GameMaker audio functions\"\n");
+            if (audio_muxed || !audio_wav.empty()) {
+                if (audio_wav.empty()) {
+                    fprintf(metadata_file, "    \"file\": null,\n");
+                } else {
+                    fprintf(metadata_file, "    \"file\": \"%s\",\n", audio_wav.c_str());
+                }
+                // Muxed: the codec in the MP4; WAV: the codec NiceShot_Converter should encode it with
+                fprintf(metadata_file, "    \"codec\": \"%s\",\n",
+                        audio_codec_name(audio_muxed ? audio->encoder.get_codec() : audio->codec));
+                fprintf(metadata_file, "    \"sample_rate\": %u,\n", audio->sample_rate);
+                fprintf(metadata_file, "    \"channels\": %u,\n", audio->channels);
+                fprintf(metadata_file, "    \"muxed\": %s,\n", audio_muxed ? "true" : "false");
+                fprintf(metadata_file, "    \"sync_offset\": 0.0,\n");
+                fprintf(metadata_file, "    \"note\": \"%s\"\n", audio_muxed
+                        ? "Interleaved with the video in the MP4"
+                        : "16-bit PCM WAV starting at the first video frame");
+            } else {
+                fprintf(metadata_file, "    \"file\": null,\n");
+                fprintf(metadata_file, "    \"codec\": null,\n");
+                fprintf(metadata_file, "    \"sample_rate\": null,\n");
+                fprintf(metadata_file, "    \"muxed\": false,\n");
+                fprintf(metadata_file, "    \"sync_offset\": 0.0,\n");
+                fprintf(metadata_file, "    \"note\": \"Set niceshot_set_audio_format and push PCM with niceshot_record_audio to record audio\"\n");
+            }
             fprintf(metadata_file, "  },\n");
             fprintf(metadata_file, "  \"output\": {\n");
             fprintf(metadata_file, "    \"target_h264\": \"%s\",\n", h264_path.c_str());
-            fprintf(metadata_file, "    \"target_mp4\": \"%s\",\n", g_recording_session->output_filepath.c_str());
+            fprintf(metadata_file, "    \"target_mp4\": \"%s\",\n", mp4_path.c_str());
             fprintf(metadata_file, "    \"quality_preset\": \"high\",\n");
             fprintf(metadata_file, "    \"crf\": 18\n");
             fprintf(metadata_file, "  },\n");
             fprintf(metadata_file, "  \"conversion\": {\n");
-            fprintf(metadata_file, "    \"status\": \"ready\",\n");
+            fprintf(metadata_file, "    \"status\": \"%s\",\n", live_h264 ? "not_required" : "ready");
             fprintf(metadata_file, "    \"converter_script\": \"%s\",\n", (metadata_path.substr(0, metadata_path.find_last_of('.')) + "_convert.bat").c_str());
             fprintf(metadata_file, "    \"x264_available\": true\n");
             fprintf(metadata_file, "  }\n");
@@ -1626,14 +3835,17 @@ NICESHOT_API double niceshot_stop_recording() {
             std::cout << "[NiceShot] Created recording metadata: " << metadata_path << std::endl;
         }
         
-        // Create standalone conversion batch file
+        // Create standalone conversion batch file (live H.264 recordings have nothing to convert)
         std::string converter_script = metadata_path.substr(0, metadata_path.find_last_of('.')) + "_convert.bat";
+        std::string converter_target = mp4_output ? mp4_path : h264_path;
         script_file = nullptr;
+        if (!live_h264) {
 #ifdef _WIN32
-        fopen_s(&script_file, converter_script.c_str(), "w");
+            fopen_s(&script_file, converter_script.c_str(), "w");
 #else
-        script_file = fopen(converter_script.c_str(), "w");
+            script_file = fopen(converter_script.c_str(), "w");
 #endif
+        }
         
         if (script_file) {
             fprintf(script_file, "@echo off\n");
@@ -1643,7 +3855,7 @@ NICESHOT_API double niceshot_stop_recording() {
             fprintf(script_file, "echo.\n");
             fprintf(script_file, "echo Converting raw RGBA frames to high-quality H.264...\n");
             fprintf(script_file, "echo Source: %s\n", raw_path.c_str());
-            fprintf(script_file, "echo Target: %s\n", h264_path.c_str());
+            fprintf(script_file, "echo Target: %s\n", converter_target.c_str());
             fprintf(script_file, "echo Resolution: %ux%u @ %.2f fps\n", g_recording_session->width, g_recording_session->height, g_recording_session->fps);
             fprintf(script_file, "echo Frames: %llu\n", g_recording_session->frames_encoded);
             fprintf(script_file, "echo.\n");
@@ -1658,20 +3870,32 @@ NICESHOT_API double niceshot_stop_recording() {
             fprintf(script_file, "\n");
             fprintf(script_file, "echo Conversion parameters:\n");
             fprintf(script_file, "echo   Input: %s (%llu frames)\n", raw_path.c_str(), g_recording_session->frames_encoded);
-            fprintf(script_file, "echo   Output: %s\n", h264_path.c_str());
+            fprintf(script_file, "echo   Output: %s\n", converter_target.c_str());
             fprintf(script_file, "echo   Quality: High (CRF 18, slow preset)\n");
-            fprintf(script_file, "echo   Audio: Not included (add separately)\n");
+            if (audio_wav.empty()) {
+                fprintf(script_file, "echo   Audio: Not included (add separately)\n");
+            } else {
+                fprintf(script_file, "echo   Audio: %s (%s)\n", audio_wav.c_str(), mp4_output ? "muxed into the MP4" : "kept as WAV");
+            }
             fprintf(script_file, "echo.\n");
             fprintf(script_file, "echo To complete conversion, run: NiceShot_Converter.exe \"%s\"\n", metadata_path.c_str());
             fprintf(script_file, "echo.\n");
             fprintf(script_file, "\n");
-            fprintf(script_file, "REM Alternative: Use FFmpeg directly\n");
-            fprintf(script_file, "REM ffmpeg -f rawvideo -pix_fmt rgba -s %ux%u -r %.2f -i \"%s\" -c:v libx264 -preset slow -crf 18 \"%s\"\n", 
-                   g_recording_session->width, g_recording_session->height, g_recording_session->fps, raw_path.c_str(), h264_path.c_str());
-            fprintf(script_file, "\n");
-            fprintf(script_file, "REM To add audio later:\n");
-            fprintf(script_file, "REM ffmpeg -i \"%s\" -i \"audio.wav\" -c:v copy -c:a aac \"%s\"\n", h264_path.c_str(), g_recording_session->output_filepath.c_str());
+            if (raw_compressed) {
+                fprintf(script_file, "REM The .raw file is a compressed NiceShot container; FFmpeg cannot read it directly\n");
+            } else {
+                fprintf(script_file, "REM Alternative: Use FFmpeg directly\n");
+                fprintf(script_file, "REM ffmpeg -f rawvideo -pix_fmt rgba -s %ux%u -r %.2f -i \"%s\" -c:v libx264 -preset slow -crf 18 \"%s\"\n", 
+                       g_recording_session->width, g_recording_session->height, g_recording_session->fps, raw_path.c_str(), h264_path.c_str());
+            }
             fprintf(script_file, "\n");
+            if (audio_wav.empty() || !mp4_output) {
+                fprintf(script_file, "REM To add audio later:\n");
+                fprintf(script_file, "REM ffmpeg -i \"%s\" -i \"%s\" -c:v copy -c:a aac \"%s\"\n", converter_target.c_str(),
+                        audio_wav.empty() ? "audio.wav" : audio_wav.c_str(),
+                        path_with_extension(g_recording_session->output_filepath, "_audio.mp4").c_str());
+                fprintf(script_file, "\n");
+            }
             fprintf(script_file, "echo Conversion script ready. See instructions above.\n");
             fprintf(script_file, "pause\n");
             fclose(script_file);
@@ -1680,11 +3904,13 @@ NICESHOT_API double niceshot_stop_recording() {
         }
         
         g_recording_session.reset();
+        frame_buffer_pool().release_reservation();
         return 1.0;
     }
     catch (const std::exception& e) {
         std::cerr << "[NiceShot] Failed to stop recording: " << e.what() << std::endl;
         g_recording_session.reset();
+        frame_buffer_pool().release_reservation();
         return 0.0;
     }
 }
@@ -1721,6 +3947,150 @@ NICESHOT_API double niceshot_get_recording_status() {
     return static_cast<double>(g_recording_session->status);
 }
 
+NICESHOT_API double niceshot_set_replay_buffer(double seconds, double memory_mb) {
+    if (seconds <= 0.0 || seconds > 3600.0 || memory_mb < 16.0) {
+        std::cerr << "[NiceShot] Invalid replay buffer: " << seconds << "s, " << memory_mb
+                  << "MB (seconds must be 0-3600, memory at least 16MB)" << std::endl;
+        return 0.0;
+    }
+    
+    g_replay_seconds = seconds;
+    g_replay_max_bytes = static_cast<size_t>(memory_mb * 1024 * 1024);
+    std::cout << "[NiceShot] Replay buffer set to: " << seconds << "s, up to " << memory_mb << "MB" << std::endl;
+    return 1.0;
+}
+
+// Write the clip on a background thread; 0 = done, -1 = failed (the session keeps one save at a time)
+static void replay_save_thread_main(VideoRecordingSession* session, ReplayClip clip, std::string path) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::string error;
+    bool ok;
+    
+    if (clip.format == ReplayFormat::H264) {
+        ok = write_replay_mp4(clip, path_with_extension(path, ".mp4"), error);
+    } else {
+        // Lossless clips take the raw recording route: .raw + WAV + metadata for NiceShot_Converter
+        std::string raw_path = path_with_extension(path, ".raw");
+        std::string wav_path = path_with_extension(path, "_audio.wav");
+        std::string metadata_path = path_with_extension(path, "_recording.json");
+        bool has_audio = clip.audio && !clip.audio_packets.empty();
+        ok = write_replay_raw(clip, raw_path, wav_path, error);
+        
+        FILE* metadata_file = nullptr;
+        if (ok) {
+#ifdef _WIN32
+            fopen_s(&metadata_file, metadata_path.c_str(), "w");
+#else
+            metadata_file = fopen(metadata_path.c_str(), "w");
+#endif
+            if (!metadata_file) {
+                error = "cannot create " + metadata_path;
+                ok = false;
+            }
+        }
+        
+        // Same layout as a raw recording's metadata, so NiceShot_Converter encodes the clip like one
+        if (metadata_file) {
+            fprintf(metadata_file, "{\n");
+            fprintf(metadata_file, "  \"recording_info\": {\n");
+            fprintf(metadata_file, "    \"replay\": true,\n");
+            fprintf(metadata_file, "    \"duration_seconds\": %.3f\n", clip.get_seconds());
+            fprintf(metadata_file, "  },\n");
+            fprintf(metadata_file, "  \"video\": {\n");
+            fprintf(metadata_file, "    \"raw_file\": \"%s\",\n", raw_path.c_str());
+            fprintf(metadata_file, "    \"width\": %u,\n", clip.width);
+            fprintf(metadata_file, "    \"height\": %u,\n", clip.height);
+            fprintf(metadata_file, "    \"fps\": %.2f,\n", session->fps);
+            fprintf(metadata_file, "    \"format\": \"NSRAW-QOI\",\n");
+            fprintf(metadata_file, "    \"container\": \"%s\",\n", video_container_name(VideoContainer::MP4));
+            fprintf(metadata_file, "    \"timing\": \"%s\",\n", video_timing_name(session->timing));
+            fprintf(metadata_file, "    \"timestamps\": true,\n");
+            fprintf(metadata_file, "    \"frame_count\": %llu\n", static_cast<unsigned long long>(clip.video.size()));
+            fprintf(metadata_file, "  },\n");
+            fprintf(metadata_file, "  \"audio\": {\n");
+            if (has_audio) {
+                fprintf(metadata_file, "    \"file\": \"%s\",\n", wav_path.c_str());
+                fprintf(metadata_file, "    \"codec\": \"%s\",\n", audio_codec_name(clip.audio->get_codec()));
+                fprintf(metadata_file, "    \"sample_rate\": %u,\n", clip.audio->get_sample_rate());
+                fprintf(metadata_file, "    \"channels\": %u,\n", clip.audio->get_channels());
+            } else {
+                fprintf(metadata_file, "    \"file\": null,\n");
+                fprintf(metadata_file, "    \"codec\": null,\n");
+            }
+            fprintf(metadata_file, "    \"muxed\": false,\n");
+            fprintf(metadata_file, "    \"sync_offset\": 0.0\n");
+            fprintf(metadata_file, "  },\n");
+            fprintf(metadata_file, "  \"output\": {\n");
+            fprintf(metadata_file, "    \"target_h264\": \"%s\",\n", path_with_extension(path, ".h264").c_str());
+            fprintf(metadata_file, "    \"target_mp4\": \"%s\"\n", path_with_extension(path, ".mp4").c_str());
+            fprintf(metadata_file, "  }\n");
+            fprintf(metadata_file, "}\n");
+            ok = fclose(metadata_file) == 0 && ok;
+        }
+    }
+    
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+    if (ok) {
+        std::cout << "[NiceShot] Replay saved: " << path << " (" << clip.get_seconds() << "s, " << clip.video.size()
+                  << " frames, " << clip.audio_packets.size() << " audio packets) in " << elapsed_ms << "ms" << std::endl;
+    } else {
+        std::cerr << "[NiceShot] Failed to save replay: " << error << std::endl;
+    }
+    session->replay_save_status = ok ? 0 : -1;
+}
+
+NICESHOT_API double niceshot_save_replay(const char* filepath, double seconds) {
+    if (!filepath || seconds <= 0.0) {
+        return 0.0;
+    }
+    
+    std::lock_guard<std::mutex> lock(g_recording_mutex);
+    
+    if (!g_recording_session || g_recording_session->status != RecordingStatus::RECORDING || !g_recording_session->replay) {
+        std::cerr << "[NiceShot] Cannot save replay: instant replay is not running" << std::endl;
+        return 0.0;
+    }
+    if (g_recording_session->replay_save_status == 1) {
+        std::cerr << "[NiceShot] Cannot save replay: previous save still in progress" << std::endl;
+        return 0.0;
+    }
+    
+    // Snapshot the buffer (shared samples, no copies); the encoder keeps filling it while the clip is written
+    ReplayClip clip;
+    if (!g_recording_session->replay->take_clip(seconds, clip)) {
+        std::cerr << "[NiceShot] Cannot save replay: nothing buffered yet" << std::endl;
+        return 0.0;
+    }
+    
+    if (g_recording_session->replay_save_thread.joinable()) {
+        g_recording_session->replay_save_thread.join();
+    }
+    g_recording_session->replay_save_status = 1;
+    g_recording_session->replay_save_thread = std::thread(replay_save_thread_main, g_recording_session.get(),
+                                                          std::move(clip), std::string(filepath));
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_replay_save_status() {
+    std::lock_guard<std::mutex> lock(g_recording_mutex);
+    
+    if (!g_recording_session || !g_recording_session->replay) {
+        return -2.0; // No replay session
+    }
+    
+    return static_cast<double>(g_recording_session->replay_save_status.load());
+}
+
+NICESHOT_API double niceshot_get_replay_seconds() {
+    std::lock_guard<std::mutex> lock(g_recording_mutex);
+    
+    if (!g_recording_session || !g_recording_session->replay) {
+        return -1.0;
+    }
+    
+    return g_recording_session->replay->get_seconds();
+}
+
 NICESHOT_API double niceshot_set_video_preset(double preset) {
     int preset_int = static_cast<int>(preset);
     if (preset_int < 0 || preset_int > 4) {
@@ -1735,6 +4105,125 @@ NICESHOT_API double niceshot_set_video_preset(double preset) {
     return 1.0;
 }
 
+NICESHOT_API double niceshot_set_recording_mode(double mode) {
+    int mode_int = static_cast<int>(mode);
+    if (mode_int < 0 || mode_int > 2) {
+        std::cerr << "[NiceShot] Invalid recording mode: " << mode_int << " (must be 0-2)" << std::endl;
+        return 0.0;
+    }
+    
+    g_recording_mode = mode_int;
+    
+    const char* mode_names[] = {"raw RGBA (offline encode)", "live H.264", "instant replay (in memory)"};
+    std::cout << "[NiceShot] Recording mode set to: " << mode_names[mode_int] << std::endl;
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_recording_mode() {
+    return static_cast<double>(g_recording_mode.load());
+}
+
+NICESHOT_API double niceshot_set_raw_compression(double enabled) {
+    g_raw_compression = enabled != 0.0;
+    std::cout << "[NiceShot] Raw capture format set to: " 
+              << (g_raw_compression.load() ? "compressed container (QOI)" : "headerless RGBA") << std::endl;
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_raw_compression() {
+    return g_raw_compression.load() ? 1.0 : 0.0;
+}
+
+NICESHOT_API double niceshot_set_frame_delta(double enabled) {
+    g_frame_delta = enabled != 0.0;
+    std::cout << "[NiceShot] Frame delta capture " << (g_frame_delta.load() ? "enabled" : "disabled") << std::endl;
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_frame_delta() {
+    return g_frame_delta.load() ? 1.0 : 0.0;
+}
+
+NICESHOT_API double niceshot_set_video_timing(double mode) {
+    int value = static_cast<int>(mode);
+    if (value < 0 || value >= VIDEO_TIMING_COUNT) {
+        std::cerr << "[NiceShot] Invalid video timing: " << mode << std::endl;
+        return 0.0;
+    }
+    
+    g_video_timing = value;
+    std::cout << "[NiceShot] Video timing set to: " << video_timing_name(static_cast<VideoTiming>(value)) << std::endl;
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_video_timing() {
+    return static_cast<double>(g_video_timing.load());
+}
+
+NICESHOT_API double niceshot_set_video_container(double container) {
+    int value = static_cast<int>(container);
+    if (value < 0 || value >= VIDEO_CONTAINER_COUNT) {
+        std::cerr << "[NiceShot] Invalid video container: " << container << std::endl;
+        return 0.0;
+    }
+    
+    g_video_container = value;
+    std::cout << "[NiceShot] Video container set to: " << video_container_name(static_cast<VideoContainer>(value)) << std::endl;
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_video_container() {
+    return static_cast<double>(g_video_container.load());
+}
+
+NICESHOT_API double niceshot_set_audio_format(double sample_rate, double channels) {
+    int rate = static_cast<int>(sample_rate);
+    int count = static_cast<int>(channels);
+    if (rate != 0 && (rate < 8000 || rate > 48000 || count < 1 || count > 2)) {
+        std::cerr << "[NiceShot] Invalid audio format: " << sample_rate << " Hz, " << channels << " channels" << std::endl;
+        return 0.0;
+    }
+    
+    g_audio_sample_rate = static_cast<uint32_t>(rate);
+    if (rate > 0) {
+        g_audio_channels = static_cast<uint32_t>(count);
+        std::cout << "[NiceShot] Audio format set to: " << rate << " Hz, " << count << " channel(s)" << std::endl;
+    } else {
+        std::cout << "[NiceShot] Audio recording disabled" << std::endl;
+    }
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_set_audio_codec(double codec, double bitrate_kbps) {
+    int value = static_cast<int>(codec);
+    if (value < 0 || value >= AUDIO_CODEC_COUNT || bitrate_kbps < 0) {
+        std::cerr << "[NiceShot] Invalid audio codec: " << codec << std::endl;
+        return 0.0;
+    }
+    if (!audio_codec_available(static_cast<AudioCodec>(value))) {
+        std::cerr << "[NiceShot] Audio codec not available in this build: "
+                  << audio_codec_name(static_cast<AudioCodec>(value)) << std::endl;
+        return 0.0;
+    }
+    
+    g_audio_codec = value;
+    g_audio_bitrate_kbps = static_cast<uint32_t>(bitrate_kbps);
+    std::cout << "[NiceShot] Audio codec set to: " << audio_codec_name(static_cast<AudioCodec>(value)) << std::endl;
+    return 1.0;
+}
+
+NICESHOT_API double niceshot_get_audio_codec() {
+    return static_cast<double>(g_audio_codec.load());
+}
+
+NICESHOT_API double niceshot_is_audio_codec_available(double codec) {
+    int value = static_cast<int>(codec);
+    if (value < 0 || value >= AUDIO_CODEC_COUNT) {
+        return 0.0;
+    }
+    return audio_codec_available(static_cast<AudioCodec>(value)) ? 1.0 : 0.0;
+}
+
 NICESHOT_API double niceshot_test_x264() {
     std::cout << "[NiceShot] Testing x264 availability..." << std::endl;
     
@@ -1764,6 +4253,141 @@ NICESHOT_API double niceshot_test_x264() {
 #endif
 }
 
+NICESHOT_API double niceshot_test_yuv_conversion() {
+    std::cout << "[NiceShot] Testing RGBA to YUV420p kernels..." << std::endl;
+    std::cout << "[NiceShot] Best kernel on this CPU: " << yuv_kernel_name(yuv_best_kernel()) << std::endl;
+    
+    // Random frames, including odd sizes and widths that leave SIMD tail columns
+    const uint32_t sizes[][2] = { {2, 2}, {16, 2}, {64, 64}, {1920, 1080}, {1, 1}, {33, 17}, {47, 31}, {1279, 719} };
+    const YuvKernel kernels[] = { YuvKernel::SSE2, YuvKernel::SSSE3, YuvKernel::AVX2 };
+    uint32_t seed = 12345;
+    bool all_passed = true;
+    
+    for (const auto& size : sizes) {
+        uint32_t w = size[0];
+        uint32_t h = size[1];
+        uint32_t chroma_w = (w + 1) / 2;
+        uint32_t chroma_h = (h + 1) / 2;
+        size_t luma_size = static_cast<size_t>(w) * h;
+        size_t chroma_size = static_cast<size_t>(chroma_w) * chroma_h;
+        
+        std::vector<uint8_t> rgba(luma_size * 4);
+        for (auto& byte : rgba) {
+            seed = seed * 1664525u + 1013904223u; // LCG keeps the test deterministic
+            byte = static_cast<uint8_t>(seed >> 24);
+        }
+        
+        std::vector<uint8_t> reference(luma_size + chroma_size * 2);
+        YuvPlanes ref_planes = { reference.data(), reference.data() + luma_size, reference.data() + luma_size + chroma_size,
+                                 static_cast<int>(w), static_cast<int>(chroma_w), static_cast<int>(chroma_w) };
+        convert_rgba_to_yuv420p_rows(YuvKernel::SCALAR, rgba.data(), w, h, 0, h, ref_planes);
+        
+        for (YuvKernel kernel : kernels) {
+            if (!yuv_kernel_supported(kernel)) {
+                continue;
+            }
+            
+            std::vector<uint8_t> output(reference.size(), 0);
+            YuvPlanes planes = { output.data(), output.data() + luma_size, output.data() + luma_size + chroma_size,
+                                 static_cast<int>(w), static_cast<int>(chroma_w), static_cast<int>(chroma_w) };
+            convert_rgba_to_yuv420p_rows(kernel, rgba.data(), w, h, 0, h, planes);
+            
+            if (output != reference) {
+                std::cerr << "[NiceShot] YUV kernel " << yuv_kernel_name(kernel) << " mismatch at " << w << "x" << h << std::endl;
+                all_passed = false;
+            }
+        }
+    }
+    
+    std::cout << "[NiceShot] YUV conversion test: " << (all_passed ? "SUCCESS" : "FAILED") << std::endl;
+    return all_passed ? 1.0 : 0.0;
+}
+
+NICESHOT_API double niceshot_test_image_decoders() {
+    std::cout << "[NiceShot] Testing image decoders..." << std::endl;
+    
+    std::string path = (std::filesystem::temp_directory_path() / "niceshot_decoder_test.img").string();
+    bool all_passed = true;
+    
+    // Lossless formats read back exactly
+    const uint32_t w = 33;
+    const uint32_t h = 17;
+    std::vector<uint8_t> pixels(static_cast<size_t>(w) * h * 4);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        pixels[i] = (i / 4) % 5 == 0 ? 255 : static_cast<uint8_t>(seed >> 24); // Some runs for QOI
+    }
+    for (ImageFormat format : { ImageFormat::QOI, ImageFormat::TGA, ImageFormat::BMP }) {
+        std::string error;
+        std::vector<uint8_t> rgba;
+        uint32_t read_w = 0;
+        uint32_t read_h = 0;
+        ImageFormat read_format;
+        if (!write_image_file(format, pixels.data(), w, h, path, error) ||
+            !read_image_file(path, rgba, read_w, read_h, read_format, error) ||
+            read_format != format || read_w != w || read_h != h || rgba != pixels) {
+            std::cerr << "[NiceShot] " << image_format_name(format) << " round trip failed " << error << std::endl;
+            all_passed = false;
+        }
+    }
+    
+    // Writes a crafted file and checks read_image_file turns it down
+    auto expect_rejected = [&](const uint8_t* file, size_t size, const std::string& label) {
+        FILE* fp = nullptr;
+#ifdef _WIN32
+        fopen_s(&fp, path.c_str(), "wb");
+#else
+        fp = fopen(path.c_str(), "wb");
+#endif
+        bool written = fp && fwrite(file, 1, size, fp) == size;
+        if (fp) {
+            fclose(fp);
+        }
+        
+        std::string error;
+        std::vector<uint8_t> rgba;
+        uint32_t read_w = 0;
+        uint32_t read_h = 0;
+        ImageFormat read_format;
+        if (!written || read_image_file(path, rgba, read_w, read_h, read_format, error)) {
+            std::cerr << "[NiceShot] Hostile " << label << " header was not rejected" << std::endl;
+            all_passed = false;
+        }
+    };
+    
+    // QOI headers whose size wraps the allocation, exceeds the spec cap, or outgrows the payload
+    const uint32_t hostile_sizes[][2] = { {0x80000000u, 0x80000000u}, {0xFFFFFFFFu, 0xFFFFFFFFu}, {65536, 65536}, {10000, 10000} };
+    for (const auto& size : hostile_sizes) {
+        uint8_t file[14 + 16 + 8] = { 'q', 'o', 'i', 'f' };
+        for (int i = 0; i < 4; ++i) {
+            file[4 + i] = static_cast<uint8_t>(size[0] >> (24 - 8 * i));
+            file[8 + i] = static_cast<uint8_t>(size[1] >> (24 - 8 * i));
+        }
+        file[12] = 4;
+        std::memset(file + 14, 0xFD, 16); // Maximal runs
+        file[sizeof(file) - 1] = 1;       // End marker
+        expect_rejected(file, sizeof(file), "QOI " + std::to_string(size[0]) + "x" + std::to_string(size[1]));
+    }
+    
+    // TGA headers (uncompressed and RLE) claiming far more pixels than the file holds
+    const uint16_t hostile_tga[][3] = { {10, 65535, 32}, {2, 65535, 32}, {2, 1000, 24}, {10, 1000, 24} }; // Type, side, bpp
+    for (const auto& tga : hostile_tga) {
+        uint8_t file[18 + 16] = {};
+        file[2] = static_cast<uint8_t>(tga[0]);
+        file[12] = file[14] = static_cast<uint8_t>(tga[1] & 0xFF);
+        file[13] = file[15] = static_cast<uint8_t>(tga[1] >> 8);
+        file[16] = static_cast<uint8_t>(tga[2]);
+        std::memset(file + 18, 0xFF, 16); // RLE: run packets of 128 pixels
+        expect_rejected(file, sizeof(file), "TGA type " + std::to_string(tga[0]) + " " + std::to_string(tga[1]) + "x" +
+                        std::to_string(tga[1]));
+    }
+    
+    std::remove(path.c_str());
+    std::cout << "[NiceShot] Image decoder test: " << (all_passed ? "SUCCESS" : "FAILED") << std::endl;
+    return all_passed ? 1.0 : 0.0;
+}
+
 NICESHOT_API double niceshot_get_encoding_status() {
     // Check if there are any _encode.json files in common recording directories
     // This is a simple check - in production you might want a more robust system
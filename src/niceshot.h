@@ -40,16 +40,95 @@ extern "C" {
     // Returns: job_id (>0) on success, 0.0 on failure
     NICESHOT_API double niceshot_save_png_async(const char* buffer_ptr_str, double width, double height, const char* filepath);
     
-    // Get status of async PNG job
+    // Save PNG asynchronously without copying the buffer (returns immediately with job ID)
+    // The caller must keep the buffer alive and unmodified until niceshot_get_job_buffer_released returns 1
+    // Parameters: buffer_ptr_str (GameMaker buffer address as string), width, height, filepath
+    // Returns: job_id (>0) on success, 0.0 on failure
+    NICESHOT_API double niceshot_save_png_async_borrowed(const char* buffer_ptr_str, double width, double height, const char* filepath);
+    
+    // Multi-format screenshots: the format comes from the filepath extension
+    // (.png, .qoi, .tga, .bmp, .jpg/.jpeg, .webp; QOI/TGA/BMP skip deflate for much lower latency,
+    // JPEG/WebP are lossy at niceshot_set_image_quality)
+    // GameMaker limits string-taking externals to 4 arguments, hence no separate format argument
+    
+    // Save an image synchronously on the calling thread
+    // Parameters: buffer_ptr_str (GameMaker buffer address as string), width, height, filepath
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_save_image(const char* buffer_ptr_str, double width, double height, const char* filepath);
+    
+    // Save an image asynchronously (returns immediately with job ID; same job functions as PNG jobs)
+    // Parameters: buffer_ptr_str, width, height, filepath
+    // Returns: job_id (>0) on success, 0.0 on failure
+    NICESHOT_API double niceshot_save_image_async(const char* buffer_ptr_str, double width, double height, const char* filepath);
+    
+    // Save an image asynchronously without copying the buffer (see niceshot_save_png_async_borrowed)
+    // Parameters: buffer_ptr_str, width, height, filepath
+    // Returns: job_id (>0) on success, 0.0 on failure
+    NICESHOT_API double niceshot_save_image_async_borrowed(const char* buffer_ptr_str, double width, double height, const char* filepath);
+    
+    // Thumbnails: downscaled copies written by the next save from the pixels it already holds,
+    // so a save slot needs one call instead of a second full save plus GML-side scaling.
+    // Add them right before the save call; it takes every variant added since the previous save, synchronous or async.
+    // The save returns 0.0 (async: the job reports failed (-1)) if its image or any variant could not be written.
+    
+    // Add a thumbnail variant to the next save (up to 8; the format comes from the extension)
+    // Parameters: filepath, width (1-16384), height (0 = keep the screenshot's aspect ratio)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_add_thumbnail(const char* filepath, double width, double height);
+    
+    // Forget thumbnail variants added since the last save
+    // Returns: 1.0
+    NICESHOT_API double niceshot_clear_thumbnails();
+    
+    // Set the downscale filter for thumbnails (applies to jobs queued afterwards)
+    // Parameters: filter (0=box/area average (default), 1=Lanczos-3, sharper but slower)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_thumbnail_filter(double filter);
+    
+    // Transcode a QOI/TGA/BMP file to PNG on a worker thread with the current PNG settings
+    // Parameters: source_path, png_path ("" = source path with a .png extension)
+    // Returns: job_id (>0) on success, 0.0 on failure
+    NICESHOT_API double niceshot_convert_to_png_async(const char* source_path, const char* png_path);
+    
+    // Queue PNG conversion jobs for every .qoi/.tga/.bmp file in a directory (not recursive)
+    // Parameters: directory, delete_sources (1=delete each source after its PNG is written)
+    // Returns: number of jobs queued, -1.0 on error
+    NICESHOT_API double niceshot_convert_directory_to_png(const char* directory, double delete_sources);
+    
+    // Check whether NiceShot has finished reading the buffer of an async PNG job
+    // Parameters: job_id
+    // Returns: 1.0 if the buffer may be reused/freed, 0.0 if still in use, -2=not_found/invalid
+    NICESHOT_API double niceshot_get_job_buffer_released(double job_id);
+    
+    // Get status of async PNG job (lock-free, cheap enough to poll every step)
     // Parameters: job_id
     // Returns: 0=queued, 1=processing, 2=completed, -1=failed, -2=not_found/invalid
     NICESHOT_API double niceshot_get_job_status(double job_id);
     
-    // Cleanup completed/failed job (frees memory)
+    // Cleanup completed/failed job (frees its status slot; up to 16384 jobs can be outstanding,
+    // further saves fail until finished jobs are cleaned up). The id then reads as not found.
     // Parameters: job_id
     // Returns: 1.0 on success, 0.0 on failure
     NICESHOT_API double niceshot_cleanup_job(double job_id);
     
+    // Completion queue: instead of polling every job id each step, drain all finished jobs with one call.
+    // Enable it before queueing the jobs you want reported. Drained jobs are cleaned up automatically
+    // (niceshot_cleanup_job becomes optional; their ids then read as not found).
+    // Parameters: enabled (1=record finished jobs, 0=stop and discard undrained ones)
+    // Returns: 1.0
+    NICESHOT_API double niceshot_set_completion_queue(double enabled);
+    
+    // Get number of finished jobs waiting to be drained (may include jobs already cleaned up by id)
+    // Returns: count, -1.0 if not initialized
+    NICESHOT_API double niceshot_get_completion_count();
+    
+    // Write finished jobs into a GameMaker buffer, 16 bytes each:
+    // buffer_u32 job_id, buffer_s32 status (2=completed, -1=failed), buffer_f32 queue wait ms, buffer_f32 run ms.
+    // Jobs that do not fit stay queued for the next call.
+    // Parameters: buffer_ptr_str (buffer_get_address as string), buffer_size (bytes)
+    // Returns: number of records written, -1.0 on error
+    NICESHOT_API double niceshot_drain_completions(const char* buffer_ptr_str, double buffer_size);
+    
     // Get number of jobs waiting in queue
     // Returns: number of pending jobs, -1.0 if not initialized
     NICESHOT_API double niceshot_get_pending_job_count();
@@ -58,6 +137,48 @@ extern "C" {
     // Returns: 1.0 if running, 0.0 if stopped
     NICESHOT_API double niceshot_worker_thread_status();
     
+    // Priority classes for async jobs (GameMaker's 4-argument limit rules out a priority argument on the save calls):
+    // the class and deadline set here apply to every async save/conversion queued afterwards.
+    // Workers take the highest class first, earliest deadline first within a class; a job still queued
+    // past its deadline competes one class higher so background work is not starved forever.
+    // Parameters: priority (0=low, 1=normal (default), 2=high), deadline_ms (0 = class default: 10000/1000/100ms)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_job_priority(double priority, double deadline_ms);
+    
+    // Get the priority class applied to newly queued jobs
+    // Returns: 0=low, 1=normal, 2=high
+    NICESHOT_API double niceshot_get_job_priority();
+    
+    // Queue-wait statistics for one priority class (time from queueing until a worker starts the job)
+    // Parameters: priority (0-2), stat (0=jobs started, 1=average wait ms, 2=max wait ms, 3=deadline misses, 4=jobs queued now)
+    // Returns: the statistic, -1.0 for an invalid priority or stat
+    NICESHOT_API double niceshot_get_queue_wait_stat(double priority, double stat);
+    
+    // Reset the queue-wait statistics of all priority classes
+    // Returns: 1.0
+    NICESHOT_API double niceshot_reset_queue_wait_stats();
+    
+    // Bound the async queue. Pixel copies count against max_megabytes until their job has encoded them
+    // (borrowed buffers do not count); jobs count against max_jobs until a worker starts them.
+    // Parameters: max_megabytes (0 = unlimited, default 1024), max_jobs (0 = unlimited, default)
+    // Returns: 1.0 on success, 0.0 on negative limits
+    NICESHOT_API double niceshot_set_queue_limits(double max_megabytes, double max_jobs);
+    
+    // What a save/convert call does when the queue is full. Overflowing calls return job id 0.
+    // Parameters: policy (0=reject the new job, 1=drop the oldest waiting job of the same or a lower priority,
+    //             2=block until there is room, then reject), timeout_ms (longest block for policy 2)
+    // Dropped jobs end as failed (-1) and are reported by niceshot_drain_completions.
+    // Returns: 1.0 on success, 0.0 for an invalid policy or timeout
+    NICESHOT_API double niceshot_set_queue_overflow_policy(double policy, double timeout_ms);
+    
+    // Pixel memory held by queued and running async jobs
+    // Returns: megabytes
+    NICESHOT_API double niceshot_get_queued_memory();
+    
+    // Jobs rejected or dropped by the queue limits since initialization
+    // Returns: count
+    NICESHOT_API double niceshot_get_queue_overflow_count();
+    
     // Performance tuning functions
     
     // Set PNG compression level (0=fastest, 9=smallest, 6=default)
@@ -78,11 +199,85 @@ extern "C" {
     // Returns: current thread count, -1.0 if not initialized
     NICESHOT_API double niceshot_get_thread_count();
     
+    // Enable parallel PNG encoding: images of 1 megapixel or more are split into row stripes
+    // that are filtered and deflated across the worker threads (default on)
+    // Parameters: enabled (1=on, 0=always encode on a single worker)
+    // Returns: 1.0 on success
+    NICESHOT_API double niceshot_set_parallel_png(double enabled);
+    
+    // Get parallel PNG encoding setting
+    // Returns: 1=enabled, 0=disabled
+    NICESHOT_API double niceshot_get_parallel_png();
+    
+    // Select the deflate backend used for PNG output
+    // Parameters: backend (0=zlib, 1=zlib-ng, 2=libdeflate; optional backends must be built in)
+    // Returns: 1.0 on success, 0.0 if the backend is unknown or not available in this build
+    NICESHOT_API double niceshot_set_png_backend(double backend);
+    
+    // Get the current PNG deflate backend
+    // Returns: backend id (0=zlib, 1=zlib-ng, 2=libdeflate)
+    NICESHOT_API double niceshot_get_png_backend();
+    
+    // Check whether a deflate backend was built into this DLL
+    // Parameters: backend id
+    // Returns: 1=available, 0=not available
+    NICESHOT_API double niceshot_is_png_backend_available(double backend);
+    
+    // Select how PNG rows are filtered before deflate (trades file size for encode speed)
+    // Parameters: strategy (0=none, 1=up, 2=min-sum-abs (default), 3=brute-force)
+    // Returns: 1.0 on success, 0.0 on invalid strategy
+    NICESHOT_API double niceshot_set_png_filter(double strategy);
+    
+    // Get the current PNG filter strategy
+    // Returns: strategy id (0=none, 1=up, 2=min-sum-abs, 3=brute-force)
+    NICESHOT_API double niceshot_get_png_filter();
+    
+    // Set the quality used by JPEG and WebP saves (applies to jobs queued afterwards)
+    // Parameters: quality (1-100; 100 makes WebP lossless and JPEG keeps full-resolution chroma from 90 up)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_image_quality(double quality);
+    
+    // Get the current JPEG/WebP quality
+    // Returns: quality (1-100)
+    NICESHOT_API double niceshot_get_image_quality();
+    
+    // Check whether an image format is compiled into this build (JPEG and WebP are optional)
+    // Parameters: format (0=PNG, 1=QOI, 2=TGA, 3=BMP, 4=JPEG, 5=WebP)
+    // Returns: 1.0 if available, 0.0 otherwise
+    NICESHOT_API double niceshot_is_image_format_available(double format);
+    
+    // Set the maximum memory kept in the pixel buffer pool (recordings may exceed it while active)
+    // Parameters: megabytes (0 disables pooling outside recordings)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_buffer_pool_limit(double megabytes);
+    
+    // Get number of pixel buffer requests served from the pool
+    // Returns: hit count
+    NICESHOT_API double niceshot_get_buffer_pool_hits();
+    
+    // Get number of pixel buffer requests that had to allocate
+    // Returns: miss count
+    NICESHOT_API double niceshot_get_buffer_pool_misses();
+    
+    // Get memory currently held by idle pooled buffers
+    // Returns: pooled memory in megabytes
+    NICESHOT_API double niceshot_get_buffer_pool_memory();
+    
     // Benchmark function - test PNG encoding performance
     // Parameters: width, height, iteration_count
     // Returns: average encode time in milliseconds, -1.0 on error
     NICESHOT_API double niceshot_benchmark_png(double width, double height, double iterations);
     
+    // Benchmark function - encode the same image with every available deflate backend and log time, MB/s and size
+    // Parameters: width, height, iteration_count (per backend)
+    // Returns: id of the fastest backend, -1.0 on error
+    NICESHOT_API double niceshot_benchmark_png_backends(double width, double height, double iterations);
+    
+    // Benchmark function - test RGBA to YUV420p colour conversion throughput
+    // Parameters: width, height, iteration_count
+    // Returns: multithreaded conversion throughput in GB/s of RGBA input, -1.0 on error
+    NICESHOT_API double niceshot_benchmark_yuv(double width, double height, double iterations);
+    
     // Video Recording Functions
     
     // Start video recording with specified settings (width,height,fps,bitrate,buffer_frames)
@@ -95,6 +290,13 @@ extern "C" {
     // Returns: 1.0 on success, 0.0 on failure, -1.0 if buffer full (frame dropped)
     NICESHOT_API double niceshot_record_frame(const char* buffer_ptr_str);
     
+    // Record a block of game audio (call before or after record_frame, whenever the game has audio to push)
+    // Set the format first with niceshot_set_audio_format. The block is placed at the time of the call and later blocks
+    // follow on gaplessly; a pause of more than 100ms in pushing is filled with silence. Audio before the first frame is dropped.
+    // Parameters: buffer_ptr_str (GameMaker buffer address as string, interleaved signed 16-bit samples), bytes
+    // Returns: 1.0 on success, 0.0 on failure or if no audio is being recorded, -1.0 if the audio queue is full (block dropped)
+    NICESHOT_API double niceshot_record_audio(const char* buffer_ptr_str, double bytes);
+    
     // Stop video recording and finalize file
     // Returns: 1.0 on success, 0.0 on failure
     NICESHOT_API double niceshot_stop_recording();
@@ -111,15 +313,118 @@ extern "C" {
     // Returns: 0=not recording, 1=recording, 2=finalizing, -1=error
     NICESHOT_API double niceshot_get_recording_status();
     
+    // Set the instant replay window (call before start_recording in mode 2). The buffer keeps at least the window
+    // while it fits in the memory budget, dropping whole 1-second GOPs from the oldest end.
+    // Parameters: seconds (default 30), memory_mb (default 512, at least 16)
+    // Returns: 1.0 on success, 0.0 if invalid
+    NICESHOT_API double niceshot_set_replay_buffer(double seconds, double memory_mb);
+    
+    // Save the last seconds of an instant replay recording on a background thread; recording carries on meanwhile.
+    // The clip starts on a keyframe, so it can run up to a second longer than asked. H.264 clips are written as
+    // filepath with .mp4; without x264 they are lossless .raw + _audio.wav + _recording.json for NiceShot_Converter.
+    // Parameters: filepath, seconds (clamped to what is buffered)
+    // Returns: 1.0 if the save started, 0.0 if not in replay mode, nothing is buffered or a save is in progress
+    NICESHOT_API double niceshot_save_replay(const char* filepath, double seconds);
+    
+    // Get the state of the last niceshot_save_replay
+    // Returns: 1=saving, 0=saved (or no save yet), -1=failed, -2=not in replay mode
+    NICESHOT_API double niceshot_get_replay_save_status();
+    
+    // Get how much video the replay buffer holds
+    // Returns: seconds buffered, -1.0 if not in replay mode
+    NICESHOT_API double niceshot_get_replay_seconds();
+    
     // Set video quality preset (call before start_recording)
     // Parameters: preset (0=ultrafast, 1=fast, 2=medium, 3=slow, 4=slower)
     // Returns: 1.0 on success, 0.0 on failure
     NICESHOT_API double niceshot_set_video_preset(double preset);
     
+    // Set recording mode (call before start_recording)
+    // Parameters: mode (0=raw RGBA to .raw for offline encoding, 1=live H.264 to .h264, falls back to raw if x264 fails,
+    //                   2=instant replay: the last seconds stay in memory and nothing is written until niceshot_save_replay)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_recording_mode(double mode);
+    
+    // Get current recording mode
+    // Returns: 0=raw, 1=live H.264, 2=instant replay
+    NICESHOT_API double niceshot_get_recording_mode();
+    
+    // Set raw capture format (call before start_recording)
+    // Parameters: enabled (1=lossless QOI-compressed .raw container, 0=legacy headerless RGBA readable by FFmpeg rawvideo)
+    // Returns: 1.0 on success
+    NICESHOT_API double niceshot_set_raw_compression(double enabled);
+    
+    // Get current raw capture format
+    // Returns: 1=compressed container, 0=headerless RGBA
+    NICESHOT_API double niceshot_get_raw_compression();
+    
+    // Enable frame delta capture (call before start_recording; raw mode with compression only)
+    // Identical frames are stored as repeat markers and partially changed frames as changed 32x32 tiles
+    // Parameters: enabled (1=on, default; 0=store every frame in full)
+    // Returns: 1.0 on success
+    NICESHOT_API double niceshot_set_frame_delta(double enabled);
+    
+    // Get frame delta capture setting
+    // Returns: 1=enabled, 0=disabled
+    NICESHOT_API double niceshot_get_frame_delta();
+
+    // Set how recorded frames are placed in time (call before start_recording)
+    // Live H.264 applies it while encoding; the compressed raw container stores capture timestamps for the converter.
+    // Headerless raw has no timestamps and always uses frame count timing.
+    // Parameters: mode (0=frame count at the nominal fps, 1=constant frame rate, default: duplicates frames across
+    //             hitches and drops extras, 2=variable frame rate: capture times, writes <name>_timecodes.txt for muxing)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_video_timing(double mode);
+
+    // Get video timing mode
+    // Returns: 0=frame count, 1=constant frame rate, 2=variable frame rate
+    NICESHOT_API double niceshot_get_video_timing();
+
+    // Set the output container for encoded video (call before start_recording)
+    // Live H.264 writes it directly; raw recordings pass it on to NiceShot_Converter through the metadata.
+    // Parameters: container (0=bare .h264 stream plus an FFmpeg remux script, 1=MP4, default,
+    //             2=fragmented MP4: flushed every second, playable up to the last fragment if the game crashes)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_video_container(double container);
+
+    // Get video output container
+    // Returns: 0=.h264, 1=MP4, 2=fragmented MP4
+    NICESHOT_API double niceshot_get_video_container();
+
+    // Set the format of the audio pushed with niceshot_record_audio (call before start_recording)
+    // MP4 recordings get an interleaved audio track; raw and .h264 recordings get <name>_audio.wav, starting at the first
+    // frame, which NiceShot_Converter muxes into its MP4.
+    // Parameters: sample_rate (8000-48000 Hz, 0=no audio, default), channels (1 or 2)
+    // Returns: 1.0 on success, 0.0 on failure
+    NICESHOT_API double niceshot_set_audio_format(double sample_rate, double channels);
+
+    // Set the audio codec for MP4 recordings (call before start_recording)
+    // Opus needs 8000, 12000, 16000, 24000 or 48000 Hz; other rates are recorded as PCM.
+    // Parameters: codec (0=16-bit PCM, 1=Opus, the default when available), bitrate_kbps (Opus only, 0=64 per channel)
+    // Returns: 1.0 on success, 0.0 if invalid or not available in this build
+    NICESHOT_API double niceshot_set_audio_codec(double codec, double bitrate_kbps);
+
+    // Get audio codec
+    // Returns: 0=PCM, 1=Opus
+    NICESHOT_API double niceshot_get_audio_codec();
+
+    // Check whether an audio codec was compiled in (Opus needs libopus, see VCPKG_SETUP.md)
+    // Parameters: codec (0=PCM, 1=Opus)
+    // Returns: 1.0 if available, 0.0 if not
+    NICESHOT_API double niceshot_is_audio_codec_available(double codec);
+
     // Test x264 H.264 encoder availability and functionality
     // Returns: 1.0 if x264 available and working, 0.0 if not available/failed
     NICESHOT_API double niceshot_test_x264();
     
+    // Verify the SIMD RGBA to YUV420p kernels against the scalar reference on random frames
+    // Returns: 1.0 if every supported kernel is bit-identical, 0.0 on mismatch
+    NICESHOT_API double niceshot_test_yuv_conversion();
+    
+    // Round-trip QOI, TGA and BMP through the readers and check that corrupt or hostile headers are rejected
+    // Returns: 1.0 if every case behaves, 0.0 otherwise
+    NICESHOT_API double niceshot_test_image_decoders();
+    
     // Check if offline H.264 encoding is currently running
     // Returns: 1.0 if encoding in progress, 0.0 if no encoding active
     NICESHOT_API double niceshot_get_encoding_status();
@@ -0,0 +1,337 @@
+#include "png_filter.h"
+#include "simd_target.h"
+#include "yuv_convert.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NICESHOT_PNG_X86
+#include <immintrin.h>
+#endif
+
+static const size_t BPP = 4;
+
+enum PngFilter : uint8_t {
+    FILTER_NONE = 0,
+    FILTER_SUB = 1,
+    FILTER_UP = 2,
+    FILTER_AVERAGE = 3,
+    FILTER_PAETH = 4,
+    FILTER_COUNT = 5
+};
+
+// Filter bytes [begin, end) of a row into out and return the sum of absolute filtered values taken as signed
+// (libpng's cost heuristic). prev is the row above, all zeros for the first image row.
+typedef uint64_t (*FilterKernel)(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out);
+
+static inline uint32_t signed_abs(uint8_t v) {
+    int8_t s = static_cast<int8_t>(v);
+    return static_cast<uint32_t>(s < 0 ? -s : s);
+}
+
+static inline uint8_t paeth_predictor(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    if (pb <= pc) return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+}
+
+static uint64_t filter_none_scalar(const uint8_t* row, const uint8_t*, size_t begin, size_t end, uint8_t* out) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; ++i) {
+        out[i] = row[i];
+        cost += signed_abs(out[i]);
+    }
+    return cost;
+}
+
+static uint64_t filter_sub_scalar(const uint8_t* row, const uint8_t*, size_t begin, size_t end, uint8_t* out) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; ++i) {
+        uint8_t left = i >= BPP ? row[i - BPP] : 0;
+        out[i] = static_cast<uint8_t>(row[i] - left);
+        cost += signed_abs(out[i]);
+    }
+    return cost;
+}
+
+static uint64_t filter_up_scalar(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; ++i) {
+        out[i] = static_cast<uint8_t>(row[i] - prev[i]);
+        cost += signed_abs(out[i]);
+    }
+    return cost;
+}
+
+static uint64_t filter_average_scalar(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; ++i) {
+        int left = i >= BPP ? row[i - BPP] : 0;
+        out[i] = static_cast<uint8_t>(row[i] - ((left + prev[i]) >> 1));
+        cost += signed_abs(out[i]);
+    }
+    return cost;
+}
+
+static uint64_t filter_paeth_scalar(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; ++i) {
+        int a = i >= BPP ? row[i - BPP] : 0;
+        int c = i >= BPP ? prev[i - BPP] : 0;
+        out[i] = static_cast<uint8_t>(row[i] - paeth_predictor(a, prev[i], c));
+        cost += signed_abs(out[i]);
+    }
+    return cost;
+}
+
+#ifdef NICESHOT_PNG_X86
+
+// AVX2 kernels: 32 bytes per step from the first full pixel on; the first pixel and the tail use the scalar code.
+// abs_epi8 maps -128 to 0x80, which sad_epu8 then counts as 128, matching signed_abs.
+
+NICESHOT_TARGET("avx2")
+static inline __m256i accumulate_cost_avx2(__m256i cost, __m256i filtered) {
+    return _mm256_add_epi64(cost, _mm256_sad_epu8(_mm256_abs_epi8(filtered), _mm256_setzero_si256()));
+}
+
+NICESHOT_TARGET("avx2")
+static inline uint64_t horizontal_sum_avx2(__m256i cost) {
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(cost), _mm256_extracti128_si256(cost, 1));
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    return lanes[0] + lanes[1];
+}
+
+NICESHOT_TARGET("avx2")
+static uint64_t filter_none_avx2(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    __m256i cost = _mm256_setzero_si256();
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+        cost = accumulate_cost_avx2(cost, x);
+    }
+    return horizontal_sum_avx2(cost) + filter_none_scalar(row, prev, i, end, out);
+}
+
+NICESHOT_TARGET("avx2")
+static uint64_t filter_sub_avx2(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    size_t i = std::max(begin, BPP);
+    uint64_t head = filter_sub_scalar(row, prev, begin, std::min(i, end), out);
+    __m256i cost = _mm256_setzero_si256();
+    for (; i + 32 <= end; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i - BPP));
+        __m256i filtered = _mm256_sub_epi8(x, a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), filtered);
+        cost = accumulate_cost_avx2(cost, filtered);
+    }
+    return head + horizontal_sum_avx2(cost) + filter_sub_scalar(row, prev, i, end, out);
+}
+
+NICESHOT_TARGET("avx2")
+static uint64_t filter_up_avx2(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    __m256i cost = _mm256_setzero_si256();
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i));
+        __m256i filtered = _mm256_sub_epi8(x, b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), filtered);
+        cost = accumulate_cost_avx2(cost, filtered);
+    }
+    return horizontal_sum_avx2(cost) + filter_up_scalar(row, prev, i, end, out);
+}
+
+NICESHOT_TARGET("avx2")
+static uint64_t filter_average_avx2(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    size_t i = std::max(begin, BPP);
+    uint64_t head = filter_average_scalar(row, prev, begin, std::min(i, end), out);
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i cost = _mm256_setzero_si256();
+    for (; i + 32 <= end; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i - BPP));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i));
+        // avg_epu8 rounds up; subtract the carry bit to get floor((a + b) / 2)
+        __m256i average = _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), one));
+        __m256i filtered = _mm256_sub_epi8(x, average);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), filtered);
+        cost = accumulate_cost_avx2(cost, filtered);
+    }
+    return head + horizontal_sum_avx2(cost) + filter_average_scalar(row, prev, i, end, out);
+}
+
+// Paeth predictor on 16-bit lanes: pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+NICESHOT_TARGET("avx2")
+static inline __m256i paeth_predictor_avx2(__m256i a, __m256i b, __m256i c) {
+    __m256i pa_signed = _mm256_sub_epi16(b, c);
+    __m256i pb_signed = _mm256_sub_epi16(a, c);
+    __m256i pa = _mm256_abs_epi16(pa_signed);
+    __m256i pb = _mm256_abs_epi16(pb_signed);
+    __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(pa_signed, pb_signed));
+    __m256i not_a = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb), _mm256_cmpgt_epi16(pa, pc));
+    __m256i b_or_c = _mm256_blendv_epi8(b, c, _mm256_cmpgt_epi16(pb, pc));
+    return _mm256_blendv_epi8(a, b_or_c, not_a);
+}
+
+NICESHOT_TARGET("avx2")
+static uint64_t filter_paeth_avx2(const uint8_t* row, const uint8_t* prev, size_t begin, size_t end, uint8_t* out) {
+    size_t i = std::max(begin, BPP);
+    uint64_t head = filter_paeth_scalar(row, prev, begin, std::min(i, end), out);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i cost = _mm256_setzero_si256();
+    for (; i + 32 <= end; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i - BPP));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i - BPP));
+        // Unpack and pack both work per 128-bit lane, so the byte order survives the round trip
+        __m256i predicted_lo = paeth_predictor_avx2(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero),
+                                                    _mm256_unpacklo_epi8(c, zero));
+        __m256i predicted_hi = paeth_predictor_avx2(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero),
+                                                    _mm256_unpackhi_epi8(c, zero));
+        __m256i filtered = _mm256_sub_epi8(x, _mm256_packus_epi16(predicted_lo, predicted_hi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), filtered);
+        cost = accumulate_cost_avx2(cost, filtered);
+    }
+    return head + horizontal_sum_avx2(cost) + filter_paeth_scalar(row, prev, i, end, out);
+}
+
+#endif // NICESHOT_PNG_X86
+
+struct FilterKernels {
+    FilterKernel kernel[FILTER_COUNT];
+    bool simd;
+};
+
+static FilterKernels select_filter_kernels() {
+#ifdef NICESHOT_PNG_X86
+    // CPU feature detection lives with the YUV kernels
+    if (yuv_kernel_supported(YuvKernel::AVX2)) {
+        return { { filter_none_avx2, filter_sub_avx2, filter_up_avx2, filter_average_avx2, filter_paeth_avx2 }, true };
+    }
+#endif
+    return { { filter_none_scalar, filter_sub_scalar, filter_up_scalar, filter_average_scalar, filter_paeth_scalar }, false };
+}
+
+static const FilterKernels& filter_kernels() {
+    static const FilterKernels kernels = select_filter_kernels();
+    return kernels;
+}
+
+const char* png_filter_strategy_name(PngFilterStrategy strategy) {
+    switch (strategy) {
+    case PngFilterStrategy::NONE: return "none";
+    case PngFilterStrategy::UP: return "up";
+    case PngFilterStrategy::MIN_SUM_ABS: return "min-sum-abs";
+    case PngFilterStrategy::BRUTE_FORCE: return "brute-force";
+    }
+    return "unknown";
+}
+
+bool png_filter_simd_available() {
+    return filter_kernels().simd;
+}
+
+// Deflates candidate rows on their own to measure them; one stream reused for every trial of a row range
+class TrialDeflater {
+public:
+    explicit TrialDeflater(int level) : ready(false) {
+        std::memset(&zs, 0, sizeof(zs));
+        ready = deflateInit2(&zs, std::max(1, std::min(level, 9)), Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~TrialDeflater() {
+        if (ready) {
+            deflateEnd(&zs);
+        }
+    }
+
+    bool is_ready() const { return ready; }
+
+    uint64_t compressed_size(const uint8_t* data, size_t size) {
+        deflateReset(&zs);
+        output.resize(deflateBound(&zs, static_cast<uLong>(size)));
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = static_cast<uInt>(size);
+        zs.next_out = output.data();
+        zs.avail_out = static_cast<uInt>(output.size());
+        deflate(&zs, Z_FINISH);
+        return zs.total_out;
+    }
+
+private:
+    z_stream zs;
+    bool ready;
+    std::vector<uint8_t> output;
+};
+
+// Try every filter on a row and keep the cheapest into out ([filter byte][row bytes]).
+// candidate needs row bytes of scratch; trial == nullptr scores by sum of absolute values.
+static void filter_row_best(const FilterKernels& kernels, const uint8_t* row, const uint8_t* prev, size_t bytes,
+                            uint8_t* out, uint8_t* candidate, TrialDeflater* trial) {
+    uint64_t best_cost = UINT64_MAX;
+    uint8_t* best = out + 1;
+    uint8_t* attempt = candidate;
+    for (uint8_t f = FILTER_NONE; f < FILTER_COUNT; ++f) {
+        uint64_t cost = kernels.kernel[f](row, prev, 0, bytes, attempt);
+        if (trial) {
+            cost = trial->compressed_size(attempt, bytes);
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            out[0] = f;
+            std::swap(best, attempt);
+        }
+    }
+    if (best != out + 1) {
+        std::memcpy(out + 1, best, bytes);
+    }
+}
+
+void png_filter_rows(PngFilterStrategy strategy, int compression_level, const uint8_t* pixels, uint32_t width,
+                     uint32_t row_begin, uint32_t row_end, uint8_t* out) {
+    const FilterKernels& kernels = filter_kernels();
+    size_t stride = static_cast<size_t>(width) * BPP;
+    std::vector<uint8_t> zero_row(row_begin == 0 ? stride : 0, 0);
+    std::vector<uint8_t> candidate;
+    std::unique_ptr<TrialDeflater> trial;
+    if (strategy == PngFilterStrategy::MIN_SUM_ABS || strategy == PngFilterStrategy::BRUTE_FORCE) {
+        candidate.resize(stride);
+    }
+    if (strategy == PngFilterStrategy::BRUTE_FORCE) {
+        trial.reset(new TrialDeflater(compression_level));
+        if (!trial->is_ready()) {
+            trial.reset(); // Out of memory for the trial stream: fall back to the heuristic
+        }
+    }
+
+    for (uint32_t y = row_begin; y < row_end; ++y) {
+        const uint8_t* row = pixels + y * stride;
+        const uint8_t* prev = y > 0 ? row - stride : zero_row.data();
+        uint8_t* dst = out + (y - row_begin) * (stride + 1);
+
+        switch (strategy) {
+        case PngFilterStrategy::NONE:
+            dst[0] = FILTER_NONE;
+            std::memcpy(dst + 1, row, stride);
+            break;
+        case PngFilterStrategy::UP:
+            dst[0] = FILTER_UP;
+            kernels.kernel[FILTER_UP](row, prev, 0, stride, dst + 1);
+            break;
+        default:
+            filter_row_best(kernels, row, prev, stride, dst, candidate.data(), trial.get());
+            break;
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// PNG row filter stage for 8-bit RGBA (4 bytes per pixel).
+// Sub/Up/Average/Paeth have AVX2 versions picked at runtime that produce output identical to the scalar code.
+// Each filtered row depends only on its own pixels and the row above, so any row range can be filtered
+// independently (the striped writer relies on this to rebuild deflate dictionaries).
+
+enum class PngFilterStrategy {
+    NONE = 0,        // Filter type None on every row: no filtering cost, largest files
+    UP = 1,          // Filter type Up on every row: one cheap pass, good for UI and flat scenes
+    MIN_SUM_ABS = 2, // All five filters per row, smallest sum of absolute values wins (libpng's heuristic)
+    BRUTE_FORCE = 3  // All five filters per row, smallest trial deflate of the row wins (slowest)
+};
+
+static const int PNG_FILTER_STRATEGY_COUNT = 4;
+
+const char* png_filter_strategy_name(PngFilterStrategy strategy);
+
+// True when the AVX2 filter kernels are in use
+bool png_filter_simd_available();
+
+// Filter rows [row_begin, row_end) of tightly packed RGBA pixels into out:
+// one filter type byte followed by width * 4 filtered bytes per row.
+// compression_level is the deflate level BRUTE_FORCE uses for its trials.
+void png_filter_rows(PngFilterStrategy strategy, int compression_level, const uint8_t* pixels, uint32_t width,
+                     uint32_t row_begin, uint32_t row_end, uint8_t* out);
@@ -0,0 +1,169 @@
+#include "png_parallel.h"
+#include "png_filter.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const size_t PNG_BYTES_PER_PIXEL = 4;
+static const size_t DEFLATE_WINDOW = 32768;
+
+static inline void put_be32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+static bool write_chunk(FILE* fp, const char* type, const uint8_t* data, size_t length) {
+    uint8_t header[8];
+    put_be32(header, static_cast<uint32_t>(length));
+    std::memcpy(header + 4, type, 4);
+
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+    if (length > 0) {
+        crc = crc32(crc, data, static_cast<uInt>(length));
+    }
+    uint8_t crc_bytes[4];
+    put_be32(crc_bytes, static_cast<uint32_t>(crc));
+
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) &&
+           (length == 0 || fwrite(data, 1, length, fp) == length) &&
+           fwrite(crc_bytes, 1, sizeof(crc_bytes), fp) == sizeof(crc_bytes);
+}
+
+// Result of one stripe: raw deflate bytes plus the Adler-32 of its uncompressed (filtered) data
+struct PngStripe {
+    std::vector<uint8_t> compressed;
+    uLong adler;
+    uLong filtered_size;
+    bool ok;
+};
+
+unsigned png_stripe_count(uint32_t height, unsigned max_threads) {
+    unsigned by_rows = std::max<uint32_t>(1, height / PNG_MIN_ROWS_PER_STRIPE);
+    return std::max(1u, std::min(max_threads, by_rows));
+}
+
+static void encode_stripe(const uint8_t* pixels, uint32_t width, int level, DeflateBackend backend,
+                          PngFilterStrategy filter, uint32_t row_begin, uint32_t row_end, bool last, PngStripe& stripe) {
+    size_t row_bytes = static_cast<size_t>(width) * PNG_BYTES_PER_PIXEL + 1;
+    std::vector<uint8_t> filtered((row_end - row_begin) * row_bytes);
+    png_filter_rows(filter, level, pixels, width, row_begin, row_end, filtered.data());
+
+    stripe.filtered_size = static_cast<uLong>(filtered.size());
+    stripe.adler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), static_cast<uInt>(filtered.size()));
+
+    // Prime with the previous stripe's trailing filtered bytes so matches can reach back across the seam.
+    // Filtering is deterministic, so those rows are simply re-filtered here instead of waiting on the other stripe.
+    std::vector<uint8_t> dictionary;
+    size_t dict_size = 0;
+    if (row_begin > 0) {
+        uint32_t dict_rows = static_cast<uint32_t>(std::min<size_t>(row_begin, (DEFLATE_WINDOW + row_bytes - 1) / row_bytes));
+        dictionary.resize(dict_rows * row_bytes);
+        png_filter_rows(filter, level, pixels, width, row_begin - dict_rows, row_begin, dictionary.data());
+        dict_size = std::min(dictionary.size(), DEFLATE_WINDOW);
+    }
+
+    // Inner stripes end byte-aligned on a sync flush so the streams can be concatenated
+    stripe.ok = deflate_raw_piece(backend, level, dictionary.data() + dictionary.size() - dict_size, dict_size,
+                                  filtered.data(), filtered.size(), last, stripe.compressed);
+}
+
+// Backends without stream concatenation: filter the stripes in parallel into one buffer, then deflate it in one call
+static bool encode_whole(const uint8_t* pixels, uint32_t width, uint32_t height, int level, DeflateBackend backend,
+                         PngFilterStrategy filter, unsigned stripes, uint32_t rows_per_stripe, const PngParallelFor& parallel_for,
+                         std::vector<uint8_t>& zlib_stream) {
+    size_t row_bytes = static_cast<size_t>(width) * PNG_BYTES_PER_PIXEL + 1;
+    std::vector<uint8_t> filtered(height * row_bytes);
+    parallel_for(stripes, [&](unsigned i) {
+        uint32_t row_begin = i * rows_per_stripe;
+        uint32_t row_end = std::min(height, row_begin + rows_per_stripe);
+        png_filter_rows(filter, level, pixels, width, row_begin, row_end, filtered.data() + row_begin * row_bytes);
+    });
+    return deflate_zlib_buffer(backend, level, filtered.data(), filtered.size(), zlib_stream);
+}
+
+bool write_png_striped(const uint8_t* pixels, uint32_t width, uint32_t height, int compression_level,
+                       DeflateBackend backend, PngFilterStrategy filter, unsigned stripes, const PngParallelFor& parallel_for,
+                       const std::string& filepath, std::string& error_message) {
+    if (stripes == 0) {
+        stripes = 1;
+    }
+    uint32_t rows_per_stripe = (height + stripes - 1) / stripes;
+    stripes = (height + rows_per_stripe - 1) / rows_per_stripe;
+
+    bool striped = deflate_backend_supports_stripes(backend);
+    std::vector<PngStripe> results;
+    std::vector<uint8_t> zlib_stream;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    if (striped) {
+        results.resize(stripes);
+        parallel_for(stripes, [&](unsigned i) {
+            uint32_t row_begin = i * rows_per_stripe;
+            uint32_t row_end = std::min(height, row_begin + rows_per_stripe);
+            encode_stripe(pixels, width, compression_level, backend, filter, row_begin, row_end, i + 1 == stripes, results[i]);
+        });
+
+        for (const PngStripe& stripe : results) {
+            if (!stripe.ok) {
+                error_message = std::string("Parallel PNG deflate failed (") + deflate_backend_name(backend) + ")";
+                return false;
+            }
+            adler = adler32_combine(adler, stripe.adler, static_cast<z_off_t>(stripe.filtered_size));
+        }
+    } else if (!encode_whole(pixels, width, height, compression_level, backend, filter, stripes, rows_per_stripe,
+                             parallel_for, zlib_stream)) {
+        error_message = std::string("PNG deflate failed (") + deflate_backend_name(backend) + ")";
+        return false;
+    }
+
+    FILE* fp = nullptr;
+#ifdef _WIN32
+    fopen_s(&fp, filepath.c_str(), "wb");
+#else
+    fp = fopen(filepath.c_str(), "wb");
+#endif
+    if (!fp) {
+        error_message = "Failed to open file for writing: " + filepath;
+        return false;
+    }
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13];
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8;   // Bit depth
+    ihdr[9] = 6;   // Colour type RGBA
+    ihdr[10] = 0;  // Deflate
+    ihdr[11] = 0;  // Adaptive filtering
+    ihdr[12] = 0;  // No interlace
+
+    // zlib header: 32 KiB window, FLEVEL matching the compression level, FCHECK making it a multiple of 31
+    uint8_t flevel = compression_level < 2 ? 0 : compression_level < 6 ? 1 : compression_level == 6 ? 2 : 3;
+    uint8_t zlib_header[2] = { 0x78, static_cast<uint8_t>(flevel << 6) };
+    zlib_header[1] = static_cast<uint8_t>(zlib_header[1] + 31 - ((zlib_header[0] * 256 + zlib_header[1]) % 31));
+
+    uint8_t adler_bytes[4];
+    put_be32(adler_bytes, static_cast<uint32_t>(adler));
+
+    bool ok = fwrite(signature, 1, sizeof(signature), fp) == sizeof(signature) &&
+              write_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    if (striped) {
+        ok = ok && write_chunk(fp, "IDAT", zlib_header, sizeof(zlib_header));
+        for (size_t i = 0; ok && i < results.size(); ++i) {
+            ok = write_chunk(fp, "IDAT", results[i].compressed.data(), results[i].compressed.size());
+        }
+        ok = ok && write_chunk(fp, "IDAT", adler_bytes, sizeof(adler_bytes));
+    } else {
+        ok = ok && write_chunk(fp, "IDAT", zlib_stream.data(), zlib_stream.size());
+    }
+    ok = ok && write_chunk(fp, "IEND", nullptr, 0);
+
+    fclose(fp);
+    if (!ok) {
+        error_message = "Failed to write PNG data: " + filepath;
+    }
+    return ok;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "deflate_backend.h"
+#include "png_filter.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Parallel PNG writer: the image is split into row stripes that are filtered and deflated independently
+// (pigz-style: each stripe is primed with the previous stripe's last 32 KiB and ends on a sync flush),
+// then the raw deflate streams are stitched into one zlib stream across IDAT chunks.
+// Backends that cannot concatenate streams (libdeflate) still filter in parallel, then deflate in one call.
+// The output is a standard 8-bit RGBA PNG readable by any decoder.
+
+// Runs fn(i) for every i in [0, count) and returns once all calls have finished
+typedef std::function<void(unsigned count, const std::function<void(unsigned)>& fn)> PngParallelFor;
+
+// Below this many rows per stripe the dictionary priming and flush overhead outweigh the gain
+static const uint32_t PNG_MIN_ROWS_PER_STRIPE = 64;
+
+// Number of stripes worth using for an image on max_threads threads (1 = encode serially)
+unsigned png_stripe_count(uint32_t height, unsigned max_threads);
+
+// Encode tightly packed RGBA pixels to filepath using the given deflate backend, filter strategy and number of stripes
+bool write_png_striped(const uint8_t* pixels, uint32_t width, uint32_t height, int compression_level,
+                       DeflateBackend backend, PngFilterStrategy filter, unsigned stripes, const PngParallelFor& parallel_for,
+                       const std::string& filepath, std::string& error_message);
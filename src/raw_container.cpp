@@ -0,0 +1,821 @@
+#include "raw_container.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// SSE2 is part of the x64 baseline, so the tile compare needs no runtime dispatch
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define NICESHOT_RAW_SSE2
+#include <emmintrin.h>
+#endif
+
+// QOI op codes
+static const uint8_t QOI_OP_INDEX = 0x00; // 00xxxxxx
+static const uint8_t QOI_OP_DIFF = 0x40;  // 01xxxxxx
+static const uint8_t QOI_OP_LUMA = 0x80;  // 10xxxxxx
+static const uint8_t QOI_OP_RUN = 0xc0;   // 11xxxxxx
+static const uint8_t QOI_OP_RGB = 0xfe;
+static const uint8_t QOI_OP_RGBA = 0xff;
+static const uint8_t QOI_MASK_2 = 0xc0;
+static const int QOI_MAX_RUN = 62;
+
+static inline uint32_t qoi_hash(uint32_t px) {
+    uint32_t r = px & 0xff, g = (px >> 8) & 0xff, b = (px >> 16) & 0xff, a = px >> 24;
+    return (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+}
+
+static inline uint32_t load_pixel(const uint8_t* p) {
+    uint32_t px;
+    std::memcpy(&px, p, 4); // RGBA in memory -> R in the low byte on little-endian
+    return px;
+}
+
+size_t qoi_max_encoded_size(uint32_t width, uint32_t height) {
+    return static_cast<size_t>(width) * height * 5; // Worst case: one QOI_OP_RGBA per pixel
+}
+
+size_t qoi_encode_rgba(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* out) {
+    uint32_t index[64] = { 0 };
+    uint32_t prev = 0xff000000; // r=0 g=0 b=0 a=255
+    size_t pixel_count = static_cast<size_t>(width) * height;
+    size_t pos = 0;
+    int run = 0;
+
+    for (size_t i = 0; i < pixel_count; ++i) {
+        uint32_t px = load_pixel(rgba + i * 4);
+
+        // Flat regions are the common case in game frames
+        if (px == prev) {
+            run++;
+            if (run == QOI_MAX_RUN || i + 1 == pixel_count) {
+                out[pos++] = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            out[pos++] = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        uint32_t hash = qoi_hash(px);
+        if (index[hash] == px) {
+            out[pos++] = static_cast<uint8_t>(QOI_OP_INDEX | hash);
+        } else {
+            index[hash] = px;
+
+            if ((px >> 24) == (prev >> 24)) {
+                int8_t vr = static_cast<int8_t>((px & 0xff) - (prev & 0xff));
+                int8_t vg = static_cast<int8_t>(((px >> 8) & 0xff) - ((prev >> 8) & 0xff));
+                int8_t vb = static_cast<int8_t>(((px >> 16) & 0xff) - ((prev >> 16) & 0xff));
+                int8_t vg_r = static_cast<int8_t>(vr - vg);
+                int8_t vg_b = static_cast<int8_t>(vb - vg);
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    out[pos++] = static_cast<uint8_t>(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    out[pos++] = static_cast<uint8_t>(QOI_OP_LUMA | (vg + 32));
+                    out[pos++] = static_cast<uint8_t>(((vg_r + 8) << 4) | (vg_b + 8));
+                } else {
+                    out[pos++] = QOI_OP_RGB;
+                    out[pos++] = static_cast<uint8_t>(px);
+                    out[pos++] = static_cast<uint8_t>(px >> 8);
+                    out[pos++] = static_cast<uint8_t>(px >> 16);
+                }
+            } else {
+                out[pos++] = QOI_OP_RGBA;
+                std::memcpy(out + pos, &px, 4);
+                pos += 4;
+            }
+        }
+        prev = px;
+    }
+
+    return pos;
+}
+
+bool qoi_decode_rgba(const uint8_t* data, size_t size, uint32_t width, uint32_t height, uint8_t* rgba_out) {
+    uint32_t index[64] = { 0 };
+    uint8_t px[4] = { 0, 0, 0, 255 };
+    size_t pixel_count = static_cast<size_t>(width) * height;
+    size_t pos = 0;
+    int run = 0;
+
+    for (size_t i = 0; i < pixel_count; ++i) {
+        if (run > 0) {
+            run--;
+        } else {
+            if (pos >= size) {
+                return false; // Truncated payload
+            }
+
+            uint8_t b1 = data[pos++];
+            if (b1 == QOI_OP_RGB) {
+                if (pos + 3 > size) return false;
+                px[0] = data[pos++];
+                px[1] = data[pos++];
+                px[2] = data[pos++];
+            } else if (b1 == QOI_OP_RGBA) {
+                if (pos + 4 > size) return false;
+                px[0] = data[pos++];
+                px[1] = data[pos++];
+                px[2] = data[pos++];
+                px[3] = data[pos++];
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                uint32_t cached = index[b1];
+                std::memcpy(px, &cached, 4);
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                px[0] = static_cast<uint8_t>(px[0] + ((b1 >> 4) & 0x03) - 2);
+                px[1] = static_cast<uint8_t>(px[1] + ((b1 >> 2) & 0x03) - 2);
+                px[2] = static_cast<uint8_t>(px[2] + (b1 & 0x03) - 2);
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                if (pos >= size) return false;
+                uint8_t b2 = data[pos++];
+                int vg = (b1 & 0x3f) - 32;
+                px[0] = static_cast<uint8_t>(px[0] + vg - 8 + ((b2 >> 4) & 0x0f));
+                px[1] = static_cast<uint8_t>(px[1] + vg);
+                px[2] = static_cast<uint8_t>(px[2] + vg - 8 + (b2 & 0x0f));
+            } else {
+                run = b1 & 0x3f; // QOI_OP_RUN: this pixel plus `run` more
+            }
+
+            uint32_t current;
+            std::memcpy(&current, px, 4);
+            index[qoi_hash(current)] = current;
+        }
+
+        std::memcpy(rgba_out + i * 4, px, 4);
+    }
+
+    return true;
+}
+
+// Frame delta tiles
+
+uint32_t raw_delta_tile_count(uint32_t width, uint32_t height, uint32_t tile_size) {
+    return ((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+}
+
+static inline bool bytes_equal(const uint8_t* a, const uint8_t* b, size_t bytes) {
+    size_t i = 0;
+#ifdef NICESHOT_RAW_SSE2
+    // 64 bytes per step: OR the XORs together and test once
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 64 <= bytes; i += 64) {
+        __m128i d0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m128i d1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16)));
+        __m128i d2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 32)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 32)));
+        __m128i d3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 48)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 48)));
+        __m128i any = _mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i d = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(d, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    return std::memcmp(a + i, b + i, bytes - i) == 0;
+}
+
+size_t raw_delta_find_changed_tiles(const uint8_t* reference, const uint8_t* frame, uint32_t width, uint32_t height,
+                                    uint32_t tile_size, uint32_t* changed_out) {
+    uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    size_t stride = static_cast<size_t>(width) * 4;
+    size_t changed_count = 0;
+
+    for (uint32_t ty = 0; ty * tile_size < height; ++ty) {
+        uint32_t y_end = std::min(height, (ty + 1) * tile_size);
+
+        for (uint32_t tx = 0; tx < tiles_x; ++tx) {
+            size_t x_offset = static_cast<size_t>(tx) * tile_size * 4;
+            size_t row_bytes = static_cast<size_t>(std::min(tile_size, width - tx * tile_size)) * 4;
+
+            // Stop at the first differing row, so fully changed frames cost about one row per tile
+            for (uint32_t y = ty * tile_size; y < y_end; ++y) {
+                size_t offset = y * stride + x_offset;
+                if (!bytes_equal(reference + offset, frame + offset, row_bytes)) {
+                    changed_out[changed_count++] = ty * tiles_x + tx;
+                    break;
+                }
+            }
+        }
+    }
+
+    return changed_count;
+}
+
+size_t raw_delta_pack_tiles(const uint8_t* frame, uint32_t width, uint32_t height, uint32_t tile_size,
+                            const uint32_t* tiles, size_t tile_count, uint8_t* packed_out, uint8_t* reference) {
+    uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    size_t stride = static_cast<size_t>(width) * 4;
+    size_t pos = 0;
+
+    for (size_t i = 0; i < tile_count; ++i) {
+        uint32_t x = (tiles[i] % tiles_x) * tile_size;
+        uint32_t y = (tiles[i] / tiles_x) * tile_size;
+        size_t row_bytes = static_cast<size_t>(std::min(tile_size, width - x)) * 4;
+        uint32_t y_end = std::min(height, y + tile_size);
+
+        for (; y < y_end; ++y) {
+            size_t offset = y * stride + static_cast<size_t>(x) * 4;
+            std::memcpy(packed_out + pos, frame + offset, row_bytes);
+            if (reference) {
+                std::memcpy(reference + offset, frame + offset, row_bytes);
+            }
+            pos += row_bytes;
+        }
+    }
+
+    return pos;
+}
+
+void raw_delta_unpack_tiles(const uint8_t* packed, uint32_t width, uint32_t height, uint32_t tile_size,
+                            const uint32_t* tiles, size_t tile_count, uint8_t* frame) {
+    uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    size_t stride = static_cast<size_t>(width) * 4;
+    size_t pos = 0;
+
+    for (size_t i = 0; i < tile_count; ++i) {
+        uint32_t x = (tiles[i] % tiles_x) * tile_size;
+        uint32_t y = (tiles[i] / tiles_x) * tile_size;
+        size_t row_bytes = static_cast<size_t>(std::min(tile_size, width - x)) * 4;
+        uint32_t y_end = std::min(height, y + tile_size);
+
+        for (; y < y_end; ++y) {
+            std::memcpy(frame + y * stride + static_cast<size_t>(x) * 4, packed + pos, row_bytes);
+            pos += row_bytes;
+        }
+    }
+}
+
+// Packed size of a tile list, matching raw_delta_pack_tiles
+static size_t packed_tiles_size(uint32_t width, uint32_t height, uint32_t tile_size,
+                                const uint32_t* tiles, size_t tile_count) {
+    uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    size_t total = 0;
+    for (size_t i = 0; i < tile_count; ++i) {
+        uint32_t x = (tiles[i] % tiles_x) * tile_size;
+        uint32_t y = (tiles[i] / tiles_x) * tile_size;
+        total += static_cast<size_t>(std::min(tile_size, width - x)) * std::min(tile_size, height - y) * 4;
+    }
+    return total;
+}
+
+// RawFrameWriter
+
+RawFrameWriter::RawFrameWriter(FILE* f, uint32_t w, uint32_t h, RawFrameCodec c)
+    : file(f), width(w), height(h), codec(c), timestamps(false), timebase_num(1), timebase_den(1), input_bytes(0),
+      output_bytes(0) {
+    if (codec == RawFrameCodec::QOI) {
+        // Room for a full QOI frame plus a TILES record header listing every tile
+        scratch.resize(qoi_max_encoded_size(width, height) + 8 +
+                       static_cast<size_t>(raw_delta_tile_count(width, height, RAW_DELTA_TILE_SIZE)) * 4);
+    }
+}
+
+void RawFrameWriter::enable_timestamps(uint32_t num, uint32_t den) {
+    timestamps = true;
+    timebase_num = num;
+    timebase_den = den;
+}
+
+bool RawFrameWriter::write_header() {
+    uint32_t fields[4] = { RAW_CONTAINER_VERSION, width, height, timestamps ? RAW_HEADER_TIMESTAMPS : 0 };
+    uint32_t timebase[2] = { timebase_num, timebase_den };
+    if (fwrite(RAW_CONTAINER_MAGIC, 1, sizeof(RAW_CONTAINER_MAGIC), file) != sizeof(RAW_CONTAINER_MAGIC) ||
+        fwrite(fields, sizeof(uint32_t), 4, file) != 4 ||
+        (timestamps && fwrite(timebase, sizeof(uint32_t), 2, file) != 2)) {
+        return false;
+    }
+    output_bytes += sizeof(RAW_CONTAINER_MAGIC) + sizeof(fields) + (timestamps ? sizeof(timebase) : 0);
+    return true;
+}
+
+bool RawFrameWriter::write_frame(const uint8_t* rgba, int64_t timestamp) {
+    size_t frame_size = static_cast<size_t>(width) * height * 4;
+    const uint8_t* payload = rgba;
+    size_t payload_size = frame_size;
+    RawFrameCodec frame_codec = RawFrameCodec::UNCOMPRESSED;
+
+    if (codec == RawFrameCodec::QOI) {
+        size_t encoded_size = qoi_encode_rgba(rgba, width, height, scratch.data());
+        // Noise-like frames can expand; store those uncompressed
+        if (encoded_size < frame_size) {
+            payload = scratch.data();
+            payload_size = encoded_size;
+            frame_codec = RawFrameCodec::QOI;
+        }
+    }
+
+    if (!write_record(frame_codec, payload, payload_size, timestamp)) {
+        return false;
+    }
+
+    input_bytes += frame_size;
+    return true;
+}
+
+bool RawFrameWriter::write_qoi_frame(const uint8_t* encoded, size_t encoded_size, int64_t timestamp) {
+    if (!write_record(RawFrameCodec::QOI, encoded, encoded_size, timestamp)) {
+        return false;
+    }
+
+    input_bytes += static_cast<size_t>(width) * height * 4;
+    return true;
+}
+
+bool RawFrameWriter::write_repeat(uint32_t count, const int64_t* repeat_timestamps) {
+    if (count == 0) {
+        return true;
+    }
+    if (timestamps) {
+        // One record per frame so each keeps its own timestamp
+        if (!repeat_timestamps) {
+            return false;
+        }
+        uint32_t one = 1;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!write_record(RawFrameCodec::REPEAT, &one, sizeof(one), repeat_timestamps[i])) {
+                return false;
+            }
+        }
+    } else if (!write_record(RawFrameCodec::REPEAT, &count, sizeof(count), 0)) {
+        return false;
+    }
+
+    input_bytes += static_cast<uint64_t>(count) * width * height * 4;
+    return true;
+}
+
+bool RawFrameWriter::write_tiles(const uint32_t* tiles, size_t tile_count, const uint8_t* packed_pixels, size_t packed_size,
+                                 int64_t timestamp) {
+    if (codec != RawFrameCodec::QOI) {
+        return false; // Tile records need the scratch buffer sized in the constructor
+    }
+
+    uint32_t header[2] = { RAW_DELTA_TILE_SIZE, static_cast<uint32_t>(tile_count) };
+    size_t pos = 0;
+    std::memcpy(scratch.data(), header, sizeof(header));
+    pos += sizeof(header);
+    std::memcpy(scratch.data() + pos, tiles, tile_count * sizeof(uint32_t));
+    pos += tile_count * sizeof(uint32_t);
+
+    // Packed tiles are compressed as a single row of pixels
+    pos += qoi_encode_rgba(packed_pixels, static_cast<uint32_t>(packed_size / 4), 1, scratch.data() + pos);
+
+    if (!write_record(RawFrameCodec::TILES, scratch.data(), pos, timestamp)) {
+        return false;
+    }
+
+    input_bytes += static_cast<uint64_t>(width) * height * 4;
+    return true;
+}
+
+bool RawFrameWriter::write_record(RawFrameCodec record_codec, const void* payload, size_t payload_size, int64_t timestamp) {
+    size_t timestamp_size = timestamps ? sizeof(timestamp) : 0;
+    uint32_t size_field = static_cast<uint32_t>(timestamp_size + payload_size);
+    uint16_t codec_field = static_cast<uint16_t>(record_codec);
+    uint16_t flags_field = timestamps ? RAW_RECORD_TIMESTAMPED : 0;
+
+    if (fwrite(&size_field, sizeof(size_field), 1, file) != 1 ||
+        fwrite(&codec_field, sizeof(codec_field), 1, file) != 1 ||
+        fwrite(&flags_field, sizeof(flags_field), 1, file) != 1 ||
+        (timestamps && fwrite(&timestamp, sizeof(timestamp), 1, file) != 1) ||
+        fwrite(payload, 1, payload_size, file) != payload_size) {
+        return false;
+    }
+
+    output_bytes += 8 + size_field;
+    return true;
+}
+
+// RawFrameReader
+
+RawFrameReader::RawFrameReader()
+    : map_data(nullptr), map_size(0), map_pos(0),
+#ifdef _WIN32
+      file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr),
+#else
+      file_descriptor(-1),
+#endif
+      file(nullptr), width(0), height(0), container(false), timestamps(false), timebase_num(1), timebase_den(1),
+      frame_timestamp(0), frame_repeat(false), current(nullptr), repeats_left(0) {}
+
+RawFrameReader::~RawFrameReader() {
+    close();
+}
+
+bool RawFrameReader::map_file(const std::string& path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle, &file_size) || file_size.QuadPart == 0 ||
+        static_cast<unsigned long long>(file_size.QuadPart) > SIZE_MAX) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file_handle = handle;
+    mapping_handle = mapping;
+    map_data = static_cast<const uint8_t*>(view);
+    map_size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    file_descriptor = fd;
+    map_data = static_cast<const uint8_t*>(view);
+    map_size = static_cast<size_t>(st.st_size);
+#endif
+    map_pos = 0;
+    return true;
+}
+
+void RawFrameReader::unmap_file() {
+    if (!map_data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(map_data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = INVALID_HANDLE_VALUE;
+#else
+    munmap(const_cast<uint8_t*>(map_data), map_size);
+    ::close(file_descriptor);
+    file_descriptor = -1;
+#endif
+    map_data = nullptr;
+    map_size = 0;
+    map_pos = 0;
+}
+
+// Ask the OS to start reading [offset, offset + length) of the mapping in the background
+void RawFrameReader::prefetch(size_t offset, size_t length) {
+    if (!map_data || offset >= map_size) {
+        return;
+    }
+    length = std::min(length, map_size - offset);
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<uint8_t*>(map_data + offset);
+    range.NumberOfBytes = length;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise needs a page-aligned start
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = reinterpret_cast<uintptr_t>(map_data + offset);
+    uintptr_t aligned = begin & ~(static_cast<uintptr_t>(page_size) - 1);
+    madvise(reinterpret_cast<void*>(aligned), length + (begin - aligned), MADV_WILLNEED);
+#endif
+}
+
+// Prefetch one record ahead so disk reads overlap the caller's conversion/encode of the current frame
+void RawFrameReader::prefetch_next_record() {
+    if (!map_data) {
+        return;
+    }
+
+    if (!container) {
+        prefetch(map_pos, static_cast<size_t>(width) * height * 4);
+        return;
+    }
+
+    uint32_t size_field = 0;
+    if (map_pos + sizeof(size_field) <= map_size) {
+        std::memcpy(&size_field, map_data + map_pos, sizeof(size_field));
+        prefetch(map_pos, 8 + static_cast<size_t>(size_field));
+    }
+}
+
+bool RawFrameReader::open(const std::string& path, uint32_t w, uint32_t h) {
+    close();
+    width = w;
+    height = h;
+
+    // Prefer a mapping; stdio keeps working where mapping is unavailable (e.g. 32-bit address space)
+    if (!map_file(path)) {
+#ifdef _WIN32
+        fopen_s(&file, path.c_str(), "rb");
+#else
+        file = fopen(path.c_str(), "rb");
+#endif
+        if (!file) {
+            return false;
+        }
+    }
+
+    // Detect the container header; anything else is a legacy headerless RGBA dump
+    char magic[sizeof(RAW_CONTAINER_MAGIC)];
+    uint32_t fields[4];
+    const size_t header_size = sizeof(magic) + sizeof(fields);
+    bool has_header = false;
+    if (map_data) {
+        if (map_size >= header_size) {
+            std::memcpy(magic, map_data, sizeof(magic));
+            std::memcpy(fields, map_data + sizeof(magic), sizeof(fields));
+            has_header = true;
+        }
+    } else {
+        has_header = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                     fread(fields, sizeof(uint32_t), 4, file) == 4;
+    }
+
+    if (has_header && std::memcmp(magic, RAW_CONTAINER_MAGIC, sizeof(magic)) == 0) {
+        if (fields[0] > RAW_CONTAINER_VERSION) {
+            std::cerr << "[NiceShot] Raw container version " << fields[0] << " is newer than this build supports ("
+                      << RAW_CONTAINER_VERSION << ")" << std::endl;
+            close();
+            return false;
+        }
+        if (fields[1] != width || fields[2] != height) {
+            std::cerr << "[NiceShot] Raw container is " << fields[1] << "x" << fields[2]
+                      << ", expected " << width << "x" << height << std::endl;
+            close();
+            return false;
+        }
+        container = true;
+        map_pos = header_size;
+
+        // Version 1 wrote 0 into the header flags
+        if (fields[3] & RAW_HEADER_TIMESTAMPS) {
+            uint32_t timebase[2] = { 0, 0 };
+            if (map_data) {
+                if (map_size >= header_size + sizeof(timebase)) {
+                    std::memcpy(timebase, map_data + header_size, sizeof(timebase));
+                }
+                map_pos += sizeof(timebase);
+            } else if (fread(timebase, sizeof(uint32_t), 2, file) != 2) {
+                timebase[1] = 0;
+            }
+            if (timebase[0] == 0 || timebase[1] == 0) {
+                std::cerr << "[NiceShot] Raw container has an invalid timebase" << std::endl;
+                close();
+                return false;
+            }
+            timestamps = true;
+            timebase_num = timebase[0];
+            timebase_den = timebase[1];
+        }
+    } else {
+        container = false;
+        map_pos = 0;
+        if (file) {
+            fseek(file, 0, SEEK_SET);
+        }
+    }
+
+    reference.assign(static_cast<size_t>(width) * height * 4, 0);
+    current = reference.data();
+    repeats_left = 0;
+    prefetch_next_record();
+    return true;
+}
+
+void RawFrameReader::close() {
+    unmap_file();
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    container = false;
+    timestamps = false;
+    timebase_num = 1;
+    timebase_den = 1;
+    frame_timestamp = 0;
+    frame_repeat = false;
+    current = nullptr;
+}
+
+// Next container record; data points into the mapping or into the payload buffer
+bool RawFrameReader::read_record(uint16_t& codec, const uint8_t*& data, uint32_t& size, int64_t& timestamp) {
+    uint32_t size_field = 0;
+    uint16_t codec_field = 0;
+    uint16_t flags_field = 0;
+
+    if (map_data) {
+        if (map_size - map_pos < 8) {
+            return false; // End of file
+        }
+        std::memcpy(&size_field, map_data + map_pos, sizeof(size_field));
+        std::memcpy(&codec_field, map_data + map_pos + 4, sizeof(codec_field));
+        std::memcpy(&flags_field, map_data + map_pos + 6, sizeof(flags_field));
+        if (map_size - map_pos - 8 < size_field) {
+            return false; // Truncated record
+        }
+        data = map_data + map_pos + 8;
+        map_pos += 8 + static_cast<size_t>(size_field);
+    } else {
+        if (fread(&size_field, sizeof(size_field), 1, file) != 1 ||
+            fread(&codec_field, sizeof(codec_field), 1, file) != 1 ||
+            fread(&flags_field, sizeof(flags_field), 1, file) != 1) {
+            return false; // End of file
+        }
+        payload.resize(size_field);
+        if (fread(payload.data(), 1, size_field, file) != size_field) {
+            return false;
+        }
+        data = payload.data();
+    }
+
+    timestamp = 0;
+    if (flags_field & RAW_RECORD_TIMESTAMPED) {
+        if (size_field < sizeof(timestamp)) {
+            return false;
+        }
+        std::memcpy(&timestamp, data, sizeof(timestamp));
+        data += sizeof(timestamp);
+        size_field -= sizeof(timestamp);
+    }
+
+    codec = codec_field;
+    size = size_field;
+    return true;
+}
+
+const uint8_t* RawFrameReader::next_frame() {
+    if (!map_data && !file) {
+        return nullptr;
+    }
+
+    size_t frame_size = static_cast<size_t>(width) * height * 4;
+
+    if (!container) {
+        if (map_data) {
+            if (map_size - map_pos < frame_size) {
+                return nullptr;
+            }
+            current = map_data + map_pos;
+            map_pos += frame_size;
+        } else {
+            if (fread(reference.data(), 1, frame_size, file) != frame_size) {
+                return nullptr;
+            }
+            current = reference.data();
+        }
+        prefetch_next_record();
+        return current;
+    }
+
+    if (repeats_left > 0) {
+        repeats_left--;
+        frame_repeat = true;
+        return current;
+    }
+
+    uint16_t codec = 0;
+    const uint8_t* data = nullptr;
+    uint32_t size = 0;
+    int64_t timestamp = 0;
+    if (!read_record(codec, data, size, timestamp)) {
+        return nullptr;
+    }
+    prefetch_next_record();
+    frame_timestamp = timestamp;
+    frame_repeat = static_cast<RawFrameCodec>(codec) == RawFrameCodec::REPEAT;
+
+    // current always holds the last full frame so REPEAT and TILES can build on it
+    switch (static_cast<RawFrameCodec>(codec)) {
+    case RawFrameCodec::UNCOMPRESSED:
+        if (size != frame_size) {
+            return nullptr;
+        }
+        if (map_data) {
+            current = data; // Zero-copy
+        } else {
+            std::memcpy(reference.data(), data, frame_size);
+            current = reference.data();
+        }
+        break;
+
+    case RawFrameCodec::QOI:
+        if (!qoi_decode_rgba(data, size, width, height, reference.data())) {
+            return nullptr;
+        }
+        current = reference.data();
+        break;
+
+    case RawFrameCodec::REPEAT: {
+        uint32_t count = 0;
+        if (size != sizeof(count)) {
+            return nullptr;
+        }
+        std::memcpy(&count, data, sizeof(count));
+        if (count == 0) {
+            return nullptr;
+        }
+        repeats_left = count - 1;
+        break;
+    }
+
+    case RawFrameCodec::TILES: {
+        uint32_t header[2];
+        if (size < sizeof(header)) {
+            return nullptr;
+        }
+        std::memcpy(header, data, sizeof(header));
+        uint32_t tile_size = header[0];
+        uint32_t tile_count = header[1];
+        uint32_t tile_total = tile_size ? raw_delta_tile_count(width, height, tile_size) : 0;
+        size_t list_bytes = static_cast<size_t>(tile_count) * sizeof(uint32_t);
+        if (tile_size == 0 || tile_count > tile_total || sizeof(header) + list_bytes > size) {
+            return nullptr;
+        }
+
+        tiles.resize(tile_count);
+        std::memcpy(tiles.data(), data + sizeof(header), list_bytes);
+        for (uint32_t tile : tiles) {
+            if (tile >= tile_total) {
+                return nullptr;
+            }
+        }
+
+        size_t packed_size = packed_tiles_size(width, height, tile_size, tiles.data(), tiles.size());
+        tile_pixels.resize(packed_size);
+        if (!qoi_decode_rgba(data + sizeof(header) + list_bytes, size - sizeof(header) - list_bytes,
+                             static_cast<uint32_t>(packed_size / 4), 1, tile_pixels.data())) {
+            return nullptr;
+        }
+
+        // A zero-copy base frame has to be materialised before it can be patched
+        if (current != reference.data()) {
+            std::memcpy(reference.data(), current, frame_size);
+            current = reference.data();
+        }
+        raw_delta_unpack_tiles(tile_pixels.data(), width, height, tile_size, tiles.data(), tiles.size(), reference.data());
+        break;
+    }
+
+    default:
+        std::cerr << "[NiceShot] Unknown raw frame codec: " << codec << std::endl;
+        return nullptr;
+    }
+
+    return current;
+}
+
+bool RawFrameReader::read_frame(uint8_t* rgba_out) {
+    const uint8_t* frame = next_frame();
+    if (!frame) {
+        return false;
+    }
+    std::memcpy(rgba_out, frame, static_cast<size_t>(width) * height * 4);
+    return true;
+}
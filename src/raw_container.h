@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// NiceShot raw capture container (.raw) shared by the DLL and NiceShot_Converter
+//
+// Layout: file header, then one record per frame:
+//   [uint32 payload_size][uint16 codec][uint16 flags][payload]
+// Header: magic, then uint32 version, width, height, header flags; with RAW_HEADER_TIMESTAMPS (version 2)
+// two more uint32 give the timebase (num / den seconds per tick) and every record's payload starts with
+// its frame's int64 timestamp (record flag RAW_RECORD_TIMESTAMPED). Timestamped REPEAT records cover one frame each.
+// Files without the header are legacy headerless RGBA dumps and are still readable.
+
+enum class RawFrameCodec : uint16_t {
+    UNCOMPRESSED = 0, // width * height * 4 bytes of RGBA
+    QOI = 1,          // QOI-style lossless ops (runs, index, small deltas)
+    REPEAT = 2,       // uint32 count: the previous frame repeated count times
+    TILES = 3         // Changed tiles only: [uint32 tile_size][uint32 tile_count][uint32 index * tile_count][QOI tile pixels]
+};
+
+static const char RAW_CONTAINER_MAGIC[8] = { 'N', 'S', 'R', 'A', 'W', 'C', 'A', 'P' };
+static const uint32_t RAW_CONTAINER_VERSION = 2;
+static const uint32_t RAW_HEADER_TIMESTAMPS = 1;
+static const uint16_t RAW_RECORD_TIMESTAMPED = 1;
+
+// Lossless QOI-style RGBA codec. Encode output is at most qoi_max_encoded_size() bytes.
+size_t qoi_max_encoded_size(uint32_t width, uint32_t height);
+size_t qoi_encode_rgba(const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* out);
+bool qoi_decode_rgba(const uint8_t* data, size_t size, uint32_t width, uint32_t height, uint8_t* rgba_out);
+
+// Frame delta tiles (square, row-major tile grid; edge tiles are clipped to the frame)
+static const uint32_t RAW_DELTA_TILE_SIZE = 32;
+
+uint32_t raw_delta_tile_count(uint32_t width, uint32_t height, uint32_t tile_size);
+
+// Compare frame against reference tile by tile (SSE2), writing indices of changed tiles. Returns the count.
+size_t raw_delta_find_changed_tiles(const uint8_t* reference, const uint8_t* frame, uint32_t width, uint32_t height,
+                                    uint32_t tile_size, uint32_t* changed_out);
+
+// Copy the listed tiles of frame into packed_out (tile after tile, rows tightly packed) and into reference.
+// Returns the number of packed bytes.
+size_t raw_delta_pack_tiles(const uint8_t* frame, uint32_t width, uint32_t height, uint32_t tile_size,
+                            const uint32_t* tiles, size_t tile_count, uint8_t* packed_out, uint8_t* reference);
+
+// Inverse of raw_delta_pack_tiles: write packed tiles back into a full frame
+void raw_delta_unpack_tiles(const uint8_t* packed, uint32_t width, uint32_t height, uint32_t tile_size,
+                            const uint32_t* tiles, size_t tile_count, uint8_t* frame);
+
+// Writes frames into a container on a FILE* owned by the caller
+class RawFrameWriter {
+public:
+    RawFrameWriter(FILE* file, uint32_t width, uint32_t height, RawFrameCodec codec);
+
+    // Store a timestamp with every frame (call before write_header); timestamps are in num / den seconds
+    void enable_timestamps(uint32_t timebase_num, uint32_t timebase_den);
+
+    // timestamp is ignored unless enable_timestamps was called
+    bool write_header();
+    bool write_frame(const uint8_t* rgba, int64_t timestamp = 0);
+    // A frame already compressed with qoi_encode_rgba (instant replay keeps frames that way in memory)
+    bool write_qoi_frame(const uint8_t* encoded, size_t encoded_size, int64_t timestamp = 0);
+    // timestamps: one per repeated frame (required when timestamps are enabled)
+    bool write_repeat(uint32_t count, const int64_t* timestamps = nullptr);
+    bool write_tiles(const uint32_t* tiles, size_t tile_count, const uint8_t* packed_pixels, size_t packed_size,
+                     int64_t timestamp = 0);
+
+    uint64_t get_input_bytes() const { return input_bytes; }
+    uint64_t get_output_bytes() const { return output_bytes; }
+
+private:
+    bool write_record(RawFrameCodec record_codec, const void* payload, size_t payload_size, int64_t timestamp);
+
+    FILE* file;
+    uint32_t width;
+    uint32_t height;
+    RawFrameCodec codec;
+    bool timestamps;
+    uint32_t timebase_num;
+    uint32_t timebase_den;
+    std::vector<uint8_t> scratch; // Compressed payload of the current frame
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+};
+
+// Reads container or legacy headerless .raw files frame by frame.
+// The file is memory-mapped when possible (stdio fallback otherwise) and the next record is prefetched
+// while the current one is being converted.
+class RawFrameReader {
+public:
+    RawFrameReader();
+    ~RawFrameReader();
+
+    // width/height describe legacy files; container files must match them
+    bool open(const std::string& path, uint32_t width, uint32_t height);
+    void close();
+
+    // Next frame (width * height * 4 bytes), or nullptr at end of file or on error.
+    // Uncompressed frames point straight into the mapping; the pointer is valid until the next call.
+    const uint8_t* next_frame();
+
+    // Copying variant of next_frame()
+    bool read_frame(uint8_t* rgba_out);
+
+    bool is_container() const { return container; }
+    bool is_mapped() const { return map_data != nullptr; }
+
+    // Frame timestamps (container files written with RawFrameWriter::enable_timestamps)
+    bool has_timestamps() const { return timestamps; }
+    uint32_t get_timebase_num() const { return timebase_num; }
+    uint32_t get_timebase_den() const { return timebase_den; }
+
+    // Of the last next_frame(): its timestamp (0 without timestamps) and whether it repeats the frame before
+    int64_t get_frame_timestamp() const { return frame_timestamp; }
+    bool frame_is_repeat() const { return frame_repeat; }
+
+    // True when the last next_frame() pointer lies in the mapping and stays valid until close()
+    bool frame_is_mapped() const { return map_data && current && current != reference.data(); }
+
+private:
+    bool map_file(const std::string& path);
+    void unmap_file();
+    bool read_record(uint16_t& codec, const uint8_t*& data, uint32_t& size, int64_t& timestamp);
+    void prefetch_next_record();
+    void prefetch(size_t offset, size_t length);
+
+    // Memory-mapped source
+    const uint8_t* map_data;
+    size_t map_size;
+    size_t map_pos;
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#else
+    int file_descriptor;
+#endif
+
+    FILE* file; // stdio fallback when mapping fails
+    uint32_t width;
+    uint32_t height;
+    bool container;
+    bool timestamps;
+    uint32_t timebase_num;
+    uint32_t timebase_den;
+    int64_t frame_timestamp;
+    bool frame_repeat;
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> reference; // Decode target and base for REPEAT and TILES records
+    const uint8_t* current;         // Last returned frame: reference or a pointer into the mapping
+    std::vector<uint32_t> tiles;
+    std::vector<uint8_t> tile_pixels;
+    uint32_t repeats_left;
+};
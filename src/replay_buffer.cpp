@@ -0,0 +1,243 @@
+#include "replay_buffer.h"
+#include "mp4_muxer.h"
+#include "raw_container.h"
+#include <algorithm>
+#include <cstdio>
+
+double ReplayClip::get_seconds() const {
+    if (video.empty()) {
+        return 0.0;
+    }
+    return static_cast<double>(video.back()->dts - video.front()->dts + default_duration) / timescale;
+}
+
+ReplayBuffer::ReplayBuffer(double window, size_t memory_budget)
+    : window_seconds(window), max_bytes(memory_budget), format(ReplayFormat::H264), width(0), height(0), timescale(1),
+      default_duration(1), audio(nullptr), evicted(0), bytes(0) {}
+
+void ReplayBuffer::set_video(ReplayFormat video_format, uint32_t video_width, uint32_t video_height, uint32_t video_timescale,
+                             uint32_t frame_duration, const uint8_t* video_headers, size_t headers_size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    format = video_format;
+    width = video_width;
+    height = video_height;
+    timescale = std::max<uint32_t>(1, video_timescale);
+    default_duration = std::max<uint32_t>(1, frame_duration);
+    headers.assign(video_headers, video_headers + (video_headers ? headers_size : 0));
+}
+
+void ReplayBuffer::set_audio(const AudioEncoder* encoder) {
+    std::lock_guard<std::mutex> lock(mutex);
+    audio = encoder;
+}
+
+void ReplayBuffer::push_video(std::vector<uint8_t>&& data, int64_t dts, int64_t pts, bool keyframe) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (video.empty() && !keyframe) {
+        evicted++; // Nothing decodes before the first keyframe
+        return;
+    }
+
+    if (keyframe) {
+        keyframes.push_back(evicted + video.size());
+    }
+    bytes += data.size();
+    video.push_back(std::make_shared<const ReplaySample>(ReplaySample{ std::move(data), dts, pts, keyframe }));
+    evict_locked();
+}
+
+void ReplayBuffer::push_audio(std::vector<uint8_t>&& data, int64_t pts) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!audio) {
+        return;
+    }
+    bytes += data.size();
+    audio_packets.push_back(std::make_shared<const ReplaySample>(ReplaySample{ std::move(data), pts, pts, true }));
+    evict_locked();
+}
+
+double ReplayBuffer::video_seconds_locked(size_t from) const {
+    return static_cast<double>(video.back()->dts - video[from]->dts + default_duration) / timescale;
+}
+
+void ReplayBuffer::evict_locked() {
+    // Drop the oldest GOP while the rest still covers the window, or while over budget; the newest GOP always stays
+    while (keyframes.size() >= 2) {
+        size_t next_gop = keyframes[1] - evicted;
+        if (bytes <= max_bytes && video_seconds_locked(next_gop) < window_seconds) {
+            break;
+        }
+        for (size_t i = 0; i < next_gop; ++i) {
+            bytes -= video.front()->data.size();
+            video.pop_front();
+        }
+        evicted += next_gop;
+        keyframes.pop_front();
+    }
+
+    // Audio older than the first frame kept can never be part of a clip
+    if (audio && !video.empty()) {
+        double start = static_cast<double>(video.front()->pts) / timescale;
+        double packet = static_cast<double>(audio->get_packet_duration()) / audio->get_timescale();
+        while (!audio_packets.empty() &&
+               static_cast<double>(audio_packets.front()->pts) / audio->get_timescale() + packet <= start) {
+            bytes -= audio_packets.front()->data.size();
+            audio_packets.pop_front();
+        }
+    }
+}
+
+bool ReplayBuffer::take_clip(double seconds, ReplayClip& clip) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (video.empty()) {
+        return false;
+    }
+
+    // The latest keyframe that still covers the requested length, or the oldest one
+    size_t start = keyframes.front() - evicted;
+    for (size_t keyframe : keyframes) {
+        if (video_seconds_locked(keyframe - evicted) < seconds) {
+            break;
+        }
+        start = keyframe - evicted;
+    }
+
+    clip.format = format;
+    clip.width = width;
+    clip.height = height;
+    clip.timescale = timescale;
+    clip.default_duration = default_duration;
+    clip.headers = headers;
+    clip.audio = audio;
+    clip.video.assign(video.begin() + start, video.end());
+    clip.audio_packets.clear();
+
+    // Audio from the packet nearest the first frame, so the tracks line up to within half a packet
+    if (audio) {
+        double clip_start = static_cast<double>(video[start]->pts) / timescale;
+        double half_packet = 0.5 * audio->get_packet_duration() / audio->get_timescale();
+        for (const std::shared_ptr<const ReplaySample>& packet : audio_packets) {
+            if (static_cast<double>(packet->pts) / audio->get_timescale() + half_packet >= clip_start) {
+                clip.audio_packets.push_back(packet);
+            }
+        }
+    }
+    return true;
+}
+
+double ReplayBuffer::get_seconds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return video.empty() ? 0.0 : video_seconds_locked(0);
+}
+
+size_t ReplayBuffer::get_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+uint64_t ReplayBuffer::get_evicted_frames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return evicted;
+}
+
+bool write_replay_mp4(const ReplayClip& clip, const std::string& path, std::string& error) {
+    if (clip.format != ReplayFormat::H264 || clip.video.empty()) {
+        error = "no H.264 frames in the clip";
+        return false;
+    }
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "wb");
+#else
+    file = fopen(path.c_str(), "wb");
+#endif
+    if (!file) {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    Mp4Muxer muxer(file, false);
+    int video_track = muxer.add_h264_track(clip.width, clip.height, clip.timescale, clip.default_duration,
+                                           clip.headers.data(), clip.headers.size());
+    int audio_track = clip.audio && !clip.audio_packets.empty() ? clip.audio->add_track(muxer) : -1;
+    if (video_track < 0) {
+        fclose(file);
+        error = "invalid H.264 headers";
+        return false;
+    }
+
+    // Interleave: after each frame, the audio that starts before it (both measured from the clip start)
+    bool ok = true;
+    size_t next_audio = 0;
+    int64_t first_dts = clip.video.front()->dts;
+    int64_t first_audio = audio_track >= 0 ? clip.audio_packets.front()->pts : 0;
+    for (const std::shared_ptr<const ReplaySample>& sample : clip.video) {
+        ok = ok && muxer.write_sample(video_track, sample->data.data(), sample->data.size(), sample->dts, sample->pts,
+                                      sample->keyframe);
+        double video_time = static_cast<double>(sample->dts - first_dts) / clip.timescale;
+        while (audio_track >= 0 && next_audio < clip.audio_packets.size() &&
+               static_cast<double>(clip.audio_packets[next_audio]->pts - first_audio) / clip.audio->get_timescale() <= video_time) {
+            const ReplaySample& packet = *clip.audio_packets[next_audio++];
+            ok = ok && muxer.write_sample(audio_track, packet.data.data(), packet.data.size(), packet.pts, packet.pts, true);
+        }
+    }
+    for (; audio_track >= 0 && next_audio < clip.audio_packets.size(); ++next_audio) {
+        const ReplaySample& packet = *clip.audio_packets[next_audio];
+        ok = ok && muxer.write_sample(audio_track, packet.data.data(), packet.data.size(), packet.pts, packet.pts, true);
+    }
+
+    ok = muxer.finish() && ok;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        error = "write failed: " + path;
+    }
+    return ok;
+}
+
+bool write_replay_raw(const ReplayClip& clip, const std::string& raw_path, const std::string& wav_path, std::string& error) {
+    if (clip.format != ReplayFormat::QOI || clip.video.empty()) {
+        error = "no QOI frames in the clip";
+        return false;
+    }
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, raw_path.c_str(), "wb");
+#else
+    file = fopen(raw_path.c_str(), "wb");
+#endif
+    if (!file) {
+        error = "cannot create " + raw_path;
+        return false;
+    }
+
+    RawFrameWriter writer(file, clip.width, clip.height, RawFrameCodec::QOI);
+    writer.enable_timestamps(1, clip.timescale);
+    bool ok = writer.write_header();
+    for (const std::shared_ptr<const ReplaySample>& sample : clip.video) {
+        ok = ok && writer.write_qoi_frame(sample->data.data(), sample->data.size(), sample->pts);
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        error = "write failed: " + raw_path;
+        return false;
+    }
+
+    // WAV holds PCM only; the replay buffer keeps PCM packets when it stores QOI frames
+    if (clip.audio && !clip.audio_packets.empty() && clip.audio->get_codec() == AudioCodec::PCM) {
+        WavWriter wav;
+        uint32_t channels = clip.audio->get_channels();
+        ok = wav.open(wav_path, clip.audio->get_sample_rate(), channels);
+        for (const std::shared_ptr<const ReplaySample>& packet : clip.audio_packets) {
+            ok = ok && wav.write(reinterpret_cast<const int16_t*>(packet->data.data()),
+                                 packet->data.size() / (channels * sizeof(int16_t)));
+        }
+        ok = wav.close() && ok;
+        if (!ok) {
+            error = "write failed: " + wav_path;
+            return false;
+        }
+    }
+    return true;
+}
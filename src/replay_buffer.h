@@ -0,0 +1,99 @@
+#pragma once
+
+#include "audio_encoder.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Instant replay: the last seconds of a recording kept compressed in memory, written to disk only when the game
+// saves a clip. Video is held as H.264 samples from the live encoder, or as QOI frames when x264 is unavailable.
+// Eviction drops whole GOPs from the front, so every clip starts on a keyframe and saving one is a copy, never a
+// re-encode.
+
+enum class ReplayFormat {
+    H264 = 0, // Length-prefixed H.264 access units; clips are written as MP4
+    QOI = 1   // qoi_encode_rgba frames, all keyframes; clips are written as a .raw container for NiceShot_Converter
+};
+
+// One video frame or audio packet. Samples are immutable once buffered and shared with any clip taken meanwhile.
+struct ReplaySample {
+    std::vector<uint8_t> data;
+    int64_t dts;
+    int64_t pts;
+    bool keyframe;
+};
+
+// Everything needed to write a clip, detached from the buffer
+struct ReplayClip {
+    ReplayFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t timescale;        // Video timestamps (QOI: CAPTURE_TIMEBASE)
+    uint32_t default_duration; // One frame in timescale units
+    std::vector<uint8_t> headers; // H.264 SPS/PPS, length-prefixed
+    const AudioEncoder* audio;    // Describes the audio packets (null without audio); outlives the clip
+    std::vector<std::shared_ptr<const ReplaySample>> video;
+    std::vector<std::shared_ptr<const ReplaySample>> audio_packets;
+
+    ReplayClip() : format(ReplayFormat::H264), width(0), height(0), timescale(1), default_duration(1), audio(nullptr) {}
+
+    // Video length from the first frame to the end of the last
+    double get_seconds() const;
+};
+
+// Filled by the encoding thread, read by save requests from the game thread
+class ReplayBuffer {
+public:
+    // Keeps at least window_seconds when it fits in max_bytes; whole GOPs are evicted past either limit
+    ReplayBuffer(double window_seconds, size_t max_bytes);
+
+    // Describe the video before the first push_video. H.264 headers are the SPS/PPS as for Mp4Muxer::add_h264_track.
+    void set_video(ReplayFormat format, uint32_t width, uint32_t height, uint32_t timescale, uint32_t default_duration,
+                   const uint8_t* headers, size_t headers_size);
+
+    // Keep audio packets from this encoder (opened, and left alone except for encoding, while the buffer lives)
+    void set_audio(const AudioEncoder* encoder);
+
+    // Append a frame in decode order, then evict what the window and memory budget no longer need
+    void push_video(std::vector<uint8_t>&& data, int64_t dts, int64_t pts, bool keyframe);
+
+    // Append an audio packet (pts in the encoder's timescale, on the same origin as the video)
+    void push_audio(std::vector<uint8_t>&& data, int64_t pts);
+
+    // Take the last seconds (from the latest keyframe that covers them, or everything buffered if less).
+    // Returns false while nothing is buffered.
+    bool take_clip(double seconds, ReplayClip& clip) const;
+
+    double get_seconds() const;
+    size_t get_bytes() const;
+    uint64_t get_evicted_frames() const;
+
+private:
+    void evict_locked();
+    double video_seconds_locked(size_t from) const;
+
+    mutable std::mutex mutex;
+    double window_seconds;
+    size_t max_bytes;
+    ReplayFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t timescale;
+    uint32_t default_duration;
+    std::vector<uint8_t> headers;
+    const AudioEncoder* audio;
+    std::deque<std::shared_ptr<const ReplaySample>> video;
+    std::deque<std::shared_ptr<const ReplaySample>> audio_packets;
+    std::deque<size_t> keyframes; // Indices into video, offset by evicted
+    size_t evicted;               // Frames evicted so far (keyframes hold absolute indices)
+    size_t bytes;
+};
+
+// Write an H.264 clip as a regular MP4, with its audio interleaved
+bool write_replay_mp4(const ReplayClip& clip, const std::string& path, std::string& error);
+
+// Write a QOI clip as a timestamped .raw container, and its PCM audio (if any) as a WAV starting at the first frame
+bool write_replay_raw(const ReplayClip& clip, const std::string& raw_path, const std::string& wav_path, std::string& error);
@@ -0,0 +1,12 @@
+#pragma once
+
+// Internal to the SIMD kernels (yuv_convert, png_filter, image_scale); runtime dispatch goes through
+// yuv_kernel_supported, so each kernel is compiled for its instruction set and only called when the CPU has it.
+
+// GCC/Clang need per-function target attributes to emit SSSE3/AVX2 code without global flags;
+// MSVC allows the intrinsics anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define NICESHOT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NICESHOT_TARGET(isa)
+#endif
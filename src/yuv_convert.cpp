@@ -0,0 +1,565 @@
+#include "yuv_convert.h"
+#include "simd_target.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NICESHOT_YUV_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Row pair kernel: converts columns [x_begin, width) of two source rows into two Y rows and one U/V row.
+// For the last row of an odd-height frame src1 == src0 and y1 == y0.
+typedef void (*RowPairKernel)(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint32_t x_begin,
+                              uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+
+// Scalar 2x2 block - the reference every SIMD kernel must match bit for bit
+static inline void convert_block_scalar(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint32_t x,
+                                        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    uint32_t x1 = (x + 1 < width) ? x + 1 : x; // Replicate the last column for odd widths
+
+    const uint8_t* p0 = src0 + static_cast<size_t>(x) * 4;  // Top-left
+    const uint8_t* p1 = src0 + static_cast<size_t>(x1) * 4; // Top-right
+    const uint8_t* p2 = src1 + static_cast<size_t>(x) * 4;  // Bottom-left
+    const uint8_t* p3 = src1 + static_cast<size_t>(x1) * 4; // Bottom-right
+
+    // Convert to Y (luma) using fast integer math
+    y0[x] = static_cast<uint8_t>((77 * p0[0] + 150 * p0[1] + 29 * p0[2]) >> 8);
+    y0[x1] = static_cast<uint8_t>((77 * p1[0] + 150 * p1[1] + 29 * p1[2]) >> 8);
+    y1[x] = static_cast<uint8_t>((77 * p2[0] + 150 * p2[1] + 29 * p2[2]) >> 8);
+    y1[x1] = static_cast<uint8_t>((77 * p3[0] + 150 * p3[1] + 29 * p3[2]) >> 8);
+
+    // Average 2x2 block for U and V (chroma subsampling)
+    int avg_r = (p0[0] + p1[0] + p2[0] + p3[0]) / 4;
+    int avg_g = (p0[1] + p1[1] + p2[1] + p3[1]) / 4;
+    int avg_b = (p0[2] + p1[2] + p2[2] + p3[2]) / 4;
+
+    u[x / 2] = static_cast<uint8_t>(128 + ((-43 * avg_r - 84 * avg_g + 127 * avg_b) >> 8));
+    v[x / 2] = static_cast<uint8_t>(128 + ((127 * avg_r - 106 * avg_g - 21 * avg_b) >> 8));
+}
+
+static void convert_row_pair_scalar(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint32_t x_begin,
+                                    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    for (uint32_t x = x_begin; x < width; x += 2) {
+        convert_block_scalar(src0, src1, width, x, y0, y1, u, v);
+    }
+}
+
+#ifdef NICESHOT_YUV_X86
+
+// SSE2: 16 pixels per row per iteration, channels widened to 16-bit lanes.
+// Every intermediate fits in 16 bits (luma sums <= 65280 unsigned, chroma sums within +-32385),
+// so the vector math is exact and matches the scalar reference.
+
+// Split 16 RGBA pixels into R, G, B as 16-bit lanes (pixels 0-7 in [0], 8-15 in [1])
+NICESHOT_TARGET("sse2")
+static inline void unpack_rgba16_sse2(const uint8_t* src, __m128i r[2], __m128i g[2], __m128i b[2]) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    for (int i = 0; i < 2; ++i) {
+        __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 32));
+        __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 32 + 16));
+        r[i] = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+        g[i] = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+        b[i] = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+    }
+}
+
+NICESHOT_TARGET("sse2")
+static inline __m128i luma_sse2(__m128i r, __m128i g, __m128i b) {
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+    return _mm_srli_epi16(y, 8);
+}
+
+// 2x2 averages of 16 columns from two rows -> 8 averages in 16-bit lanes
+NICESHOT_TARGET("sse2")
+static inline __m128i average_2x2_sse2(const __m128i top[2], const __m128i bottom[2]) {
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i s0 = _mm_madd_epi16(_mm_add_epi16(top[0], bottom[0]), ones); // Horizontal pair sums
+    __m128i s1 = _mm_madd_epi16(_mm_add_epi16(top[1], bottom[1]), ones);
+    return _mm_srli_epi16(_mm_packs_epi32(s0, s1), 2);
+}
+
+NICESHOT_TARGET("sse2")
+static inline __m128i chroma_sse2(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb) {
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    return _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+}
+
+// Shared arithmetic for the 128-bit kernels once channels are unpacked
+NICESHOT_TARGET("sse2")
+static inline void store_block16_sse2(const __m128i r0[2], const __m128i g0[2], const __m128i b0[2],
+                                      const __m128i r1[2], const __m128i g1[2], const __m128i b1[2],
+                                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y0),
+                     _mm_packus_epi16(luma_sse2(r0[0], g0[0], b0[0]), luma_sse2(r0[1], g0[1], b0[1])));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y1),
+                     _mm_packus_epi16(luma_sse2(r1[0], g1[0], b1[0]), luma_sse2(r1[1], g1[1], b1[1])));
+
+    __m128i avg_r = average_2x2_sse2(r0, r1);
+    __m128i avg_g = average_2x2_sse2(g0, g1);
+    __m128i avg_b = average_2x2_sse2(b0, b1);
+
+    __m128i cu = chroma_sse2(avg_r, avg_g, avg_b, -43, -84, 127);
+    __m128i cv = chroma_sse2(avg_r, avg_g, avg_b, 127, -106, -21);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(u), _mm_packus_epi16(cu, cu));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(v), _mm_packus_epi16(cv, cv));
+}
+
+NICESHOT_TARGET("sse2")
+static inline void convert_block16_sse2(const uint8_t* src0, const uint8_t* src1, uint32_t x,
+                                        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    __m128i r0[2], g0[2], b0[2], r1[2], g1[2], b1[2];
+    unpack_rgba16_sse2(src0 + static_cast<size_t>(x) * 4, r0, g0, b0);
+    unpack_rgba16_sse2(src1 + static_cast<size_t>(x) * 4, r1, g1, b1);
+    store_block16_sse2(r0, g0, b0, r1, g1, b1, y0 + x, y1 + x, u + x / 2, v + x / 2);
+}
+
+NICESHOT_TARGET("sse2")
+static void convert_row_pair_sse2(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint32_t x_begin,
+                                  uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    uint32_t x = x_begin;
+    for (; x + 16 <= width; x += 16) {
+        convert_block16_sse2(src0, src1, x, y0, y1, u, v);
+    }
+    convert_row_pair_scalar(src0, src1, width, x, y0, y1, u, v);
+}
+
+// SSSE3: same arithmetic, but pshufb deinterleaves the channels instead of mask/shift/pack
+NICESHOT_TARGET("ssse3")
+static inline void unpack_rgba16_ssse3(const uint8_t* src, __m128i r[2], __m128i g[2], __m128i b[2]) {
+    const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m128i zero = _mm_setzero_si128();
+
+    // Each register becomes [R0-3 G0-3 B0-3 A0-3]
+    __m128i q0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), gather);
+    __m128i q1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), gather);
+    __m128i q2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), gather);
+    __m128i q3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)), gather);
+
+    __m128i rg01 = _mm_unpacklo_epi32(q0, q1); // R0-3 R4-7 G0-3 G4-7
+    __m128i ba01 = _mm_unpackhi_epi32(q0, q1); // B0-3 B4-7 A0-3 A4-7
+    __m128i rg23 = _mm_unpacklo_epi32(q2, q3);
+    __m128i ba23 = _mm_unpackhi_epi32(q2, q3);
+
+    __m128i r8 = _mm_unpacklo_epi64(rg01, rg23);
+    __m128i g8 = _mm_unpackhi_epi64(rg01, rg23);
+    __m128i b8 = _mm_unpacklo_epi64(ba01, ba23);
+
+    r[0] = _mm_unpacklo_epi8(r8, zero);
+    r[1] = _mm_unpackhi_epi8(r8, zero);
+    g[0] = _mm_unpacklo_epi8(g8, zero);
+    g[1] = _mm_unpackhi_epi8(g8, zero);
+    b[0] = _mm_unpacklo_epi8(b8, zero);
+    b[1] = _mm_unpackhi_epi8(b8, zero);
+}
+
+NICESHOT_TARGET("ssse3")
+static void convert_row_pair_ssse3(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint32_t x_begin,
+                                   uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    uint32_t x = x_begin;
+    for (; x + 16 <= width; x += 16) {
+        __m128i r0[2], g0[2], b0[2], r1[2], g1[2], b1[2];
+        unpack_rgba16_ssse3(src0 + static_cast<size_t>(x) * 4, r0, g0, b0);
+        unpack_rgba16_ssse3(src1 + static_cast<size_t>(x) * 4, r1, g1, b1);
+        store_block16_sse2(r0, g0, b0, r1, g1, b1, y0 + x, y1 + x, u + x / 2, v + x / 2);
+    }
+    convert_row_pair_scalar(src0, src1, width, x, y0, y1, u, v);
+}
+
+// AVX2: 32 pixels per row per iteration. The 256-bit pack instructions work per 128-bit lane,
+// so each pack is followed by a qword permute to restore pixel order.
+
+// Split 32 RGBA pixels into R, G, B as 16-bit lanes (pixels 0-15 in [0], 16-31 in [1])
+NICESHOT_TARGET("avx2")
+static inline void unpack_rgba32_avx2(const uint8_t* src, __m256i r[2], __m256i g[2], __m256i b[2]) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    for (int i = 0; i < 2; ++i) {
+        __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 64));
+        __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 64 + 32));
+        r[i] = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask)), 0xD8);
+        g[i] = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+                               _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask)), 0xD8);
+        b[i] = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+                               _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask)), 0xD8);
+    }
+}
+
+NICESHOT_TARGET("avx2")
+static inline __m256i luma_avx2(__m256i r, __m256i g, __m256i b) {
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(77)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(150)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(29)));
+    return _mm256_srli_epi16(y, 8);
+}
+
+NICESHOT_TARGET("avx2")
+static inline __m256i average_2x2_avx2(const __m256i top[2], const __m256i bottom[2]) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i s0 = _mm256_madd_epi16(_mm256_add_epi16(top[0], bottom[0]), ones);
+    __m256i s1 = _mm256_madd_epi16(_mm256_add_epi16(top[1], bottom[1]), ones);
+    return _mm256_srli_epi16(_mm256_permute4x64_epi64(_mm256_packs_epi32(s0, s1), 0xD8), 2);
+}
+
+NICESHOT_TARGET("avx2")
+static inline __m256i chroma_avx2(__m256i r, __m256i g, __m256i b, short cr, short cg, short cb) {
+    __m256i c = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(cr)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(cg)));
+    c = _mm256_add_epi16(c, _mm256_mullo_epi16(b, _mm256_set1_epi16(cb)));
+    return _mm256_add_epi16(_mm256_srai_epi16(c, 8), _mm256_set1_epi16(128));
+}
+
+// Narrow 16 words to 16 bytes in order
+NICESHOT_TARGET("avx2")
+static inline __m128i pack_words_avx2(__m256i w) {
+    return _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+}
+
+NICESHOT_TARGET("avx2")
+static void convert_row_pair_avx2(const uint8_t* src0, const uint8_t* src1, uint32_t width, uint32_t x_begin,
+                                  uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    uint32_t x = x_begin;
+    for (; x + 32 <= width; x += 32) {
+        __m256i r0[2], g0[2], b0[2], r1[2], g1[2], b1[2];
+        unpack_rgba32_avx2(src0 + static_cast<size_t>(x) * 4, r0, g0, b0);
+        unpack_rgba32_avx2(src1 + static_cast<size_t>(x) * 4, r1, g1, b1);
+
+        __m256i luma0 = _mm256_packus_epi16(luma_avx2(r0[0], g0[0], b0[0]), luma_avx2(r0[1], g0[1], b0[1]));
+        __m256i luma1 = _mm256_packus_epi16(luma_avx2(r1[0], g1[0], b1[0]), luma_avx2(r1[1], g1[1], b1[1]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), _mm256_permute4x64_epi64(luma0, 0xD8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), _mm256_permute4x64_epi64(luma1, 0xD8));
+
+        __m256i avg_r = average_2x2_avx2(r0, r1);
+        __m256i avg_g = average_2x2_avx2(g0, g1);
+        __m256i avg_b = average_2x2_avx2(b0, b1);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2),
+                         pack_words_avx2(chroma_avx2(avg_r, avg_g, avg_b, -43, -84, 127)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2),
+                         pack_words_avx2(chroma_avx2(avg_r, avg_g, avg_b, 127, -106, -21)));
+    }
+    // Finish the remaining columns 16 at a time, then scalar. The 128-bit block is inlined here
+    // rather than calling the SSE2 kernel so it stays VEX-encoded (no SSE/AVX transition stalls).
+    for (; x + 16 <= width; x += 16) {
+        convert_block16_sse2(src0, src1, x, y0, y1, u, v);
+    }
+    convert_row_pair_scalar(src0, src1, width, x, y0, y1, u, v);
+}
+
+// CPU feature detection
+struct CpuFeatures {
+    bool sse2;
+    bool ssse3;
+    bool avx2;
+};
+
+static void read_cpuid(int leaf, int subleaf, int regs[4]) {
+#ifdef _MSC_VER
+    __cpuidex(regs, leaf, subleaf);
+#else
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    regs[0] = static_cast<int>(a);
+    regs[1] = static_cast<int>(b);
+    regs[2] = static_cast<int>(c);
+    regs[3] = static_cast<int>(d);
+#endif
+}
+
+static uint64_t read_xcr0() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax = 0, edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures features = { false, false, false };
+    int regs[4] = { 0, 0, 0, 0 };
+
+    read_cpuid(0, 0, regs);
+    int max_leaf = regs[0];
+    if (max_leaf < 1) {
+        return features;
+    }
+
+    read_cpuid(1, 0, regs);
+    features.sse2 = (regs[3] & (1 << 26)) != 0;
+    features.ssse3 = (regs[2] & (1 << 9)) != 0;
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+
+    // AVX2 also needs the OS to save YMM state
+    if (max_leaf >= 7 && osxsave && avx && (read_xcr0() & 0x6) == 0x6) {
+        read_cpuid(7, 0, regs);
+        features.avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+
+    return features;
+}
+
+static const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+#endif // NICESHOT_YUV_X86
+
+bool yuv_kernel_supported(YuvKernel kernel) {
+    switch (kernel) {
+    case YuvKernel::SCALAR:
+        return true;
+#ifdef NICESHOT_YUV_X86
+    case YuvKernel::SSE2:
+        return cpu_features().sse2;
+    case YuvKernel::SSSE3:
+        return cpu_features().ssse3;
+    case YuvKernel::AVX2:
+        return cpu_features().avx2;
+#endif
+    default:
+        return false;
+    }
+}
+
+YuvKernel yuv_best_kernel() {
+    static const YuvKernel best =
+        yuv_kernel_supported(YuvKernel::AVX2) ? YuvKernel::AVX2 :
+        yuv_kernel_supported(YuvKernel::SSSE3) ? YuvKernel::SSSE3 :
+        yuv_kernel_supported(YuvKernel::SSE2) ? YuvKernel::SSE2 : YuvKernel::SCALAR;
+    return best;
+}
+
+const char* yuv_kernel_name(YuvKernel kernel) {
+    switch (kernel) {
+    case YuvKernel::SCALAR: return "scalar";
+    case YuvKernel::SSE2: return "SSE2";
+    case YuvKernel::SSSE3: return "SSSE3";
+    case YuvKernel::AVX2: return "AVX2";
+    }
+    return "unknown";
+}
+
+static RowPairKernel row_pair_kernel(YuvKernel kernel) {
+    if (!yuv_kernel_supported(kernel)) {
+        return convert_row_pair_scalar;
+    }
+
+    switch (kernel) {
+#ifdef NICESHOT_YUV_X86
+    case YuvKernel::SSE2: return convert_row_pair_sse2;
+    case YuvKernel::SSSE3: return convert_row_pair_ssse3;
+    case YuvKernel::AVX2: return convert_row_pair_avx2;
+#endif
+    default: return convert_row_pair_scalar;
+    }
+}
+
+void convert_rgba_to_yuv420p_rows(YuvKernel kernel, const uint8_t* rgba_data, uint32_t width, uint32_t height,
+                                  uint32_t row_begin, uint32_t row_end, const YuvPlanes& planes) {
+    RowPairKernel convert_row_pair = row_pair_kernel(kernel);
+    const size_t src_stride = static_cast<size_t>(width) * 4;
+
+    if (row_end > height) {
+        row_end = height;
+    }
+
+    for (uint32_t y = row_begin & ~1u; y < row_end; y += 2) {
+        bool has_second_row = (y + 1 < height); // Odd heights reuse the last row
+
+        const uint8_t* src0 = rgba_data + y * src_stride;
+        const uint8_t* src1 = has_second_row ? src0 + src_stride : src0;
+        uint8_t* y0 = planes.y + static_cast<size_t>(y) * planes.y_stride;
+        uint8_t* y1 = has_second_row ? y0 + planes.y_stride : y0;
+        uint8_t* u = planes.u + static_cast<size_t>(y / 2) * planes.u_stride;
+        uint8_t* v = planes.v + static_cast<size_t>(y / 2) * planes.v_stride;
+
+        convert_row_pair(src0, src1, width, 0, y0, y1, u, v);
+    }
+}
+
+void convert_rgba_to_yuv420p(const uint8_t* rgba_data, uint32_t width, uint32_t height, const YuvPlanes& planes) {
+    convert_rgba_to_yuv420p_rows(yuv_best_kernel(), rgba_data, width, height, 0, height, planes);
+}
+
+// Persistent pool that runs a banded task on its workers plus the calling thread.
+// Workers sleep on a condition variable between frames, so there is no per-frame thread creation.
+class BandThreadPool {
+public:
+    explicit BandThreadPool(unsigned worker_count)
+        : task(nullptr), band_count(0), next_band(0), remaining(0), active_workers(0), generation(0), stopping(false) {
+        for (unsigned i = 0; i < worker_count; ++i) {
+            workers.emplace_back(&BandThreadPool::worker_main, this);
+        }
+    }
+
+    ~BandThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_condition.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    unsigned thread_count() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Run fn(band) for every band in [0, bands) and return once all of them have finished.
+    // Concurrent callers take turns: the pool runs one task at a time.
+    void run(unsigned bands, const std::function<void(unsigned)>& fn) {
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &fn;
+            band_count = bands;
+            next_band = 0;
+            remaining = bands;
+            generation++;
+        }
+        work_condition.notify_all();
+
+        // The caller works too instead of idling
+        run_bands(fn);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [this] { return remaining == 0 && active_workers == 0; });
+        task = nullptr;
+    }
+
+private:
+    void run_bands(const std::function<void(unsigned)>& fn) {
+        unsigned band;
+        while ((band = next_band.fetch_add(1)) < band_count) {
+            fn(band);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0) {
+                done_condition.notify_all();
+            }
+        }
+    }
+
+    void worker_main() {
+        uint64_t seen_generation = 0;
+        while (true) {
+            const std::function<void(unsigned)>* current = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work_condition.wait(lock, [&] { return stopping || generation != seen_generation; });
+                if (stopping) {
+                    return;
+                }
+                seen_generation = generation;
+                current = task;
+                if (!current) {
+                    continue; // Woke after the task already finished
+                }
+                active_workers++;
+            }
+
+            run_bands(*current);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active_workers == 0 && remaining == 0) {
+                done_condition.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex run_mutex; // Held for a whole run()
+    std::mutex mutex;
+    std::condition_variable work_condition;
+    std::condition_variable done_condition;
+    const std::function<void(unsigned)>* task;
+    unsigned band_count;
+    std::atomic<unsigned> next_band;
+    unsigned remaining;      // Bands not yet finished
+    unsigned active_workers; // Workers inside run_bands for the current task
+    uint64_t generation;
+    bool stopping;
+};
+
+// Created on first use and only torn down explicitly: joining threads from a static destructor
+// would run under the DLL loader lock and deadlock
+static std::mutex g_conversion_pool_mutex;
+static BandThreadPool* g_conversion_pool = nullptr;
+
+static BandThreadPool& conversion_pool() {
+    std::lock_guard<std::mutex> lock(g_conversion_pool_mutex);
+    if (!g_conversion_pool) {
+        unsigned hw_threads = std::thread::hardware_concurrency();
+        if (hw_threads == 0) hw_threads = 1; // Fallback if unable to detect
+        if (hw_threads > 8) hw_threads = 8;  // Cap at 8 threads like the PNG workers
+        g_conversion_pool = new BandThreadPool(hw_threads - 1); // The calling thread is the last one
+    }
+    return *g_conversion_pool;
+}
+
+unsigned yuv_conversion_thread_count() {
+    return conversion_pool().thread_count();
+}
+
+void yuv_shutdown_conversion_threads() {
+    std::lock_guard<std::mutex> lock(g_conversion_pool_mutex);
+    delete g_conversion_pool;
+    g_conversion_pool = nullptr;
+}
+
+void convert_rgba_to_yuv420p_parallel(const uint8_t* rgba_data, uint32_t width, uint32_t height,
+                                      const YuvPlanes& planes, unsigned max_threads) {
+    // Below ~64 rows per thread the hand-off costs more than it saves
+    const uint32_t min_rows_per_band = 64;
+
+    BandThreadPool& pool = conversion_pool();
+    unsigned threads = pool.thread_count();
+    if (max_threads != 0) {
+        threads = std::min(threads, max_threads);
+    }
+    threads = std::min<unsigned>(threads, std::max<uint32_t>(1, height / min_rows_per_band));
+
+    if (threads <= 1) {
+        convert_rgba_to_yuv420p(rgba_data, width, height, planes);
+        return;
+    }
+
+    // Bands start on even rows so every chroma row belongs to exactly one band
+    uint32_t row_pairs = (height + 1) / 2;
+    uint32_t pairs_per_band = (row_pairs + threads - 1) / threads;
+    unsigned bands = (row_pairs + pairs_per_band - 1) / pairs_per_band;
+    YuvKernel kernel = yuv_best_kernel();
+
+    pool.run(bands, [&](unsigned band) {
+        uint32_t row_begin = band * pairs_per_band * 2;
+        uint32_t row_end = std::min<uint32_t>(height, row_begin + pairs_per_band * 2);
+        convert_rgba_to_yuv420p_rows(kernel, rgba_data, width, height, row_begin, row_end, planes);
+    });
+}
+
+void convert_rgba_to_yuv420p_fast(const uint8_t* rgba_data, uint32_t width, uint32_t height,
+                                  uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane) {
+    int chroma_stride = static_cast<int>((width + 1) / 2);
+    YuvPlanes planes = { y_plane, u_plane, v_plane, static_cast<int>(width), chroma_stride, chroma_stride };
+    convert_rgba_to_yuv420p(rgba_data, width, height, planes);
+}
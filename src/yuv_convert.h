@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// RGBA to YUV420p (I420) colour conversion shared by the DLL and NiceShot_Converter
+// All kernels produce bit-identical output; the fastest one the CPU supports is picked at runtime.
+
+enum class YuvKernel {
+    SCALAR = 0,
+    SSE2 = 1,
+    SSSE3 = 2,
+    AVX2 = 3
+};
+
+// Destination planes (strides in bytes)
+struct YuvPlanes {
+    uint8_t* y;
+    uint8_t* u;
+    uint8_t* v;
+    int y_stride;
+    int u_stride;
+    int v_stride;
+};
+
+// Convert a tightly packed RGBA frame using the best available kernel
+// Odd widths/heights replicate the last column/row into the final chroma sample
+void convert_rgba_to_yuv420p(const uint8_t* rgba_data, uint32_t width, uint32_t height, const YuvPlanes& planes);
+
+// Convert source rows [row_begin, row_end) with a specific kernel (row_begin must be even)
+// Falls back to scalar if the kernel is not supported on this CPU
+void convert_rgba_to_yuv420p_rows(YuvKernel kernel, const uint8_t* rgba_data, uint32_t width, uint32_t height,
+                                  uint32_t row_begin, uint32_t row_end, const YuvPlanes& planes);
+
+// Convert using the best kernel, split into even-row bands across a persistent worker pool
+// max_threads = 0 uses every pool thread (hardware concurrency, capped at 8); small frames stay single-threaded.
+// Safe to call from several threads; their frames are converted one after another.
+void convert_rgba_to_yuv420p_parallel(const uint8_t* rgba_data, uint32_t width, uint32_t height,
+                                      const YuvPlanes& planes, unsigned max_threads = 0);
+
+// Number of threads (including the caller) the parallel converter can use
+unsigned yuv_conversion_thread_count();
+
+// Join the conversion pool threads (call before unloading; the pool is recreated on next use)
+void yuv_shutdown_conversion_threads();
+
+// Packed-plane convenience wrapper (Y stride = width, chroma stride = (width + 1) / 2)
+void convert_rgba_to_yuv420p_fast(const uint8_t* rgba_data, uint32_t width, uint32_t height,
+                                  uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane);
+
+// Runtime CPU dispatch helpers
+bool yuv_kernel_supported(YuvKernel kernel);
+YuvKernel yuv_best_kernel();
+const char* yuv_kernel_name(YuvKernel kernel);